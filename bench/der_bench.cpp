@@ -0,0 +1,300 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <format>
+#include "../include/lexer.hpp"
+#include "../include/parser.hpp"
+#include "../include/typechecker.hpp"
+#include "../include/optimizer.hpp"
+#include "../include/emit.hpp"
+#include "../include/report.hpp"
+
+// der_bench: how fast the compiler goes through a generated program, phase by phase. the program is made up to push
+// on the parts that get slow: lots of functions, deeply nested expressions, many structs and enums, long array
+// literals and long |> chains. the results come out as JSON on stdout (a table on stderr), and given the JSON of an
+// earlier run with --compare, it fails when a phase got slower than --threshold percent.
+
+void *operator new(std::size_t size)
+{
+    der::report::count(size);
+    if (void *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc{};
+}
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+void operator delete(void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+struct Shape
+{
+    size_t functions = 300;
+    size_t depth = 12;
+    size_t structs = 40;
+    size_t enums = 40;
+    size_t array = 64;
+    size_t pipes = 16;
+};
+
+// the same shape always makes the same program
+static std::string generate(const Shape &shape)
+{
+    uint64_t state = 0x9e3779b97f4a7c15;
+    auto next = [&](uint64_t n)
+    {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state % n;
+    };
+    size_t structs = std::max<size_t>(shape.structs, 1), enums = std::max<size_t>(shape.enums, 1), array = std::max<size_t>(shape.array, 1);
+    std::string out = "dalaton g(x: ra9m, y: ra9m): ra9m {\n    rje3 x + y;\n};\n";
+    for (size_t s = 0; s < structs; ++s)
+        out += std::format("jism S{} {{\n    x: ra9m;\n    y: ra9m;\n    z: ra9m;\n}};\n", s);
+    for (size_t e = 0; e < enums; ++e)
+        out += std::format("ti3dad E{} {{\n    M0, M1, M2, M3\n}};\n", e);
+    // an expression nested depth calls deep, over the arguments, literals, the array and the struct
+    auto nested = [&](auto &self, size_t depth) -> std::string
+    {
+        if (depth == 0)
+        {
+            switch (next(5))
+            {
+            case 0:
+                return "a";
+            case 1:
+                return "b";
+            case 2:
+                return std::format("arr[{}]", next(array));
+            case 3:
+                return "p.y";
+            default:
+                return std::to_string(next(100));
+            }
+        }
+        static const char *ops[] = {"+", "-", "*"};
+        // there are no parentheses in der, calls are what nests
+        return std::format("g({} {} {}, {})", self(self, depth - 1), ops[next(3)], self(self, 0), next(9) + 1);
+    };
+    for (size_t f = 0; f < shape.functions; ++f)
+    {
+        size_t s = f % structs, e = f % enums;
+        out += std::format("dalaton f{}(a: ra9m, b: ra9m): ra9m {{\n", f);
+        out += std::format("    dir arr: [ra9m; {}] = [", array);
+        for (size_t i = 0; i < array; ++i)
+            out += std::format("{}{}", i ? ", " : "", next(1000));
+        out += "];\n";
+        out += std::format("    dir p: S{0} = jadid S{0}{{x: {1}, y: {2}, z: {3}}};\n", s, next(50), next(50), next(50));
+        out += std::format("    dir e: E{0} = E{0}.M{1};\n", e, next(4));
+        out += std::format("    dir v: ra9m = {};\n", nested(nested, shape.depth));
+        out += std::format("    ila e == E{}.M0 {{\n        v = v + p.z;\n    }};\n", e);
+        out += "    dir w: ra9m = v";
+        for (size_t i = 0; i < shape.pipes; ++i)
+            out += i % 2 ? " |> g(b)" : " |> g(a)";
+        out += f ? std::format(";\n    rje3 w + p.x + f{}(a, b) % 3;\n}};\n", f - 1) : ";\n    rje3 w + p.x;\n};\n";
+    }
+    out += std::format("dalaton main(): ra9m {{\n    rje3 {};\n}};\n", shape.functions ? std::format("f{}(1, 2) % 7", shape.functions - 1) : "0");
+    return out;
+}
+
+struct Result
+{
+    std::string name, unit;
+    double wall_ms = 0;
+    double items = 0;
+    uint64_t allocations = 0, bytes = 0;
+
+    double per_s() const
+    {
+        return wall_ms > 0 ? items / wall_ms * 1e3 : 0;
+    }
+};
+
+// one go through the compiler, the phases in the order they run
+static std::vector<Result> run(const std::string &source)
+{
+    der::report::Report report{};
+    auto xyz = der::lexer::Lexer(source);
+    report.phase("lex", [&]
+                 { xyz.lex(); });
+    auto tokens = xyz.get_output();
+    auto abc = der::parser::Parser(tokens);
+    report.phase("parse", [&]
+                 { abc.parse(); });
+    auto ijk = der::typechecker::TypeChecker(abc.get_output());
+    report.check(ijk);
+    // the AST has no way to walk it, the IR straight out of lowering has about a node for each of its nodes
+    double nodes = 0, functions = 0;
+    for (auto &e : ijk.m_output)
+    {
+        nodes += double(der::emit::ir_size(e.get()));
+        functions += dynamic_cast<der::ir::Function *>(e.get()) ? 1 : 0;
+    }
+    report.phase("optimize", [&]
+                 { der::optimizer::Optimizer(ijk.m_output, ijk.c_includes, {}).run(); });
+    std::string c{};
+    report.phase("emit", [&]
+                 { c = ijk.get_output(); });
+    std::vector<std::pair<std::string, double>> units{
+        {"tokens", double(tokens.size())}, {"nodes", nodes}, {"functions", functions}, {"nodes", nodes}, {"functions", functions}, {"bytes", double(c.size())}};
+    std::vector<Result> out{};
+    for (size_t i = 0; i < report.m_phases.size(); ++i)
+    {
+        auto &p = report.m_phases.at(i);
+        out.push_back({p.name, units.at(i).first, p.wall_ms, units.at(i).second, p.allocations, p.bytes});
+    }
+    return out;
+}
+
+// the number after "key": in the object of the phase called name, in what this program writes
+static std::optional<double> lookup(const std::string &json, const std::string &name, const std::string &key)
+{
+    size_t at = json.find(std::format("\"name\": \"{}\"", name));
+    if (at == std::string::npos)
+        return std::nullopt;
+    size_t end = json.find('}', at);
+    size_t k = json.find(std::format("\"{}\": ", key), at);
+    if (k == std::string::npos || k > end)
+        return std::nullopt;
+    return std::strtod(json.c_str() + k + key.size() + 4, nullptr);
+}
+
+static std::optional<double> corpus_field(const std::string &json, const std::string &key)
+{
+    size_t k = json.find(std::format("\"{}\": ", key));
+    if (k == std::string::npos)
+        return std::nullopt;
+    return std::strtod(json.c_str() + k + key.size() + 4, nullptr);
+}
+
+int main(int argc, char **argv)
+{
+    Shape shape{};
+    size_t reps = 5;
+    double threshold = 20;
+    std::string compare{}, emit_to{};
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (i + 1 >= argc)
+        {
+            std::cerr << std::format("der_bench: '{}' expects a value.\n", arg);
+            return 2;
+        }
+        std::string value = argv[++i];
+        if (arg == "--compare")
+            compare = value;
+        else if (arg == "--emit")
+            emit_to = value;
+        else if (arg == "--threshold")
+            threshold = std::stod(value);
+        else if (arg == "--reps")
+            reps = std::max<size_t>(std::stoul(value), 1);
+        else if (arg == "--functions")
+            shape.functions = std::stoul(value);
+        else if (arg == "--depth")
+            shape.depth = std::stoul(value);
+        else if (arg == "--structs")
+            shape.structs = std::stoul(value);
+        else if (arg == "--enums")
+            shape.enums = std::stoul(value);
+        else if (arg == "--array")
+            shape.array = std::stoul(value);
+        else if (arg == "--pipes")
+            shape.pipes = std::stoul(value);
+        else
+        {
+            std::cerr << std::format("der_bench: unknown option '{}'.\n", arg);
+            return 2;
+        }
+    }
+    std::string source = generate(shape);
+    if (!emit_to.empty())
+    {
+        std::ofstream out{emit_to};
+        out << source;
+        return 0;
+    }
+
+    // a warm up, then the median of every phase over the runs
+    std::vector<std::vector<Result>> runs{};
+    try
+    {
+        run(source);
+        for (size_t r = 0; r < reps; ++r)
+            runs.push_back(run(source));
+    }
+    catch (const der::parser::SyntaxErr &exc)
+    {
+        std::cerr << std::format("der_bench: the generated program doesn't parse: {} (line: {})\n", exc.msg, exc.loc.line + 1);
+        return 2;
+    }
+    catch (const der::types::CompilationErr &exc)
+    {
+        std::cerr << std::format("der_bench: the generated program doesn't check: {} (line: {})\n", exc.msg, exc.loc.line + 1);
+        return 2;
+    }
+    std::vector<Result> results = runs.front();
+    for (size_t p = 0; p < results.size(); ++p)
+    {
+        std::vector<double> walls{};
+        for (auto &r : runs)
+            walls.push_back(r.at(p).wall_ms);
+        std::sort(walls.begin(), walls.end());
+        results.at(p).wall_ms = walls.at(walls.size() / 2);
+    }
+
+    std::string json = std::format("{{\"corpus\": {{\"functions\": {}, \"depth\": {}, \"structs\": {}, \"enums\": {}, \"array\": {}, \"pipes\": {}, \"bytes\": {}}}, \"reps\": {}, \"phases\": [",
+                                   shape.functions, shape.depth, shape.structs, shape.enums, shape.array, shape.pipes, source.size(), reps);
+    std::cerr << std::format("{:<10} {:>10} {:>18} {:>12} {:>10}\n", "phase", "wall", "throughput", "allocations", "allocated");
+    for (size_t p = 0; p < results.size(); ++p)
+    {
+        auto &r = results.at(p);
+        json += std::format("{}{{\"name\": \"{}\", \"wall_ms\": {:.3f}, \"unit\": \"{}\", \"items\": {:.0f}, \"per_s\": {:.1f}, \"allocations\": {}, \"bytes\": {}}}",
+                            p ? ", " : "", r.name, r.wall_ms, r.unit, r.items, r.per_s(), r.allocations, r.bytes);
+        std::cerr << std::format("{:<10} {:>8.2f}ms {:>12.0f} {:<5} {:>12} {:>10}\n", r.name, r.wall_ms, r.per_s(), r.unit + "/s", r.allocations, der::report::bytes_str(double(r.bytes)));
+    }
+    json += "]}\n";
+    std::cout << json;
+    if (compare.empty())
+        return 0;
+
+    std::ifstream in{compare};
+    if (!in.is_open())
+    {
+        std::cerr << std::format("der_bench: failed to open '{}'.\n", compare);
+        return 2;
+    }
+    std::stringstream ss{};
+    ss << in.rdbuf();
+    std::string base = ss.str();
+    if (corpus_field(base, "bytes") != double(source.size()))
+    {
+        std::cerr << std::format("der_bench: '{}' was run on a different program, use the same options.\n", compare);
+        return 2;
+    }
+    bool regressed = false;
+    std::cerr << std::format("\n{:<10} {:>14} {:>14} {:>8}\n", "phase", "before", "now", "change");
+    for (auto &r : results)
+    {
+        auto before = lookup(base, r.name, "per_s");
+        if (!before || *before <= 0)
+            continue;
+        double change = (r.per_s() / *before - 1) * 100;
+        bool worse = change < -threshold;
+        regressed = regressed || worse;
+        std::cerr << std::format("{:<10} {:>14.0f} {:>14.0f} {:>+7.1f}%{}\n", r.name, *before, r.per_s(), change, worse ? "  regressed" : "");
+    }
+    return regressed ? 1 : 0;
+}
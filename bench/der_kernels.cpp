@@ -0,0 +1,182 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <vector>
+#include <format>
+#include <unistd.h>
+#include <sys/wait.h>
+
+// der_kernels: how fast the C derijac writes runs, next to C written by hand. every kernel in bench/kernels is a
+// `kernel(n: ra9m): ra9m` in der and an `int kernel(int n)` in C doing the same work, both get linked with
+// harness.c, which times them, and what matters is the ratio between the two. the kernels must return the same
+// thing, otherwise the der one is wrong and it counts as a failure.
+
+#ifndef DER_KERNELS_DIR
+#define DER_KERNELS_DIR "bench/kernels"
+#endif
+
+struct Options
+{
+    std::string derijac{}, cc{}, cflags = "-O2", der_flags{}, dir = DER_KERNELS_DIR;
+    long n = 1000000, warmup = 3, reps = 11;
+    std::vector<std::string> only{};
+};
+
+struct Timing
+{
+    long long checksum = 0, median_ns = 0, min_ns = 0;
+};
+
+static std::string quote(const std::string &s)
+{
+    std::string out = "'";
+    for (char c : s)
+        out += c == '\'' ? std::string("'\\''") : std::string(1, c);
+    return out + "'";
+}
+
+// runs a shell command, gives its exit status and everything it printed
+static std::pair<int, std::string> shell(const std::string &command)
+{
+    std::string out{};
+    FILE *p = popen((command + " 2>&1").c_str(), "r");
+    if (!p)
+        return {-1, out};
+    char buf[4096];
+    for (size_t n; (n = fread(buf, 1, sizeof buf, p)) > 0;)
+        out.append(buf, n);
+    int status = pclose(p);
+    return {WIFEXITED(status) ? WEXITSTATUS(status) : -1, out};
+}
+
+// compiles the C in sources with the harness into exe and runs it
+static std::optional<Timing> measure(const Options &o, const std::vector<std::string> &sources, const std::string &exe, std::string &error)
+{
+    std::string command = std::format("{} {} -o {}", o.cc, o.cflags, quote(exe));
+    for (auto &s : sources)
+        command += " " + quote(s);
+    command += " " + quote(o.dir + "/harness.c");
+    if (auto [status, out] = shell(command); status != 0)
+    {
+        error = out;
+        return std::nullopt;
+    }
+    auto [status, out] = shell(std::format("{} {} {} {}", quote(exe), o.n, o.warmup, o.reps));
+    Timing t{};
+    if (status != 0 || std::sscanf(out.c_str(), "%lld %lld %lld", &t.checksum, &t.median_ns, &t.min_ns) != 3)
+    {
+        error = out;
+        return std::nullopt;
+    }
+    return t;
+}
+
+int main(int argc, char **argv)
+{
+    Options o{};
+    o.derijac = (std::filesystem::path(argv[0]).parent_path() / "derijac").string();
+    const char *cc = std::getenv("CC");
+    o.cc = cc && *cc ? cc : "cc";
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (!arg.starts_with("--"))
+        {
+            o.only.push_back(arg);
+            continue;
+        }
+        if (i + 1 >= argc)
+        {
+            std::cerr << std::format("der_kernels: '{}' expects a value.\n", arg);
+            return 2;
+        }
+        std::string value = argv[++i];
+        if (arg == "--derijac")
+            o.derijac = value;
+        else if (arg == "--cc")
+            o.cc = value;
+        else if (arg == "--cflags")
+            o.cflags = value;
+        else if (arg == "--der-flags")
+            o.der_flags = value;
+        else if (arg == "--kernels")
+            o.dir = value;
+        else if (arg == "--n")
+            o.n = std::stol(value);
+        else if (arg == "--warmup")
+            o.warmup = std::stol(value);
+        else if (arg == "--reps")
+            o.reps = std::max(std::stol(value), 1L);
+        else
+        {
+            std::cerr << std::format("der_kernels: unknown option '{}'.\n", arg);
+            return 2;
+        }
+    }
+
+    std::vector<std::string> kernels{};
+    std::error_code ec{};
+    for (auto &entry : std::filesystem::directory_iterator(o.dir, ec))
+    {
+        auto path = entry.path();
+        std::string name = path.stem().string();
+        if (path.extension() == ".der" && std::filesystem::exists(path.parent_path() / (name + ".c")) && (o.only.empty() || std::find(o.only.begin(), o.only.end(), name) != o.only.end()))
+            kernels.push_back(name);
+    }
+    if (ec || kernels.empty())
+    {
+        std::cerr << std::format("der_kernels: no kernels in '{}'.\n", o.dir);
+        return 2;
+    }
+    std::sort(kernels.begin(), kernels.end());
+
+    char tmpl[] = "/tmp/der_kernels.XXXXXX";
+    if (!mkdtemp(tmpl))
+    {
+        std::cerr << "der_kernels: can't make a temporary directory.\n";
+        return 2;
+    }
+    std::string tmp = tmpl;
+
+    bool failed = false;
+    std::string json = std::format("{{\"n\": {}, \"warmup\": {}, \"reps\": {}, \"cc\": \"{}\", \"cflags\": \"{}\", \"der_flags\": \"{}\", \"kernels\": [",
+                                   o.n, o.warmup, o.reps, o.cc, o.cflags, o.der_flags);
+    std::cerr << std::format("{:<10} {:>12} {:>12} {:>8} {:>12}\n", "kernel", "der", "c", "der/c", "checksum");
+    size_t done = 0;
+    for (auto &name : kernels)
+    {
+        // the kernel is copied over first, derijac writes the C next to its input
+        std::string der = std::format("{}/{}.der", tmp, name);
+        std::filesystem::copy_file(std::format("{}/{}.der", o.dir, name), der, std::filesystem::copy_options::overwrite_existing, ec);
+        std::string error{};
+        std::optional<Timing> d{}, c{};
+        if (auto [status, out] = shell(std::format("{} --no-cache {} {}", quote(o.derijac), o.der_flags, quote(der))); ec || status != 0)
+            error = ec ? ec.message() : out;
+        else if ((d = measure(o, {der + ".c"}, std::format("{}/{}.der.out", tmp, name), error)))
+            c = measure(o, {std::format("{}/{}.c", o.dir, name)}, std::format("{}/{}.c.out", tmp, name), error);
+        if (!d || !c)
+        {
+            failed = true;
+            std::cerr << std::format("{:<10} failed:\n{}", name, error);
+            continue;
+        }
+        if (d->checksum != c->checksum)
+        {
+            failed = true;
+            std::cerr << std::format("{:<10} returned {} where the C returns {}.\n", name, d->checksum, c->checksum);
+            continue;
+        }
+        double ratio = c->median_ns > 0 ? double(d->median_ns) / double(c->median_ns) : 0;
+        json += std::format("{}{{\"name\": \"{}\", \"der_ns\": {}, \"c_ns\": {}, \"der_min_ns\": {}, \"c_min_ns\": {}, \"ratio\": {:.3f}, \"checksum\": {}}}",
+                            done++ ? ", " : "", name, d->median_ns, c->median_ns, d->min_ns, c->min_ns, ratio, d->checksum);
+        std::cerr << std::format("{:<10} {:>10.3f}ms {:>10.3f}ms {:>7.2f}x {:>12}\n", name, double(d->median_ns) / 1e6, double(c->median_ns) / 1e6, ratio, d->checksum);
+    }
+    json += "]}\n";
+    std::cout << json;
+    std::filesystem::remove_all(tmp, ec);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,27 @@
+// mini_calc: picking the operation on every call
+static int mini_calc(int a, char op, int b)
+{
+    switch (op)
+    {
+    case '+':
+        return a + b;
+    case '-':
+        return a - b;
+    case '/':
+        return a / b;
+    case '*':
+        return a * b;
+    }
+    return 0;
+}
+
+int kernel(int n)
+{
+    int total = 1;
+    for (int i = 0; i < n; ++i)
+    {
+        char op = "+-*/"[i % 4];
+        total = mini_calc(total, op, i % 5 + 1) % 100003;
+    }
+    return total;
+}
@@ -0,0 +1,48 @@
+// times kernel(n): a few runs to warm up, then reps timed runs. prints the checksum (what kernel returned), the
+// median and the fastest run in nanoseconds
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+int kernel(int n);
+
+static long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int cmp(const void *a, const void *b)
+{
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 4)
+    {
+        fprintf(stderr, "usage: %s N WARMUP REPS\n", argv[0]);
+        return 2;
+    }
+    // through a volatile so the compiler can't see n, or throw away what the kernel returns
+    volatile int n = atoi(argv[1]);
+    int warmup = atoi(argv[2]), reps = atoi(argv[3]);
+    if (reps < 1)
+        reps = 1;
+    volatile int sink = 0;
+    for (int i = 0; i < warmup; ++i)
+        sink = kernel(n);
+    long long *times = malloc(sizeof *times * reps);
+    for (int i = 0; i < reps; ++i)
+    {
+        long long start = now_ns();
+        sink = kernel(n);
+        times[i] = now_ns() - start;
+    }
+    qsort(times, reps, sizeof *times, cmp);
+    printf("%d %lld %lld\n", sink, times[reps / 2], times[0]);
+    free(times);
+    return 0;
+}
@@ -0,0 +1,10 @@
+// a fixed array folded over and over
+int kernel(int n)
+{
+    int g[16] = {3, 1, 4, 1, 5, 9, 2, 6, 5, 3, 5, 8, 9, 7, 9, 3};
+    int total = 0;
+    for (int i = 0; i < n; ++i)
+        for (int j = 0; j < 16; ++j)
+            total = total % 100003 + g[j] * i % 7 - g[j] % 3;
+    return total;
+}
@@ -0,0 +1,23 @@
+// l7ajm: looking for the end of a string a character at a time
+static int length(const char *s)
+{
+    int i = 0;
+    while (s[i] != '\0')
+        ++i;
+    return i;
+}
+
+int kernel(int n)
+{
+    int total = 0;
+    for (int i = 0; i < n; ++i)
+    {
+        const char *s = "salam 3alam, hadi jomla twila chwiya bach n9isso biha ch7al dyal lwe9t kaykhod l7ajm f kol mra";
+        if (i % 3 == 1)
+            s = "jomla 9sira";
+        if (i % 3 == 2)
+            s = "w hadi jomla khra ma twila ma 9sira, ghir bach ikon chi tanawo3";
+        total = total % 100003 + length(s);
+    }
+    return total;
+}
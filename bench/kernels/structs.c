@@ -0,0 +1,29 @@
+// small structs passed around by value and their fields read
+struct point
+{
+    int x, y;
+};
+
+static int dot(struct point p, struct point q)
+{
+    return p.x * q.x + p.y * q.y;
+}
+
+static int proj(struct point p, int t)
+{
+    return p.x * t + p.y;
+}
+
+static int area(struct point a, struct point b)
+{
+    return (b.x - a.x) * (b.y - a.y);
+}
+
+int kernel(int n)
+{
+    struct point p = {3, 5}, q = {7, 2};
+    int total = 0;
+    for (int i = 0; i < n; ++i)
+        total = total % 100003 + dot(p, q) * i % 1013 + proj(p, i) % 17 - proj(q, i) % 13 + area(p, q);
+    return total;
+}
@@ -45,7 +45,7 @@ namespace der
 
             std::unique_ptr<types::TypeHandle> get_ty() const override
             {
-                return std::unique_ptr<types::TypeHandle>(new types::BinaryOp(left->get_ty(), right->get_ty()));
+                return std::unique_ptr<types::TypeHandle>(new types::BinaryOp(left->get_ty(), right->get_ty(), lexer::tokens_to_str.contains(op) ? lexer::tokens_to_str.at(op) : ""));
             }
         };
         // expr = expr;
@@ -105,13 +105,19 @@ namespace der
             std::unique_ptr<Expr> f_end;
             std::vector<T> body;
             std::string ident;
+            // from `lkola<...>`, 0 lets the optimizer decide
+            size_t unroll = 0;
+            bool simd = false;
+            // `lkola mota7arik(+ s) i: ...`
+            bool parallel = false;
+            std::vector<std::pair<std::string, std::string>> reductions;
 
             RangedFor(const std::string &ident, std::unique_ptr<Expr> f1, std::unique_ptr<Expr> f2, const std::vector<T> &body) : ident(ident), f_start(std::move(f1)), f_end(std::move(f2))
             {
                 for (auto &x : body)
                     this->body.push_back(T(x.expr->clone(), x.loc));
             }
-            RangedFor(const RangedFor &other) : ident(other.ident), f_start(other.f_start->clone()), f_end(other.f_end->clone())
+            RangedFor(const RangedFor &other) : ident(other.ident), f_start(other.f_start->clone()), f_end(other.f_end->clone()), unroll(other.unroll), simd(other.simd), parallel(other.parallel), reductions(other.reductions)
             {
                 for (auto &x : other.body)
                     body.push_back(T(x.expr->clone(), x.loc));
@@ -134,7 +140,10 @@ namespace der
                 std::vector<std::unique_ptr<types::TypeHandle>> stmts{};
                 for (auto &e : body)
                     stmts.push_back(e.expr->get_ty()->clone());
-                return std::unique_ptr<types::TypeHandle>(new types::RangedFor(ident, f_start->get_ty()->clone(), f_end->get_ty()->clone(), stmts));
+                auto loop = std::make_unique<types::RangedFor>(ident, f_start->get_ty()->clone(), f_end->get_ty()->clone(), stmts);
+                loop->parallel = parallel;
+                loop->reductions = reductions;
+                return loop;
             }
         };
 
@@ -255,7 +264,7 @@ namespace der
 
             std::unique_ptr<types::TypeHandle> get_ty() const override
             {
-                return std::unique_ptr<types::TypeHandle>(new types::LogicalBinaryOp(left->get_ty(), right->get_ty()));
+                return std::unique_ptr<types::TypeHandle>(new types::LogicalBinaryOp(left->get_ty(), right->get_ty(), lexer::tokens_to_str.contains(op) ? lexer::tokens_to_str.at(op) : ""));
             }
         };
 
@@ -614,6 +623,53 @@ namespace der
             }
         };
 
+        template <class T>
+        struct MatchArm
+        {
+            // nullptr for the `_` arm
+            ptr<Expr> pattern;
+            std::vector<T> body;
+            MatchArm(ptr<Expr> pattern, std::vector<T> &&body) : pattern(std::move(pattern)), body(std::move(body)) {}
+            MatchArm(const MatchArm &other) : pattern(other.pattern ? other.pattern->clone() : nullptr), body(other.body) {}
+        };
+
+        // chouf x { A => ..., B => { ...; }, _ => ... }
+        template <class T>
+        struct Match : Expr
+        {
+            ptr<Expr> scrutinee;
+            std::vector<MatchArm<T>> arms;
+
+            Match(ptr<Expr> scrutinee, std::vector<MatchArm<T>> &&arms) : scrutinee(std::move(scrutinee)), arms(std::move(arms)) {}
+            Match(const Match &other) : scrutinee(other.scrutinee->clone()), arms(other.arms) {}
+
+            std::string debug() const override
+            {
+                std::string out = std::format("[Match {}", scrutinee->debug());
+                for (const auto &arm : arms)
+                    out += std::format("\n\t{} => {} stmts", arm.pattern ? arm.pattern->debug() : "_", arm.body.size());
+                return out + "]";
+            }
+
+            ptr<Expr> clone() const override
+            {
+                return std::make_unique<Match>(*this);
+            }
+
+            std::unique_ptr<types::TypeHandle> get_ty() const override
+            {
+                std::vector<types::MatchArm> __arms{};
+                for (const auto &arm : arms)
+                {
+                    std::vector<std::unique_ptr<types::TypeHandle>> body{};
+                    for (const auto &e : arm.body)
+                        body.push_back(e.expr->get_ty());
+                    __arms.emplace_back(arm.pattern ? arm.pattern->get_ty() : nullptr, arm.pattern ? arm.pattern->debug() : "_", std::move(body));
+                }
+                return std::make_unique<types::Match>(scrutinee->get_ty(), std::move(__arms));
+            }
+        };
+
         struct Array : Expr
         {
             std::vector<std::unique_ptr<Expr>> values;
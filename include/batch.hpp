@@ -0,0 +1,350 @@
+#ifndef DER_BATCH_HPP
+#define DER_BATCH_HPP
+#include <algorithm>
+#include <cctype>
+#include <condition_variable>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <variant>
+#include <vector>
+#include <format>
+#include "der.hpp"
+#include "cache.hpp"
+#include "report.hpp"
+
+// `derijac batch`: lots of small programs compiled in one process instead of a derijac for each. they come as JSON
+// lines ({"name": ..., "source": ...}) or as the .der files of a directory, and go through der::compile on a pool of
+// threads. what each one came out as (its C, or its errors) is written as a JSON line in the order they came in.
+namespace der
+{
+    namespace batch
+    {
+        struct Input
+        {
+            std::string name, source;
+        };
+
+        struct Output
+        {
+            std::string name;
+            CompileResult result{};
+            std::string c{};
+        };
+
+        // the string starting at in[at] (on the opening quote), at is left after the closing one
+        inline std::optional<std::string> json_string(const std::string &in, size_t &at)
+        {
+            if (at >= in.size() || in[at] != '"')
+                return std::nullopt;
+            std::string out{};
+            auto hex = [&](size_t from) -> std::optional<uint32_t>
+            {
+                if (from + 4 > in.size())
+                    return std::nullopt;
+                uint32_t v = 0;
+                for (size_t i = from; i < from + 4; ++i)
+                {
+                    char c = in[i];
+                    int d = std::isdigit(static_cast<unsigned char>(c)) ? c - '0' : (c >= 'a' && c <= 'f') ? c - 'a' + 10 : (c >= 'A' && c <= 'F') ? c - 'A' + 10 : -1;
+                    if (d < 0)
+                        return std::nullopt;
+                    v = v * 16 + uint32_t(d);
+                }
+                return v;
+            };
+            for (++at; at < in.size(); ++at)
+            {
+                char c = in[at];
+                if (c == '"')
+                {
+                    ++at;
+                    return out;
+                }
+                if (c != '\\')
+                {
+                    out += c;
+                    continue;
+                }
+                if (++at >= in.size())
+                    return std::nullopt;
+                switch (in[at])
+                {
+                case 'n':
+                    out += '\n';
+                    break;
+                case 't':
+                    out += '\t';
+                    break;
+                case 'r':
+                    out += '\r';
+                    break;
+                case 'b':
+                    out += '\b';
+                    break;
+                case 'f':
+                    out += '\f';
+                    break;
+                case 'u':
+                {
+                    auto cp = hex(at + 1);
+                    if (!cp)
+                        return std::nullopt;
+                    at += 4;
+                    // the two halves of a surrogate pair
+                    if (*cp >= 0xd800 && *cp < 0xdc00 && at + 2 < in.size() && in[at + 1] == '\\' && in[at + 2] == 'u')
+                        if (auto low = hex(at + 3); low && *low >= 0xdc00 && *low < 0xe000)
+                        {
+                            cp = 0x10000 + ((*cp - 0xd800) << 10) + (*low - 0xdc00);
+                            at += 6;
+                        }
+                    if (*cp < 0x80)
+                        out += char(*cp);
+                    else if (*cp < 0x800)
+                        out += {char(0xc0 | *cp >> 6), char(0x80 | (*cp & 0x3f))};
+                    else if (*cp < 0x10000)
+                        out += {char(0xe0 | *cp >> 12), char(0x80 | (*cp >> 6 & 0x3f)), char(0x80 | (*cp & 0x3f))};
+                    else
+                        out += {char(0xf0 | *cp >> 18), char(0x80 | (*cp >> 12 & 0x3f)), char(0x80 | (*cp >> 6 & 0x3f)), char(0x80 | (*cp & 0x3f))};
+                    break;
+                }
+                default:
+                    // \" \\ \/
+                    out += in[at];
+                }
+            }
+            return std::nullopt;
+        }
+
+        // {"name": "...", "source": "..."} on one line. other keys are let through as long as their values are
+        // strings, numbers, booleans or null
+        inline std::optional<Input> parse_record(const std::string &line, std::string &error)
+        {
+            Input out{};
+            bool sourced = false;
+            size_t at = 0;
+            auto skip = [&]
+            {
+                while (at < line.size() && std::isspace(static_cast<unsigned char>(line[at])))
+                    ++at;
+            };
+            skip();
+            if (at >= line.size() || line[at++] != '{')
+            {
+                error = "expected an object";
+                return std::nullopt;
+            }
+            for (skip(); at < line.size() && line[at] != '}';)
+            {
+                auto key = json_string(line, at);
+                skip();
+                if (!key || at >= line.size() || line[at++] != ':')
+                {
+                    error = "expected a key";
+                    return std::nullopt;
+                }
+                skip();
+                if (at < line.size() && line[at] == '"')
+                {
+                    auto value = json_string(line, at);
+                    if (!value)
+                    {
+                        error = std::format("unterminated string for '{}'", *key);
+                        return std::nullopt;
+                    }
+                    if (*key == "name")
+                        out.name = *value;
+                    else if (*key == "source")
+                        out.source = *value, sourced = true;
+                }
+                else
+                {
+                    if (*key == "name" || *key == "source")
+                    {
+                        error = std::format("'{}' should be a string", *key);
+                        return std::nullopt;
+                    }
+                    while (at < line.size() && line[at] != ',' && line[at] != '}')
+                        ++at;
+                }
+                skip();
+                if (at < line.size() && line[at] == ',')
+                    ++at;
+                skip();
+            }
+            if (at >= line.size())
+            {
+                error = "unterminated object";
+                return std::nullopt;
+            }
+            if (!sourced)
+            {
+                error = "no \"source\"";
+                return std::nullopt;
+            }
+            return out;
+        }
+
+        // where the inputs come from, handed out one at a time to whichever worker asks. an input that can't be read
+        // comes out with an error instead of a source
+        struct Reader
+        {
+            std::ifstream m_file{};
+            std::istream *m_in = nullptr;
+            std::vector<std::string> m_paths{};
+            std::string m_dir{};
+            size_t m_line = 0, m_next = 0;
+            std::mutex m_lock{};
+
+            // a directory, a JSON lines file, or - for JSON lines on stdin
+            explicit Reader(const std::string &path, std::istream &stdin_)
+            {
+                std::error_code ec{};
+                if (path != "-" && std::filesystem::is_directory(path, ec))
+                {
+                    m_dir = path;
+                    for (auto &entry : std::filesystem::recursive_directory_iterator(path, ec))
+                        if (entry.is_regular_file() && entry.path().extension() == ".der")
+                            m_paths.push_back(entry.path().string());
+                    std::sort(m_paths.begin(), m_paths.end());
+                    return;
+                }
+                if (path == "-")
+                    m_in = &stdin_;
+                else
+                {
+                    m_file.open(path);
+                    if (m_file.is_open())
+                        m_in = &m_file;
+                }
+            }
+
+            bool ok() const
+            {
+                return m_in || !m_dir.empty();
+            }
+
+            // the next input and where it stands, nullopt once they're all out
+            std::optional<std::pair<size_t, std::variant<Input, Output>>> next()
+            {
+                std::lock_guard lock{m_lock};
+                if (!m_dir.empty())
+                {
+                    if (m_next >= m_paths.size())
+                        return std::nullopt;
+                    std::string path = m_paths.at(m_next);
+                    std::string name = std::filesystem::relative(path, m_dir).string();
+                    auto source = cache::read_file(path);
+                    if (!source)
+                        return std::pair{m_next++, failed(name, std::format("failed to open file '{}'.", path))};
+                    return std::pair{m_next++, Input{name, *source}};
+                }
+                for (std::string line; std::getline(*m_in, line);)
+                {
+                    ++m_line;
+                    if (line.find_first_not_of(" \t\r") == std::string::npos)
+                        continue;
+                    std::string error{};
+                    if (auto record = parse_record(line, error))
+                    {
+                        if (record->name.empty())
+                            record->name = std::format("line {}", m_line);
+                        return std::pair{m_next++, *record};
+                    }
+                    return std::pair{m_next++, failed(std::format("line {}", m_line), std::format("line {} isn't a record: {}.", m_line, error))};
+                }
+                return std::nullopt;
+            }
+
+            static Output failed(const std::string &name, const std::string &msg)
+            {
+                Output out{name};
+                out.result.diagnostics.push_back({Diagnostic::Kind::Internal, msg});
+                return out;
+            }
+        };
+
+        inline std::string json(const Output &out)
+        {
+            static const char *kinds[] = {"syntax", "type", "internal"};
+            std::string line = std::format("{{\"name\": \"{}\", \"ok\": {}", report::escape(out.name), out.result.ok);
+            if (out.result.ok)
+                line += std::format(", \"c\": \"{}\"", report::escape(out.c));
+            line += ", \"diagnostics\": [";
+            for (size_t i = 0; i < out.result.diagnostics.size(); ++i)
+            {
+                auto &d = out.result.diagnostics.at(i);
+                line += std::format("{}{{\"kind\": \"{}\", \"message\": \"{}\", \"line\": {}, \"column\": {}}}", i ? ", " : "", kinds[int(d.kind)], report::escape(d.message), d.line, d.column);
+            }
+            return line + "]}\n";
+        }
+
+        struct Summary
+        {
+            size_t compiled = 0, failed = 0;
+        };
+
+        // compiles everything the reader has on `workers` threads and writes a line for each to out, in the order
+        // they were read. lines are written as soon as the ones before them are, so out keeps up with the workers
+        inline Summary run(Reader &reader, const CompileOptions &options, size_t workers, std::ostream &out)
+        {
+            std::map<size_t, std::string> done{};
+            std::mutex lock{};
+            std::condition_variable ready{};
+            size_t running = std::max<size_t>(workers, 1);
+            Summary summary{};
+            auto work = [&]
+            {
+                while (auto item = reader.next())
+                {
+                    auto &[index, input] = *item;
+                    Output result{};
+                    if (auto *in = std::get_if<Input>(&input))
+                    {
+                        result.name = in->name;
+                        result.result = compile(in->source, options, result.c);
+                    }
+                    else
+                        result = std::move(std::get<Output>(input));
+                    std::string line = json(result);
+                    std::lock_guard guard{lock};
+                    ++(result.result.ok ? summary.compiled : summary.failed);
+                    done[index] = std::move(line);
+                    ready.notify_one();
+                }
+                std::lock_guard guard{lock};
+                --running;
+                ready.notify_one();
+            };
+            std::vector<std::thread> threads{};
+            for (size_t i = 0; i < std::max<size_t>(workers, 1); ++i)
+                threads.emplace_back(work);
+            size_t next = 0;
+            std::unique_lock guard{lock};
+            while (true)
+            {
+                ready.wait(guard, [&]
+                           { return done.contains(next) || running == 0; });
+                if (!done.contains(next))
+                    break;
+                std::string line = std::move(done.at(next));
+                done.erase(next++);
+                guard.unlock();
+                out << line;
+                guard.lock();
+            }
+            guard.unlock();
+            out.flush();
+            for (auto &t : threads)
+                t.join();
+            return summary;
+        }
+    }
+}
+#endif
@@ -0,0 +1,234 @@
+#ifndef DER_CACHE_HPP
+#define DER_CACHE_HPP
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <format>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// a content addressed cache for what the compiler produces (the C, objects, executables). an entry is named after
+// the SHA-256 of everything that went into making it: the source, this compiler binary, the options, and for the
+// later stages the C compiler binary and its flags. a hit means none of that work is done again.
+// entries are written to a temporary file next to where they go and renamed into place, so builds running at the
+// same time can share a cache directory and never see half of a file, two of them writing the same entry is fine.
+namespace der
+{
+    namespace cache
+    {
+        // FIPS 180-4
+        struct Sha256
+        {
+            std::array<uint32_t, 8> m_state{0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+            std::array<uint8_t, 64> m_block{};
+            size_t m_used = 0;
+            uint64_t m_length = 0;
+
+            static uint32_t rotr(uint32_t x, int n)
+            {
+                return (x >> n) | (x << (32 - n));
+            }
+
+            void compress()
+            {
+                static constexpr uint32_t k[64] = {
+                    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+                    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+                    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+                    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+                    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+                    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+                    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+                    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+                uint32_t w[64];
+                for (int i = 0; i < 16; ++i)
+                    w[i] = uint32_t(m_block[4 * i]) << 24 | uint32_t(m_block[4 * i + 1]) << 16 | uint32_t(m_block[4 * i + 2]) << 8 | m_block[4 * i + 3];
+                for (int i = 16; i < 64; ++i)
+                {
+                    uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+                    uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+                    w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+                }
+                auto [a, b, c, d, e, f, g, h] = m_state;
+                for (int i = 0; i < 64; ++i)
+                {
+                    uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + k[i] + w[i];
+                    uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+                    h = g;
+                    g = f;
+                    f = e;
+                    e = d + t1;
+                    d = c;
+                    c = b;
+                    b = a;
+                    a = t1 + t2;
+                }
+                uint32_t out[8] = {a, b, c, d, e, f, g, h};
+                for (int i = 0; i < 8; ++i)
+                    m_state[size_t(i)] += out[i];
+            }
+
+            Sha256 &update(std::string_view data)
+            {
+                for (char ch : data)
+                {
+                    m_block[m_used++] = uint8_t(ch);
+                    if (m_used == 64)
+                    {
+                        compress();
+                        m_used = 0;
+                    }
+                }
+                m_length += data.size();
+                return *this;
+            }
+
+            // the digest in hex, the object can't be updated anymore after this
+            std::string hex()
+            {
+                uint64_t bits = m_length * 8;
+                m_block[m_used++] = 0x80;
+                if (m_used > 56)
+                {
+                    std::fill(m_block.begin() + long(m_used), m_block.end(), 0);
+                    compress();
+                    m_used = 0;
+                }
+                std::fill(m_block.begin() + long(m_used), m_block.end(), 0);
+                for (int i = 0; i < 8; ++i)
+                    m_block[size_t(63 - i)] = uint8_t(bits >> (8 * i));
+                compress();
+                std::string out{};
+                for (uint32_t s : m_state)
+                    out += std::format("{:08x}", s);
+                return out;
+            }
+        };
+
+        // a cache key, built from fields that are each length prefixed so ("ab", "c") and ("a", "bc") differ
+        struct Key
+        {
+            Sha256 m_hash{};
+
+            Key &add(std::string_view field)
+            {
+                m_hash.update(std::format("{}:", field.size())).update(field);
+                return *this;
+            }
+            std::string hex()
+            {
+                return m_hash.hex();
+            }
+        };
+
+        // a program named like on the command line, searched in PATH when there's no slash in it
+        inline std::string find_program(const std::string &name)
+        {
+            if (name.find('/') != std::string::npos)
+                return name;
+            const char *path = std::getenv("PATH");
+            std::stringstream dirs{path ? path : ""};
+            for (std::string dir; std::getline(dirs, dir, ':');)
+            {
+                std::string candidate = (dir.empty() ? "." : dir) + "/" + name;
+                if (access(candidate.c_str(), X_OK) == 0)
+                    return candidate;
+            }
+            return name;
+        }
+
+        // stands for the contents of a file without reading it: where it really is, its size and when it changed.
+        // rebuilding or upgrading a compiler changes it
+        inline std::string file_identity(const std::string &path)
+        {
+            char *real = realpath(path.c_str(), nullptr);
+            std::string resolved = real ? real : path;
+            std::free(real);
+            struct stat st{};
+            if (stat(resolved.c_str(), &st) != 0)
+                return resolved;
+            return std::format("{} {} {}.{}", resolved, st.st_size, st.st_mtim.tv_sec, st.st_mtim.tv_nsec);
+        }
+
+        inline std::optional<std::string> read_file(const std::string &path)
+        {
+            std::ifstream in{path, std::ios::binary};
+            if (!in.is_open())
+                return std::nullopt;
+            std::stringstream ss{};
+            ss << in.rdbuf();
+            return ss.str();
+        }
+
+        // writes data to path through a temporary file in the same directory and a rename, so whoever opens path
+        // sees either the old file or all of the new one
+        inline bool write_atomically(const std::string &path, const std::string &data, bool executable = false)
+        {
+            std::string tmp = path + ".tmp.XXXXXX";
+            int fd = mkstemp(tmp.data());
+            if (fd < 0)
+                return false;
+            bool ok = true;
+            for (size_t done = 0; ok && done < data.size();)
+            {
+                ssize_t n = write(fd, data.data() + done, data.size() - done);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                ok = n > 0;
+                done += ok ? size_t(n) : 0;
+            }
+            // mkstemp makes it 0600, entries are shared like any other build output
+            ok = ok && fchmod(fd, executable ? 0755 : 0644) == 0;
+            ok = close(fd) == 0 && ok;
+            ok = ok && rename(tmp.c_str(), path.c_str()) == 0;
+            if (!ok)
+                unlink(tmp.c_str());
+            return ok;
+        }
+
+        struct Cache
+        {
+            std::string m_dir;
+
+            Cache(const std::string &dir) : m_dir(dir) {}
+
+            // the entry for a hash, spread over 256 subdirectories so none of them gets huge. ext says what it is
+            std::string path(const std::string &hash, const std::string &ext) const
+            {
+                return std::format("{}/{}/{}.{}", m_dir, hash.substr(0, 2), hash.substr(2), ext);
+            }
+
+            std::optional<std::string> read(const std::string &hash, const std::string &ext) const
+            {
+                return read_file(path(hash, ext));
+            }
+
+            bool write(const std::string &hash, const std::string &ext, const std::string &data, bool executable = false) const
+            {
+                std::error_code ec{};
+                std::filesystem::create_directories(std::format("{}/{}", m_dir, hash.substr(0, 2)), ec);
+                if (ec)
+                    return false;
+                return write_atomically(path(hash, ext), data, executable);
+            }
+
+            // copies the entry to dest, atomically as well. false when there's no such entry
+            bool restore(const std::string &hash, const std::string &ext, const std::string &dest, bool executable = false) const
+            {
+                auto data = read(hash, ext);
+                return data && write_atomically(dest, *data, executable);
+            }
+        };
+    }
+}
+#endif
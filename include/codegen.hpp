@@ -1,16 +1,2032 @@
 #ifndef DER_CODEGEN_HPP
 #define DER_CODEGEN_HPP
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <optional>
+#include <set>
 #include <string>
+#include <vector>
 #include <format>
-namespace der {
-    namespace codegen {
-        // now here comes the real shit
-        struct Codegen {
+#include "der_ir.hpp"
+#include "lexer.hpp"
+#include "debug.hpp"
+#include "runtime.hpp"
 
-            std::string gen_bin_add() {
-                return std::format("add {}");
+// `derijac native`: the lowered IR becomes x86-64 System V assembly in GNU as syntax, `as` and `ld` turn it into a
+// static executable with no C compiler or libc involved (the little runtime it needs is in runtime.hpp).
+// it goes in three steps: lowering to machine instructions over an unbounded supply of virtual registers, linear
+// scan to give those registers real ones (or stack slots), then printing. the data layout and calling convention
+// are the ones a C compiler would use for the C backend's output, so the object files could be linked with C.
+namespace der
+{
+    namespace codegen
+    {
+        using Stmts = std::vector<std::unique_ptr<ir::Expr>>;
+
+        struct CodegenErr
+        {
+            std::string msg;
+            CodegenErr(const std::string &m) : msg(m) {}
+        };
+
+        // v is a virtual register, 32 bit unless it's wide (pointers and the eightbytes structs are moved in).
+        // nothing writes its dst before it has read all of its operands, so dst may be one of them
+        enum class MOp
+        {
+            MOVI,   // dst = imm
+            MOV,    // dst = a
+            SYM,    // dst = &sym
+            FRAME,  // dst = &stack object imm
+            BIN,    // dst = a <sym> b, or imm when b < 0, sym is the mnemonic without its size
+            DIV,    // dst = a / b, a % b when imm is 1
+            SHIFT,  // dst = a <sym> b, or imm when b < 0
+            ADDI,   // dst = a + imm
+            NEG,    // dst = -a
+            NOT,    // dst = !a
+            SEXT8,  // dst = (char)a
+            ZEXT8,  // dst = (unsigned char)a
+            SET,    // dst = a <sym> b, or imm when b < 0, sym is a condition code
+            LABEL,  // label:
+            JMP,    // goto label
+            JCC,    // if a <sym> b (or imm when b < 0) goto label
+            JZ,     // if !a goto label
+            JNZ,    // if a goto label
+            TABLE,  // goto tables[imm][a]
+            LOAD,   // dst = *(a + imm), size bytes
+            STORE,  // *(a + imm) = b, size bytes
+            LOADX,  // dst = a[b], size byte elements
+            STOREX, // a[b] = c, size byte elements
+            ELEM,   // dst = a + b * imm
+            COPY,   // memcpy(a, b, size)
+            ZERO,   // memset(a + imm, 0, size)
+            PARAMS, // args = the argument registers, first thing in a function
+            ARG,    // dst = the imm-th eightbyte of the arguments passed on the stack
+            CALL,   // dst (and b from rdx) = sym(args in registers, stack pushed)
+            RET,    // return a (and b in rdx)
+        };
+
+        struct MInst
+        {
+            MOp op;
+            int dst = -1;
+            int a = -1;
+            int b = -1;
+            int c = -1;
+            int64_t imm = 0;
+            int64_t size = 0;
+            int label = -1;
+            std::string sym{};
+            std::vector<int> args{};
+            std::vector<int> stack{};
+            // compares pointers rather than ints
+            bool wide = false;
+        };
+
+        struct JumpTable
+        {
+            int64_t low = 0;
+            std::vector<int> targets{};
+            int fallback = -1;
+        };
+
+        struct StackObject
+        {
+            int64_t size;
+            int64_t align;
+        };
+
+        struct MFunction
+        {
+            std::string name;
+            std::vector<MInst> code{};
+            // per virtual register
+            std::vector<bool> wide{};
+            std::vector<StackObject> objects{};
+            int labels = 0;
+            std::vector<JumpTable> tables{};
+        };
+
+        struct GlobalData
+        {
+            std::string name;
+            int64_t size;
+            int64_t align;
+        };
+
+        struct MModule
+        {
+            std::vector<MFunction> functions{};
+            std::vector<GlobalData> globals{};
+            // string literals as written in the source, their escapes mean the same thing to `as`
+            std::vector<std::string> strings{};
+        };
+
+        inline ir::Expr *strip(ir::Expr *e)
+        {
+            while (auto g = dynamic_cast<ir::Group *>(e))
+                e = g->inner.get();
+            return e;
+        }
+
+        inline bool fits32(int64_t v)
+        {
+            return v >= INT32_MIN && v <= INT32_MAX;
+        }
+
+        struct Lowering
+        {
+            struct Layout
+            {
+                int64_t size = 0;
+                int64_t align = 1;
+                std::vector<std::string> order{};
+                std::map<std::string, std::pair<int64_t, std::string>> members{};
+            };
+            struct Signature
+            {
+                std::string ret;
+                std::vector<std::string> args;
+            };
+            // scalars live in a virtual register unless their address is taken, structs and arrays always
+            // get a stack object. an array's type is its element's plus `*` since that's what its name means
+            struct Var
+            {
+                enum Kind
+                {
+                    REG,
+                    MEMORY,
+                    ARRAY,
+                } kind;
+                int id;
+                std::string ty;
+            };
+            struct Global
+            {
+                std::string ty;
+                bool array;
+            };
+
+            MModule m_module{};
+            std::map<std::string, Layout> m_structs{};
+            std::map<std::string, Signature> m_functions{};
+            std::map<std::string, int64_t> m_enums{};
+            std::map<std::string, Global> m_globals{};
+
+            // per function state
+            MFunction m_fn{""};
+            std::vector<std::map<std::string, Var>> m_scopes{};
+            std::map<std::string, int> m_named_labels{};
+            std::set<std::string> m_address_taken{};
+            std::string m_ret_ty{};
+            int m_sret = -1;
+            bool m_in_init = false;
+
+            [[noreturn]] static void unsupported(ir::Expr *e)
+            {
+                throw CodegenErr(std::format("derijac native doesn't support '{}' yet, compile it to C instead.", e->value()));
+            }
+
+            // types are the C spellings the IR carries around
+            static std::string trim(std::string ty)
+            {
+                for (const std::string q : {" restrict", "restrict "})
+                    for (size_t at = ty.find(q); at != std::string::npos; at = ty.find(q))
+                        ty.erase(at, q.size());
+                while (ty.ends_with(" "))
+                    ty.pop_back();
+                while (ty.starts_with(" "))
+                    ty.erase(0, 1);
+                return ty;
+            }
+            static std::string unqualified(const std::string &ty)
+            {
+                std::string out = trim(ty);
+                if (out.starts_with("const ") && !out.ends_with("*"))
+                    out = out.substr(6);
+                return out;
+            }
+            static bool is_pointer(const std::string &ty)
+            {
+                return trim(ty).ends_with("*");
+            }
+            static std::string pointee(const std::string &ty)
+            {
+                std::string out = trim(ty);
+                if (!out.ends_with("*"))
+                    return "int";
+                out.pop_back();
+                return unqualified(out);
+            }
+            static bool is_struct(const std::string &ty)
+            {
+                return !is_pointer(ty) && unqualified(ty).starts_with("struct ");
+            }
+            const Layout &layout(const std::string &ty) const
+            {
+                std::string name = unqualified(ty).substr(7);
+                if (!m_structs.contains(name))
+                    throw CodegenErr(std::format("unknown struct '{}'.", name));
+                return m_structs.at(name);
+            }
+            int64_t size_of(const std::string &ty) const
+            {
+                if (is_pointer(ty))
+                    return 8;
+                if (is_struct(ty))
+                    return layout(ty).size;
+                std::string base = unqualified(ty);
+                if (base == "char" || base == "unsigned char" || base == "signed char")
+                    return 1;
+                return 4;
+            }
+            int64_t align_of(const std::string &ty) const
+            {
+                return is_struct(ty) ? layout(ty).align : size_of(ty);
+            }
+            bool is_wide(const std::string &ty) const
+            {
+                return is_pointer(ty);
+            }
+
+            // C's rules: every member at the next multiple of its alignment, the whole thing padded to the biggest one
+            void add_struct(ir::Struct *st)
+            {
+                Layout out{};
+                for (auto &m : st->members)
+                {
+                    int64_t align = align_of(m.type);
+                    out.size = (out.size + align - 1) / align * align;
+                    out.members[m.name] = {out.size, m.type};
+                    out.order.push_back(m.name);
+                    out.size += size_of(m.type);
+                    out.align = std::max(out.align, align);
+                }
+                out.size = (out.size + out.align - 1) / out.align * out.align;
+                m_structs[st->name] = out;
+            }
+
+            int vreg(bool wide = false)
+            {
+                m_fn.wide.push_back(wide);
+                return int(m_fn.wide.size() - 1);
+            }
+            // objects are rounded up to whole eightbytes so a struct in one can always be moved 8 bytes at a time
+            int object(int64_t size, int64_t align)
+            {
+                m_fn.objects.push_back(StackObject{std::max<int64_t>((size + 7) / 8 * 8, 8), std::max<int64_t>(align, 8)});
+                return int(m_fn.objects.size() - 1);
+            }
+            MInst &emit(MInst in)
+            {
+                m_fn.code.push_back(std::move(in));
+                return m_fn.code.back();
+            }
+            int new_label()
+            {
+                return m_fn.labels++;
+            }
+            void place(int label)
+            {
+                emit({.op = MOp::LABEL, .label = label});
+            }
+            int label_for(const std::string &name)
+            {
+                if (!m_named_labels.contains(name))
+                    m_named_labels[name] = new_label();
+                return m_named_labels.at(name);
+            }
+            int frame(int obj)
+            {
+                int d = vreg(true);
+                emit({.op = MOp::FRAME, .dst = d, .imm = obj});
+                return d;
+            }
+            int offset(int addr, int64_t off)
+            {
+                if (off == 0)
+                    return addr;
+                int d = vreg(true);
+                emit({.op = MOp::ADDI, .dst = d, .a = addr, .imm = off});
+                return d;
+            }
+
+            std::optional<Var> lookup(const std::string &name) const
+            {
+                for (auto it = m_scopes.rbegin(); it != m_scopes.rend(); ++it)
+                    if (auto found = it->find(name); found != it->end())
+                        return found->second;
+                return std::nullopt;
+            }
+
+            std::optional<int64_t> constant(ir::Expr *e) const
+            {
+                e = strip(e);
+                if (auto x = dynamic_cast<ir::Integer *>(e))
+                    return x->val;
+                if (auto x = dynamic_cast<ir::Char *>(e))
+                    return int64_t(x->val);
+                if (auto x = dynamic_cast<ir::Bool *>(e))
+                    return int64_t(x->val);
+                if (auto x = dynamic_cast<ir::Ident *>(e); x && m_enums.contains(x->_value) && !lookup(x->_value))
+                    return m_enums.at(x->_value);
+                if (auto x = dynamic_cast<ir::Unary *>(e); x && x->op == "-")
+                {
+                    if (auto v = constant(x->victim.get()))
+                        return -*v;
+                }
+                return std::nullopt;
+            }
+
+            std::string member_type(ir::Dot *dot, int64_t *off = nullptr)
+            {
+                auto name = dynamic_cast<ir::Ident *>(strip(dot->rfs.get()));
+                std::string ty = type_of(dot->lfs.get());
+                if (!name || !is_struct(ty))
+                    unsupported(dot);
+                auto &l = layout(ty);
+                if (!l.members.contains(name->_value))
+                    throw CodegenErr(std::format("'{}' has no member '{}'.", ty, name->_value));
+                if (off)
+                    *off = l.members.at(name->_value).first;
+                return l.members.at(name->_value).second;
+            }
+
+            std::optional<Signature> signature(const std::string &name)
+            {
+                if (m_functions.contains(name))
+                    return m_functions.at(name);
+                static const std::map<std::string, Signature> natives{
+                    {"dkhel", {"int", {}}},
+                    {"strlen", {"int", {"const char*"}}},
+                    {"memcmp", {"int", {"const char*", "const char*", "int"}}},
+                    {"__der_str_hash", {"int", {"const char*", "int", "int"}}},
+                };
+                if (natives.contains(name))
+                    return natives.at(name);
+                return std::nullopt;
+            }
+
+            std::string type_of(ir::Expr *e)
+            {
+                e = strip(e);
+                if (dynamic_cast<ir::String *>(e))
+                    return "const char*";
+                if (dynamic_cast<ir::Char *>(e))
+                    return "char";
+                if (auto x = dynamic_cast<ir::Cast *>(e))
+                    return x->ty;
+                if (auto x = dynamic_cast<ir::Ident *>(e))
+                {
+                    if (auto var = lookup(x->_value))
+                        return var->ty;
+                    if (m_globals.contains(x->_value))
+                        return m_globals.at(x->_value).ty;
+                    return "int";
+                }
+                if (auto x = dynamic_cast<ir::Subscript *>(e))
+                    return pointee(type_of(x->target.get()));
+                if (auto x = dynamic_cast<ir::Dot *>(e))
+                    return member_type(x);
+                if (auto x = dynamic_cast<ir::PointerDeref *>(e))
+                    return pointee(type_of(x->victim.get()));
+                if (auto x = dynamic_cast<ir::GetAddress *>(e))
+                    return type_of(x->victim.get()) + "*";
+                if (auto x = dynamic_cast<ir::Binary *>(e))
+                {
+                    std::string ty = type_of(x->lfs.get());
+                    return is_pointer(ty) ? ty : "int";
+                }
+                ir::Expr *callee = nullptr;
+                if (auto x = dynamic_cast<ir::FunctionCall *>(e))
+                    callee = x->callee.get();
+                if (auto x = dynamic_cast<ir::Pipe *>(e))
+                    callee = x->rfs.get();
+                if (auto id = dynamic_cast<ir::Ident *>(callee ? strip(callee) : nullptr))
+                {
+                    if (auto sig = signature(id->_value))
+                        return sig->ret;
+                }
+                return "int";
+            }
+
+            // how many times v shows up in the code emitted since `from`
+            size_t mentions(int v, size_t from) const
+            {
+                size_t n = 0;
+                for (size_t pc = from; pc < m_fn.code.size(); ++pc)
+                {
+                    auto &in = m_fn.code.at(pc);
+                    n += (in.dst == v) + (in.a == v) + (in.b == v) + (in.c == v);
+                    n += size_t(std::count(in.args.begin(), in.args.end(), v) + std::count(in.stack.begin(), in.stack.end(), v));
+                }
+                return n;
+            }
+
+            // r was computed by the code since `from`, when it's a fresh temp only the last instruction wrote
+            // that instruction writes dst instead, so `s = s + x` is one add and not an add and a move
+            void move(int dst, int r, size_t from, int fresh)
+            {
+                if (r == dst)
+                    return;
+                if (r >= fresh && !m_fn.code.empty() && m_fn.code.back().dst == r && m_fn.wide.at(r) == m_fn.wide.at(dst) && mentions(r, from) == 1)
+                {
+                    m_fn.code.back().dst = dst;
+                    return;
+                }
+                emit({.op = MOp::MOV, .dst = dst, .a = r});
+            }
+            void value_into(int dst, ir::Expr *e)
+            {
+                size_t from = m_fn.code.size();
+                int fresh = int(m_fn.wide.size());
+                move(dst, value(e), from, fresh);
+            }
+
+            // jumps to target when e's truthiness is `when`, comparisons and && / || never materialize a bool
+            void jump_if(ir::Expr *e, bool when, int target)
+            {
+                e = strip(e);
+                if (auto v = constant(e))
+                {
+                    if ((*v != 0) == when)
+                        emit({.op = MOp::JMP, .label = target});
+                    return;
+                }
+                if (auto un = dynamic_cast<ir::Unary *>(e); un && un->op == "!")
+                    return jump_if(un->victim.get(), !when, target);
+                if (auto log = dynamic_cast<ir::Logical *>(e))
+                {
+                    if (log->op == "&&" || log->op == "||")
+                    {
+                        bool all = (log->op == "&&") == when;
+                        if (all)
+                        {
+                            int skip = new_label();
+                            jump_if(log->lfs.get(), !when, skip);
+                            jump_if(log->rfs.get(), when, target);
+                            place(skip);
+                        }
+                        else
+                        {
+                            jump_if(log->lfs.get(), when, target);
+                            jump_if(log->rfs.get(), when, target);
+                        }
+                        return;
+                    }
+                    static const std::map<std::string, std::pair<std::string, std::string>> jumps{
+                        {"==", {"e", "ne"}},
+                        {"!=", {"ne", "e"}},
+                        {"<", {"l", "ge"}},
+                        {"<=", {"le", "g"}},
+                        {">", {"g", "le"}},
+                        {">=", {"ge", "l"}},
+                    };
+                    if (auto it = jumps.find(log->op); it != jumps.end())
+                    {
+                        MInst in{.op = MOp::JCC, .label = target, .sym = when ? it->second.first : it->second.second};
+                        in.wide = is_pointer(type_of(log->lfs.get())) || is_pointer(type_of(log->rfs.get()));
+                        in.a = value(log->lfs.get());
+                        if (auto k = constant(log->rfs.get()); k && fits32(*k))
+                            in.imm = *k;
+                        else
+                            in.b = value(log->rfs.get());
+                        emit(std::move(in));
+                        return;
+                    }
+                }
+                emit({.op = when ? MOp::JNZ : MOp::JZ, .a = value(e), .label = target, .wide = is_pointer(type_of(e))});
+            }
+
+            // SysV: the first six eightbytes go in rdi, rsi, rdx, rcx, r8 and r9. a struct of at most 16 bytes takes one
+            // or two of them if they're still free, anything bigger (or that doesn't fit anymore) goes on the stack.
+            // a struct result of at most 16 bytes comes back in rax:rdx, a bigger one is written through a pointer the
+            // caller passes before everything else. returns the result's register, or its address for a struct
+            int call(ir::Expr *callee_expr, const std::vector<ir::Expr *> &args)
+            {
+                auto callee = dynamic_cast<ir::Ident *>(strip(callee_expr));
+                if (!callee)
+                    unsupported(callee_expr);
+                std::string name = callee->_value;
+                std::optional<Signature> sig{};
+                if (name == "kteb" && args.size() == 1 && !m_functions.contains(name))
+                {
+                    std::string ty = type_of(args.at(0));
+                    if (is_struct(ty))
+                        unsupported(args.at(0));
+                    bool text = is_pointer(ty) && size_of(pointee(ty)) == 1;
+                    name = unqualified(ty) == "char" ? "__der_kteb_char" : text ? "__der_kteb_str" : "__der_kteb_int";
+                    sig = Signature{"void", {unqualified(ty) == "char" ? "char" : text ? "const char*" : "int"}};
+                }
+                else
+                    sig = signature(name);
+                if (!sig)
+                    throw CodegenErr(std::format("'{}' isn't a function derijac native knows about.", name));
+                if (sig->args.size() != args.size())
+                    throw CodegenErr(std::format("'{}' takes {} arguments.", name, sig->args.size()));
+                MInst in{.op = MOp::CALL, .sym = name};
+                int result = -1;
+                if (is_struct(sig->ret))
+                {
+                    result = frame(object(size_of(sig->ret), align_of(sig->ret)));
+                    if (size_of(sig->ret) > 16)
+                        in.args.push_back(result);
+                }
+                for (size_t i = 0; i < args.size(); ++i)
+                {
+                    const std::string &ty = sig->args.at(i);
+                    if (!is_struct(ty))
+                    {
+                        int v = value(args.at(i));
+                        (in.args.size() < 6 ? in.args : in.stack).push_back(v);
+                        continue;
+                    }
+                    // the callee gets its own copy, moved out of it an eightbyte at a time
+                    int64_t size = size_of(ty);
+                    int copy = frame(object(size, align_of(ty)));
+                    struct_into(copy, ty, args.at(i));
+                    size_t n = size_t((size + 7) / 8);
+                    bool in_regs = size <= 16 && in.args.size() + n <= 6;
+                    for (size_t k = 0; k < n; ++k)
+                    {
+                        int v = vreg(true);
+                        emit({.op = MOp::LOAD, .dst = v, .a = copy, .imm = int64_t(k * 8), .size = 8});
+                        (in_regs ? in.args : in.stack).push_back(v);
+                    }
+                }
+                if (is_struct(sig->ret) && size_of(sig->ret) <= 16)
+                {
+                    in.dst = vreg(true);
+                    if (size_of(sig->ret) > 8)
+                        in.b = vreg(true);
+                }
+                else if (!is_struct(sig->ret) && sig->ret != "void")
+                    in.dst = vreg(is_wide(sig->ret));
+                int dst = in.dst, high = in.b;
+                emit(std::move(in));
+                if (!is_struct(sig->ret))
+                    return dst;
+                if (size_of(sig->ret) <= 16)
+                {
+                    emit({.op = MOp::STORE, .a = result, .b = dst, .size = 8});
+                    if (high >= 0)
+                        emit({.op = MOp::STORE, .a = result, .b = high, .imm = 8, .size = 8});
+                }
+                return result;
+            }
+            int call(ir::Expr *e)
+            {
+                e = strip(e);
+                if (auto x = dynamic_cast<ir::Pipe *>(e))
+                    return call(x->rfs.get(), {x->lfs.get()});
+                auto x = dynamic_cast<ir::FunctionCall *>(e);
+                std::vector<ir::Expr *> args{};
+                for (auto &a : x->args)
+                    args.push_back(a.get());
+                return call(x->callee.get(), args);
+            }
+
+            int load(int addr, int64_t off, const std::string &ty)
+            {
+                int d = vreg(is_wide(ty));
+                emit({.op = MOp::LOAD, .dst = d, .a = addr, .imm = off, .size = size_of(ty)});
+                return d;
+            }
+
+            // the address of something that lives in memory: a struct, an array element, a member, a global
+            int address(ir::Expr *e)
+            {
+                e = strip(e);
+                if (auto x = dynamic_cast<ir::Ident *>(e))
+                {
+                    if (auto var = lookup(x->_value))
+                    {
+                        if (var->kind == Var::REG)
+                            unsupported(e);
+                        return frame(var->id);
+                    }
+                    if (m_globals.contains(x->_value))
+                    {
+                        int d = vreg(true);
+                        emit({.op = MOp::SYM, .dst = d, .sym = x->_value});
+                        return d;
+                    }
+                    throw CodegenErr(std::format("unknown name '{}'.", x->_value));
+                }
+                if (auto x = dynamic_cast<ir::Subscript *>(e))
+                {
+                    std::string elem = pointee(type_of(x->target.get()));
+                    int base = value(x->target.get());
+                    int index = value(x->inner.get());
+                    int d = vreg(true);
+                    emit({.op = MOp::ELEM, .dst = d, .a = base, .b = index, .imm = size_of(elem)});
+                    return d;
+                }
+                if (auto x = dynamic_cast<ir::Dot *>(e))
+                {
+                    int64_t off = 0;
+                    member_type(x, &off);
+                    return offset(address(x->lfs.get()), off);
+                }
+                if (auto x = dynamic_cast<ir::PointerDeref *>(e))
+                    return value(x->victim.get());
+                if (dynamic_cast<ir::FunctionCall *>(e) || dynamic_cast<ir::Pipe *>(e))
+                {
+                    if (is_struct(type_of(e)))
+                        return call(e);
+                }
+                unsupported(e);
+            }
+
+            void zero(int addr, int64_t off, int64_t size)
+            {
+                if (size > 0)
+                    emit({.op = MOp::ZERO, .a = addr, .imm = off, .size = size});
+            }
+
+            // writes the struct value e into memory at addr, StructInstance members it doesn't name are zeroed like in C
+            void struct_into(int addr, const std::string &ty, ir::Expr *e)
+            {
+                e = strip(e);
+                auto &l = layout(ty);
+                if (auto x = dynamic_cast<ir::StructInstance *>(e))
+                {
+                    std::set<std::string> named{};
+                    for (auto &init : x->inits)
+                        named.insert(init.ident);
+                    for (auto &m : l.order)
+                        if (!named.contains(m))
+                            zero(addr, l.members.at(m).first, size_of(l.members.at(m).second));
+                    for (auto &init : x->inits)
+                    {
+                        if (!l.members.contains(init.ident))
+                            throw CodegenErr(std::format("'{}' has no member '{}'.", ty, init.ident));
+                        auto &[off, mty] = l.members.at(init.ident);
+                        store(addr, off, mty, init.value.get());
+                    }
+                    return;
+                }
+                emit({.op = MOp::COPY, .a = addr, .b = address(e), .size = l.size});
+            }
+
+            // *(addr + off) = e for a value of type ty
+            void store(int addr, int64_t off, const std::string &ty, ir::Expr *e)
+            {
+                if (is_struct(ty))
+                    return struct_into(offset(addr, off), ty, e);
+                emit({.op = MOp::STORE, .a = addr, .b = value(e), .imm = off, .size = size_of(ty)});
+            }
+
+            // struct assignment goes through a temporary when the right side is built in place, so
+            // `p = jadid P{x: p.y, y: p.x}` reads p before writing it
+            void struct_assign(int addr, const std::string &ty, ir::Expr *e)
+            {
+                if (dynamic_cast<ir::StructInstance *>(strip(e)))
+                {
+                    int tmp = frame(object(size_of(ty), align_of(ty)));
+                    struct_into(tmp, ty, e);
+                    emit({.op = MOp::COPY, .a = addr, .b = tmp, .size = size_of(ty)});
+                    return;
+                }
+                struct_into(addr, ty, e);
+            }
+
+            // computes e into a virtual register. a local's own register is returned as is, nobody writes the result
+            int value(ir::Expr *e)
+            {
+                e = strip(e);
+                if (auto v = constant(e))
+                {
+                    int d = vreg();
+                    emit({.op = MOp::MOVI, .dst = d, .imm = *v});
+                    return d;
+                }
+                if (auto x = dynamic_cast<ir::String *>(e))
+                {
+                    m_module.strings.push_back(x->val);
+                    int d = vreg(true);
+                    emit({.op = MOp::SYM, .dst = d, .sym = std::format(".Lstr{}", m_module.strings.size() - 1)});
+                    return d;
+                }
+                if (auto x = dynamic_cast<ir::Ident *>(e))
+                {
+                    auto var = lookup(x->_value);
+                    if (var && var->kind == Var::REG)
+                        return var->id;
+                    if (var && var->kind == Var::ARRAY)
+                        return frame(var->id);
+                    if (!var && m_globals.contains(x->_value) && m_globals.at(x->_value).array)
+                        return address(e);
+                    std::string ty = type_of(e);
+                    if (is_struct(ty))
+                        unsupported(e);
+                    return load(address(e), 0, ty);
+                }
+                if (auto x = dynamic_cast<ir::Binary *>(e))
+                {
+                    std::string lty = type_of(x->lfs.get());
+                    if (is_pointer(lty) && (x->op == "+" || x->op == "-"))
+                    {
+                        // pointer arithmetic
+                        int base = value(x->lfs.get());
+                        int index = value(x->rfs.get());
+                        if (x->op == "-")
+                        {
+                            int neg = vreg();
+                            emit({.op = MOp::NEG, .dst = neg, .a = index});
+                            index = neg;
+                        }
+                        int d = vreg(true);
+                        emit({.op = MOp::ELEM, .dst = d, .a = base, .b = index, .imm = size_of(pointee(lty))});
+                        return d;
+                    }
+                    static const std::map<std::string, std::pair<MOp, std::string>> ops{
+                        {"+", {MOp::BIN, "add"}},
+                        {"-", {MOp::BIN, "sub"}},
+                        {"*", {MOp::BIN, "imul"}},
+                        {"&", {MOp::BIN, "and"}},
+                        {"|", {MOp::BIN, "or"}},
+                        {"^", {MOp::BIN, "xor"}},
+                        {"/", {MOp::DIV, ""}},
+                        {"%", {MOp::DIV, ""}},
+                        {"<<", {MOp::SHIFT, "sal"}},
+                        {">>", {MOp::SHIFT, "sar"}},
+                    };
+                    auto it = ops.find(x->op);
+                    if (it == ops.end())
+                        unsupported(e);
+                    MInst in{.op = it->second.first, .a = value(x->lfs.get()), .sym = it->second.second};
+                    auto k = constant(x->rfs.get());
+                    if (k && fits32(*k) && (x->op == "+" || x->op == "-"))
+                    {
+                        in.op = MOp::ADDI;
+                        in.imm = x->op == "+" ? *k : -*k;
+                    }
+                    else if (k && fits32(*k) && in.op != MOp::DIV)
+                        in.imm = in.op == MOp::SHIFT ? (*k & 31) : *k;
+                    else
+                        in.b = value(x->rfs.get());
+                    if (x->op == "%")
+                        in.imm = 1;
+                    in.dst = vreg();
+                    return emit(std::move(in)).dst;
+                }
+                if (auto x = dynamic_cast<ir::Logical *>(e))
+                {
+                    static const std::map<std::string, std::string> ops{
+                        {"==", "e"},
+                        {"!=", "ne"},
+                        {"<", "l"},
+                        {"<=", "le"},
+                        {">", "g"},
+                        {">=", "ge"},
+                    };
+                    if (auto it = ops.find(x->op); it != ops.end())
+                    {
+                        MInst in{.op = MOp::SET, .sym = it->second};
+                        in.wide = is_pointer(type_of(x->lfs.get())) || is_pointer(type_of(x->rfs.get()));
+                        in.a = value(x->lfs.get());
+                        if (auto k = constant(x->rfs.get()); k && fits32(*k))
+                            in.imm = *k;
+                        else
+                            in.b = value(x->rfs.get());
+                        in.dst = vreg();
+                        return emit(std::move(in)).dst;
+                    }
+                    int t = vreg();
+                    int end = new_label();
+                    emit({.op = MOp::MOVI, .dst = t, .imm = 0});
+                    jump_if(e, false, end);
+                    emit({.op = MOp::MOVI, .dst = t, .imm = 1});
+                    place(end);
+                    return t;
+                }
+                if (auto x = dynamic_cast<ir::Unary *>(e))
+                {
+                    if (x->op == "+")
+                        return value(x->victim.get());
+                    if (x->op != "-" && x->op != "!")
+                        unsupported(e);
+                    int v = value(x->victim.get());
+                    int d = vreg();
+                    emit({.op = x->op == "-" ? MOp::NEG : MOp::NOT, .dst = d, .a = v, .wide = m_fn.wide.at(v)});
+                    return d;
+                }
+                if (auto x = dynamic_cast<ir::Cast *>(e))
+                {
+                    int v = value(x->victim.get());
+                    int d = vreg(is_wide(x->ty));
+                    if (x->ty == "char")
+                        emit({.op = MOp::SEXT8, .dst = d, .a = v});
+                    else if (x->ty == "unsigned char")
+                        emit({.op = MOp::ZEXT8, .dst = d, .a = v});
+                    else
+                        emit({.op = MOp::MOV, .dst = d, .a = v});
+                    return d;
+                }
+                if (auto x = dynamic_cast<ir::Subscript *>(e))
+                {
+                    std::string elem = pointee(type_of(x->target.get()));
+                    if (is_struct(elem))
+                        unsupported(e);
+                    int base = value(x->target.get());
+                    int index = value(x->inner.get());
+                    int d = vreg(is_wide(elem));
+                    emit({.op = MOp::LOADX, .dst = d, .a = base, .b = index, .size = size_of(elem)});
+                    return d;
+                }
+                if (auto x = dynamic_cast<ir::Dot *>(e))
+                {
+                    int64_t off = 0;
+                    std::string ty = member_type(x, &off);
+                    if (is_struct(ty))
+                        unsupported(e);
+                    return load(address(x->lfs.get()), off, ty);
+                }
+                if (auto x = dynamic_cast<ir::PointerDeref *>(e))
+                {
+                    std::string ty = pointee(type_of(x->victim.get()));
+                    if (is_struct(ty))
+                        unsupported(e);
+                    return load(value(x->victim.get()), 0, ty);
+                }
+                if (auto x = dynamic_cast<ir::GetAddress *>(e))
+                    return address(x->victim.get());
+                if (dynamic_cast<ir::FunctionCall *>(e) || dynamic_cast<ir::Pipe *>(e))
+                {
+                    if (is_struct(type_of(e)))
+                        unsupported(e);
+                    return call(e);
+                }
+                unsupported(e);
+            }
+
+            void assign(ir::SetOp *set)
+            {
+                ir::Expr *target = strip(set->target.get());
+                std::string ty = type_of(target);
+                if (auto id = dynamic_cast<ir::Ident *>(target))
+                {
+                    auto var = lookup(id->_value);
+                    if (var && var->kind == Var::REG)
+                        return value_into(var->id, set->_value.get());
+                }
+                if (is_struct(ty))
+                    return struct_assign(address(target), ty, set->_value.get());
+                if (auto sub = dynamic_cast<ir::Subscript *>(target))
+                {
+                    int base = value(sub->target.get());
+                    int index = value(sub->inner.get());
+                    int v = value(set->_value.get());
+                    emit({.op = MOp::STOREX, .a = base, .b = index, .c = v, .size = size_of(ty)});
+                    return;
+                }
+                int addr = address(target);
+                emit({.op = MOp::STORE, .a = addr, .b = value(set->_value.get()), .size = size_of(ty)});
+            }
+
+            void block(const Stmts &body)
+            {
+                m_scopes.push_back({});
+                for (auto &s : body)
+                    stmt(s.get());
+                m_scopes.pop_back();
+            }
+
+            void array(ir::ArrayVariable *arr)
+            {
+                int64_t elem = size_of(arr->ty);
+                int base = -1;
+                if (m_in_init)
+                {
+                    base = vreg(true);
+                    emit({.op = MOp::SYM, .dst = base, .sym = arr->name});
+                }
+                else
+                {
+                    int obj = object(elem * int64_t(arr->size), align_of(arr->ty));
+                    base = frame(obj);
+                    m_scopes.back()[arr->name] = Var{Var::ARRAY, obj, arr->ty + "*"};
+                }
+                if (!arr->_value)
+                    return;
+                auto values = dynamic_cast<ir::Array *>(arr->_value.get());
+                if (!values)
+                    unsupported(arr);
+                size_t given = std::min(values->values.size(), arr->size);
+                for (size_t i = 0; i < given; ++i)
+                    store(base, int64_t(i) * elem, arr->ty, values->values.at(i).get());
+                // the rest is zeroed like C does, globals already are
+                if (!m_in_init)
+                    zero(base, int64_t(given) * elem, int64_t(arr->size - given) * elem);
+            }
+
+            void stmt(ir::Expr *e)
+            {
+                if (auto var = dynamic_cast<ir::Variable *>(e))
+                {
+                    // the initializer is compiled before the name exists, `dir x = x + 1` reads the outer x
+                    if (is_struct(var->ty) || m_address_taken.contains(var->name))
+                    {
+                        int obj = object(size_of(var->ty), align_of(var->ty));
+                        int addr = frame(obj);
+                        if (var->_value)
+                            store(addr, 0, var->ty, var->_value.get());
+                        else
+                            zero(addr, 0, size_of(var->ty));
+                        m_scopes.back()[var->name] = Var{Var::MEMORY, obj, var->ty};
+                        return;
+                    }
+                    int reg = vreg(is_wide(var->ty));
+                    if (var->_value)
+                        value_into(reg, var->_value.get());
+                    else
+                        emit({.op = MOp::MOVI, .dst = reg, .imm = 0});
+                    m_scopes.back()[var->name] = Var{Var::REG, reg, var->ty};
+                    return;
+                }
+                if (auto arr = dynamic_cast<ir::ArrayVariable *>(e))
+                    return array(arr);
+                if (auto set = dynamic_cast<ir::SetOp *>(e))
+                    assign(set);
+                else if (auto x = dynamic_cast<ir::If *>(e))
+                {
+                    int other = new_label();
+                    jump_if(x->cond.get(), false, other);
+                    block(x->body);
+                    if (x->else_block.size() > 0)
+                    {
+                        int end = new_label();
+                        emit({.op = MOp::JMP, .label = end});
+                        place(other);
+                        block(x->else_block);
+                        place(end);
+                    }
+                    else
+                        place(other);
+                }
+                else if (auto x = dynamic_cast<ir::SmolIf *>(e))
+                {
+                    int end = new_label();
+                    jump_if(x->lfs.get(), false, end);
+                    stmt(x->rfs.get());
+                    place(end);
+                }
+                else if (auto x = dynamic_cast<ir::RangedFor *>(e))
+                    ranged_for(x);
+                else if (auto x = dynamic_cast<ir::For *>(e))
+                {
+                    m_scopes.push_back({});
+                    if (x->init)
+                        stmt(x->init.get());
+                    int top = new_label(), cond = new_label();
+                    emit({.op = MOp::JMP, .label = cond});
+                    place(top);
+                    block(x->body);
+                    if (x->step)
+                        stmt(x->step.get());
+                    place(cond);
+                    jump_if(x->cond.get(), true, top);
+                    m_scopes.pop_back();
+                }
+                else if (auto x = dynamic_cast<ir::Block *>(e))
+                    block(x->body);
+                else if (auto x = dynamic_cast<ir::Return *>(e))
+                    ret(x->ret.get());
+                else if (auto x = dynamic_cast<ir::Label *>(e))
+                    place(label_for(x->name));
+                else if (auto x = dynamic_cast<ir::Goto *>(e))
+                    emit({.op = MOp::JMP, .label = label_for(x->label)});
+                else if (auto x = dynamic_cast<ir::Switch *>(e))
+                    lower_switch(x);
+                else if (dynamic_cast<ir::FunctionCall *>(strip(e)) || dynamic_cast<ir::Pipe *>(strip(e)))
+                    call(e);
+                else
+                    value(e);
+            }
+
+            void ret(ir::Expr *e)
+            {
+                if (!is_struct(m_ret_ty))
+                {
+                    emit({.op = MOp::RET, .a = value(e)});
+                    return;
+                }
+                int64_t size = size_of(m_ret_ty);
+                if (size > 16)
+                {
+                    struct_into(m_sret, m_ret_ty, e);
+                    emit({.op = MOp::RET, .a = m_sret});
+                    return;
+                }
+                int tmp = frame(object(size, align_of(m_ret_ty)));
+                struct_into(tmp, m_ret_ty, e);
+                MInst in{.op = MOp::RET, .a = vreg(true)};
+                emit({.op = MOp::LOAD, .dst = in.a, .a = tmp, .size = 8});
+                if (size > 8)
+                {
+                    in.b = vreg(true);
+                    emit({.op = MOp::LOAD, .dst = in.b, .a = tmp, .imm = 8, .size = 8});
+                }
+                emit(std::move(in));
+            }
+
+            // the goal is read again on every iteration like in C, unless it's a constant
+            void ranged_for(ir::RangedFor *loop)
+            {
+                m_scopes.push_back({});
+                int i = vreg();
+                value_into(i, loop->init.get());
+                m_scopes.back()[loop->ident] = Var{Var::REG, i, "int"};
+                int top = new_label(), end = new_label();
+                if (auto goal = constant(loop->goal.get()); goal && fits32(*goal))
+                {
+                    emit({.op = MOp::JCC, .a = i, .imm = *goal, .label = end, .sym = "ge"});
+                    place(top);
+                    block(loop->body);
+                    emit({.op = MOp::ADDI, .dst = i, .a = i, .imm = 1});
+                    emit({.op = MOp::JCC, .a = i, .imm = *goal, .label = top, .sym = "l"});
+                }
+                else
+                {
+                    int cond = new_label();
+                    emit({.op = MOp::JMP, .label = cond});
+                    place(top);
+                    block(loop->body);
+                    emit({.op = MOp::ADDI, .dst = i, .a = i, .imm = 1});
+                    place(cond);
+                    emit({.op = MOp::JCC, .a = i, .b = value(loop->goal.get()), .label = top, .sym = "l"});
+                }
+                place(end);
+                m_scopes.pop_back();
+            }
+
+            // dense case values go through a jump table, sparse ones through a row of compare and jumps
+            void lower_switch(ir::Switch *sw)
+            {
+                int scrutinee = value(sw->scrutinee.get());
+                std::vector<std::pair<int64_t, int>> cases{};
+                for (auto &c : sw->cases)
+                {
+                    auto v = constant(c.label.get());
+                    if (!v || !fits32(*v))
+                        unsupported(c.label.get());
+                    cases.push_back({*v, new_label()});
+                }
+                int fallback = new_label(), end = new_label();
+                int64_t low = INT64_MAX, high = INT64_MIN;
+                for (auto &[v, _] : cases)
+                {
+                    low = std::min(low, v);
+                    high = std::max(high, v);
+                }
+                if (cases.size() >= 4 && high - low < int64_t(cases.size()) * 2 + 8)
+                {
+                    JumpTable table{low, std::vector<int>(size_t(high - low + 1), fallback), fallback};
+                    for (auto &[v, label] : cases)
+                        table.targets.at(size_t(v - low)) = label;
+                    m_fn.tables.push_back(std::move(table));
+                    emit({.op = MOp::TABLE, .a = scrutinee, .imm = int64_t(m_fn.tables.size() - 1)});
+                }
+                else
+                {
+                    for (auto &[v, label] : cases)
+                        emit({.op = MOp::JCC, .a = scrutinee, .imm = v, .label = label, .sym = "e"});
+                    emit({.op = MOp::JMP, .label = fallback});
+                }
+                for (size_t i = 0; i < cases.size(); ++i)
+                {
+                    place(cases.at(i).second);
+                    block(sw->cases.at(i).body);
+                    emit({.op = MOp::JMP, .label = end});
+                }
+                place(fallback);
+                block(sw->default_block);
+                place(end);
+            }
+
+            static void find_address_taken(ir::Expr *e, std::set<std::string> &out)
+            {
+                if (!e)
+                    return;
+                if (auto x = dynamic_cast<ir::GetAddress *>(e))
+                {
+                    if (auto id = dynamic_cast<ir::Ident *>(strip(x->victim.get())))
+                        out.insert(id->_value);
+                    return find_address_taken(x->victim.get(), out);
+                }
+                auto all = [&](const Stmts &body)
+                {
+                    for (auto &s : body)
+                        find_address_taken(s.get(), out);
+                };
+                if (auto x = dynamic_cast<ir::Group *>(e))
+                    find_address_taken(x->inner.get(), out);
+                else if (auto x = dynamic_cast<ir::Binary *>(e))
+                {
+                    find_address_taken(x->lfs.get(), out);
+                    find_address_taken(x->rfs.get(), out);
+                }
+                else if (auto x = dynamic_cast<ir::Logical *>(e))
+                {
+                    find_address_taken(x->lfs.get(), out);
+                    find_address_taken(x->rfs.get(), out);
+                }
+                else if (auto x = dynamic_cast<ir::Pipe *>(e))
+                {
+                    find_address_taken(x->lfs.get(), out);
+                    find_address_taken(x->rfs.get(), out);
+                }
+                else if (auto x = dynamic_cast<ir::Unary *>(e))
+                    find_address_taken(x->victim.get(), out);
+                else if (auto x = dynamic_cast<ir::Cast *>(e))
+                    find_address_taken(x->victim.get(), out);
+                else if (auto x = dynamic_cast<ir::PointerDeref *>(e))
+                    find_address_taken(x->victim.get(), out);
+                else if (auto x = dynamic_cast<ir::Subscript *>(e))
+                {
+                    find_address_taken(x->target.get(), out);
+                    find_address_taken(x->inner.get(), out);
+                }
+                else if (auto x = dynamic_cast<ir::Dot *>(e))
+                    find_address_taken(x->lfs.get(), out);
+                else if (auto x = dynamic_cast<ir::FunctionCall *>(e))
+                {
+                    for (auto &a : x->args)
+                        find_address_taken(a.get(), out);
+                }
+                else if (auto x = dynamic_cast<ir::StructInstance *>(e))
+                {
+                    for (auto &init : x->inits)
+                        find_address_taken(init.value.get(), out);
+                }
+                else if (auto x = dynamic_cast<ir::Array *>(e))
+                    all(x->values);
+                else if (auto x = dynamic_cast<ir::Variable *>(e))
+                    find_address_taken(x->_value.get(), out);
+                else if (auto x = dynamic_cast<ir::ArrayVariable *>(e))
+                    find_address_taken(x->_value.get(), out);
+                else if (auto x = dynamic_cast<ir::SetOp *>(e))
+                {
+                    find_address_taken(x->target.get(), out);
+                    find_address_taken(x->_value.get(), out);
+                }
+                else if (auto x = dynamic_cast<ir::If *>(e))
+                {
+                    find_address_taken(x->cond.get(), out);
+                    all(x->body);
+                    all(x->else_block);
+                }
+                else if (auto x = dynamic_cast<ir::SmolIf *>(e))
+                {
+                    find_address_taken(x->lfs.get(), out);
+                    find_address_taken(x->rfs.get(), out);
+                }
+                else if (auto x = dynamic_cast<ir::RangedFor *>(e))
+                {
+                    find_address_taken(x->init.get(), out);
+                    find_address_taken(x->goal.get(), out);
+                    all(x->body);
+                }
+                else if (auto x = dynamic_cast<ir::For *>(e))
+                {
+                    find_address_taken(x->init.get(), out);
+                    find_address_taken(x->cond.get(), out);
+                    find_address_taken(x->step.get(), out);
+                    all(x->body);
+                }
+                else if (auto x = dynamic_cast<ir::Block *>(e))
+                    all(x->body);
+                else if (auto x = dynamic_cast<ir::Return *>(e))
+                    find_address_taken(x->ret.get(), out);
+                else if (auto x = dynamic_cast<ir::Switch *>(e))
+                {
+                    find_address_taken(x->scrutinee.get(), out);
+                    for (auto &c : x->cases)
+                        all(c.body);
+                    all(x->default_block);
+                }
+            }
+
+            void function(const std::string &name, const std::string &ret_ty, const std::vector<ir::CArgTy> &args, const Stmts &body)
+            {
+                m_fn = MFunction{name};
+                m_scopes.assign(1, {});
+                m_named_labels.clear();
+                m_address_taken.clear();
+                for (auto &s : body)
+                    find_address_taken(s.get(), m_address_taken);
+                m_ret_ty = ret_ty;
+                m_sret = -1;
+                // what arrives in registers is taken first, everything else is read off the stack after
+                MInst params{.op = MOp::PARAMS};
+                std::vector<MInst> after{};
+                int64_t on_stack = 0;
+                if (is_struct(ret_ty) && size_of(ret_ty) > 16)
+                {
+                    m_sret = vreg(true);
+                    params.args.push_back(m_sret);
+                }
+                for (auto &a : args)
+                {
+                    if (is_struct(a.ty) || m_address_taken.contains(a.name))
+                    {
+                        int64_t size = size_of(a.ty);
+                        int obj = object(size, align_of(a.ty));
+                        int addr = vreg(true);
+                        after.push_back({.op = MOp::FRAME, .dst = addr, .imm = obj});
+                        size_t n = size_t((size + 7) / 8);
+                        bool in_regs = size <= 16 && params.args.size() + n <= 6;
+                        for (size_t k = 0; k < n; ++k)
+                        {
+                            int v = vreg(true);
+                            if (in_regs)
+                                params.args.push_back(v);
+                            else
+                                after.push_back({.op = MOp::ARG, .dst = v, .imm = on_stack++});
+                            after.push_back({.op = MOp::STORE, .a = addr, .b = v, .imm = int64_t(k * 8), .size = 8});
+                        }
+                        m_scopes.back()[a.name] = Var{Var::MEMORY, obj, a.ty};
+                        continue;
+                    }
+                    int v = vreg(is_wide(a.ty));
+                    if (params.args.size() < 6)
+                        params.args.push_back(v);
+                    else
+                        after.push_back({.op = MOp::ARG, .dst = v, .imm = on_stack++});
+                    m_scopes.back()[a.name] = Var{Var::REG, v, a.ty};
+                }
+                emit(std::move(params));
+                for (auto &in : after)
+                    emit(std::move(in));
+                for (auto &s : body)
+                    stmt(s.get());
+                // falling off the end returns 0 like the other backends
+                MInst fallthrough{.op = MOp::RET};
+                if (!is_struct(ret_ty) && ret_ty != "void")
+                {
+                    fallthrough.a = vreg(is_wide(ret_ty));
+                    emit({.op = MOp::MOVI, .dst = fallthrough.a, .imm = 0});
+                }
+                emit(std::move(fallthrough));
+                m_module.functions.push_back(std::move(m_fn));
+            }
+
+            MModule lower(const Stmts &module)
+            {
+                // names first, functions can call ones defined after them
+                Stmts init{};
+                for (auto &e : module)
+                {
+                    if (auto st = dynamic_cast<ir::Struct *>(e.get()))
+                        add_struct(st);
+                    else if (auto fn = dynamic_cast<ir::Function *>(e.get()))
+                    {
+                        Signature sig{fn->ret_ty, {}};
+                        for (auto &a : fn->args)
+                            sig.args.push_back(a.ty);
+                        m_functions[fn->name] = sig;
+                    }
+                    else if (auto en = dynamic_cast<ir::Enum *>(e.get()))
+                    {
+                        for (size_t i = 0; i < en->members.size(); ++i)
+                            m_enums[std::format("{}_{}", en->name, en->members.at(i))] = int64_t(i);
+                    }
+                    else if (auto var = dynamic_cast<ir::Variable *>(e.get()))
+                    {
+                        m_globals[var->name] = Global{var->ty, false};
+                        m_module.globals.push_back(GlobalData{var->name, size_of(var->ty), align_of(var->ty)});
+                        if (var->_value)
+                            init.push_back(std::make_unique<ir::SetOp>(std::make_unique<ir::Ident>(var->name), var->_value->clone()));
+                    }
+                    else if (auto arr = dynamic_cast<ir::ArrayVariable *>(e.get()))
+                    {
+                        m_globals[arr->name] = Global{arr->ty + "*", true};
+                        m_module.globals.push_back(GlobalData{arr->name, size_of(arr->ty) * int64_t(arr->size), align_of(arr->ty)});
+                        init.push_back(arr->clone());
+                    }
+                }
+                for (auto &e : module)
+                {
+                    if (auto fn = dynamic_cast<ir::Function *>(e.get()))
+                        function(fn->name, fn->ret_ty, fn->args, fn->body);
+                }
+                // _start runs this before main
+                m_in_init = true;
+                function("__der_init", "void", {}, init);
+                m_in_init = false;
+                if (!m_functions.contains("main"))
+                    throw CodegenErr("there's no main function to start from.");
+                return std::move(m_module);
+            }
+        };
+
+        enum Reg
+        {
+            RAX,
+            RCX,
+            RDX,
+            RBX,
+            RSI,
+            RDI,
+            R8,
+            R9,
+            R10,
+            R11,
+            R12,
+            R13,
+            R14,
+            R15,
+            // never allocated, only the frame uses them
+            RSP,
+            RBP,
+            NO_REG = -1,
+        };
+
+        inline std::string reg_name(int r, int64_t size)
+        {
+            static const char *names[][3] = {
+                {"%rax", "%eax", "%al"},
+                {"%rcx", "%ecx", "%cl"},
+                {"%rdx", "%edx", "%dl"},
+                {"%rbx", "%ebx", "%bl"},
+                {"%rsi", "%esi", "%sil"},
+                {"%rdi", "%edi", "%dil"},
+                {"%r8", "%r8d", "%r8b"},
+                {"%r9", "%r9d", "%r9b"},
+                {"%r10", "%r10d", "%r10b"},
+                {"%r11", "%r11d", "%r11b"},
+                {"%r12", "%r12d", "%r12b"},
+                {"%r13", "%r13d", "%r13b"},
+                {"%r14", "%r14d", "%r14b"},
+                {"%r15", "%r15d", "%r15b"},
+                {"%rsp", "%esp", "%spl"},
+                {"%rbp", "%ebp", "%bpl"},
+            };
+            return names[r][size == 8 ? 0 : size == 1 ? 2 : 1];
+        }
+
+        // where every virtual register ended up, a real register or a slot in the frame
+        struct Allocation
+        {
+            std::vector<int> reg{};
+            // stack object backing a spilled register
+            std::vector<int> slot{};
+            std::vector<int> saved{};
+        };
+
+        // the frame below rbp: the callee saved registers we push, then the stack objects at offsets[i] below rbp.
+        // size is how much rsp goes down after the pushes, so that calls see it 16 byte aligned
+        struct Frame
+        {
+            std::vector<int64_t> offsets{};
+            int64_t saved = 0;
+            int64_t size = 0;
+        };
+
+        inline Frame frame_layout(const MFunction &fn, const Allocation &alloc)
+        {
+            Frame out{std::vector<int64_t>(fn.objects.size(), 0), int64_t(alloc.saved.size()) * 8, 0};
+            int64_t top = out.saved;
+            for (size_t i = 0; i < fn.objects.size(); ++i)
+            {
+                auto &obj = fn.objects.at(i);
+                top = (top + obj.size + obj.align - 1) / obj.align * obj.align;
+                out.offsets.at(i) = top;
+            }
+            out.size = (top + 15) / 16 * 16 - out.saved;
+            if ((out.saved + out.size) % 16 != 0)
+                out.size += 8;
+            return out;
+        }
+
+        // linear scan (Poletto & Sarkar) over live intervals in code order. an interval is stretched over every loop
+        // it's live into, and one that spans a call only gets a callee saved register, the caller saved ones would
+        // need saving around it. rax, rcx, rdx, r10 and r11 are never handed out, the printer uses them as scratch
+        struct RegAlloc
+        {
+            static constexpr Reg callee_saved[] = {RBX, R12, R13, R14, R15};
+            static constexpr Reg caller_saved[] = {RSI, RDI, R8, R9};
+
+            static std::vector<int> operands(const MInst &in)
+            {
+                std::vector<int> out{};
+                for (int v : {in.dst, in.a, in.b, in.c})
+                    if (v >= 0)
+                        out.push_back(v);
+                out.insert(out.end(), in.args.begin(), in.args.end());
+                out.insert(out.end(), in.stack.begin(), in.stack.end());
+                return out;
+            }
+
+            static Allocation allocate(MFunction &fn)
+            {
+                size_t n = fn.wide.size();
+                std::vector<int64_t> start(n, INT64_MAX), end(n, -1);
+                std::map<int, int64_t> label_pc{};
+                std::vector<int64_t> calls{};
+                for (size_t pc = 0; pc < fn.code.size(); ++pc)
+                {
+                    auto &in = fn.code.at(pc);
+                    for (int v : operands(in))
+                    {
+                        start.at(size_t(v)) = std::min(start.at(size_t(v)), int64_t(pc));
+                        end.at(size_t(v)) = std::max(end.at(size_t(v)), int64_t(pc));
+                    }
+                    if (in.op == MOp::LABEL)
+                        label_pc[in.label] = int64_t(pc);
+                    if (in.op == MOp::CALL)
+                        calls.push_back(int64_t(pc));
+                }
+                // a backward jump is a loop, whatever is live going into it stays live until the jump
+                std::vector<std::pair<int64_t, int64_t>> loops{};
+                for (size_t pc = 0; pc < fn.code.size(); ++pc)
+                {
+                    auto &in = fn.code.at(pc);
+                    std::vector<int> targets{};
+                    if (in.op == MOp::JMP || in.op == MOp::JCC || in.op == MOp::JZ || in.op == MOp::JNZ)
+                        targets.push_back(in.label);
+                    if (in.op == MOp::TABLE)
+                        targets = fn.tables.at(size_t(in.imm)).targets;
+                    for (int t : targets)
+                        if (label_pc.at(t) <= int64_t(pc))
+                            loops.push_back({label_pc.at(t), int64_t(pc)});
+                }
+                for (bool changed = true; changed;)
+                {
+                    changed = false;
+                    for (auto [head, tail] : loops)
+                        for (size_t v = 0; v < n; ++v)
+                            if (start.at(v) < head && end.at(v) >= head && end.at(v) < tail)
+                            {
+                                end.at(v) = tail;
+                                changed = true;
+                            }
+                }
+                auto crosses_call = [&](size_t v)
+                {
+                    auto it = std::upper_bound(calls.begin(), calls.end(), start.at(v));
+                    return it != calls.end() && *it < end.at(v);
+                };
+
+                Allocation out{std::vector<int>(n, NO_REG), std::vector<int>(n, -1), {}};
+                std::vector<size_t> order{};
+                for (size_t v = 0; v < n; ++v)
+                    if (end.at(v) >= 0)
+                        order.push_back(v);
+                std::sort(order.begin(), order.end(), [&](size_t x, size_t y)
+                          { return start.at(x) < start.at(y); });
+                std::vector<size_t> active{};
+                std::set<int> used{};
+                auto spill = [&](size_t v)
+                {
+                    out.reg.at(v) = NO_REG;
+                    fn.objects.push_back(StackObject{8, 8});
+                    out.slot.at(v) = int(fn.objects.size() - 1);
+                };
+                for (size_t v : order)
+                {
+                    std::erase_if(active, [&](size_t a)
+                                  { return end.at(a) < start.at(v); });
+                    bool across = crosses_call(v);
+                    std::vector<Reg> allowed{};
+                    if (!across)
+                        allowed.insert(allowed.end(), std::begin(caller_saved), std::end(caller_saved));
+                    allowed.insert(allowed.end(), std::begin(callee_saved), std::end(callee_saved));
+                    std::set<int> taken{};
+                    for (size_t a : active)
+                        taken.insert(out.reg.at(a));
+                    auto free = std::find_if(allowed.begin(), allowed.end(), [&](Reg r)
+                                             { return !taken.contains(r); });
+                    if (free != allowed.end())
+                    {
+                        out.reg.at(v) = *free;
+                        used.insert(*free);
+                        active.push_back(v);
+                        continue;
+                    }
+                    // the interval living longest gives its register up, unless that's this one
+                    size_t victim = v;
+                    for (size_t a : active)
+                        if (std::find(allowed.begin(), allowed.end(), Reg(out.reg.at(a))) != allowed.end() && end.at(a) > end.at(victim))
+                            victim = a;
+                    if (victim == v)
+                    {
+                        spill(v);
+                        continue;
+                    }
+                    out.reg.at(v) = out.reg.at(victim);
+                    spill(victim);
+                    std::erase(active, victim);
+                    active.push_back(v);
+                }
+                for (Reg r : callee_saved)
+                    if (used.contains(r))
+                        out.saved.push_back(r);
+                return out;
+            }
+        };
+
+        struct AsmPrinter
+        {
+            static constexpr Reg arg_regs[] = {RDI, RSI, RDX, RCX, R8, R9};
+
+            std::string m_out{};
+            const MFunction *m_fn = nullptr;
+            Allocation m_alloc{};
+            std::vector<int64_t> m_offsets{};
+            size_t m_index = 0;
+
+            template <typename... Args>
+            void line(std::format_string<Args...> fmt, Args &&...args)
+            {
+                m_out += "\t";
+                m_out += std::format(fmt, std::forward<Args>(args)...);
+                m_out += "\n";
+            }
+
+            std::string label(int l) const
+            {
+                return std::format(".L{}_{}", m_index, l);
+            }
+            bool wide(int v) const
+            {
+                return m_fn->wide.at(size_t(v));
+            }
+            int reg(int v) const
+            {
+                return m_alloc.reg.at(size_t(v));
+            }
+            static char suffix(bool w)
+            {
+                return w ? 'q' : 'l';
+            }
+            // v as an operand of the given size, its register or its frame slot
+            std::string loc(int v, int64_t size) const
+            {
+                if (reg(v) != NO_REG)
+                    return reg_name(reg(v), size);
+                return std::format("-{}(%rbp)", m_offsets.at(size_t(m_alloc.slot.at(size_t(v)))));
+            }
+            std::string loc(int v) const
+            {
+                return loc(v, wide(v) ? 8 : 4);
+            }
+            // a register holding v, `scratch` unless v already has one
+            std::string in_reg(int v, Reg scratch, int64_t size)
+            {
+                if (reg(v) != NO_REG)
+                    return reg_name(reg(v), size);
+                line("mov{} {}, {}", suffix(size == 8), loc(v, size), reg_name(scratch, size));
+                return reg_name(scratch, size);
+            }
+            void mov(const std::string &from, const std::string &to, bool w)
+            {
+                if (from != to)
+                    line("mov{} {}, {}", suffix(w), from, to);
+            }
+            // writes the scratch register holding the result to dst
+            void result(int dst, Reg scratch)
+            {
+                mov(reg_name(scratch, wide(dst) ? 8 : 4), loc(dst), wide(dst));
+            }
+            std::string operand(const MInst &in, int64_t size)
+            {
+                return in.b >= 0 ? loc(in.b, size) : std::format("${}", in.imm);
+            }
+
+            // moves from[i] to to[i] for all i at once. in order when no move overwrites what a later one still
+            // reads, otherwise everything goes through the stack
+            void parallel_move(const std::vector<std::string> &from, const std::vector<std::string> &to)
+            {
+                bool clash = false;
+                for (size_t i = 0; i < to.size(); ++i)
+                    for (size_t k = i + 1; k < from.size(); ++k)
+                        clash = clash || (to.at(i) == from.at(k) && from.at(i) != to.at(i));
+                if (!clash)
+                {
+                    for (size_t i = 0; i < to.size(); ++i)
+                    {
+                        if (from.at(i).starts_with("%") || to.at(i).starts_with("%"))
+                            mov(from.at(i), to.at(i), true);
+                        else
+                        {
+                            line("movq {}, %rax", from.at(i));
+                            line("movq %rax, {}", to.at(i));
+                        }
+                    }
+                    return;
+                }
+                for (auto &f : from)
+                    line("pushq {}", f);
+                for (size_t i = to.size(); i-- > 0;)
+                    line("popq {}", to.at(i));
+            }
+
+            void print(const MInst &in, const MInst *next)
+            {
+                switch (in.op)
+                {
+                case MOp::MOVI:
+                    if (fits32(in.imm))
+                        line("mov{} ${}, {}", suffix(wide(in.dst)), in.imm, loc(in.dst));
+                    else
+                    {
+                        line("movabsq ${}, %rax", in.imm);
+                        result(in.dst, RAX);
+                    }
+                    break;
+                case MOp::MOV:
+                    if (wide(in.dst) && !wide(in.a))
+                    {
+                        line("movslq {}, %rax", loc(in.a));
+                        result(in.dst, RAX);
+                    }
+                    else if (reg(in.dst) == NO_REG && reg(in.a) == NO_REG)
+                    {
+                        line("mov{} {}, {}", suffix(wide(in.dst)), loc(in.a, wide(in.dst) ? 8 : 4), reg_name(RAX, wide(in.dst) ? 8 : 4));
+                        result(in.dst, RAX);
+                    }
+                    else
+                        mov(loc(in.a, wide(in.dst) ? 8 : 4), loc(in.dst), wide(in.dst));
+                    break;
+                case MOp::SYM:
+                case MOp::FRAME:
+                {
+                    std::string src = in.op == MOp::SYM ? std::format("{}(%rip)", in.sym) : std::format("-{}(%rbp)", m_offsets.at(size_t(in.imm)));
+                    if (reg(in.dst) != NO_REG)
+                        line("leaq {}, {}", src, loc(in.dst));
+                    else
+                    {
+                        line("leaq {}, %rax", src);
+                        result(in.dst, RAX);
+                    }
+                    break;
+                }
+                case MOp::BIN:
+                    // straight into dst when it's a register that isn't also the right operand
+                    if (reg(in.dst) != NO_REG && (in.b < 0 || reg(in.b) != reg(in.dst)))
+                    {
+                        mov(loc(in.a), loc(in.dst), false);
+                        line("{}l {}, {}", in.sym, operand(in, 4), loc(in.dst));
+                    }
+                    else
+                    {
+                        mov(loc(in.a), "%eax", false);
+                        line("{}l {}, %eax", in.sym, operand(in, 4));
+                        result(in.dst, RAX);
+                    }
+                    break;
+                case MOp::DIV:
+                    mov(loc(in.a), "%eax", false);
+                    line("cltd");
+                    line("idivl {}", loc(in.b));
+                    result(in.dst, in.imm == 1 ? RDX : RAX);
+                    break;
+                case MOp::SHIFT:
+                    if (in.b >= 0)
+                        mov(loc(in.b), "%ecx", false);
+                    mov(loc(in.a), "%eax", false);
+                    line("{}l {}, %eax", in.sym, in.b >= 0 ? "%cl" : std::format("${}", in.imm));
+                    result(in.dst, RAX);
+                    break;
+                case MOp::ADDI:
+                {
+                    bool w = wide(in.dst);
+                    if (reg(in.dst) != NO_REG && reg(in.a) != NO_REG)
+                    {
+                        if (reg(in.dst) == reg(in.a))
+                            line("add{} ${}, {}", suffix(w), in.imm, loc(in.dst));
+                        else
+                            line("lea{} {}({}), {}", suffix(w), in.imm, reg_name(reg(in.a), 8), loc(in.dst));
+                    }
+                    else if (in.dst == in.a)
+                        line("add{} ${}, {}", suffix(w), in.imm, loc(in.dst));
+                    else
+                    {
+                        mov(loc(in.a, w ? 8 : 4), reg_name(RAX, w ? 8 : 4), w);
+                        line("add{} ${}, {}", suffix(w), in.imm, reg_name(RAX, w ? 8 : 4));
+                        result(in.dst, RAX);
+                    }
+                    break;
+                }
+                case MOp::NEG:
+                    mov(loc(in.a), "%eax", false);
+                    line("negl %eax");
+                    result(in.dst, RAX);
+                    break;
+                case MOp::NOT:
+                    line("cmp{} $0, {}", suffix(wide(in.a)), loc(in.a));
+                    line("sete %al");
+                    line("movzbl %al, %eax");
+                    result(in.dst, RAX);
+                    break;
+                case MOp::SEXT8:
+                case MOp::ZEXT8:
+                    mov(loc(in.a, 4), "%eax", false);
+                    line("mov{}bl %al, %eax", in.op == MOp::SEXT8 ? 's' : 'z');
+                    result(in.dst, RAX);
+                    break;
+                case MOp::SET:
+                case MOp::JCC:
+                {
+                    int64_t size = in.wide ? 8 : 4;
+                    if (in.b < 0)
+                        line("cmp{} ${}, {}", suffix(in.wide), in.imm, loc(in.a, size));
+                    else
+                        line("cmp{} {}, {}", suffix(in.wide), loc(in.b, size), in_reg(in.a, RAX, size));
+                    if (in.op == MOp::JCC)
+                    {
+                        line("j{} {}", in.sym, label(in.label));
+                        break;
+                    }
+                    line("set{} %al", in.sym);
+                    line("movzbl %al, %eax");
+                    result(in.dst, RAX);
+                    break;
+                }
+                case MOp::LABEL:
+                    m_out += label(in.label) + ":\n";
+                    break;
+                case MOp::JMP:
+                    // a jump to the very next instruction is left out
+                    if (!next || next->op != MOp::LABEL || next->label != in.label)
+                        line("jmp {}", label(in.label));
+                    break;
+                case MOp::JZ:
+                case MOp::JNZ:
+                    line("cmp{} $0, {}", suffix(in.wide), loc(in.a, in.wide ? 8 : 4));
+                    line("j{} {}", in.op == MOp::JZ ? "e" : "ne", label(in.label));
+                    break;
+                case MOp::TABLE:
+                {
+                    auto &table = m_fn->tables.at(size_t(in.imm));
+                    mov(loc(in.a), "%eax", false);
+                    if (table.low != 0)
+                        line("subl ${}, %eax", table.low);
+                    line("cmpl ${}, %eax", table.targets.size());
+                    line("jae {}", label(table.fallback));
+                    line("leaq .LT{}_{}(%rip), %r11", m_index, in.imm);
+                    line("jmp *(%r11,%rax,8)");
+                    break;
+                }
+                case MOp::LOAD:
+                case MOp::LOADX:
+                {
+                    std::string base = in_reg(in.a, R10, 8);
+                    std::string at = std::format("{}({})", in.imm, base);
+                    if (in.op == MOp::LOADX)
+                    {
+                        line("movslq {}, %r11", loc(in.b, 4));
+                        at = std::format("({},%r11,{})", base, in.size);
+                    }
+                    Reg into = reg(in.dst) != NO_REG ? Reg(reg(in.dst)) : RAX;
+                    if (in.size == 1)
+                        line("movsbl {}, {}", at, reg_name(into, 4));
+                    else if (in.size == 8)
+                        line("movq {}, {}", at, reg_name(into, 8));
+                    else
+                        line("movl {}, {}", at, reg_name(into, 4));
+                    if (into == RAX)
+                        result(in.dst, RAX);
+                    break;
+                }
+                case MOp::STORE:
+                case MOp::STOREX:
+                {
+                    std::string base = in_reg(in.a, R10, 8);
+                    std::string at = std::format("{}({})", in.imm, base);
+                    int val = in.b;
+                    if (in.op == MOp::STOREX)
+                    {
+                        line("movslq {}, %r11", loc(in.b, 4));
+                        at = std::format("({},%r11,{})", base, in.size);
+                        val = in.c;
+                    }
+                    int64_t size = in.size == 1 ? 1 : in.size == 8 ? 8 : 4;
+                    if (in.size != size)
+                    {
+                        // the tail of a struct that doesn't end on an eightbyte, a byte at a time
+                        line("movq {}, %rax", loc(val, 8));
+                        for (int64_t k = 0; k < in.size; ++k)
+                        {
+                            line("movb %al, {}({})", in.imm + k, base);
+                            line("shrq $8, %rax");
+                        }
+                        break;
+                    }
+                    line("mov{} {}, {}", size == 1 ? 'b' : suffix(size == 8), in_reg(val, RAX, size), at);
+                    break;
+                }
+                case MOp::ELEM:
+                    line("movslq {}, %rax", loc(in.b, 4));
+                    if (in.imm != 1)
+                        line("imulq ${}, %rax, %rax", in.imm);
+                    line("addq {}, %rax", loc(in.a, 8));
+                    result(in.dst, RAX);
+                    break;
+                case MOp::COPY:
+                {
+                    line("movq {}, %r10", loc(in.a, 8));
+                    line("movq {}, %r11", loc(in.b, 8));
+                    int64_t k = 0, size = in.size;
+                    if (size > 64)
+                    {
+                        // big ones in a loop, the pointers end up where the tail starts
+                        line("movq ${}, %rcx", size / 8);
+                        m_out += "1:\n";
+                        line("movq (%r11), %rax");
+                        line("movq %rax, (%r10)");
+                        line("addq $8, %r11");
+                        line("addq $8, %r10");
+                        line("decq %rcx");
+                        line("jnz 1b");
+                        size %= 8;
+                    }
+                    for (; k + 8 <= size; k += 8)
+                    {
+                        line("movq {}(%r11), %rax", k);
+                        line("movq %rax, {}(%r10)", k);
+                    }
+                    for (; k + 4 <= size; k += 4)
+                    {
+                        line("movl {}(%r11), %eax", k);
+                        line("movl %eax, {}(%r10)", k);
+                    }
+                    for (; k < size; ++k)
+                    {
+                        line("movb {}(%r11), %al", k);
+                        line("movb %al, {}(%r10)", k);
+                    }
+                    break;
+                }
+                case MOp::ZERO:
+                {
+                    line("movq {}, %r10", loc(in.a, 8));
+                    line("xorl %eax, %eax");
+                    int64_t k = in.imm, end = in.imm + in.size;
+                    if (in.size > 64)
+                    {
+                        line("leaq {}(%r10), %r11", in.imm);
+                        line("movq ${}, %rcx", in.size / 8);
+                        m_out += "1:\n";
+                        line("movq %rax, (%r11)");
+                        line("addq $8, %r11");
+                        line("decq %rcx");
+                        line("jnz 1b");
+                        k += in.size / 8 * 8;
+                    }
+                    for (; k + 8 <= end; k += 8)
+                        line("movq %rax, {}(%r10)", k);
+                    for (; k + 4 <= end; k += 4)
+                        line("movl %eax, {}(%r10)", k);
+                    for (; k < end; ++k)
+                        line("movb %al, {}(%r10)", k);
+                    break;
+                }
+                case MOp::PARAMS:
+                {
+                    std::vector<std::string> from{}, to{};
+                    for (size_t i = 0; i < in.args.size(); ++i)
+                    {
+                        from.push_back(reg_name(arg_regs[i], 8));
+                        to.push_back(loc(in.args.at(i), 8));
+                    }
+                    parallel_move(from, to);
+                    break;
+                }
+                case MOp::ARG:
+                    if (reg(in.dst) != NO_REG)
+                        line("movq {}(%rbp), {}", 16 + 8 * in.imm, loc(in.dst, 8));
+                    else
+                    {
+                        line("movq {}(%rbp), %rax", 16 + 8 * in.imm);
+                        result(in.dst, RAX);
+                    }
+                    break;
+                case MOp::CALL:
+                {
+                    // the stack has to be 16 byte aligned at the call, the frame itself is
+                    bool pad = in.stack.size() % 2 == 1;
+                    if (pad)
+                        line("subq $8, %rsp");
+                    for (size_t i = in.stack.size(); i-- > 0;)
+                        line("pushq {}", loc(in.stack.at(i), 8));
+                    std::vector<std::string> from{}, to{};
+                    for (size_t i = 0; i < in.args.size(); ++i)
+                    {
+                        from.push_back(loc(in.args.at(i), 8));
+                        to.push_back(reg_name(arg_regs[i], 8));
+                    }
+                    parallel_move(from, to);
+                    line("call {}", in.sym);
+                    if (size_t popped = in.stack.size() * 8 + (pad ? 8 : 0))
+                        line("addq ${}, %rsp", popped);
+                    if (in.dst >= 0)
+                        result(in.dst, RAX);
+                    if (in.b >= 0)
+                        result(in.b, RDX);
+                    break;
+                }
+                case MOp::RET:
+                    if (in.a >= 0)
+                        mov(loc(in.a), reg_name(RAX, wide(in.a) ? 8 : 4), wide(in.a));
+                    if (in.b >= 0)
+                        mov(loc(in.b), "%rdx", true);
+                    if (next)
+                        line("jmp .L{}_ret", m_index);
+                    break;
+                }
+            }
+
+            void function(const MFunction &fn, const Allocation &alloc)
+            {
+                m_fn = &fn;
+                m_alloc = alloc;
+                Frame layout = frame_layout(fn, alloc);
+                m_offsets = layout.offsets;
+                int64_t saved = layout.saved, frame = layout.size;
+                m_out += std::format("\t.globl {0}\n\t.type {0}, @function\n{0}:\n", fn.name);
+                line("pushq %rbp");
+                line("movq %rsp, %rbp");
+                for (int r : alloc.saved)
+                    line("pushq {}", reg_name(r, 8));
+                if (frame > 0)
+                    line("subq ${}, %rsp", frame);
+                for (size_t pc = 0; pc < fn.code.size(); ++pc)
+                    print(fn.code.at(pc), pc + 1 < fn.code.size() ? &fn.code.at(pc + 1) : nullptr);
+                m_out += std::format(".L{}_ret:\n", m_index);
+                if (saved > 0)
+                    line("leaq -{}(%rbp), %rsp", saved);
+                else if (frame > 0)
+                    line("movq %rbp, %rsp");
+                for (size_t i = alloc.saved.size(); i-- > 0;)
+                    line("popq {}", reg_name(alloc.saved.at(i), 8));
+                line("popq %rbp");
+                line("ret");
+                m_out += std::format("\t.size {0}, .-{0}\n", fn.name);
+                if (!fn.tables.empty())
+                {
+                    line(".section .rodata");
+                    line(".p2align 3");
+                    for (size_t t = 0; t < fn.tables.size(); ++t)
+                    {
+                        m_out += std::format(".LT{}_{}:\n", m_index, t);
+                        for (int target : fn.tables.at(t).targets)
+                            line(".quad {}", label(target));
+                    }
+                    line(".text");
+                }
+                m_index += 1;
+            }
+        };
+
+        struct Codegen
+        {
+            // the whole program as one assembly file, runtime included
+            std::string generate(const Stmts &module)
+            {
+                MModule mod = Lowering{}.lower(module);
+                AsmPrinter printer{};
+                printer.m_out += "\t.text\n";
+                for (auto &fn : mod.functions)
+                {
+                    Allocation alloc = RegAlloc::allocate(fn);
+                    printer.function(fn, alloc);
+                }
+                printer.m_out += runtime::native;
+                if (!mod.strings.empty())
+                {
+                    printer.m_out += "\t.section .rodata\n";
+                    // as doesn't know every escape C has (\a, \v), the bytes are written out again in ones it reads
+                    for (size_t i = 0; i < mod.strings.size(); ++i)
+                    {
+                        std::string text{};
+                        for (char c : lexer::unescape(mod.strings.at(i)))
+                        {
+                            auto u = static_cast<unsigned char>(c);
+                            if (c == '"' || c == '\\')
+                                text += std::format("\\{}", c);
+                            else if (u < 0x20 || u >= 0x7f)
+                                text += std::format("\\{:03o}", int(u));
+                            else
+                                text += c;
+                        }
+                        printer.m_out += std::format(".Lstr{}:\n\t.string \"{}\"\n", i, text);
+                    }
+                }
+                if (!mod.globals.empty())
+                {
+                    printer.m_out += "\t.bss\n";
+                    for (auto &g : mod.globals)
+                        printer.m_out += std::format("\t.p2align {}\n\t.globl {}\n{}:\n\t.zero {}\n", std::countr_zero(uint64_t(g.align)), g.name, g.name, std::max<int64_t>(g.size, 1));
+                }
+                printer.m_out += "\t.section .note.GNU-stack,\"\",@progbits\n";
+                return printer.m_out;
             }
         };
     }
 }
-#endif
\ No newline at end of file
+#endif
@@ -5,12 +5,12 @@
 #include <source_location>
 namespace der
 {
-    void dd_debug(const std::string &e, size_t line, const char *fname)
+    inline void dd_debug(const std::string &e, size_t line, const char *fname)
     {
         std::cout << "\u001b[34m[" << fname << ':' << line << "]\u001b[m \u001b[35m" << e << "\u001b[m" << '\n';
     }
     template <class T>
-    void dd_debug_(const std::string &e, size_t line, const char *fname, const T &value, const std::string &extra = {})
+    inline void dd_debug_(const std::string &e, size_t line, const char *fname, const T &value, const std::string &extra = {})
     {
         std::cout << "\u001b[34m[" << fname << ':' << line << "]\u001b[m \u001b[35m" << extra << "\u001b[m \"" << e << " => " << value << '"' << '\n';
     }
@@ -0,0 +1,123 @@
+#ifndef DER_DER_HPP
+#define DER_DER_HPP
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <format>
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "typechecker.hpp"
+#include "optimizer.hpp"
+
+// libder: the compiler as a single call, for programs that want to turn der into C without running derijac.
+// everything a compile needs lives in that call (the lexer, parser, type checker and optimizer are made for it and
+// thrown away after), and what's shared between calls is only ever read, so any number of threads can compile at
+// the same time. nothing is printed, the errors come back as diagnostics. link with the `der` target and
+// #include "der.hpp".
+namespace der
+{
+    struct Diagnostic
+    {
+        enum class Kind
+        {
+            // khata2 imla2i, from the lexer or the parser
+            Syntax,
+            // khata2 t9ni, from the type checker
+            Type,
+            // the compiler itself broke
+            Internal,
+        };
+        Kind kind;
+        std::string message;
+        // 1 based, 0 when there's no place in the source to point at
+        size_t line = 0, column = 0;
+
+        // the way derijac prints it, without the colors
+        std::string str() const
+        {
+            static const char *kinds[] = {"khata2 imla2i", "khata2 t9ni", "khata2 dakhili"};
+            if (line == 0)
+                return std::format("[{}]: {}", kinds[int(kind)], message);
+            return std::format("[{}]: {} (line: {}, col: {})", kinds[int(kind)], message, line, column);
+        }
+    };
+
+    struct CompileOptions
+    {
+        // jobs is how many threads optimize the functions of this one program, keep it at 1 when compiling many
+        // programs at the same time already
+        optimizer::Options optimizer{};
+    };
+
+    struct CompileResult
+    {
+        bool ok = false;
+        // bytes of C the program came out as. when that's more than the buffer can take, truncated is set and the
+        // buffer holds as much of it as fits; compile again with a buffer of size + 1
+        size_t size = 0;
+        bool truncated = false;
+        std::vector<Diagnostic> diagnostics{};
+
+        explicit operator bool() const
+        {
+            return ok;
+        }
+    };
+
+    // the C for source, the same derijac writes for a file without imports
+    inline CompileResult compile(std::string_view source, const CompileOptions &options, std::string &out)
+    {
+        CompileResult result{};
+        auto diagnose = [&](Diagnostic::Kind kind, const std::string &msg, const SourceLoc *loc)
+        {
+            result.diagnostics.push_back({kind, msg, loc ? loc->line + 1 : 0, loc ? loc->column + 1 : 0});
+        };
+        try
+        {
+            auto xyz = lexer::Lexer(std::string(source));
+            xyz.lex();
+            auto abc = parser::Parser(xyz.get_output());
+            abc.parse();
+            if (!abc.m_imports.empty())
+                throw parser::SyntaxErr("jbed only works with `derijac build` for now.", abc.m_imports.front().loc);
+            auto ijk = typechecker::TypeChecker(abc.get_output());
+            ijk.do_the_thing();
+            optimizer::Optimizer(ijk.m_output, ijk.c_includes, options.optimizer).run();
+            out = ijk.get_output();
+            result.ok = true;
+            result.size = out.size();
+        }
+        catch (const parser::SyntaxErr &exc)
+        {
+            diagnose(Diagnostic::Kind::Syntax, exc.msg, &exc.loc);
+        }
+        catch (const types::CompilationErr &exc)
+        {
+            diagnose(Diagnostic::Kind::Type, exc.msg, &exc.loc);
+        }
+        catch (const std::exception &exc)
+        {
+            diagnose(Diagnostic::Kind::Internal, exc.what(), nullptr);
+        }
+        return result;
+    }
+
+    // the same into [out, out + capacity), with a NUL after the C when there's room for it
+    inline CompileResult compile(std::string_view source, const CompileOptions &options, char *out, size_t capacity)
+    {
+        std::string c{};
+        CompileResult result = compile(source, options, c);
+        if (!result.ok)
+            return result;
+        size_t n = std::min(c.size(), capacity);
+        std::memcpy(out, c.data(), n);
+        if (n < capacity)
+            out[n] = '\0';
+        result.truncated = c.size() > capacity;
+        return result;
+    }
+}
+#endif
@@ -127,6 +127,42 @@ namespace der
             }
         };
 
+        // explicit parentheses, Binary doesn't print any so rewritten operators need them
+        struct Group : Expr
+        {
+            std::unique_ptr<Expr> inner;
+            Group(std::unique_ptr<Expr> inner) : inner(std::move(inner)) {}
+            Group(const Group &other) : inner(other.inner->clone()) {}
+
+            std::string value() override
+            {
+                return std::format("({})", inner->value());
+            }
+
+            std::unique_ptr<Expr> clone() const override
+            {
+                return std::make_unique<Group>(*this);
+            }
+        };
+
+        struct Cast : Expr
+        {
+            std::string ty;
+            std::unique_ptr<Expr> victim;
+            Cast(const std::string &ty, std::unique_ptr<Expr> vic) : ty(ty), victim(std::move(vic)) {}
+            Cast(const Cast &other) : ty(other.ty), victim(other.victim->clone()) {}
+
+            std::string value() override
+            {
+                return std::format("({}){}", ty, victim->value());
+            }
+
+            std::unique_ptr<Expr> clone() const override
+            {
+                return std::make_unique<Cast>(*this);
+            }
+        };
+
         struct Logical : Expr
         {
             std::unique_ptr<Expr> lfs;
@@ -228,6 +264,22 @@ namespace der
             Char(const Char &other) : val(other.val) {}
             std::string value() override
             {
+                switch (val)
+                {
+                case '\0':
+                    return "'\\0'";
+                case '\n':
+                    return "'\\n'";
+                case '\t':
+                    return "'\\t'";
+                case '\r':
+                    return "'\\r'";
+                case '\'':
+                case '\\':
+                    return std::format("'\\{}'", val);
+                }
+                if (static_cast<unsigned char>(val) < 0x20 || static_cast<unsigned char>(val) >= 0x7f)
+                    return std::format("'\\{:03o}'", int(static_cast<unsigned char>(val)));
                 return std::format("'{}'", val);
             }
             std::unique_ptr<Expr> clone() const override
@@ -292,14 +344,22 @@ namespace der
             std::unique_ptr<Expr> _value;
             bool is_const;
             Variable(const std::string &ty, const std::string &name, std::unique_ptr<Expr> v, bool is_const = false) : ty(ty), name(name), _value(std::move(v)), is_const(is_const) {}
-            Variable(const Variable &other) : name(other.name), ty(other.ty), _value(other._value->clone()), is_const(other.is_const) {}
+            Variable(const Variable &other) : name(other.name), ty(other.ty), _value(other._value ? other._value->clone() : nullptr), is_const(other.is_const) {}
             std::string value() override
             {
+                // an initializer nobody reads gets dropped by the optimizer
+                if (_value == nullptr)
+                    return std::format("{} {}", ty, name);
                 if (is_const)
                     return std::format("const {} {} = {}", ty, name, _value->value());
                 else
                     return std::format("{} {} = {}", ty, name, _value->value());
             }
+            // as a global defined in another file
+            std::string declaration() const
+            {
+                return std::format("extern {}{} {};\n", is_const ? "const " : "", ty, name);
+            }
 
             std::unique_ptr<Expr> clone() const override
             {
@@ -323,19 +383,33 @@ namespace der
             }
         };
 
+        // tells both gcc/clang and openmp compilers that the loop's iterations are independent
+        inline std::string simd_pragma()
+        {
+            return "\n#ifdef _OPENMP\n#pragma omp simd\n#else\n#pragma GCC ivdep\n#endif\n";
+        }
+
         struct RangedFor : Expr
         {
             std::unique_ptr<Expr> init;
             std::unique_ptr<Expr> goal;
             std::string ident;
             std::vector<std::unique_ptr<Expr>> body;
+            // the counter's C type, widened by the optimizer when it indexes arrays
+            std::string ty = "int";
+            size_t unroll = 0;
+            bool assume_noalias = false;
+            bool vectorize = false;
+            // lkola mota7arik, outlined onto the thread pool by the optimizer
+            bool parallel = false;
+            std::vector<std::pair<std::string, std::string>> reductions;
 
             RangedFor(std::unique_ptr<Expr> init, std::unique_ptr<Expr> goal, const std::string &str, const std::vector<std::unique_ptr<Expr>> &body) : init(std::move(init)), goal(std::move(goal)), ident(str)
             {
                 for (auto &x : body)
                     this->body.push_back(x->clone());
             }
-            RangedFor(const RangedFor &other) : init(other.init->clone()), goal(other.goal->clone()), ident(other.ident)
+            RangedFor(const RangedFor &other) : init(other.init->clone()), goal(other.goal->clone()), ident(other.ident), ty(other.ty), unroll(other.unroll), assume_noalias(other.assume_noalias), vectorize(other.vectorize), parallel(other.parallel), reductions(other.reductions)
             {
                 for (auto &x : other.body)
                     body.push_back(x->clone());
@@ -343,7 +417,8 @@ namespace der
 
             std::string value() override
             {
-                std::string out = std::format("for(int {} = {}; {}<{}; ++{}) {{\n", ident, init->value(), ident, goal->value(), ident);
+                std::string out = vectorize ? simd_pragma() : "";
+                out += std::format("for({} {} = {}; {}<{}; ++{}) {{\n", ty, ident, init->value(), ident, goal->value(), ident);
                 for (auto &s : body)
                     out += std::format("{};\n", s->value());
                 out += "}\n";
@@ -356,6 +431,38 @@ namespace der
             }
         };
 
+        // a plain C for loop, init and step can be left empty
+        struct For : Expr
+        {
+            std::unique_ptr<Expr> init;
+            std::unique_ptr<Expr> cond;
+            std::unique_ptr<Expr> step;
+            std::vector<std::unique_ptr<Expr>> body;
+            bool vectorize = false;
+
+            For(std::unique_ptr<Expr> init, std::unique_ptr<Expr> cond, std::unique_ptr<Expr> step, std::vector<std::unique_ptr<Expr>> &&body) : init(std::move(init)), cond(std::move(cond)), step(std::move(step)), body(std::move(body)) {}
+            For(const For &other) : init(other.init ? other.init->clone() : nullptr), cond(other.cond->clone()), step(other.step ? other.step->clone() : nullptr), vectorize(other.vectorize)
+            {
+                for (auto &x : other.body)
+                    body.push_back(x->clone());
+            }
+
+            std::string value() override
+            {
+                std::string out = vectorize ? simd_pragma() : "";
+                out += std::format("for({}; {}; {}) {{\n", init ? init->value() : "", cond->value(), step ? step->value() : "");
+                for (auto &s : body)
+                    out += std::format("{};\n", s->value());
+                out += "}\n";
+                return out;
+            }
+
+            std::unique_ptr<Expr> clone() const override
+            {
+                return std::make_unique<For>(*this);
+            }
+        };
+
         struct Subscript : Expr
         {
             std::unique_ptr<Expr> target;
@@ -406,6 +513,10 @@ namespace der
             {
                 return std::format("{} {}[{}] = {}", ty, name, size, _value->value());
             }
+            std::string declaration() const
+            {
+                return std::format("extern {} {}[{}];\n", ty, name, size);
+            }
 
             std::unique_ptr<Expr> clone() const override
             {
@@ -452,6 +563,14 @@ namespace der
                 _value += "}\n";
                 return _value;
             }
+            // the prototype, for calling it from another file
+            std::string declaration() const
+            {
+                std::string _args{};
+                for (auto &arg : args)
+                    _args += std::format("{}{} {}", _args.empty() ? "" : ", ", arg.ty, arg.name);
+                return std::format("{} {}({});\n", ret_ty, name, _args.empty() ? "void" : _args);
+            }
             std::unique_ptr<Expr> clone() const override
             {
                 return std::make_unique<Function>(*this);
@@ -538,7 +657,7 @@ namespace der
             {
                 std::string out = std::format("enum {} {{\n", name);
                 for (auto &x : members)
-                    out += std::format("{}_{};\n", name, x);
+                    out += std::format("{}_{},\n", name, x);
                 out += "};\n";
                 return out;
             }
@@ -604,6 +723,117 @@ namespace der
                 return std::make_unique<Return>(*this);
             }
         };
+
+        struct Label : Expr
+        {
+            std::string name;
+            Label(const std::string &name) : name(name) {}
+            Label(const Label &other) : name(other.name) {}
+
+            std::string value() override
+            {
+                return std::format("{}:", name);
+            }
+
+            std::unique_ptr<Expr> clone() const override
+            {
+                return std::make_unique<Label>(*this);
+            }
+        };
+
+        struct Goto : Expr
+        {
+            std::string label;
+            Goto(const std::string &label) : label(label) {}
+            Goto(const Goto &other) : label(other.label) {}
+
+            std::string value() override
+            {
+                return std::format("goto {}", label);
+            }
+
+            std::unique_ptr<Expr> clone() const override
+            {
+                return std::make_unique<Goto>(*this);
+            }
+        };
+
+        struct SwitchCase
+        {
+            std::unique_ptr<Expr> label;
+            std::vector<std::unique_ptr<Expr>> body;
+            SwitchCase(std::unique_ptr<Expr> label, std::vector<std::unique_ptr<Expr>> &&body) : label(std::move(label)), body(std::move(body)) {}
+            SwitchCase(const SwitchCase &other) : label(other.label->clone())
+            {
+                for (auto &a : other.body)
+                    body.push_back(a->clone());
+            }
+        };
+
+        struct Switch : Expr
+        {
+            std::unique_ptr<Expr> scrutinee;
+            std::vector<SwitchCase> cases;
+            std::vector<std::unique_ptr<Expr>> default_block;
+            Switch(std::unique_ptr<Expr> scrutinee, std::vector<SwitchCase> &&cases, std::vector<std::unique_ptr<Expr>> &&default_block) : scrutinee(std::move(scrutinee)), cases(std::move(cases)), default_block(std::move(default_block)) {}
+            Switch(const Switch &other) : scrutinee(other.scrutinee->clone()), cases(other.cases)
+            {
+                for (auto &a : other.default_block)
+                    default_block.push_back(a->clone());
+            }
+
+            std::string value() override
+            {
+                std::string out = std::format("switch({}) {{\n", scrutinee->value());
+                for (auto &c : cases)
+                {
+                    out += std::format("case {}: {{\n", c.label->value());
+                    for (auto &e : c.body)
+                        out += std::format("\t{};\n", e->value());
+                    out += "} break;\n";
+                }
+                if (default_block.size() > 0)
+                {
+                    out += "default: {\n";
+                    for (auto &e : default_block)
+                        out += std::format("\t{};\n", e->value());
+                    out += "} break;\n";
+                }
+                out += "}";
+                return out;
+            }
+
+            std::unique_ptr<Expr> clone() const override
+            {
+                return std::make_unique<Switch>(*this);
+            }
+        };
+
+        // a braced list of statements, mostly produced by the optimizer passes
+        struct Block : Expr
+        {
+            std::vector<std::unique_ptr<Expr>> body;
+            Block(std::vector<std::unique_ptr<Expr>> &&body) : body(std::move(body)) {}
+            Block(const Block &other)
+            {
+                for (auto &a : other.body)
+                    body.push_back(a->clone());
+            }
+
+            std::string value() override
+            {
+                std::string out = "{\n";
+                for (auto &e : body)
+                    out += std::format("\t{};\n", e->value());
+                out += "}";
+                return out;
+            }
+
+            std::unique_ptr<Expr> clone() const override
+            {
+                return std::make_unique<Block>(*this);
+            }
+        };
     }
 }
 #endif
\ No newline at end of file
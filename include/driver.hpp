@@ -0,0 +1,259 @@
+#ifndef DER_DRIVER_HPP
+#define DER_DRIVER_HPP
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+#include <format>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+extern char **environ;
+
+// `derijac build`: the C the compiler writes is piped straight into the system C compiler (`-x c -`), so there's no
+// temporary file and the result is an executable. the files are compiled on a pool of threads, each one (front end
+// and C compiler) as soon as the modules it imports are done.
+namespace der
+{
+    namespace driver
+    {
+        // the flags passed to the C compiler, picked with --profile
+        struct Profile
+        {
+            std::string name;
+            std::vector<std::string> flags{};
+        };
+
+        inline const std::vector<Profile> &profiles()
+        {
+            static const std::vector<Profile> out{
+                {"debug", {"-O0", "-g"}},
+                {"release", {"-O2"}},
+                {"native", {"-O2", "-march=native"}},
+                {"lto", {"-O2", "-march=native", "-flto"}},
+            };
+            return out;
+        }
+
+        inline std::optional<Profile> find_profile(const std::string &name)
+        {
+            for (auto &p : profiles())
+                if (p.name == name)
+                    return p;
+            return std::nullopt;
+        }
+
+        // writes all of data to fd. SIGPIPE is held back while doing it so a compiler that gives up early (and
+        // closes its end) shows up as a failed write instead of killing us, and the pending signal is dropped after
+        inline bool write_all(int fd, const std::string &data)
+        {
+            sigset_t pipe_only, old;
+            sigemptyset(&pipe_only);
+            sigaddset(&pipe_only, SIGPIPE);
+            pthread_sigmask(SIG_BLOCK, &pipe_only, &old);
+            bool ok = true;
+            for (size_t done = 0; done < data.size();)
+            {
+                ssize_t n = write(fd, data.data() + done, data.size() - done);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n <= 0)
+                {
+                    ok = false;
+                    break;
+                }
+                done += size_t(n);
+            }
+            if (!ok && errno == EPIPE)
+            {
+                timespec zero{};
+                sigtimedwait(&pipe_only, nullptr, &zero);
+            }
+            pthread_sigmask(SIG_SETMASK, &old, nullptr);
+            return ok;
+        }
+
+        // runs a program found in PATH and waits for it, returns its exit status (-1 if it couldn't be started).
+        // with input, that's what the program reads on stdin
+        inline int spawn(const std::vector<std::string> &args, const std::string *input = nullptr)
+        {
+            std::vector<char *> argv{};
+            for (auto &a : args)
+                argv.push_back(const_cast<char *>(a.c_str()));
+            argv.push_back(nullptr);
+            // close on exec, other threads may be spawning compilers at the same time and they mustn't inherit
+            // the write end, the reader would never see the end of its input
+            int fds[2] = {-1, -1};
+            if (input && pipe2(fds, O_CLOEXEC) != 0)
+                return -1;
+            posix_spawn_file_actions_t actions;
+            posix_spawn_file_actions_init(&actions);
+            if (input)
+                posix_spawn_file_actions_adddup2(&actions, fds[0], STDIN_FILENO);
+            pid_t pid;
+            int started = posix_spawnp(&pid, argv.at(0), &actions, nullptr, argv.data(), environ);
+            posix_spawn_file_actions_destroy(&actions);
+            if (input)
+            {
+                close(fds[0]);
+                if (started == 0)
+                    write_all(fds[1], *input);
+                close(fds[1]);
+            }
+            if (started != 0)
+                return -1;
+            int status = 0;
+            while (waitpid(pid, &status, 0) < 0)
+                if (errno != EINTR)
+                    return -1;
+            if (!WIFEXITED(status))
+                return -1;
+            return WEXITSTATUS(status);
+        }
+
+        // one program to hand to the C compiler
+        struct Job
+        {
+            std::string c;
+            std::string output;
+            // it uses lkola mota7arik
+            bool pthread = false;
+            // stop at an object file, modules are linked together once they're all compiled
+            bool object = false;
+        };
+
+        inline std::vector<std::string> cc_command(const std::string &cc, const Profile &profile, const Job &job)
+        {
+            std::vector<std::string> args{cc};
+            args.insert(args.end(), profile.flags.begin(), profile.flags.end());
+            if (job.pthread)
+                args.push_back("-pthread");
+            if (job.object)
+                args.push_back("-c");
+            args.insert(args.end(), {"-x", "c", "-", "-o", job.output});
+            return args;
+        }
+
+        inline std::vector<std::string> link_command(const std::string &cc, const Profile &profile, const std::vector<std::string> &objects, const std::string &output, bool pthread)
+        {
+            std::vector<std::string> args{cc};
+            args.insert(args.end(), profile.flags.begin(), profile.flags.end());
+            if (pthread)
+                args.push_back("-pthread");
+            args.insert(args.end(), objects.begin(), objects.end());
+            args.insert(args.end(), {"-o", output});
+            return args;
+        }
+
+        // a piece of work that can start once the ones in deps are done. cost is a guess of how long it takes, only the
+        // ratios matter
+        struct Task
+        {
+            std::vector<size_t> deps{};
+            double cost = 1;
+            std::function<bool()> run{};
+        };
+
+        // runs the tasks on at most `workers` threads, each once everything it depends on succeeded, the ones depending on
+        // a failed (or throwing) task are skipped. out of the tasks that are ready, the one heading the longest chain of
+        // work still to come goes first: that chain (the critical path) is what the whole thing can't be faster than, so
+        // it should never wait behind tasks nothing is waiting for. gives whether each task ran and succeeded
+        inline std::vector<bool> run_tasks(const std::vector<Task> &tasks, size_t workers)
+        {
+            size_t n = tasks.size();
+            std::vector<std::vector<size_t>> dependents(n);
+            for (size_t i = 0; i < n; ++i)
+                for (size_t d : tasks.at(i).deps)
+                    dependents.at(d).push_back(i);
+            // a task's cost plus the most expensive chain of tasks depending on it
+            std::vector<double> rank(n, -1);
+            std::function<double(size_t)> rank_of = [&](size_t i)
+            {
+                if (rank.at(i) < 0)
+                {
+                    double longest = 0;
+                    for (size_t d : dependents.at(i))
+                        longest = std::max(longest, rank_of(d));
+                    rank.at(i) = tasks.at(i).cost + longest;
+                }
+                return rank.at(i);
+            };
+            for (size_t i = 0; i < n; ++i)
+                rank_of(i);
+
+            std::vector<bool> ok(n, false), doomed(n, false);
+            std::vector<size_t> waiting(n);
+            auto later = [&](size_t a, size_t b)
+            {
+                return rank.at(a) < rank.at(b) || (rank.at(a) == rank.at(b) && a > b);
+            };
+            std::priority_queue<size_t, std::vector<size_t>, decltype(later)> ready(later);
+            for (size_t i = 0; i < n; ++i)
+                if ((waiting.at(i) = tasks.at(i).deps.size()) == 0)
+                    ready.push(i);
+            size_t remaining = n;
+            std::mutex mutex{};
+            std::condition_variable changed{};
+            // with the lock held
+            std::function<void(size_t, bool)> finish = [&](size_t i, bool success)
+            {
+                ok.at(i) = success;
+                remaining -= 1;
+                for (size_t d : dependents.at(i))
+                {
+                    doomed.at(d) = doomed.at(d) || !success;
+                    if (--waiting.at(d) > 0)
+                        continue;
+                    if (doomed.at(d))
+                        finish(d, false);
+                    else
+                        ready.push(d);
+                }
+            };
+            auto work = [&]
+            {
+                std::unique_lock lock{mutex};
+                while (true)
+                {
+                    changed.wait(lock, [&]
+                                 { return !ready.empty() || remaining == 0; });
+                    if (ready.empty())
+                        return;
+                    size_t i = ready.top();
+                    ready.pop();
+                    lock.unlock();
+                    bool success = false;
+                    try
+                    {
+                        success = tasks.at(i).run();
+                    }
+                    catch (...)
+                    {
+                    }
+                    lock.lock();
+                    finish(i, success);
+                    changed.notify_all();
+                }
+            };
+            workers = std::max<size_t>(1, std::min(workers, n));
+            std::vector<std::thread> threads{};
+            for (size_t w = 1; w < workers; ++w)
+                threads.emplace_back(work);
+            work();
+            for (auto &t : threads)
+                t.join();
+            return ok;
+        }
+    }
+}
+#endif
@@ -0,0 +1,143 @@
+#ifndef DER_EMIT_HPP
+#define DER_EMIT_HPP
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <format>
+#include "der_ir.hpp"
+#include "typechecker.hpp"
+#include "optimizer.hpp"
+#include "driver.hpp"
+#include "runtime.hpp"
+
+// --split N: instead of one big C file, a header declaring everything (structs, enums, globals, prototypes, and the
+// helpers, which are static inline) and N files with the functions spread over them by size, so N C compilers can work on
+// the program at the same time. the files are written on several threads but always come out the same.
+namespace der
+{
+    namespace emit
+    {
+        // a function along with what only it uses: the lkola mota7arik bodies outlined out of it and their context
+        // structs. the optimizer puts those right before the function and they're static, so they go in the same file
+        struct Group
+        {
+            std::vector<ir::Expr *> items{};
+            size_t size = 0;
+        };
+
+        inline size_t ir_size(ir::Expr *e)
+        {
+            size_t n = 1;
+            for (auto c : optimizer::children(e))
+                n += ir_size(c->get());
+            return n;
+        }
+
+        inline bool outlined(ir::Expr *e)
+        {
+            if (auto st = dynamic_cast<ir::Struct *>(e))
+                return st->name.starts_with("__der_par_ctx");
+            if (auto fn = dynamic_cast<ir::Function *>(e))
+                return fn->name.starts_with("__der_par_body");
+            return false;
+        }
+
+        // the biggest first, each into the file with the least in it so far (LPT). ties go to the lower index, so
+        // it only depends on the sizes
+        inline std::vector<size_t> partition(const std::vector<size_t> &sizes, size_t n)
+        {
+            std::vector<size_t> order(sizes.size());
+            for (size_t i = 0; i < order.size(); ++i)
+                order.at(i) = i;
+            std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b)
+                             { return sizes.at(a) > sizes.at(b); });
+            std::vector<size_t> load(n, 0), out(sizes.size(), 0);
+            for (size_t i : order)
+            {
+                size_t least = size_t(std::min_element(load.begin(), load.end()) - load.begin());
+                out.at(i) = least;
+                load.at(least) += sizes.at(i);
+            }
+            return out;
+        }
+
+        struct Split
+        {
+            std::string header;
+            // what goes after the header in each file, whether it's #included or pasted in
+            std::vector<std::string> units{};
+        };
+
+        // the module held by the type checker as a header and n files, the functions are written out on `workers` threads
+        inline Split split(typechecker::TypeChecker &ijk, size_t n, size_t workers)
+        {
+            n = std::max<size_t>(n, 1);
+            Split out{"#ifndef __DER_SPLIT_H\n#define __DER_SPLIT_H\n", std::vector<std::string>(n)};
+            for (auto &h : ijk.c_includes)
+                out.header += std::format("#include <{}>\n", h);
+            // the parallel runtime has a thread pool behind it, there must be only one of those so it's all in the
+            // first file and the header only says how to call it
+            for (auto &[name, helper] : ijk.c_helpers)
+                if (name == "__der_parallel_for")
+                {
+                    out.header += runtime::parallel_for_api;
+                    out.units.front() += runtime::parallel_for(true);
+                }
+                else
+                    out.header += helper;
+            out.header += ijk.c_imported;
+
+            // globals are defined in the first file, everyone else sees them through the header
+            std::string decls{}, protos{};
+            std::vector<Group> groups{};
+            Group pending{};
+            for (auto &e : ijk.m_output)
+            {
+                if (outlined(e.get()))
+                    pending.items.push_back(e.get());
+                else if (auto fn = dynamic_cast<ir::Function *>(e.get()))
+                {
+                    protos += fn->declaration();
+                    pending.items.push_back(fn);
+                    for (auto item : pending.items)
+                        pending.size += ir_size(item);
+                    groups.push_back(std::move(pending));
+                    pending = {};
+                }
+                else if (auto var = dynamic_cast<ir::Variable *>(e.get()))
+                {
+                    decls += var->declaration();
+                    out.units.front() += std::format("{};\n", var->value());
+                }
+                else if (auto arr = dynamic_cast<ir::ArrayVariable *>(e.get()))
+                {
+                    decls += arr->declaration();
+                    out.units.front() += std::format("{};\n", arr->value());
+                }
+                else
+                    out.header += std::format("{};\n", e->value());
+            }
+            out.header += decls + protos + "#endif\n";
+
+            std::vector<std::string> text(groups.size());
+            std::vector<driver::Task> tasks{};
+            for (size_t g = 0; g < groups.size(); ++g)
+                tasks.push_back({{}, double(groups.at(g).size), [&, g]
+                                 {
+                                     for (auto item : groups.at(g).items)
+                                         text.at(g) += std::format("{};\n", item->value());
+                                     return true;
+                                 }});
+            driver::run_tasks(tasks, workers);
+            std::vector<size_t> sizes{};
+            for (auto &g : groups)
+                sizes.push_back(g.size);
+            auto where = partition(sizes, n);
+            // in the order they were in the source, whichever thread got to them first
+            for (size_t g = 0; g < groups.size(); ++g)
+                out.units.at(where.at(g)) += text.at(g);
+            return out;
+        }
+    }
+}
+#endif
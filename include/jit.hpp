@@ -0,0 +1,995 @@
+#ifndef DER_JIT_HPP
+#define DER_JIT_HPP
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <initializer_list>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <format>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "typechecker.hpp"
+#include "optimizer.hpp"
+#include "codegen.hpp"
+
+// `der::jit`: the same machine instructions and register allocation `derijac native` prints as assembly, encoded
+// straight into x86-64 machine code in memory. no files and no other processes, a snippet goes from source to
+// something callable in a few microseconds. the code is written while its pages are only writable and they're
+// made read+execute before anything runs (W^X), globals live in their own read+write pages after them.
+// calls to kteb, dkhel and the other helpers go to the functions below in this process.
+namespace der
+{
+    namespace jit
+    {
+        using codegen::CodegenErr;
+        using codegen::MInst;
+        using codegen::MOp;
+        using codegen::NO_REG;
+        using codegen::Reg;
+        using codegen::RBP;
+        using codegen::RSP;
+        using Stmts = codegen::Stmts;
+
+        // the builtins, with the arguments the lowering passes them (see runtime::native for the assembly ones)
+        namespace natives
+        {
+            inline void kteb_int(int v) { std::printf("%d\n", v); }
+            inline void kteb_char(char v) { std::printf("%c\n", v); }
+            inline void kteb_str(const char *v) { std::printf("%s\n", v); }
+            inline int dkhel()
+            {
+                int v = 0;
+                if (std::scanf("%d", &v) != 1)
+                    v = 0;
+                return v;
+            }
+            inline int strlen(const char *s) { return int(std::strlen(s)); }
+            inline int memcmp(const char *a, const char *b, int n) { return std::memcmp(a, b, size_t(uint32_t(n))); }
+            inline int str_hash(const char *s, int n, int seed)
+            {
+                uint32_t h = 0;
+                for (int i = 0; i < n; ++i)
+                    h = h * uint32_t(seed) + uint8_t(s[i]);
+                return int(h & 0x7fffffffu);
+            }
+
+            inline const std::map<std::string, const void *> &table()
+            {
+                static const std::map<std::string, const void *> out{
+                    {"__der_kteb_int", reinterpret_cast<const void *>(&kteb_int)},
+                    {"__der_kteb_char", reinterpret_cast<const void *>(&kteb_char)},
+                    {"__der_kteb_str", reinterpret_cast<const void *>(&kteb_str)},
+                    {"dkhel", reinterpret_cast<const void *>(&dkhel)},
+                    {"strlen", reinterpret_cast<const void *>(&strlen)},
+                    {"memcmp", reinterpret_cast<const void *>(&memcmp)},
+                    {"__der_str_hash", reinterpret_cast<const void *>(&str_hash)},
+                };
+                return out;
+            }
+        }
+
+        // an operand: a register, base + index * scale + disp in memory, or the address of sym relative to rip
+        struct Loc
+        {
+            int reg = NO_REG;
+            int base = NO_REG;
+            int index = NO_REG;
+            int64_t scale = 1;
+            int64_t disp = 0;
+            std::string sym{};
+
+            bool is_reg() const
+            {
+                return reg != NO_REG;
+            }
+            bool operator==(const Loc &) const = default;
+        };
+
+        inline Loc R(int r)
+        {
+            return Loc{.reg = r};
+        }
+        inline Loc M(int base, int64_t disp = 0)
+        {
+            return Loc{.base = base, .disp = disp};
+        }
+
+        inline bool fits8(int64_t v)
+        {
+            return v >= INT8_MIN && v <= INT8_MAX;
+        }
+
+        // the condition codes the lowering uses, by their suffix in jcc/setcc
+        inline uint8_t condition(const std::string &cc)
+        {
+            static const std::map<std::string, uint8_t> codes{
+                {"b", 0x2}, {"ae", 0x3}, {"e", 0x4}, {"ne", 0x5}, {"be", 0x6}, {"a", 0x7}, {"l", 0xc}, {"ge", 0xd}, {"le", 0xe}, {"g", 0xf}};
+            auto it = codes.find(cc);
+            if (it == codes.end())
+                throw CodegenErr(std::format("unknown condition '{}'.", cc));
+            return it->second;
+        }
+
+        // the instruction encoder, only the forms the emitter needs. operand sizes are 1, 4 or 8 bytes.
+        // rip relative operands are only allowed where nothing follows the displacement (lea), the fixup assumes
+        // the instruction ends right after it
+        struct Assembler
+        {
+            enum Alu
+            {
+                ADD = 0,
+                OR = 1,
+                AND = 4,
+                SUB = 5,
+                XOR = 6,
+                CMP = 7,
+            };
+
+            std::vector<uint8_t> m_bytes{};
+            // rel32 fields to patch: jumps to labels of the current function, and rip relative uses of symbols
+            std::vector<std::pair<size_t, int>> m_label_fixups{};
+            std::map<int, size_t> m_labels{};
+            std::vector<std::pair<size_t, std::string>> m_sym_fixups{};
+
+            // the number the hardware knows a register by, Reg isn't in that order
+            static int hw(int r)
+            {
+                using namespace codegen;
+                // rax, rcx, rdx, rbx, rsi, rdi, r8 ... r15, rsp, rbp
+                static constexpr int numbers[] = {0, 1, 2, 3, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 4, 5};
+                return r == NO_REG ? int(NO_REG) : numbers[r];
+            }
+
+            size_t here() const
+            {
+                return m_bytes.size();
+            }
+            void byte(uint8_t b)
+            {
+                m_bytes.push_back(b);
+            }
+            void imm32(int64_t v)
+            {
+                if (!codegen::fits32(v))
+                    throw CodegenErr(std::format("{} doesn't fit in an immediate.", v));
+                for (int k = 0; k < 4; ++k)
+                    byte(uint8_t(uint64_t(v) >> (8 * k)));
+            }
+            void imm64(int64_t v)
+            {
+                for (int k = 0; k < 8; ++k)
+                    byte(uint8_t(uint64_t(v) >> (8 * k)));
+            }
+            void patch32(size_t at, int64_t v)
+            {
+                for (int k = 0; k < 4; ++k)
+                    m_bytes.at(at + size_t(k)) = uint8_t(uint64_t(v) >> (8 * k));
+            }
+
+            void modrm(int reg, const Loc &rm)
+            {
+                int r = (reg & 7) << 3;
+                if (rm.is_reg())
+                {
+                    byte(uint8_t(0xc0 | r | (rm.reg & 7)));
+                    return;
+                }
+                if (!rm.sym.empty())
+                {
+                    byte(uint8_t(0x05 | r));
+                    m_sym_fixups.push_back({here(), rm.sym});
+                    imm32(0);
+                    return;
+                }
+                int base = rm.base & 7;
+                // rbp and r13 can't go without a displacement, rsp and r12 need a SIB byte
+                int mod = rm.disp == 0 && base != 5 ? 0 : fits8(rm.disp) ? 1 : 2;
+                bool sib = rm.index != NO_REG || base == 4;
+                byte(uint8_t(mod << 6 | r | (sib ? 4 : base)));
+                if (sib)
+                {
+                    int scale = rm.scale == 8 ? 3 : rm.scale == 4 ? 2 : rm.scale == 2 ? 1 : 0;
+                    byte(uint8_t(scale << 6 | ((rm.index == NO_REG ? 4 : rm.index) & 7) << 3 | base));
+                }
+                if (mod == 1)
+                    byte(uint8_t(rm.disp));
+                else if (mod == 2)
+                    imm32(rm.disp);
+            }
+            // REX + opcode + ModRM. reg is the hardware number of a register or the opcode extension, bytes says
+            // the byte registers are meant, sil and dil only exist with a REX prefix
+            void inst(std::initializer_list<uint8_t> opcode, int64_t size, int reg, Loc rm, bool bytes = false)
+            {
+                rm.reg = hw(rm.reg);
+                rm.base = hw(rm.base);
+                rm.index = hw(rm.index);
+                uint8_t rex = 0;
+                if (size == 8)
+                    rex |= 0x48;
+                if (reg >= 8)
+                    rex |= 0x44;
+                if (rm.index >= 8)
+                    rex |= 0x42;
+                if ((rm.is_reg() ? rm.reg : rm.base) >= 8)
+                    rex |= 0x41;
+                if (bytes && ((reg >= 4 && reg < 8) || (rm.reg >= 4 && rm.reg < 8)))
+                    rex |= 0x40;
+                if (rex)
+                    byte(rex);
+                for (uint8_t o : opcode)
+                    byte(o);
+                modrm(reg, rm);
+            }
+
+            void mov(int64_t size, const Loc &dst, const Loc &src)
+            {
+                if (dst == src)
+                    return;
+                if (src.is_reg())
+                    inst({uint8_t(size == 1 ? 0x88 : 0x89)}, size, hw(src.reg), dst, size == 1);
+                else
+                    inst({uint8_t(size == 1 ? 0x8a : 0x8b)}, size, hw(dst.reg), src, size == 1);
+            }
+            void mov(int64_t size, const Loc &dst, int64_t imm)
+            {
+                if (dst.is_reg() && size == 8 && !codegen::fits32(imm))
+                {
+                    byte(uint8_t(0x48 | (hw(dst.reg) >= 8 ? 1 : 0)));
+                    byte(uint8_t(0xb8 + (hw(dst.reg) & 7)));
+                    imm64(imm);
+                }
+                else if (size == 1)
+                {
+                    inst({0xc6}, size, 0, dst, true);
+                    byte(uint8_t(imm));
+                }
+                else
+                {
+                    inst({0xc7}, size, 0, dst);
+                    imm32(imm);
+                }
+            }
+            void alu(Alu op, int64_t size, const Loc &dst, const Loc &src)
+            {
+                if (src.is_reg())
+                    inst({uint8_t(op * 8 + 1)}, size, hw(src.reg), dst);
+                else
+                    inst({uint8_t(op * 8 + 3)}, size, hw(dst.reg), src);
+            }
+            void alu(Alu op, int64_t size, const Loc &dst, int64_t imm)
+            {
+                inst({uint8_t(fits8(imm) ? 0x83 : 0x81)}, size, op, dst);
+                if (fits8(imm))
+                    byte(uint8_t(imm));
+                else
+                    imm32(imm);
+            }
+            void imul(int64_t size, int dst, const Loc &src)
+            {
+                inst({0x0f, 0xaf}, size, hw(dst), src);
+            }
+            void imul(int64_t size, int dst, const Loc &src, int64_t imm)
+            {
+                inst({uint8_t(fits8(imm) ? 0x6b : 0x69)}, size, hw(dst), src);
+                if (fits8(imm))
+                    byte(uint8_t(imm));
+                else
+                    imm32(imm);
+            }
+            void lea(int64_t size, int dst, const Loc &mem)
+            {
+                inst({0x8d}, size, hw(dst), mem);
+            }
+            // movslq, movsbl and movzbl
+            void movsxd(int dst, const Loc &src)
+            {
+                inst({0x63}, 8, hw(dst), src);
+            }
+            void movsx8(int dst, const Loc &src)
+            {
+                inst({0x0f, 0xbe}, 4, hw(dst), src, true);
+            }
+            void movzx8(int dst, const Loc &src)
+            {
+                inst({0x0f, 0xb6}, 4, hw(dst), src, true);
+            }
+            // ext is 4 for sal, 5 for shr and 7 for sar, by cl or by imm
+            void shift(int ext, int64_t size, const Loc &dst)
+            {
+                inst({0xd3}, size, ext, dst);
+            }
+            void shift(int ext, int64_t size, const Loc &dst, int64_t imm)
+            {
+                inst({0xc1}, size, ext, dst);
+                byte(uint8_t(imm));
+            }
+            void neg(int64_t size, const Loc &dst)
+            {
+                inst({0xf7}, size, 3, dst);
+            }
+            void idiv(int64_t size, const Loc &src)
+            {
+                inst({0xf7}, size, 7, src);
+            }
+            void dec(int64_t size, const Loc &dst)
+            {
+                inst({0xff}, size, 1, dst);
+            }
+            void cltd()
+            {
+                byte(0x99);
+            }
+            void setcc(const std::string &cc, int dst)
+            {
+                inst({0x0f, uint8_t(0x90 | condition(cc))}, 4, 0, R(dst), true);
+            }
+            void push(const Loc &src)
+            {
+                if (!src.is_reg())
+                    return inst({0xff}, 4, 6, src);
+                if (hw(src.reg) >= 8)
+                    byte(0x41);
+                byte(uint8_t(0x50 + (hw(src.reg) & 7)));
+            }
+            void pop(const Loc &dst)
+            {
+                if (!dst.is_reg())
+                    return inst({0x8f}, 4, 0, dst);
+                if (hw(dst.reg) >= 8)
+                    byte(0x41);
+                byte(uint8_t(0x58 + (hw(dst.reg) & 7)));
+            }
+            void ret()
+            {
+                byte(0xc3);
+            }
+
+            void bind(int label)
+            {
+                m_labels[label] = here();
+            }
+            void jcc(const std::string &cc, int label)
+            {
+                byte(0x0f);
+                byte(uint8_t(0x80 | condition(cc)));
+                m_label_fixups.push_back({here(), label});
+                imm32(0);
+            }
+            // a jump back to an offset that's already known
+            void jcc_back(const std::string &cc, size_t target)
+            {
+                byte(0x0f);
+                byte(uint8_t(0x80 | condition(cc)));
+                imm32(int64_t(target) - int64_t(here() + 4));
+            }
+            void jmp(int label)
+            {
+                byte(0xe9);
+                m_label_fixups.push_back({here(), label});
+                imm32(0);
+            }
+            void jmp(const Loc &target)
+            {
+                inst({0xff}, 4, 4, target);
+            }
+            void call(const std::string &sym)
+            {
+                byte(0xe8);
+                m_sym_fixups.push_back({here(), sym});
+                imm32(0);
+            }
+            void call(const Loc &target)
+            {
+                inst({0xff}, 4, 2, target);
+            }
+
+            // the labels of a function are resolved once it's done, they're numbered per function
+            void end_function()
+            {
+                for (auto [at, label] : m_label_fixups)
+                    patch32(at, int64_t(m_labels.at(label)) - int64_t(at + 4));
+                m_label_fixups.clear();
+                m_labels.clear();
+            }
+        };
+
+        // walks the machine instructions like codegen::AsmPrinter does, encoding what it would print
+        struct Emitter
+        {
+            Assembler m_asm{};
+            const codegen::MFunction *m_fn = nullptr;
+            codegen::Allocation m_alloc{};
+            codegen::Frame m_frame{};
+            size_t m_index = 0;
+            std::set<std::string> m_functions{};
+            // jump tables as offsets into the code, laid out after it
+            std::map<std::string, std::vector<size_t>> m_tables{};
+
+            bool wide(int v) const
+            {
+                return m_fn->wide.at(size_t(v));
+            }
+            int reg(int v) const
+            {
+                return m_alloc.reg.at(size_t(v));
+            }
+            Loc loc(int v) const
+            {
+                if (reg(v) != NO_REG)
+                    return R(reg(v));
+                return M(codegen::RBP, -m_frame.offsets.at(size_t(m_alloc.slot.at(size_t(v)))));
+            }
+            int64_t size(int v) const
+            {
+                return wide(v) ? 8 : 4;
+            }
+            Loc in_reg(int v, Reg scratch, int64_t size)
+            {
+                if (reg(v) != NO_REG)
+                    return R(reg(v));
+                m_asm.mov(size, R(scratch), loc(v));
+                return R(scratch);
+            }
+            void result(int dst, Reg scratch)
+            {
+                m_asm.mov(size(dst), loc(dst), R(scratch));
+            }
+            int ret_label() const
+            {
+                return m_fn->labels;
+            }
+
+            void binary(const MInst &in, int into)
+            {
+                if (in.sym == "imul")
+                {
+                    if (in.b >= 0)
+                        m_asm.imul(4, into, loc(in.b));
+                    else
+                        m_asm.imul(4, into, R(into), in.imm);
+                    return;
+                }
+                static const std::map<std::string, Assembler::Alu> ops{
+                    {"add", Assembler::ADD}, {"sub", Assembler::SUB}, {"and", Assembler::AND}, {"or", Assembler::OR}, {"xor", Assembler::XOR}};
+                auto op = ops.at(in.sym);
+                if (in.b >= 0)
+                    m_asm.alu(op, 4, R(into), loc(in.b));
+                else
+                    m_asm.alu(op, 4, R(into), in.imm);
+            }
+
+            // same as AsmPrinter::parallel_move
+            void parallel_move(const std::vector<Loc> &from, const std::vector<Loc> &to)
+            {
+                bool clash = false;
+                for (size_t i = 0; i < to.size(); ++i)
+                    for (size_t k = i + 1; k < from.size(); ++k)
+                        clash = clash || (to.at(i) == from.at(k) && from.at(i) != to.at(i));
+                if (!clash)
+                {
+                    for (size_t i = 0; i < to.size(); ++i)
+                    {
+                        if (from.at(i).is_reg() || to.at(i).is_reg())
+                            m_asm.mov(8, to.at(i), from.at(i));
+                        else
+                        {
+                            m_asm.mov(8, R(codegen::RAX), from.at(i));
+                            m_asm.mov(8, to.at(i), R(codegen::RAX));
+                        }
+                    }
+                    return;
+                }
+                for (auto &f : from)
+                    m_asm.push(f);
+                for (size_t i = to.size(); i-- > 0;)
+                    m_asm.pop(to.at(i));
+            }
+
+            void emit(const MInst &in, const MInst *next)
+            {
+                using namespace codegen;
+                auto &a = m_asm;
+                switch (in.op)
+                {
+                case MOp::MOVI:
+                    if (fits32(in.imm))
+                        a.mov(size(in.dst), loc(in.dst), in.imm);
+                    else
+                    {
+                        a.mov(8, R(RAX), in.imm);
+                        result(in.dst, RAX);
+                    }
+                    break;
+                case MOp::MOV:
+                    if (wide(in.dst) && !wide(in.a))
+                    {
+                        a.movsxd(RAX, loc(in.a));
+                        result(in.dst, RAX);
+                    }
+                    else if (reg(in.dst) == NO_REG && reg(in.a) == NO_REG)
+                    {
+                        a.mov(size(in.dst), R(RAX), loc(in.a));
+                        result(in.dst, RAX);
+                    }
+                    else
+                        a.mov(size(in.dst), loc(in.dst), loc(in.a));
+                    break;
+                case MOp::SYM:
+                case MOp::FRAME:
+                {
+                    Loc src = in.op == MOp::SYM ? Loc{.sym = in.sym} : M(RBP, -m_frame.offsets.at(size_t(in.imm)));
+                    if (reg(in.dst) != NO_REG)
+                        a.lea(8, reg(in.dst), src);
+                    else
+                    {
+                        a.lea(8, RAX, src);
+                        result(in.dst, RAX);
+                    }
+                    break;
+                }
+                case MOp::BIN:
+                    if (reg(in.dst) != NO_REG && (in.b < 0 || reg(in.b) != reg(in.dst)))
+                    {
+                        a.mov(4, loc(in.dst), loc(in.a));
+                        binary(in, reg(in.dst));
+                    }
+                    else
+                    {
+                        a.mov(4, R(RAX), loc(in.a));
+                        binary(in, RAX);
+                        result(in.dst, RAX);
+                    }
+                    break;
+                case MOp::DIV:
+                    a.mov(4, R(RAX), loc(in.a));
+                    a.cltd();
+                    a.idiv(4, loc(in.b));
+                    result(in.dst, in.imm == 1 ? RDX : RAX);
+                    break;
+                case MOp::SHIFT:
+                {
+                    int ext = in.sym == "sal" ? 4 : in.sym == "shr" ? 5 : 7;
+                    if (in.b >= 0)
+                        a.mov(4, R(RCX), loc(in.b));
+                    a.mov(4, R(RAX), loc(in.a));
+                    if (in.b >= 0)
+                        a.shift(ext, 4, R(RAX));
+                    else
+                        a.shift(ext, 4, R(RAX), in.imm);
+                    result(in.dst, RAX);
+                    break;
+                }
+                case MOp::ADDI:
+                {
+                    int64_t s = size(in.dst);
+                    if (reg(in.dst) != NO_REG && reg(in.a) != NO_REG)
+                    {
+                        if (reg(in.dst) == reg(in.a))
+                            a.alu(Assembler::ADD, s, loc(in.dst), in.imm);
+                        else
+                            a.lea(s, reg(in.dst), M(reg(in.a), in.imm));
+                    }
+                    else if (in.dst == in.a)
+                        a.alu(Assembler::ADD, s, loc(in.dst), in.imm);
+                    else
+                    {
+                        a.mov(s, R(RAX), loc(in.a));
+                        a.alu(Assembler::ADD, s, R(RAX), in.imm);
+                        result(in.dst, RAX);
+                    }
+                    break;
+                }
+                case MOp::NEG:
+                    a.mov(4, R(RAX), loc(in.a));
+                    a.neg(4, R(RAX));
+                    result(in.dst, RAX);
+                    break;
+                case MOp::NOT:
+                    a.alu(Assembler::CMP, size(in.a), loc(in.a), 0);
+                    a.setcc("e", RAX);
+                    a.movzx8(RAX, R(RAX));
+                    result(in.dst, RAX);
+                    break;
+                case MOp::SEXT8:
+                case MOp::ZEXT8:
+                    a.mov(4, R(RAX), loc(in.a));
+                    if (in.op == MOp::SEXT8)
+                        a.movsx8(RAX, R(RAX));
+                    else
+                        a.movzx8(RAX, R(RAX));
+                    result(in.dst, RAX);
+                    break;
+                case MOp::SET:
+                case MOp::JCC:
+                {
+                    int64_t s = in.wide ? 8 : 4;
+                    if (in.b < 0)
+                        a.alu(Assembler::CMP, s, loc(in.a), in.imm);
+                    else
+                    {
+                        Loc lhs = in_reg(in.a, RAX, s);
+                        a.alu(Assembler::CMP, s, lhs, loc(in.b));
+                    }
+                    if (in.op == MOp::JCC)
+                    {
+                        a.jcc(in.sym, in.label);
+                        break;
+                    }
+                    a.setcc(in.sym, RAX);
+                    a.movzx8(RAX, R(RAX));
+                    result(in.dst, RAX);
+                    break;
+                }
+                case MOp::LABEL:
+                    a.bind(in.label);
+                    break;
+                case MOp::JMP:
+                    if (!next || next->op != MOp::LABEL || next->label != in.label)
+                        a.jmp(in.label);
+                    break;
+                case MOp::JZ:
+                case MOp::JNZ:
+                    a.alu(Assembler::CMP, in.wide ? 8 : 4, loc(in.a), 0);
+                    a.jcc(in.op == MOp::JZ ? "e" : "ne", in.label);
+                    break;
+                case MOp::TABLE:
+                {
+                    auto &table = m_fn->tables.at(size_t(in.imm));
+                    a.mov(4, R(RAX), loc(in.a));
+                    if (table.low != 0)
+                        a.alu(Assembler::SUB, 4, R(RAX), table.low);
+                    a.alu(Assembler::CMP, 4, R(RAX), int64_t(table.targets.size()));
+                    a.jcc("ae", table.fallback);
+                    a.lea(8, R11, Loc{.sym = std::format(".LT{}_{}", m_index, in.imm)});
+                    a.jmp(Loc{.base = R11, .index = RAX, .scale = 8});
+                    break;
+                }
+                case MOp::LOAD:
+                case MOp::LOADX:
+                {
+                    Loc base = in_reg(in.a, R10, 8);
+                    Loc at = M(base.reg, in.imm);
+                    if (in.op == MOp::LOADX)
+                    {
+                        a.movsxd(R11, loc(in.b));
+                        at = Loc{.base = base.reg, .index = R11, .scale = in.size};
+                    }
+                    Reg into = reg(in.dst) != NO_REG ? Reg(reg(in.dst)) : RAX;
+                    if (in.size == 1)
+                        a.movsx8(into, at);
+                    else
+                        a.mov(in.size == 8 ? 8 : 4, R(into), at);
+                    if (into == RAX)
+                        result(in.dst, RAX);
+                    break;
+                }
+                case MOp::STORE:
+                case MOp::STOREX:
+                {
+                    Loc base = in_reg(in.a, R10, 8);
+                    Loc at = M(base.reg, in.imm);
+                    int val = in.b;
+                    if (in.op == MOp::STOREX)
+                    {
+                        a.movsxd(R11, loc(in.b));
+                        at = Loc{.base = base.reg, .index = R11, .scale = in.size};
+                        val = in.c;
+                    }
+                    int64_t s = in.size == 1 ? 1 : in.size == 8 ? 8 : 4;
+                    if (in.size != s)
+                    {
+                        a.mov(8, R(RAX), loc(val));
+                        for (int64_t k = 0; k < in.size; ++k)
+                        {
+                            a.mov(1, M(base.reg, in.imm + k), R(RAX));
+                            a.shift(5, 8, R(RAX), 8);
+                        }
+                        break;
+                    }
+                    a.mov(s, at, in_reg(val, RAX, s));
+                    break;
+                }
+                case MOp::ELEM:
+                    a.movsxd(RAX, loc(in.b));
+                    if (in.imm != 1)
+                        a.imul(8, RAX, R(RAX), in.imm);
+                    a.alu(Assembler::ADD, 8, R(RAX), loc(in.a));
+                    result(in.dst, RAX);
+                    break;
+                case MOp::COPY:
+                {
+                    a.mov(8, R(R10), loc(in.a));
+                    a.mov(8, R(R11), loc(in.b));
+                    int64_t k = 0, n = in.size;
+                    if (n > 64)
+                    {
+                        a.mov(8, R(RCX), n / 8);
+                        size_t top = a.here();
+                        a.mov(8, R(RAX), M(R11));
+                        a.mov(8, M(R10), R(RAX));
+                        a.alu(Assembler::ADD, 8, R(R11), 8);
+                        a.alu(Assembler::ADD, 8, R(R10), 8);
+                        a.dec(8, R(RCX));
+                        a.jcc_back("ne", top);
+                        n %= 8;
+                    }
+                    for (; k + 8 <= n; k += 8)
+                    {
+                        a.mov(8, R(RAX), M(R11, k));
+                        a.mov(8, M(R10, k), R(RAX));
+                    }
+                    for (; k + 4 <= n; k += 4)
+                    {
+                        a.mov(4, R(RAX), M(R11, k));
+                        a.mov(4, M(R10, k), R(RAX));
+                    }
+                    for (; k < n; ++k)
+                    {
+                        a.mov(1, R(RAX), M(R11, k));
+                        a.mov(1, M(R10, k), R(RAX));
+                    }
+                    break;
+                }
+                case MOp::ZERO:
+                {
+                    a.mov(8, R(R10), loc(in.a));
+                    a.alu(Assembler::XOR, 4, R(RAX), R(RAX));
+                    int64_t k = in.imm, end = in.imm + in.size;
+                    if (in.size > 64)
+                    {
+                        a.lea(8, R11, M(R10, in.imm));
+                        a.mov(8, R(RCX), in.size / 8);
+                        size_t top = a.here();
+                        a.mov(8, M(R11), R(RAX));
+                        a.alu(Assembler::ADD, 8, R(R11), 8);
+                        a.dec(8, R(RCX));
+                        a.jcc_back("ne", top);
+                        k += in.size / 8 * 8;
+                    }
+                    for (; k + 8 <= end; k += 8)
+                        a.mov(8, M(R10, k), R(RAX));
+                    for (; k + 4 <= end; k += 4)
+                        a.mov(4, M(R10, k), R(RAX));
+                    for (; k < end; ++k)
+                        a.mov(1, M(R10, k), R(RAX));
+                    break;
+                }
+                case MOp::PARAMS:
+                {
+                    std::vector<Loc> from{}, to{};
+                    for (size_t i = 0; i < in.args.size(); ++i)
+                    {
+                        from.push_back(R(AsmPrinter::arg_regs[i]));
+                        to.push_back(loc(in.args.at(i)));
+                    }
+                    parallel_move(from, to);
+                    break;
+                }
+                case MOp::ARG:
+                    if (reg(in.dst) != NO_REG)
+                        a.mov(8, loc(in.dst), M(RBP, 16 + 8 * in.imm));
+                    else
+                    {
+                        a.mov(8, R(RAX), M(RBP, 16 + 8 * in.imm));
+                        result(in.dst, RAX);
+                    }
+                    break;
+                case MOp::CALL:
+                {
+                    bool pad = in.stack.size() % 2 == 1;
+                    if (pad)
+                        a.alu(Assembler::SUB, 8, R(RSP), 8);
+                    for (size_t i = in.stack.size(); i-- > 0;)
+                        a.push(loc(in.stack.at(i)));
+                    std::vector<Loc> from{}, to{};
+                    for (size_t i = 0; i < in.args.size(); ++i)
+                    {
+                        from.push_back(loc(in.args.at(i)));
+                        to.push_back(R(AsmPrinter::arg_regs[i]));
+                    }
+                    parallel_move(from, to);
+                    if (m_functions.contains(in.sym))
+                        a.call(in.sym);
+                    else
+                    {
+                        // a builtin of this process, rax is free here and can be anywhere in the address space
+                        auto &builtins = natives::table();
+                        auto it = builtins.find(in.sym);
+                        if (it == builtins.end())
+                            throw CodegenErr(std::format("'{}' isn't defined anywhere.", in.sym));
+                        a.mov(8, R(RAX), int64_t(reinterpret_cast<uintptr_t>(it->second)));
+                        a.call(R(RAX));
+                    }
+                    if (size_t popped = in.stack.size() * 8 + (pad ? 8 : 0))
+                        a.alu(Assembler::ADD, 8, R(RSP), int64_t(popped));
+                    if (in.dst >= 0)
+                        result(in.dst, RAX);
+                    if (in.b >= 0)
+                        result(in.b, RDX);
+                    break;
+                }
+                case MOp::RET:
+                    if (in.a >= 0)
+                        a.mov(size(in.a), R(RAX), loc(in.a));
+                    if (in.b >= 0)
+                        a.mov(8, R(RDX), loc(in.b));
+                    if (next)
+                        a.jmp(ret_label());
+                    break;
+                }
+            }
+
+            // returns where the function starts
+            size_t function(const codegen::MFunction &fn, const codegen::Allocation &alloc)
+            {
+                using namespace codegen;
+                m_fn = &fn;
+                m_alloc = alloc;
+                m_frame = frame_layout(fn, alloc);
+                auto &a = m_asm;
+                size_t start = a.here();
+                a.push(R(RBP));
+                a.mov(8, R(RBP), R(RSP));
+                for (int r : alloc.saved)
+                    a.push(R(r));
+                if (m_frame.size > 0)
+                    a.alu(Assembler::SUB, 8, R(RSP), m_frame.size);
+                for (size_t pc = 0; pc < fn.code.size(); ++pc)
+                    emit(fn.code.at(pc), pc + 1 < fn.code.size() ? &fn.code.at(pc + 1) : nullptr);
+                a.bind(ret_label());
+                if (m_frame.saved > 0)
+                    a.lea(8, RSP, M(RBP, -m_frame.saved));
+                else if (m_frame.size > 0)
+                    a.mov(8, R(RSP), R(RBP));
+                for (size_t i = alloc.saved.size(); i-- > 0;)
+                    a.pop(R(alloc.saved.at(i)));
+                a.pop(R(RBP));
+                a.ret();
+                for (size_t t = 0; t < fn.tables.size(); ++t)
+                {
+                    auto &entries = m_tables[std::format(".LT{}_{}", m_index, t)];
+                    for (int target : fn.tables.at(t).targets)
+                        entries.push_back(a.m_labels.at(target));
+                }
+                a.end_function();
+                m_index += 1;
+                return start;
+            }
+        };
+
+        // a compiled module mapped into memory, it's unmapped when this goes away. the globals keep their values
+        // between calls, they're initialized once when the module is loaded
+        struct Code
+        {
+            using Entry = int (*)();
+
+            uint8_t *m_base = nullptr;
+            size_t m_size = 0;
+            std::map<std::string, void *> m_symbols{};
+            // the program's main
+            Entry entry = nullptr;
+
+            Code() = default;
+            Code(const Code &) = delete;
+            Code &operator=(const Code &) = delete;
+            Code(Code &&other) noexcept
+            {
+                *this = std::move(other);
+            }
+            Code &operator=(Code &&other) noexcept
+            {
+                std::swap(m_base, other.m_base);
+                std::swap(m_size, other.m_size);
+                std::swap(m_symbols, other.m_symbols);
+                std::swap(entry, other.entry);
+                return *this;
+            }
+            ~Code()
+            {
+                if (m_base)
+                    munmap(m_base, m_size);
+            }
+
+            // a function or global by its der name, nullptr if there's none
+            template <typename T>
+            T get(const std::string &name) const
+            {
+                auto it = m_symbols.find(name);
+                return it == m_symbols.end() ? nullptr : reinterpret_cast<T>(it->second);
+            }
+        };
+
+        // encodes an already type checked and optimized module (c_backend off) and loads it
+        inline Code load(const Stmts &module)
+        {
+            codegen::MModule mod = codegen::Lowering{}.lower(module);
+            Emitter emitter{};
+            for (auto &fn : mod.functions)
+                emitter.m_functions.insert(fn.name);
+            // image offsets of everything, code first, then the read only data, then the globals on their own pages
+            std::map<std::string, size_t> symbols{};
+            for (auto &fn : mod.functions)
+                symbols[fn.name] = emitter.function(fn, codegen::RegAlloc::allocate(fn));
+            auto &bytes = emitter.m_asm.m_bytes;
+            std::vector<std::pair<size_t, size_t>> absolute{};
+            bytes.resize((bytes.size() + 7) / 8 * 8, 0xcc);
+            for (auto &[name, entries] : emitter.m_tables)
+            {
+                symbols[name] = bytes.size();
+                for (size_t target : entries)
+                {
+                    absolute.push_back({bytes.size(), target});
+                    bytes.resize(bytes.size() + 8, 0);
+                }
+            }
+            for (size_t i = 0; i < mod.strings.size(); ++i)
+            {
+                symbols[std::format(".Lstr{}", i)] = bytes.size();
+                std::string s = lexer::unescape(mod.strings.at(i));
+                bytes.insert(bytes.end(), s.begin(), s.end());
+                bytes.push_back(0);
+            }
+            size_t page = size_t(sysconf(_SC_PAGESIZE));
+            size_t text = (bytes.size() + page - 1) / page * page;
+            size_t data = 0;
+            for (auto &g : mod.globals)
+            {
+                data = (data + size_t(g.align) - 1) / size_t(g.align) * size_t(g.align);
+                symbols[g.name] = text + data;
+                data += size_t(std::max<int64_t>(g.size, 1));
+            }
+            for (auto &[at, sym] : emitter.m_asm.m_sym_fixups)
+            {
+                auto it = symbols.find(sym);
+                if (it == symbols.end())
+                    throw CodegenErr(std::format("'{}' isn't defined anywhere.", sym));
+                emitter.m_asm.patch32(at, int64_t(it->second) - int64_t(at + 4));
+            }
+
+            Code out{};
+            out.m_size = text + (data + page - 1) / page * page;
+            void *base = mmap(nullptr, out.m_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (base == MAP_FAILED)
+                throw CodegenErr(std::format("couldn't map {} bytes for the code.", out.m_size));
+            out.m_base = static_cast<uint8_t *>(base);
+            std::memcpy(out.m_base, bytes.data(), bytes.size());
+            for (auto [at, target] : absolute)
+            {
+                uint64_t addr = reinterpret_cast<uintptr_t>(out.m_base + target);
+                std::memcpy(out.m_base + at, &addr, 8);
+            }
+            if (mprotect(out.m_base, text, PROT_READ | PROT_EXEC) != 0)
+                throw CodegenErr("couldn't make the code executable.");
+            for (auto &[name, at] : symbols)
+                if (!name.starts_with(".L"))
+                    out.m_symbols[name] = out.m_base + at;
+            out.entry = out.get<Code::Entry>("main");
+            out.get<void (*)()>("__der_init")();
+            return out;
+        }
+
+        // source to callable code, the errors are the same the rest of the compiler throws
+        // (parser::SyntaxErr, types::CompilationErr, CodegenErr)
+        inline Code compile(const std::string &source)
+        {
+            auto lex = lexer::Lexer(source);
+            lex.lex();
+            auto parse = parser::Parser(lex.get_output());
+            parse.parse();
+            auto check = typechecker::TypeChecker(parse.get_output());
+            check.do_the_thing();
+            optimizer::Options options{};
+            options.c_backend = false;
+            optimizer::Optimizer(check.m_output, check.c_includes, options).run();
+            return load(check.m_output);
+        }
+    }
+}
+#endif
@@ -1,15 +1,99 @@
 #ifndef DER_LEXER_HPP
 #define DER_LEXER_HPP
 #include <cctype>
+#include <optional>
 #include <string>
 #include <vector>
 #include <map>
+#include <format>
 #include "source_loc.hpp"
 
 namespace der
 {
     namespace lexer
     {
+        // a mistake in the source, from the lexer or the parser (which knows it as parser::SyntaxErr)
+        struct SyntaxErr
+        {
+            std::string msg = {};
+            SourceLoc loc = {};
+            SyntaxErr(const std::string &m, const SourceLoc &loc) : msg(m), loc(loc) {}
+        };
+
+        // the escape in s starting at s[i], right after its backslash, read the way a C compiler reads it: octal (up to
+        // 3 digits), \x and as many hex digits as follow, or one of n t r a b f v \\ ' \" ?. i is left on its last
+        // character. nullopt for one C doesn't have
+        inline std::optional<char> read_escape(const std::string &s, size_t &i)
+        {
+            if (i >= s.size())
+                return std::nullopt;
+            char c = s[i];
+            if (c >= '0' && c <= '7')
+            {
+                int v = 0;
+                for (int k = 0; k < 3 && i < s.size() && s[i] >= '0' && s[i] <= '7'; ++k, ++i)
+                    v = v * 8 + (s[i] - '0');
+                --i;
+                return char(v);
+            }
+            if (c == 'x')
+            {
+                if (i + 1 >= s.size() || !std::isxdigit(static_cast<unsigned char>(s[i + 1])))
+                    return std::nullopt;
+                int v = 0;
+                while (i + 1 < s.size() && std::isxdigit(static_cast<unsigned char>(s[i + 1])))
+                {
+                    char h = char(std::tolower(static_cast<unsigned char>(s[++i])));
+                    v = (v * 16 + (h <= '9' ? h - '0' : h - 'a' + 10)) & 0xff;
+                }
+                return char(v);
+            }
+            switch (c)
+            {
+            case 'n':
+                return '\n';
+            case 't':
+                return '\t';
+            case 'r':
+                return '\r';
+            case 'a':
+                return '\a';
+            case 'b':
+                return '\b';
+            case 'f':
+                return '\f';
+            case 'v':
+                return '\v';
+            case '\\':
+            case '\'':
+            case '"':
+            case '?':
+                return c;
+            }
+            return std::nullopt;
+        }
+
+        // the actual bytes behind a string literal, the lexer keeps escapes as they were written. one C doesn't know
+        // stands for the character after the backslash, like a C compiler (with a warning) would have it
+        inline std::string unescape(const std::string &raw)
+        {
+            std::string out{};
+            for (size_t i = 0; i < raw.size(); ++i)
+            {
+                if (raw[i] != '\\' || i + 1 >= raw.size())
+                {
+                    out.push_back(raw[i]);
+                    continue;
+                }
+                size_t at = ++i;
+                if (auto c = read_escape(raw, i))
+                    out.push_back(*c);
+                else
+                    out.push_back(raw[at]);
+            }
+            return out;
+        }
+
         enum class TOKENS
         {
             KEYWORD_ILA,
@@ -64,10 +148,13 @@ namespace der
             TOKEN_FOR,
             KEYWORD_JADID,
             KEYWORD_KA,
-            TOKEN_DOUBLE_QST
+            TOKEN_DOUBLE_QST,
+            TOKEN_FAT_ARROW,
+            TOKEN_MODULO
         };
 
-        std::map<TOKENS, std::string> tokens_to_str{
+        // read by every file being compiled at the same time, so it's const and only ever looked up with at/find
+        inline const std::map<TOKENS, std::string> tokens_to_str{
             {TOKENS::TOKEN_PLUS, "+"},
             {TOKENS::TOKEN_MULTIPLY, "*"},
             {TOKENS::TOKEN_AND, "&&"},
@@ -76,8 +163,16 @@ namespace der
             {TOKENS::TOKEN_MINUS, "-"},
             {TOKENS::TOKEN_LESS_THAN, "<"},
             {TOKENS::TOKEN_GREATER_THAN, ">"},
+            {TOKENS::TOKEN_LESS_THAN_OR_EQUAL, "<="},
+            {TOKENS::TOKEN_GREATER_THAN_OR_EQUAL, ">="},
+            {TOKENS::TOKEN_NOT_EQUAL, "!="},
+            {TOKENS::TOKEN_OR, "||"},
+            {TOKENS::TOKEN_BIT_AND, "&"},
+            {TOKENS::TOKEN_BIT_OR, "|"},
             {TOKENS::TOKEN_EQUALITY, "=="},
             {TOKENS::TOKEN_DOUBLE_QST, "??"},
+            {TOKENS::TOKEN_FAT_ARROW, "=>"},
+            {TOKENS::TOKEN_MODULO, "%"},
             {TOKENS::TOKEN_RANGE, "..."},
             {TOKENS::TOKEN_DOT, "."}};
         struct TokenHandle
@@ -152,7 +247,7 @@ namespace der
                         local_loc.column += temp.size();
                         m_output.push_back(TokenHandle{.token = TOKENS::TOKEN_INTEGER, .raw_value = temp, .source_loc = local_loc});
                     }
-                    else if (std::isalpha(current))
+                    else if (std::isalpha(current) || current == '_')
                     {
                         std::string temp{current};
                         char b = m_consume();
@@ -212,6 +307,12 @@ namespace der
                             local_loc.column += 2;
                             m_output.push_back(TokenHandle{.token = TOKENS::TOKEN_EQUALITY, .raw_value = "==", .source_loc = local_loc});
                         }
+                        else if (m_input.at(m_index) == '>')
+                        {
+                            m_advance();
+                            local_loc.column += 2;
+                            m_output.push_back(TokenHandle{.token = TOKENS::TOKEN_FAT_ARROW, .raw_value = "=>", .source_loc = local_loc});
+                        }
                         else
                         {
                             local_loc.column += 1;
@@ -234,6 +335,10 @@ namespace der
                         local_loc.column += 1;
                         m_output.push_back(TokenHandle{.token = TOKENS::TOKEN_DIVIDE, .raw_value = "+", .source_loc = local_loc});
                         break;
+                    case '%':
+                        local_loc.column += 1;
+                        m_output.push_back(TokenHandle{.token = TOKENS::TOKEN_MODULO, .raw_value = "%", .source_loc = local_loc});
+                        break;
                     case '(':
                         local_loc.column += 1;
                         m_output.push_back(TokenHandle{.token = TOKENS::TOKEN_OPEN_PAREN, .raw_value = "(", .source_loc = local_loc});
@@ -275,10 +380,18 @@ namespace der
 
                         local_loc.column += 1;
                         char a = m_consume();
-                        std::cout << a << ' ' << m_current() << '\n';
+                        if (a == '\\')
+                        {
+                            size_t end = m_index;
+                            auto e = read_escape(m_input, end);
+                            if (!e)
+                                throw SyntaxErr(std::format("unknown escape '\\{}' in character", m_current()), local_loc);
+                            a = *e;
+                            m_index = end + 1;
+                        }
                         if (m_current() != '\'')
                         {
-                            throw "expected \"'\" quote after character";
+                            throw SyntaxErr("expected \"'\" quote after character", local_loc);
                         }
                         m_index += 1;
                         m_output.push_back(TokenHandle{.token = TOKENS::TOKEN_CHAR, .raw_value = std::format("{}", a), .source_loc = local_loc});
@@ -289,7 +402,6 @@ namespace der
                         {
                             if (m_input.at(m_index) == '.' && m_input.at(m_index + 1) == '.')
                             {
-                                std::cout << "so true and real\n";
                                 local_loc.column += 3;
                                 m_index += 2;
                                 m_output.push_back(TokenHandle{.token = TOKENS::TOKEN_RANGE, .raw_value = "...", .source_loc = local_loc});
@@ -322,7 +434,7 @@ namespace der
                         break;
                     }
                     case '<':
-                        if (m_input[m_index + 1] == '=')
+                        if (m_input[m_index] == '=')
                         {
                             m_advance();
                             local_loc.column += 2;
@@ -368,7 +480,7 @@ namespace der
                         {
                             m_advance();
                             local_loc.column += 2;
-                            m_output.push_back(TokenHandle{.token = TOKENS::TOKEN_AND, .raw_value = "||", .source_loc = local_loc});
+                            m_output.push_back(TokenHandle{.token = TOKENS::TOKEN_OR, .raw_value = "||", .source_loc = local_loc});
                         }
                         else if (m_input[m_index] == '>')
                         {
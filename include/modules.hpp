@@ -0,0 +1,791 @@
+#ifndef DER_MODULES_HPP
+#define DER_MODULES_HPP
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <set>
+#include <string>
+#include <tuple>
+#include <vector>
+#include <format>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "types.hpp"
+#include "der_ir.hpp"
+#include "typechecker.hpp"
+#include "optimizer.hpp"
+#include "cache.hpp"
+#include "driver.hpp"
+
+// jbed: every file is a module, compiled on its own into an object (file.der.o) and a binary interface (file.deri)
+// holding what importers need to know about it: the types it uses (interned, each one stored once), the structs and
+// enums with their members, the function signatures and the globals, plus the C declarations to paste into the
+// importer, with the small functions (a single rje3 without calls) as static inline definitions so they still get
+// inlined. importers map the interface and load it straight into the type checker, the module is never parsed again.
+// a module is only recompiled when its source, or the interface of something it imports, changed: the interface has a
+// hash of its contents, so changing the body of a function that isn't inlined leaves everything importing it alone.
+// there's one namespace for the whole program, what a module defines is visible as is to whoever imports it.
+namespace der
+{
+    namespace modules
+    {
+        struct ModuleErr
+        {
+            std::string msg;
+            ModuleErr(const std::string &m) : msg(m) {}
+        };
+
+        struct Symbol
+        {
+            enum class Kind : uint32_t
+            {
+                STRUCT,
+                ENUM,
+                FUNCTION,
+                GLOBAL
+            };
+            Kind kind;
+            std::string name;
+            // the struct or enum itself, the function without a body, or the global's type
+            std::shared_ptr<types::TypeHandle> ty;
+        };
+
+        struct Interface
+        {
+            std::vector<Symbol> symbols{};
+            // headers and declarations the importer's C needs, see exported
+            std::vector<std::string> includes{};
+            std::string c_decls{};
+            // the modules this one was compiled against, with the hash their interface had back then
+            std::vector<std::pair<std::string, std::string>> imports{};
+            // everything that went into compiling the module, it's up to date as long as this is the same
+            std::string key{};
+            // of all of the above but the key, importers are only recompiled when it changes
+            std::string hash{};
+        };
+
+        // the .deri layout: a header, then arrays of fixed size records that refer to each other and to the strings by
+        // index, and the strings last. everything is a uint32_t so the records can be read right where they're mapped
+        namespace format
+        {
+            inline constexpr char magic[4] = {'D', 'E', 'R', 'I'};
+            inline constexpr uint32_t version = 1;
+            inline constexpr uint32_t none = 0xffffffff;
+
+            enum class Ty : uint32_t
+            {
+                INTEGER,
+                STRING,
+                BOOL,
+                CHAR,
+                VOID,
+                POINTER, // a: the type pointed to
+                ARRAY,   // a: the element type, b: the size
+                NAMED    // a: the name of a struct or enum
+            };
+
+            struct Header
+            {
+                char magic[4];
+                uint32_t version;
+                char key[64];
+                char hash[64];
+                uint32_t strings, string_bytes, types, symbols, fields, imports, includes;
+                uint32_t c_decls;
+            };
+            // followed by uint32_t string_offsets[strings + 1], then these, then uint32_t includes[] and the strings
+            struct TypeRec
+            {
+                uint32_t kind, a, b;
+            };
+            // a struct's members, an enum's members (without a type) or a function's arguments are the fields
+            // [first, first + count)
+            struct SymbolRec
+            {
+                uint32_t kind, name, type, first, count;
+            };
+            struct FieldRec
+            {
+                uint32_t name, type;
+            };
+            struct ImportRec
+            {
+                uint32_t path, hash;
+            };
+        }
+
+        // the name of a struct or enum type, however the type checker happens to hold it
+        inline std::optional<std::string> type_name(const types::TypeHandle *ty)
+        {
+            if (auto id = dynamic_cast<const types::Identifier *>(ty))
+                return id->ident;
+            if (auto st = dynamic_cast<const types::Struct *>(ty))
+                return st->name;
+            if (auto en = dynamic_cast<const types::Enum *>(ty))
+                return en->name;
+            if (auto en = dynamic_cast<const types::EnumInstance *>(ty))
+                return en->en.name;
+            if (auto st = dynamic_cast<const types::StructInstance *>(ty))
+                return st->name;
+            return std::nullopt;
+        }
+
+        inline std::optional<format::Ty> primitive(const types::TypeHandle *ty)
+        {
+            switch (ty->get_ty())
+            {
+            case types::TYPES::INTEGER:
+                return format::Ty::INTEGER;
+            case types::TYPES::STRING:
+                return format::Ty::STRING;
+            case types::TYPES::BOOL:
+                return format::Ty::BOOL;
+            case types::TYPES::CHAR:
+                return format::Ty::CHAR;
+            case types::TYPES::VOID:
+                return format::Ty::VOID;
+            default:
+                return std::nullopt;
+            }
+        }
+
+        // generics and the like can't be written down in an interface
+        inline bool exportable(const types::TypeHandle *ty)
+        {
+            if (auto p = dynamic_cast<const types::Pointer *>(ty))
+                return exportable(p->victim.get());
+            if (auto a = dynamic_cast<const types::Array *>(ty))
+                return exportable(a->ty.get());
+            return primitive(ty) || type_name(ty);
+        }
+
+        struct Writer
+        {
+            std::vector<uint32_t> m_offsets{0};
+            std::string m_strings{};
+            std::map<std::string, uint32_t> m_string_ids{};
+            std::vector<format::TypeRec> m_types{};
+            std::map<std::tuple<uint32_t, uint32_t, uint32_t>, uint32_t> m_type_ids{};
+            std::vector<format::SymbolRec> m_symbols{};
+            std::vector<format::FieldRec> m_fields{};
+            std::vector<format::ImportRec> m_imports{};
+            std::vector<uint32_t> m_includes{};
+
+            uint32_t string(const std::string &s)
+            {
+                auto [it, added] = m_string_ids.try_emplace(s, uint32_t(m_offsets.size() - 1));
+                if (added)
+                {
+                    m_strings += s;
+                    m_offsets.push_back(uint32_t(m_strings.size()));
+                }
+                return it->second;
+            }
+
+            // the inner types are written first, so a record only ever points back
+            uint32_t type(const types::TypeHandle *ty)
+            {
+                format::TypeRec rec{};
+                if (auto p = dynamic_cast<const types::Pointer *>(ty))
+                    rec = {uint32_t(format::Ty::POINTER), type(p->victim.get()), 0};
+                else if (auto a = dynamic_cast<const types::Array *>(ty))
+                    rec = {uint32_t(format::Ty::ARRAY), type(a->ty.get()), uint32_t(a->size)};
+                else if (auto name = type_name(ty))
+                    rec = {uint32_t(format::Ty::NAMED), string(*name), 0};
+                else
+                    rec = {uint32_t(*primitive(ty)), 0, 0};
+                auto [it, added] = m_type_ids.try_emplace({rec.kind, rec.a, rec.b}, uint32_t(m_types.size()));
+                if (added)
+                    m_types.push_back(rec);
+                return it->second;
+            }
+
+            void symbol(const Symbol &sym)
+            {
+                format::SymbolRec rec{uint32_t(sym.kind), string(sym.name), format::none, uint32_t(m_fields.size()), 0};
+                if (auto st = dynamic_cast<types::Struct *>(sym.ty.get()); st && sym.kind == Symbol::Kind::STRUCT)
+                    for (auto &m : st->members)
+                        m_fields.push_back({string(m.name), type(m.type.get())});
+                else if (auto en = dynamic_cast<types::Enum *>(sym.ty.get()); en && sym.kind == Symbol::Kind::ENUM)
+                    for (auto &m : en->members)
+                        m_fields.push_back({string(m), format::none});
+                else if (auto fn = dynamic_cast<types::Function *>(sym.ty.get()); fn && sym.kind == Symbol::Kind::FUNCTION)
+                {
+                    for (auto &a : fn->args)
+                        m_fields.push_back({string(a.ident), type(a.ty.get())});
+                    rec.type = type(fn->ret_ty.get());
+                }
+                else
+                    rec.type = type(sym.ty.get());
+                rec.count = uint32_t(m_fields.size()) - rec.first;
+                m_symbols.push_back(rec);
+            }
+        };
+
+        template <typename T>
+        void append(std::string &out, const std::vector<T> &v)
+        {
+            out.append(reinterpret_cast<const char *>(v.data()), v.size() * sizeof(T));
+        }
+
+        // the bytes of a .deri, and sets the interface's hash
+        inline std::string encode(Interface &iface)
+        {
+            Writer w{};
+            for (auto &s : iface.symbols)
+                w.symbol(s);
+            for (auto &[path, hash] : iface.imports)
+                w.m_imports.push_back({w.string(path), w.string(hash)});
+            for (auto &inc : iface.includes)
+                w.m_includes.push_back(w.string(inc));
+            format::Header h{};
+            std::memcpy(h.magic, format::magic, sizeof(h.magic));
+            h.version = format::version;
+            h.c_decls = w.string(iface.c_decls);
+            h.strings = uint32_t(w.m_offsets.size() - 1);
+            h.string_bytes = uint32_t(w.m_strings.size());
+            h.types = uint32_t(w.m_types.size());
+            h.symbols = uint32_t(w.m_symbols.size());
+            h.fields = uint32_t(w.m_fields.size());
+            h.imports = uint32_t(w.m_imports.size());
+            h.includes = uint32_t(w.m_includes.size());
+            std::string out(sizeof(h), '\0');
+            std::memcpy(out.data(), &h, sizeof(h));
+            append(out, w.m_offsets);
+            append(out, w.m_types);
+            append(out, w.m_symbols);
+            append(out, w.m_fields);
+            append(out, w.m_imports);
+            append(out, w.m_includes);
+            out += w.m_strings;
+            // hashed while the key and the hash are still zeroes
+            iface.hash = cache::Sha256{}.update(out).hex();
+            iface.key.copy(h.key, sizeof(h.key));
+            iface.hash.copy(h.hash, sizeof(h.hash));
+            std::memcpy(out.data(), &h, sizeof(h));
+            return out;
+        }
+
+        // nullopt when it isn't an interface this compiler wrote, everything is bounds checked before it's looked at
+        inline std::optional<Interface> decode(const char *data, size_t size)
+        {
+            if (size < sizeof(format::Header))
+                return std::nullopt;
+            const auto *h = reinterpret_cast<const format::Header *>(data);
+            if (std::memcmp(h->magic, format::magic, sizeof(h->magic)) != 0 || h->version != format::version)
+                return std::nullopt;
+            size_t at = sizeof(format::Header);
+            bool fits = true;
+            auto section = [&]<typename T>(size_t count) -> const T *
+            {
+                if (count > (size - at) / sizeof(T))
+                {
+                    fits = false;
+                    return nullptr;
+                }
+                const T *out = reinterpret_cast<const T *>(data + at);
+                at += count * sizeof(T);
+                return out;
+            };
+            const uint32_t *offsets = section.operator()<uint32_t>(size_t(h->strings) + 1);
+            const format::TypeRec *type_recs = section.operator()<format::TypeRec>(h->types);
+            const format::SymbolRec *symbol_recs = section.operator()<format::SymbolRec>(h->symbols);
+            const format::FieldRec *field_recs = section.operator()<format::FieldRec>(h->fields);
+            const format::ImportRec *import_recs = section.operator()<format::ImportRec>(h->imports);
+            const uint32_t *include_recs = section.operator()<uint32_t>(h->includes);
+            const char *strings = section.operator()<char>(h->string_bytes);
+            if (!fits || offsets[0] != 0 || offsets[h->strings] != h->string_bytes)
+                return std::nullopt;
+            for (uint32_t i = 0; i < h->strings; ++i)
+                if (offsets[i] > offsets[i + 1])
+                    return std::nullopt;
+            auto string = [&](uint32_t i) -> std::optional<std::string>
+            {
+                if (i >= h->strings)
+                    return std::nullopt;
+                return std::string(strings + offsets[i], offsets[i + 1] - offsets[i]);
+            };
+
+            std::vector<std::shared_ptr<types::TypeHandle>> tys{};
+            for (uint32_t i = 0; i < h->types; ++i)
+            {
+                const auto &rec = type_recs[i];
+                std::shared_ptr<types::TypeHandle> ty{};
+                switch (format::Ty(rec.kind))
+                {
+                case format::Ty::INTEGER:
+                    ty = std::make_shared<types::Integer>();
+                    break;
+                case format::Ty::STRING:
+                    ty = std::make_shared<types::String>();
+                    break;
+                case format::Ty::BOOL:
+                    ty = std::make_shared<types::Bool>();
+                    break;
+                case format::Ty::CHAR:
+                    ty = std::make_shared<types::Character>();
+                    break;
+                case format::Ty::VOID:
+                    ty = std::make_shared<types::Void>();
+                    break;
+                case format::Ty::POINTER:
+                    if (rec.a < i)
+                        ty = std::make_shared<types::Pointer>(tys.at(rec.a)->clone());
+                    break;
+                case format::Ty::ARRAY:
+                    if (rec.a < i)
+                        ty = std::make_shared<types::Array>(tys.at(rec.a)->clone(), rec.b);
+                    break;
+                case format::Ty::NAMED:
+                    if (auto name = string(rec.a))
+                        ty = std::make_shared<types::Identifier>(*name);
+                    break;
+                }
+                if (!ty)
+                    return std::nullopt;
+                tys.push_back(ty);
+            }
+
+            Interface out{};
+            for (uint32_t i = 0; i < h->symbols; ++i)
+            {
+                const auto &rec = symbol_recs[i];
+                auto name = string(rec.name);
+                if (!name || uint64_t(rec.first) + rec.count > h->fields || (rec.type != format::none && rec.type >= h->types))
+                    return std::nullopt;
+                std::vector<std::pair<std::string, std::shared_ptr<types::TypeHandle>>> fields{};
+                for (uint32_t f = rec.first; f < rec.first + rec.count; ++f)
+                {
+                    auto field = string(field_recs[f].name);
+                    if (!field || (field_recs[f].type != format::none && field_recs[f].type >= h->types))
+                        return std::nullopt;
+                    fields.push_back({*field, field_recs[f].type == format::none ? nullptr : tys.at(field_recs[f].type)});
+                }
+                // everything but enum members has a type
+                bool typed = std::all_of(fields.begin(), fields.end(), [](auto &f)
+                                         { return f.second != nullptr; });
+                auto kind = Symbol::Kind(rec.kind);
+                std::shared_ptr<types::TypeHandle> ty{};
+                if (kind == Symbol::Kind::STRUCT && typed)
+                {
+                    std::vector<types::StructMember> members{};
+                    for (auto &[n, t] : fields)
+                        members.emplace_back(n, t->clone());
+                    ty = std::make_shared<types::Struct>(*name, members);
+                }
+                else if (kind == Symbol::Kind::ENUM)
+                {
+                    std::vector<std::string> members{};
+                    for (auto &[n, _] : fields)
+                        members.push_back(n);
+                    ty = std::make_shared<types::Enum>(*name, members);
+                }
+                else if (kind == Symbol::Kind::FUNCTION && typed && rec.type != format::none)
+                {
+                    std::vector<types::ArgType> args{};
+                    for (auto &[n, t] : fields)
+                        args.emplace_back(n, SourceLoc{}, t->clone());
+                    ty = std::make_shared<types::Function>(*name, std::vector<types::Generic>{}, std::vector<std::unique_ptr<types::TypeHandle>>{}, args, tys.at(rec.type)->clone());
+                }
+                else if (kind == Symbol::Kind::GLOBAL && rec.type != format::none)
+                    ty = tys.at(rec.type);
+                if (!ty)
+                    return std::nullopt;
+                out.symbols.push_back({kind, *name, ty});
+            }
+            for (uint32_t i = 0; i < h->imports; ++i)
+            {
+                auto path = string(import_recs[i].path), hash = string(import_recs[i].hash);
+                if (!path || !hash)
+                    return std::nullopt;
+                out.imports.push_back({*path, *hash});
+            }
+            for (uint32_t i = 0; i < h->includes; ++i)
+            {
+                auto inc = string(include_recs[i]);
+                if (!inc)
+                    return std::nullopt;
+                out.includes.push_back(*inc);
+            }
+            auto c_decls = string(h->c_decls);
+            if (!c_decls)
+                return std::nullopt;
+            out.c_decls = *c_decls;
+            out.key = std::string(h->key, strnlen(h->key, sizeof(h->key)));
+            out.hash = std::string(h->hash, strnlen(h->hash, sizeof(h->hash)));
+            return out;
+        }
+
+        // maps the file and decodes it in place, nullopt if there's none or it's no good (it gets rebuilt then)
+        inline std::optional<Interface> load(const std::string &path)
+        {
+            int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0)
+                return std::nullopt;
+            struct stat st{};
+            if (fstat(fd, &st) != 0 || st.st_size == 0)
+            {
+                close(fd);
+                return std::nullopt;
+            }
+            size_t size = size_t(st.st_size);
+            void *base = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            close(fd);
+            if (base == MAP_FAILED)
+                return std::nullopt;
+            auto out = decode(static_cast<const char *>(base), size);
+            munmap(base, size);
+            return out;
+        }
+
+        // `rje3 <expression without calls>`, cheap enough to hand to importers as a static inline definition
+        inline bool calls(ir::Expr *e)
+        {
+            if (dynamic_cast<ir::FunctionCall *>(e) || dynamic_cast<ir::Pipe *>(e))
+                return true;
+            for (auto c : optimizer::children(e))
+                if (calls(c->get()))
+                    return true;
+            return false;
+        }
+        inline bool inlinable(const ir::Function &fn)
+        {
+            auto ret = fn.body.size() == 1 ? dynamic_cast<ir::Return *>(fn.body.front().get()) : nullptr;
+            return ret && !calls(ret->ret.get());
+        }
+
+        // the interface of the module the type checker just went through, called once the optimizer is done with it
+        inline Interface exported(typechecker::TypeChecker &ijk)
+        {
+            Interface out{};
+            std::set<std::string> names{};
+            auto check = [](const types::TypeHandle *ty, const std::string &what, const SourceLoc &loc)
+            {
+                if (!exportable(ty))
+                    throw types::CompilationErr(std::format("{} can't be part of a module's interface, its type is {}.", what, ty->debug()), loc);
+            };
+            for (auto &x : ijk.m_input)
+            {
+                auto ty = x.expr->get_ty();
+                if (auto fn = dynamic_cast<types::Function *>(ty.get()))
+                {
+                    // generic functions only exist once they're called, there's nothing to export
+                    if (fn->name == "main" || !fn->generics.empty())
+                        continue;
+                    for (auto &a : fn->args)
+                        check(a.ty.get(), std::format("argument '{}' of '{}'", a.ident, fn->name), x.loc);
+                    check(fn->ret_ty.get(), std::format("the return value of '{}'", fn->name), x.loc);
+                    auto sig = std::make_shared<types::Function>(fn->name, std::vector<types::Generic>{}, std::vector<std::unique_ptr<types::TypeHandle>>{}, fn->args, fn->ret_ty->clone());
+                    out.symbols.push_back({Symbol::Kind::FUNCTION, fn->name, sig});
+                    names.insert(fn->name);
+                }
+                else if (auto st = dynamic_cast<types::Struct *>(ty.get()))
+                {
+                    for (auto &m : st->members)
+                        check(m.type.get(), std::format("member '{}' of '{}'", m.name, st->name), x.loc);
+                    out.symbols.push_back({Symbol::Kind::STRUCT, st->name, std::shared_ptr<types::TypeHandle>(st->clone())});
+                }
+                else if (auto en = dynamic_cast<types::Enum *>(ty.get()))
+                    out.symbols.push_back({Symbol::Kind::ENUM, en->name, std::shared_ptr<types::TypeHandle>(en->clone())});
+                else if (auto var = dynamic_cast<types::Variable *>(ty.get()))
+                {
+                    check(var->expected_ty.get(), std::format("global '{}'", var->name), x.loc);
+                    out.symbols.push_back({Symbol::Kind::GLOBAL, var->name, std::shared_ptr<types::TypeHandle>(var->expected_ty->clone())});
+                    names.insert(var->name);
+                }
+            }
+            for (auto &e : ijk.m_output)
+            {
+                if (auto st = dynamic_cast<ir::Struct *>(e.get()); st && !st->name.starts_with("__der"))
+                    out.c_decls += st->value();
+                else if (auto en = dynamic_cast<ir::Enum *>(e.get()))
+                    out.c_decls += en->value();
+                else if (auto fn = dynamic_cast<ir::Function *>(e.get()); fn && names.contains(fn->name))
+                    out.c_decls += inlinable(*fn) ? "static inline " + fn->value() : fn->declaration();
+                else if (auto var = dynamic_cast<ir::Variable *>(e.get()); var && names.contains(var->name))
+                    out.c_decls += var->declaration();
+                else if (auto arr = dynamic_cast<ir::ArrayVariable *>(e.get()); arr && names.contains(arr->name))
+                    out.c_decls += arr->declaration();
+            }
+            out.includes.assign(ijk.c_includes.begin(), ijk.c_includes.end());
+            return out;
+        }
+
+        // makes what an interface declares known to the type checker, before it starts on the importing module
+        inline void import_into(typechecker::TypeChecker &ijk, const Interface &iface, const SourceLoc &loc)
+        {
+            ijk.c_includes.insert(iface.includes.begin(), iface.includes.end());
+            for (auto &sym : iface.symbols)
+            {
+                if (ijk.local_scope.contains(sym.name))
+                    throw types::CompilationErr(std::format("'{}' is defined by more than one of the imported modules.", sym.name), loc);
+                // the type checker may take things out of what's in its scope, every module gets its own copy
+                std::shared_ptr<types::TypeHandle> ty = sym.ty->clone();
+                // a global of a struct or enum type is known by the type itself, like check_var does it
+                if (auto id = dynamic_cast<types::Identifier *>(ty.get()); id && sym.kind == Symbol::Kind::GLOBAL && ijk.local_scope.contains(id->ident))
+                    ty = ijk.local_scope.at(id->ident);
+                ijk.local_scope[sym.name] = ty;
+            }
+            ijk.c_imported += iface.c_decls;
+        }
+
+        // a file reachable from the ones being built
+        struct Unit
+        {
+            std::string path;
+            std::string source;
+            std::vector<parser::Import> imports{};
+            // the units it imports, they always come before it
+            std::vector<size_t> deps{};
+            // some other unit imports it
+            bool imported = false;
+        };
+
+        // `jbed a.b;` in dir/x.der is dir/a/b.der
+        inline std::string resolve(const std::string &from, const std::string &name)
+        {
+            std::string rel = name;
+            std::replace(rel.begin(), rel.end(), '.', '/');
+            return (std::filesystem::path(from).parent_path() / (rel + ".der")).lexically_normal().string();
+        }
+
+        inline std::string interface_path(const std::string &path)
+        {
+            return path + "i";
+        }
+
+        // the files being built and everything they import
+        struct Graph
+        {
+            // every unit after the ones it imports
+            std::vector<Unit> units{};
+            // the unit of each file that was asked for, in the same order
+            std::vector<size_t> roots{};
+        };
+
+        // finds the files imported by the roots, then the files those import and so on, reading (and lexing, only the
+        // jbed lines are parsed) the files of each round on `workers` threads
+        inline Graph discover(const std::vector<std::string> &roots, size_t workers = 1)
+        {
+            std::map<std::string, Unit> found{};
+            std::vector<std::string> round{};
+            for (auto &r : roots)
+                round.push_back(std::filesystem::path(r).lexically_normal().string());
+            // who asked for a file first, for the error when it doesn't exist
+            std::map<std::string, std::string> importer{};
+            while (!round.empty())
+            {
+                std::sort(round.begin(), round.end());
+                round.erase(std::unique(round.begin(), round.end()), round.end());
+                std::vector<std::optional<Unit>> read(round.size());
+                std::vector<std::string> errors(round.size());
+                std::vector<driver::Task> tasks{};
+                for (size_t i = 0; i < round.size(); ++i)
+                    tasks.push_back({{}, 1, [&, i]
+                                     {
+                                         const std::string &path = round.at(i);
+                                         auto source = cache::read_file(path);
+                                         if (!source)
+                                         {
+                                             errors.at(i) = importer.contains(path) ? std::format("'{}' imports '{}', which doesn't exist.", importer.at(path), path) : std::format("failed to open file '{}'.", path);
+                                             return false;
+                                         }
+                                         auto xyz = lexer::Lexer(*source);
+                                         auto abc = parser::Parser({});
+                                         try
+                                         {
+                                             xyz.lex();
+                                             abc = parser::Parser(xyz.get_output());
+                                             abc.parse_imports();
+                                         }
+                                         catch (const parser::SyntaxErr &exc)
+                                         {
+                                             errors.at(i) = std::format("{}: {} (line: {}, col: {})", path, exc.msg, exc.loc.line + 1, exc.loc.column + 1);
+                                             return false;
+                                         }
+                                         read.at(i) = Unit{path, *source, abc.m_imports};
+                                         return true;
+                                     }});
+                driver::run_tasks(tasks, workers);
+                std::vector<std::string> next{};
+                for (size_t i = 0; i < round.size(); ++i)
+                {
+                    if (!read.at(i))
+                        throw ModuleErr(errors.at(i));
+                    for (auto &imp : read.at(i)->imports)
+                    {
+                        std::string path = resolve(round.at(i), imp.name);
+                        if (found.contains(path) || importer.contains(path))
+                            continue;
+                        importer[path] = round.at(i);
+                        next.push_back(path);
+                    }
+                    found.emplace(round.at(i), std::move(*read.at(i)));
+                }
+                round = std::move(next);
+            }
+
+            // every unit after what it imports
+            Graph graph{};
+            std::map<std::string, size_t> done{};
+            // the chain of imports being followed, a file showing up in it twice is a cycle
+            std::vector<std::string> chain{};
+            std::function<size_t(const std::string &)> visit = [&](const std::string &path) -> size_t
+            {
+                if (auto it = done.find(path); it != done.end())
+                    return it->second;
+                if (auto it = std::find(chain.begin(), chain.end(), path); it != chain.end())
+                {
+                    std::string cycle{};
+                    for (; it != chain.end(); ++it)
+                        cycle += *it + " -> ";
+                    throw ModuleErr(std::format("modules can't import each other: {}{}", cycle, path));
+                }
+                Unit &unit = found.at(path);
+                std::vector<size_t> deps{};
+                chain.push_back(path);
+                for (auto &imp : unit.imports)
+                {
+                    size_t dep = visit(resolve(path, imp.name));
+                    graph.units.at(dep).imported = true;
+                    if (std::find(deps.begin(), deps.end(), dep) == deps.end())
+                        deps.push_back(dep);
+                }
+                chain.pop_back();
+                unit.deps = deps;
+                done[path] = graph.units.size();
+                graph.units.push_back(std::move(unit));
+                return graph.units.size() - 1;
+            };
+            for (auto &r : roots)
+                graph.roots.push_back(visit(std::filesystem::path(r).lexically_normal().string()));
+            return graph;
+        }
+
+        // what compiling a module gives
+        struct Compiled
+        {
+            std::string c;
+            Interface iface;
+        };
+
+        // compiles the units of a graph that aren't up to date and links programs out of them. different units can be
+        // compiled at the same time, as long as each one only starts once the ones it imports are done
+        struct Builder
+        {
+            const std::vector<Unit> &m_units;
+            std::string m_cc;
+            driver::Profile m_profile;
+            // what goes into every module's key besides its source: this compiler, the options, the C compiler and its flags
+            std::string m_key;
+            // type checks a unit against the interfaces of everything it imports, directly or not, in order.
+            // nullopt when the program has mistakes in it, they've been reported already
+            std::function<std::optional<Compiled>(const Unit &, const std::vector<Interface> &)> m_compile;
+            // each one is written by compile(i) and read by whoever imports i after that
+            std::vector<Interface> m_ifaces;
+
+            // in milliseconds
+            struct Timing
+            {
+                double frontend = 0;
+                double cc = 0;
+                bool compiled = false;
+            };
+            std::vector<Timing> m_timings;
+
+            Builder(const std::vector<Unit> &units, const std::string &cc, const driver::Profile &profile, const std::string &key) : m_units(units), m_cc(cc), m_profile(profile), m_key(key), m_ifaces(units.size()), m_timings(units.size()) {}
+
+            static double since(std::chrono::steady_clock::time_point start)
+            {
+                return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            }
+
+            // the path of unit d from where unit i is, it's the same however the files were named on the command line
+            std::string import_name(size_t i, size_t d) const
+            {
+                return std::filesystem::path(m_units.at(d).path).lexically_relative(std::filesystem::path(m_units.at(i).path).parent_path()).string();
+            }
+
+            // every unit reachable from i, in the order of units, without i itself
+            std::vector<size_t> closure(size_t i) const
+            {
+                std::set<size_t> seen{};
+                std::vector<size_t> todo = m_units.at(i).deps;
+                while (!todo.empty())
+                {
+                    size_t d = todo.back();
+                    todo.pop_back();
+                    if (seen.insert(d).second)
+                        todo.insert(todo.end(), m_units.at(d).deps.begin(), m_units.at(d).deps.end());
+                }
+                return {seen.begin(), seen.end()};
+            }
+
+            // brings the object and interface of unit i up to date, the units it imports must be done already
+            void compile(size_t i)
+            {
+                auto &unit = m_units.at(i);
+                std::string object = unit.path + ".o";
+                cache::Key key{};
+                key.add(m_key).add(unit.source);
+                for (size_t d : unit.deps)
+                    key.add(import_name(i, d)).add(m_ifaces.at(d).hash);
+                std::string hex = key.hex();
+                if (auto old = load(interface_path(unit.path)); old && old->key == hex && access(object.c_str(), R_OK) == 0)
+                {
+                    m_ifaces.at(i) = std::move(*old);
+                    return;
+                }
+                auto start = std::chrono::steady_clock::now();
+                std::vector<Interface> imported{};
+                for (size_t d : closure(i))
+                    imported.push_back(m_ifaces.at(d));
+                auto compiled = m_compile(unit, imported);
+                m_timings.at(i).frontend = since(start);
+                if (!compiled)
+                    throw ModuleErr(std::format("couldn't compile '{}'.", unit.path));
+                Interface &iface = compiled->iface;
+                iface.key = hex;
+                for (size_t d : unit.deps)
+                    iface.imports.push_back({import_name(i, d), m_ifaces.at(d).hash});
+                // the object first: if it fails the old interface stays, its key is stale so it's retried next time
+                start = std::chrono::steady_clock::now();
+                driver::Job job{compiled->c, object, compiled->c.find("#include <pthread.h>") != std::string::npos, true};
+                if (driver::spawn(driver::cc_command(m_cc, m_profile, job), &job.c) != 0)
+                    throw ModuleErr(std::format("{} couldn't compile the C for '{}'.", m_cc, unit.path));
+                m_timings.at(i).cc = since(start);
+                if (!cache::write_atomically(interface_path(unit.path), encode(iface)))
+                    throw ModuleErr(std::format("couldn't write '{}'.", interface_path(unit.path)));
+                m_ifaces.at(i) = std::move(iface);
+                m_timings.at(i).compiled = true;
+            }
+
+            // links the objects of root and everything it imports, they must all be compiled already
+            void link(size_t root, const std::string &output) const
+            {
+                std::vector<size_t> units = closure(root);
+                units.push_back(root);
+                std::vector<std::string> objects{};
+                bool pthread = false;
+                for (size_t u : units)
+                {
+                    objects.push_back(m_units.at(u).path + ".o");
+                    pthread = pthread || std::ranges::count(m_ifaces.at(u).includes, "pthread.h");
+                }
+                if (driver::spawn(driver::link_command(m_cc, m_profile, objects, output, pthread)) != 0)
+                    throw ModuleErr(std::format("{} couldn't link '{}'.", m_cc, output));
+            }
+        };
+    }
+}
+#endif
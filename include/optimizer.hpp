@@ -0,0 +1,2309 @@
+#ifndef DER_OPTIMIZER_HPP
+#define DER_OPTIMIZER_HPP
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <optional>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include <format>
+#include "der_ir.hpp"
+#include "debug.hpp"
+
+namespace der
+{
+    namespace optimizer
+    {
+        using Stmts = std::vector<std::unique_ptr<ir::Expr>>;
+
+        // every expression slot directly owned by an ir node, the member name on the right of a Dot is not an expression so it's left out
+        inline std::vector<std::unique_ptr<ir::Expr> *> children(ir::Expr *e)
+        {
+            std::vector<std::unique_ptr<ir::Expr> *> out{};
+            auto push_all = [&](Stmts &v)
+            {
+                for (auto &x : v)
+                    out.push_back(&x);
+            };
+            if (auto x = dynamic_cast<ir::Binary *>(e))
+                out = {&x->lfs, &x->rfs};
+            else if (auto x = dynamic_cast<ir::Logical *>(e))
+                out = {&x->lfs, &x->rfs};
+            else if (auto x = dynamic_cast<ir::Unary *>(e))
+                out = {&x->victim};
+            else if (auto x = dynamic_cast<ir::Pointer *>(e))
+                out = {&x->victim};
+            else if (auto x = dynamic_cast<ir::PointerDeref *>(e))
+                out = {&x->victim};
+            else if (auto x = dynamic_cast<ir::GetAddress *>(e))
+                out = {&x->victim};
+            else if (auto x = dynamic_cast<ir::Cast *>(e))
+                out = {&x->victim};
+            else if (auto x = dynamic_cast<ir::Group *>(e))
+                out = {&x->inner};
+            else if (auto x = dynamic_cast<ir::Pipe *>(e))
+                out = {&x->lfs, &x->rfs};
+            else if (auto x = dynamic_cast<ir::SmolIf *>(e))
+                out = {&x->lfs, &x->rfs};
+            else if (auto x = dynamic_cast<ir::Array *>(e))
+                push_all(x->values);
+            else if (auto x = dynamic_cast<ir::FunctionCall *>(e))
+            {
+                out.push_back(&x->callee);
+                push_all(x->args);
+            }
+            else if (auto x = dynamic_cast<ir::Variable *>(e); x && x->_value)
+                out = {&x->_value};
+            else if (auto x = dynamic_cast<ir::ArrayVariable *>(e))
+                out = {&x->_value};
+            else if (auto x = dynamic_cast<ir::SetOp *>(e))
+                out = {&x->target, &x->_value};
+            else if (auto x = dynamic_cast<ir::RangedFor *>(e))
+            {
+                out = {&x->init, &x->goal};
+                push_all(x->body);
+            }
+            else if (auto x = dynamic_cast<ir::For *>(e))
+            {
+                if (x->init)
+                    out.push_back(&x->init);
+                out.push_back(&x->cond);
+                if (x->step)
+                    out.push_back(&x->step);
+                push_all(x->body);
+            }
+            else if (auto x = dynamic_cast<ir::Subscript *>(e))
+                out = {&x->target, &x->inner};
+            else if (auto x = dynamic_cast<ir::Dot *>(e))
+                out = {&x->lfs};
+            else if (auto x = dynamic_cast<ir::Function *>(e))
+                push_all(x->body);
+            else if (auto x = dynamic_cast<ir::StructInstance *>(e))
+            {
+                for (auto &i : x->inits)
+                    out.push_back(&i.value);
+            }
+            else if (auto x = dynamic_cast<ir::If *>(e))
+            {
+                out.push_back(&x->cond);
+                push_all(x->body);
+                push_all(x->else_block);
+            }
+            else if (auto x = dynamic_cast<ir::Return *>(e))
+                out = {&x->ret};
+            else if (auto x = dynamic_cast<ir::Block *>(e))
+                push_all(x->body);
+            else if (auto x = dynamic_cast<ir::Switch *>(e))
+            {
+                out.push_back(&x->scrutinee);
+                for (auto &c : x->cases)
+                    push_all(c.body);
+                push_all(x->default_block);
+            }
+            return out;
+        }
+
+        inline bool mentions(ir::Expr *e, const std::string &ident)
+        {
+            if (auto id = dynamic_cast<ir::Ident *>(e))
+                return id->_value == ident;
+            for (auto c : children(e))
+                if (mentions(c->get(), ident))
+                    return true;
+            return false;
+        }
+
+        inline void rename(std::unique_ptr<ir::Expr> &e, const std::string &from, const std::string &to)
+        {
+            if (auto id = dynamic_cast<ir::Ident *>(e.get()); id && id->_value == from)
+            {
+                e = std::make_unique<ir::Ident>(to);
+                return;
+            }
+            for (auto c : children(e.get()))
+                rename(*c, from, to);
+        }
+
+        // statement lists nested directly inside a statement (not the statement's own expressions)
+        inline std::vector<Stmts *> nested_blocks(ir::Expr *e)
+        {
+            std::vector<Stmts *> out{};
+            if (auto x = dynamic_cast<ir::If *>(e))
+                out = {&x->body, &x->else_block};
+            else if (auto x = dynamic_cast<ir::RangedFor *>(e))
+                out = {&x->body};
+            else if (auto x = dynamic_cast<ir::For *>(e))
+                out = {&x->body};
+            else if (auto x = dynamic_cast<ir::Block *>(e))
+                out = {&x->body};
+            else if (auto x = dynamic_cast<ir::Function *>(e))
+                out = {&x->body};
+            else if (auto x = dynamic_cast<ir::Switch *>(e))
+            {
+                for (auto &c : x->cases)
+                    out.push_back(&c.body);
+                out.push_back(&x->default_block);
+            }
+            return out;
+        }
+
+        inline bool same_expr(ir::Expr *a, ir::Expr *b)
+        {
+            return a->value() == b->value();
+        }
+
+        // an lvalue that can be read any number of times without side effects: `x`, `x.y.z`
+        inline bool is_pure_place(ir::Expr *e)
+        {
+            if (dynamic_cast<ir::Ident *>(e))
+                return true;
+            if (auto dot = dynamic_cast<ir::Dot *>(e))
+                return is_pure_place(dot->lfs.get());
+            return false;
+        }
+
+        inline std::string root_ident(ir::Expr *e)
+        {
+            if (auto id = dynamic_cast<ir::Ident *>(e))
+                return id->_value;
+            if (auto dot = dynamic_cast<ir::Dot *>(e))
+                return root_ident(dot->lfs.get());
+            if (auto sub = dynamic_cast<ir::Subscript *>(e))
+                return root_ident(sub->target.get());
+            if (auto deref = dynamic_cast<ir::PointerDeref *>(e))
+                return root_ident(deref->victim.get());
+            return {};
+        }
+
+        // does control never fall out of the end of these statements
+        inline bool always_exits(const Stmts &stmts)
+        {
+            if (stmts.size() == 0)
+                return false;
+            ir::Expr *last = stmts.back().get();
+            if (dynamic_cast<ir::Return *>(last) || dynamic_cast<ir::Goto *>(last))
+                return true;
+            if (auto block = dynamic_cast<ir::Block *>(last))
+                return always_exits(block->body);
+            if (auto ifs = dynamic_cast<ir::If *>(last))
+                return always_exits(ifs->body) && always_exits(ifs->else_block);
+            return false;
+        }
+
+        // `rje3 f(...)` inside of f itself is always in tail position, so it gets rewritten into
+        // reassigning the parameters and jumping back to the top of the function.
+        struct TailCallElim
+        {
+            ir::Function *m_fn = nullptr;
+            size_t m_rewrites = 0;
+
+            std::string entry_label() const
+            {
+                return std::format("__der_tail_{}", m_fn->name);
+            }
+
+            ir::FunctionCall *self_call(ir::Expr *e)
+            {
+                auto ret = dynamic_cast<ir::Return *>(e);
+                if (ret == nullptr)
+                    return nullptr;
+                auto call = dynamic_cast<ir::FunctionCall *>(ret->ret.get());
+                if (call == nullptr || call->args.size() != m_fn->args.size())
+                    return nullptr;
+                auto callee = dynamic_cast<ir::Ident *>(call->callee.get());
+                if (callee == nullptr || callee->_value != m_fn->name)
+                    return nullptr;
+                return call;
+            }
+
+            std::unique_ptr<ir::Expr> lower_call(ir::FunctionCall *call)
+            {
+                Stmts out{};
+                std::vector<size_t> changed{};
+                for (size_t i = 0; i < call->args.size(); ++i)
+                {
+                    auto id = dynamic_cast<ir::Ident *>(call->args.at(i).get());
+                    if (id == nullptr || id->_value != m_fn->args.at(i).name)
+                        changed.push_back(i);
+                }
+                // params are assigned all at once, if an argument reads a param that gets overwritten before it, go through temporaries
+                bool needs_temps = false;
+                for (size_t i : changed)
+                    for (size_t j : changed)
+                        if (i != j && mentions(call->args.at(i).get(), m_fn->args.at(j).name))
+                            needs_temps = true;
+                for (size_t i : changed)
+                {
+                    auto &arg = m_fn->args.at(i);
+                    if (needs_temps)
+                        out.push_back(std::make_unique<ir::Variable>(arg.ty, std::format("__der_tc_{}", arg.name), call->args.at(i)->clone()));
+                    else
+                        out.push_back(std::make_unique<ir::SetOp>(std::make_unique<ir::Ident>(arg.name), call->args.at(i)->clone()));
+                }
+                if (needs_temps)
+                    for (size_t i : changed)
+                    {
+                        auto &arg = m_fn->args.at(i);
+                        out.push_back(std::make_unique<ir::SetOp>(std::make_unique<ir::Ident>(arg.name), std::make_unique<ir::Ident>(std::format("__der_tc_{}", arg.name))));
+                    }
+                out.push_back(std::make_unique<ir::Goto>(entry_label()));
+                m_rewrites += 1;
+                return std::make_unique<ir::Block>(std::move(out));
+            }
+
+            void visit(std::unique_ptr<ir::Expr> &stmt)
+            {
+                if (auto call = self_call(stmt.get()))
+                {
+                    stmt = lower_call(call);
+                }
+                else if (auto ifs = dynamic_cast<ir::If *>(stmt.get()))
+                {
+                    for (auto &s : ifs->body)
+                        visit(s);
+                    for (auto &s : ifs->else_block)
+                        visit(s);
+                }
+                else if (auto smol = dynamic_cast<ir::SmolIf *>(stmt.get()))
+                {
+                    visit(smol->rfs);
+                }
+                else if (auto loop = dynamic_cast<ir::RangedFor *>(stmt.get()))
+                {
+                    for (auto &s : loop->body)
+                        visit(s);
+                }
+                else if (auto loop = dynamic_cast<ir::For *>(stmt.get()))
+                {
+                    for (auto &s : loop->body)
+                        visit(s);
+                }
+                else if (auto block = dynamic_cast<ir::Block *>(stmt.get()))
+                {
+                    for (auto &s : block->body)
+                        visit(s);
+                }
+                // string chouf is lowered to switches before this runs
+                else if (auto sw = dynamic_cast<ir::Switch *>(stmt.get()))
+                {
+                    for (auto &c : sw->cases)
+                        for (auto &s : c.body)
+                            visit(s);
+                    for (auto &s : sw->default_block)
+                        visit(s);
+                }
+            }
+
+            void run(ir::Function &fn)
+            {
+                m_fn = &fn;
+                m_rewrites = 0;
+                for (auto &s : fn.body)
+                    visit(s);
+                if (m_rewrites > 0)
+                {
+                    der_debug(std::format("eliminated {} tail calls in {}", m_rewrites, fn.name));
+                    fn.body.insert(fn.body.begin(), std::make_unique<ir::Label>(entry_label()));
+                }
+            }
+        };
+
+        // a run of `x == 'a' ?? ...; x == 'b' ?? ...;` guards (or an ila/awla ladder) over the same scrutinee
+        // and distinct constants is turned into a C switch so the C compiler can build a jump table out of it
+        struct SwitchLowering
+        {
+            static constexpr size_t min_cases = 3;
+            std::set<std::string> m_enum_members{};
+            std::set<std::string> m_locals{};
+
+            struct Guard
+            {
+                ir::Expr *scrutinee;
+                ir::Expr *label;
+                std::string key;
+            };
+
+            SwitchLowering(const Stmts &module)
+            {
+                for (auto &e : module)
+                    if (auto en = dynamic_cast<ir::Enum *>(e.get()))
+                        for (auto &m : en->members)
+                            m_enum_members.insert(std::format("{}_{}", en->name, m));
+            }
+
+            std::optional<std::string> constant_key(ir::Expr *e)
+            {
+                if (auto x = dynamic_cast<ir::Integer *>(e))
+                    return std::format("{}", x->val);
+                if (auto x = dynamic_cast<ir::Char *>(e))
+                    return std::format("{}", int(x->val));
+                if (auto x = dynamic_cast<ir::Bool *>(e))
+                    return std::format("{}", int(x->val));
+                if (auto x = dynamic_cast<ir::Ident *>(e); x && m_enum_members.contains(x->_value))
+                    return x->_value;
+                return std::nullopt;
+            }
+
+            std::optional<Guard> match_cond(ir::Expr *cond)
+            {
+                auto eq = dynamic_cast<ir::Logical *>(cond);
+                if (eq == nullptr || eq->op != "==")
+                    return std::nullopt;
+                if (auto key = constant_key(eq->rfs.get()); key && is_pure_place(eq->lfs.get()))
+                    return Guard{eq->lfs.get(), eq->rfs.get(), *key};
+                if (auto key = constant_key(eq->lfs.get()); key && is_pure_place(eq->rfs.get()))
+                    return Guard{eq->rfs.get(), eq->lfs.get(), *key};
+                return std::nullopt;
+            }
+
+            // `cond ?? stmt` or `ila cond { ... }` without an else
+            std::optional<Guard> match_guard(ir::Expr *stmt, Stmts &body)
+            {
+                if (auto smol = dynamic_cast<ir::SmolIf *>(stmt))
+                {
+                    auto g = match_cond(smol->lfs.get());
+                    if (g)
+                        body.push_back(smol->rfs->clone());
+                    return g;
+                }
+                if (auto ifs = dynamic_cast<ir::If *>(stmt); ifs && ifs->else_block.size() == 0)
+                {
+                    auto g = match_cond(ifs->cond.get());
+                    if (g)
+                        for (auto &s : ifs->body)
+                            body.push_back(s->clone());
+                    return g;
+                }
+                return std::nullopt;
+            }
+
+            bool may_write(ir::Expr *e, const std::string &root)
+            {
+                if (auto set = dynamic_cast<ir::SetOp *>(e); set && root_ident(set->target.get()) == root)
+                    return true;
+                if (auto addr = dynamic_cast<ir::GetAddress *>(e); addr && mentions(addr->victim.get(), root))
+                    return true;
+                // a call can only reach locals through a pointer, and taking the address is already caught above
+                if (dynamic_cast<ir::FunctionCall *>(e) && !m_locals.contains(root))
+                    return true;
+                for (auto c : children(e))
+                    if (may_write(c->get(), root))
+                        return true;
+                return false;
+            }
+
+            // once a guard's body ran, the next guards must still see the same scrutinee
+            bool keeps_scrutinee(const Stmts &body, ir::Expr *scrutinee)
+            {
+                if (always_exits(body))
+                    return true;
+                std::string root = root_ident(scrutinee);
+                for (auto &s : body)
+                    if (may_write(s.get(), root))
+                        return false;
+                return true;
+            }
+
+            std::unique_ptr<ir::Expr> lower_ladder(ir::If *head)
+            {
+                std::vector<ir::SwitchCase> cases{};
+                std::set<std::string> seen{};
+                Stmts default_block{};
+                ir::Expr *scrutinee = nullptr;
+                ir::If *cur = head;
+                while (true)
+                {
+                    auto g = match_cond(cur->cond.get());
+                    if (!g || seen.contains(g->key) || (scrutinee && !same_expr(scrutinee, g->scrutinee)))
+                    {
+                        default_block.push_back(cur->clone());
+                        break;
+                    }
+                    scrutinee = g->scrutinee;
+                    seen.insert(g->key);
+                    Stmts body{};
+                    for (auto &s : cur->body)
+                        body.push_back(s->clone());
+                    cases.emplace_back(g->label->clone(), std::move(body));
+                    ir::If *next = cur->else_block.size() == 1 ? dynamic_cast<ir::If *>(cur->else_block.front().get()) : nullptr;
+                    if (next == nullptr)
+                    {
+                        for (auto &s : cur->else_block)
+                            default_block.push_back(s->clone());
+                        break;
+                    }
+                    cur = next;
+                }
+                if (cases.size() < min_cases)
+                    return nullptr;
+                return std::make_unique<ir::Switch>(scrutinee->clone(), std::move(cases), std::move(default_block));
+            }
+
+            void visit(Stmts &stmts)
+            {
+                for (auto &s : stmts)
+                    for (auto nested : nested_blocks(s.get()))
+                        visit(*nested);
+
+                for (size_t i = 0; i < stmts.size(); ++i)
+                {
+                    if (auto ifs = dynamic_cast<ir::If *>(stmts.at(i).get()); ifs && ifs->else_block.size() > 0)
+                    {
+                        if (auto sw = lower_ladder(ifs))
+                            stmts.at(i) = std::move(sw);
+                        continue;
+                    }
+                    std::vector<ir::SwitchCase> cases{};
+                    std::set<std::string> seen{};
+                    ir::Expr *scrutinee = nullptr;
+                    size_t j = i;
+                    while (j < stmts.size())
+                    {
+                        Stmts body{};
+                        auto g = match_guard(stmts.at(j).get(), body);
+                        if (!g || seen.contains(g->key) || (scrutinee && !same_expr(scrutinee, g->scrutinee)))
+                            break;
+                        if (cases.size() > 0 && !keeps_scrutinee(cases.back().body, g->scrutinee))
+                            break;
+                        scrutinee = g->scrutinee;
+                        seen.insert(g->key);
+                        cases.emplace_back(g->label->clone(), std::move(body));
+                        j += 1;
+                    }
+                    if (cases.size() < min_cases)
+                        continue;
+                    der_debug(std::format("lowered {} guards on {} into a switch", cases.size(), scrutinee->value()));
+                    auto sw = std::make_unique<ir::Switch>(scrutinee->clone(), std::move(cases), Stmts{});
+                    stmts.erase(stmts.begin() + i + 1, stmts.begin() + j);
+                    stmts.at(i) = std::move(sw);
+                }
+            }
+
+            void run(ir::Function &fn)
+            {
+                m_locals.clear();
+                for (auto &a : fn.args)
+                    m_locals.insert(a.name);
+                std::vector<ir::Expr *> work{&fn};
+                while (work.size() > 0)
+                {
+                    ir::Expr *e = work.back();
+                    work.pop_back();
+                    if (auto var = dynamic_cast<ir::Variable *>(e))
+                        m_locals.insert(var->name);
+                    for (auto c : children(e))
+                        work.push_back(c->get());
+                }
+                visit(fn.body);
+            }
+        };
+
+        // evaluating it has no effect other than producing a value
+        inline bool is_pure(ir::Expr *e)
+        {
+            if (dynamic_cast<ir::FunctionCall *>(e) || dynamic_cast<ir::Pipe *>(e) || dynamic_cast<ir::SetOp *>(e))
+                return false;
+            for (auto c : children(e))
+                if (!is_pure(c->get()))
+                    return false;
+            return true;
+        }
+
+        // backward liveness over the lowered body, a store to a local that nothing reads before it's
+        // overwritten (or the function returns) is dropped. only locals whose address is never taken are
+        // tracked, so nothing can read them behind our back through a pointer.
+        struct DeadStoreElim
+        {
+            using Live = std::set<std::string>;
+            ir::Function *m_fn = nullptr;
+            std::set<std::string> m_tracked{};
+            std::map<std::string, Live> m_at_label{};
+            bool m_rewrite = false;
+            size_t m_removed = 0;
+
+            void uses(ir::Expr *e, Live &live)
+            {
+                if (auto id = dynamic_cast<ir::Ident *>(e); id && m_tracked.contains(id->_value))
+                    live.insert(id->_value);
+                for (auto c : children(e))
+                    uses(c->get(), live);
+            }
+
+            Live transfer(Stmts &stmts, Live live)
+            {
+                for (size_t i = stmts.size(); i-- > 0;)
+                {
+                    live = step(stmts.at(i), std::move(live));
+                    if (stmts.at(i) == nullptr)
+                        stmts.erase(stmts.begin() + i);
+                }
+                return live;
+            }
+
+            // the store itself is dead, whatever side effects its value has still have to happen
+            void drop_store(std::unique_ptr<ir::Expr> &stmt, std::unique_ptr<ir::Expr> &value)
+            {
+                m_removed += 1;
+                if (is_pure(value.get()))
+                    stmt = nullptr;
+                else
+                    stmt = std::move(value);
+            }
+
+            Live step(std::unique_ptr<ir::Expr> &stmt, Live out)
+            {
+                Live in{};
+                if (auto var = dynamic_cast<ir::Variable *>(stmt.get()))
+                {
+                    bool dead = var->_value && m_tracked.contains(var->name) && !out.contains(var->name) && !(var->is_const && mentions(m_fn, var->name));
+                    out.erase(var->name);
+                    if (!dead)
+                    {
+                        if (var->_value)
+                            uses(var->_value.get(), out);
+                        return out;
+                    }
+                    bool pure = is_pure(var->_value.get());
+                    if (!pure)
+                        uses(var->_value.get(), out);
+                    if (!m_rewrite)
+                        return out;
+                    // later statements still assign to it, so the declaration stays and only the initializer goes
+                    if (!mentions(m_fn, var->name))
+                        drop_store(stmt, var->_value);
+                    else if (pure)
+                    {
+                        var->_value = nullptr;
+                        m_removed += 1;
+                    }
+                    return out;
+                }
+                if (auto set = dynamic_cast<ir::SetOp *>(stmt.get()))
+                {
+                    auto target = dynamic_cast<ir::Ident *>(set->target.get());
+                    if (target == nullptr || !m_tracked.contains(target->_value))
+                    {
+                        uses(stmt.get(), out);
+                        return out;
+                    }
+                    bool dead = !out.contains(target->_value);
+                    out.erase(target->_value);
+                    if (!dead || !is_pure(set->_value.get()))
+                        uses(set->_value.get(), out);
+                    if (dead && m_rewrite)
+                        drop_store(stmt, set->_value);
+                    return out;
+                }
+                if (auto ret = dynamic_cast<ir::Return *>(stmt.get()))
+                {
+                    uses(ret->ret.get(), in);
+                    return in;
+                }
+                if (auto go = dynamic_cast<ir::Goto *>(stmt.get()))
+                    return m_at_label[go->label];
+                if (auto label = dynamic_cast<ir::Label *>(stmt.get()))
+                {
+                    if (!m_rewrite)
+                        m_at_label[label->name] = out;
+                    return out;
+                }
+                if (auto ifs = dynamic_cast<ir::If *>(stmt.get()))
+                {
+                    in = transfer(ifs->body, out);
+                    in.merge(transfer(ifs->else_block, out));
+                    uses(ifs->cond.get(), in);
+                    return in;
+                }
+                if (auto block = dynamic_cast<ir::Block *>(stmt.get()))
+                    return transfer(block->body, out);
+                if (auto sw = dynamic_cast<ir::Switch *>(stmt.get()))
+                {
+                    for (auto &c : sw->cases)
+                        in.merge(transfer(c.body, out));
+                    in.merge(transfer(sw->default_block, out));
+                    uses(sw->scrutinee.get(), in);
+                    return in;
+                }
+                if (auto loop = dynamic_cast<ir::RangedFor *>(stmt.get()))
+                {
+                    // what's live at the condition check: the exit, the bound, and whatever the body needs on the next iteration
+                    bool rewrite = m_rewrite;
+                    m_rewrite = false;
+                    Live head = out;
+                    while (true)
+                    {
+                        Live next = transfer(loop->body, head);
+                        next.merge(Live(out));
+                        uses(loop->goal.get(), next);
+                        if (next == head)
+                            break;
+                        head = std::move(next);
+                    }
+                    m_rewrite = rewrite;
+                    if (m_rewrite)
+                        transfer(loop->body, head);
+                    head.erase(loop->ident);
+                    uses(loop->init.get(), head);
+                    return head;
+                }
+                if (auto loop = dynamic_cast<ir::For *>(stmt.get()))
+                {
+                    bool rewrite = m_rewrite;
+                    m_rewrite = false;
+                    Live head = out;
+                    while (true)
+                    {
+                        Live after_body = head;
+                        if (loop->step)
+                            uses(loop->step.get(), after_body);
+                        Live next = transfer(loop->body, after_body);
+                        next.merge(Live(out));
+                        uses(loop->cond.get(), next);
+                        if (next == head)
+                            break;
+                        head = std::move(next);
+                    }
+                    m_rewrite = rewrite;
+                    if (m_rewrite)
+                    {
+                        Live after_body = head;
+                        if (loop->step)
+                            uses(loop->step.get(), after_body);
+                        transfer(loop->body, after_body);
+                    }
+                    if (loop->init)
+                        uses(loop->init.get(), head);
+                    return head;
+                }
+                // a one line if may or may not run its statement, so nothing is killed through it
+                if (auto smol = dynamic_cast<ir::SmolIf *>(stmt.get()))
+                {
+                    bool rewrite = m_rewrite;
+                    m_rewrite = false;
+                    out.merge(step(smol->rfs, out));
+                    m_rewrite = rewrite;
+                    uses(smol->lfs.get(), out);
+                    return out;
+                }
+                uses(stmt.get(), out);
+                return out;
+            }
+
+            void run(ir::Function &fn)
+            {
+                m_fn = &fn;
+                m_tracked.clear();
+                m_at_label.clear();
+                m_removed = 0;
+                std::map<std::string, size_t> declared{};
+                std::set<std::string> escaped{};
+                for (auto &a : fn.args)
+                    declared[a.name] += 1;
+                std::vector<ir::Expr *> work{&fn};
+                while (work.size() > 0)
+                {
+                    ir::Expr *e = work.back();
+                    work.pop_back();
+                    if (auto var = dynamic_cast<ir::Variable *>(e))
+                        declared[var->name] += 1;
+                    else if (auto arr = dynamic_cast<ir::ArrayVariable *>(e))
+                        escaped.insert(arr->name);
+                    else if (auto loop = dynamic_cast<ir::RangedFor *>(e))
+                        declared[loop->ident] += 1;
+                    else if (auto addr = dynamic_cast<ir::GetAddress *>(e))
+                        if (auto root = root_ident(addr->victim.get()); !root.empty())
+                            escaped.insert(root);
+                    for (auto c : children(e))
+                        work.push_back(c->get());
+                }
+                // shadowed names would need real scopes to tell apart, leave them alone
+                for (auto &[name, count] : declared)
+                    if (count == 1 && !escaped.contains(name))
+                        m_tracked.insert(name);
+
+                m_rewrite = false;
+                std::map<std::string, Live> before{};
+                do
+                {
+                    before = m_at_label;
+                    transfer(fn.body, {});
+                } while (before != m_at_label);
+                m_rewrite = true;
+                transfer(fn.body, {});
+                if (m_removed > 0)
+                {
+                    der_debug(std::format("removed {} dead stores in {}", m_removed, fn.name));
+                }
+            }
+        };
+
+        // two back to back lkola loops over the same range become one, when running the second loop's iteration k
+        // right after the first loop's iteration k can't change what either of them sees
+        struct LoopFusion
+        {
+            std::set<std::string> m_locals{};
+            std::set<std::string> m_local_arrays{};
+            size_t m_fused = 0;
+
+            struct Access
+            {
+                std::string array;
+                std::optional<int> offset; // index is `i + offset`, nullopt when it's anything else
+                bool write;
+            };
+
+            struct Summary
+            {
+                std::set<std::string> reads{};
+                std::set<std::string> writes{};
+                std::vector<Access> accesses{};
+                bool declares = false;
+                bool opaque = false;
+            };
+
+            static std::optional<int> affine_offset(ir::Expr *index, const std::string &ident)
+            {
+                if (auto id = dynamic_cast<ir::Ident *>(index))
+                    return id->_value == ident ? std::optional<int>(0) : std::nullopt;
+                auto bin = dynamic_cast<ir::Binary *>(index);
+                if (bin == nullptr || (bin->op != "+" && bin->op != "-"))
+                    return std::nullopt;
+                auto lfs = dynamic_cast<ir::Ident *>(bin->lfs.get());
+                auto rfs = dynamic_cast<ir::Integer *>(bin->rfs.get());
+                if (lfs && rfs && lfs->_value == ident)
+                    return bin->op == "+" ? rfs->val : -rfs->val;
+                auto l_int = dynamic_cast<ir::Integer *>(bin->lfs.get());
+                auto r_id = dynamic_cast<ir::Ident *>(bin->rfs.get());
+                if (l_int && r_id && r_id->_value == ident && bin->op == "+")
+                    return l_int->val;
+                return std::nullopt;
+            }
+
+            void summarize(ir::Expr *e, const std::string &ident, Summary &out, bool is_target = false)
+            {
+                if (dynamic_cast<ir::FunctionCall *>(e) || dynamic_cast<ir::Pipe *>(e) || dynamic_cast<ir::Return *>(e) || dynamic_cast<ir::Goto *>(e) ||
+                    dynamic_cast<ir::Label *>(e) || dynamic_cast<ir::PointerDeref *>(e) || dynamic_cast<ir::GetAddress *>(e))
+                {
+                    out.opaque = true;
+                    return;
+                }
+                if (auto var = dynamic_cast<ir::Variable *>(e))
+                {
+                    out.declares = true;
+                    out.writes.insert(var->name);
+                }
+                if (auto set = dynamic_cast<ir::SetOp *>(e))
+                {
+                    summarize(set->target.get(), ident, out, true);
+                    summarize(set->_value.get(), ident, out);
+                    return;
+                }
+                if (auto sub = dynamic_cast<ir::Subscript *>(e))
+                {
+                    auto target = dynamic_cast<ir::Ident *>(sub->target.get());
+                    if (target == nullptr)
+                    {
+                        out.opaque = true;
+                        return;
+                    }
+                    out.accesses.push_back(Access{target->_value, affine_offset(sub->inner.get(), ident), is_target});
+                    summarize(sub->inner.get(), ident, out);
+                    return;
+                }
+                if (auto id = dynamic_cast<ir::Ident *>(e))
+                {
+                    (is_target ? out.writes : out.reads).insert(id->_value);
+                    return;
+                }
+                if (auto dot = dynamic_cast<ir::Dot *>(e))
+                {
+                    summarize(dot->lfs.get(), ident, out, is_target);
+                    return;
+                }
+                for (auto c : children(e))
+                    summarize(c->get(), ident, out);
+            }
+
+            // where an array's memory comes from, two pointers we didn't allocate can point to the same thing
+            std::string storage(const std::string &array)
+            {
+                return m_local_arrays.contains(array) ? array : "";
+            }
+
+            bool arrays_fusable(const Summary &first, const Summary &second)
+            {
+                for (auto &a : first.accesses)
+                    for (auto &b : second.accesses)
+                    {
+                        if (!a.write && !b.write)
+                            continue;
+                        if (storage(a.array) != storage(b.array))
+                            continue;
+                        if (a.array != b.array)
+                            return false;
+                        // iteration k of the second loop must only touch what the first loop was done with by iteration k
+                        if (!a.offset || !b.offset || *b.offset > *a.offset)
+                            return false;
+                    }
+                return true;
+            }
+
+            static bool intersects(const std::set<std::string> &a, const std::set<std::string> &b)
+            {
+                for (auto &x : a)
+                    if (b.contains(x))
+                        return true;
+                return false;
+            }
+
+            bool fusable(ir::RangedFor *first, ir::RangedFor *second)
+            {
+                if (!same_expr(first->init.get(), second->init.get()) || !same_expr(first->goal.get(), second->goal.get()))
+                    return false;
+                if (first->ty != second->ty || first->unroll != second->unroll || first->assume_noalias != second->assume_noalias)
+                    return false;
+                if (!is_pure(first->goal.get()) || !is_pure(first->init.get()))
+                    return false;
+                if (first->ident != second->ident)
+                    for (auto &s : second->body)
+                        if (mentions(s.get(), first->ident))
+                            return false;
+                Summary a{}, b{};
+                for (auto &s : first->body)
+                    summarize(s.get(), first->ident, a);
+                for (auto &s : second->body)
+                    summarize(s.get(), second->ident, b);
+                if (a.opaque || b.opaque)
+                    return false;
+                // the bounds are evaluated again for the second loop, after the first one is done with them
+                Summary bounds{};
+                summarize(first->init.get(), first->ident, bounds);
+                summarize(first->goal.get(), first->ident, bounds);
+                for (auto &name : bounds.reads)
+                    if (!m_locals.contains(name) || a.writes.contains(name) || b.writes.contains(name))
+                        return false;
+                // the counters and the loop locals are per iteration, anything else written by one loop is off limits to the other
+                std::set<std::string> a_local{}, b_local{};
+                for (auto &s : first->body)
+                    if (auto var = dynamic_cast<ir::Variable *>(s.get()))
+                        a_local.insert(var->name);
+                for (auto &s : second->body)
+                    if (auto var = dynamic_cast<ir::Variable *>(s.get()))
+                        b_local.insert(var->name);
+                std::set<std::string> a_writes{}, b_writes{}, a_reads{}, b_reads{};
+                for (auto &w : a.writes)
+                    if (!a_local.contains(w))
+                        a_writes.insert(w);
+                for (auto &w : b.writes)
+                    if (!b_local.contains(w))
+                        b_writes.insert(w);
+                for (auto &r : a.reads)
+                    if (!a_local.contains(r) && r != first->ident)
+                        a_reads.insert(r);
+                for (auto &r : b.reads)
+                    if (!b_local.contains(r) && r != second->ident)
+                        b_reads.insert(r);
+                if (a_writes.contains(first->ident) || b_writes.contains(second->ident))
+                    return false;
+                if (intersects(a_writes, b_reads) || intersects(a_writes, b_writes) || intersects(b_writes, a_reads))
+                    return false;
+                return arrays_fusable(a, b);
+            }
+
+            void fuse(ir::RangedFor *first, ir::RangedFor *second)
+            {
+                Stmts tail{};
+                for (auto &s : second->body)
+                {
+                    tail.push_back(s->clone());
+                    if (first->ident != second->ident)
+                        rename(tail.back(), second->ident, first->ident);
+                }
+                bool first_declares = false, second_declares = false;
+                for (auto &s : first->body)
+                    first_declares = first_declares || dynamic_cast<ir::Variable *>(s.get());
+                for (auto &s : tail)
+                    second_declares = second_declares || dynamic_cast<ir::Variable *>(s.get());
+                // both bodies may declare the same names, give each its own scope
+                if (first_declares && second_declares)
+                {
+                    Stmts head{};
+                    for (auto &s : first->body)
+                        head.push_back(std::move(s));
+                    first->body.clear();
+                    first->body.push_back(std::make_unique<ir::Block>(std::move(head)));
+                    first->body.push_back(std::make_unique<ir::Block>(std::move(tail)));
+                }
+                else
+                    for (auto &s : tail)
+                        first->body.push_back(std::move(s));
+                m_fused += 1;
+            }
+
+            void visit(Stmts &stmts)
+            {
+                for (auto &s : stmts)
+                    for (auto nested : nested_blocks(s.get()))
+                        visit(*nested);
+                for (size_t i = 0; i + 1 < stmts.size();)
+                {
+                    auto first = dynamic_cast<ir::RangedFor *>(stmts.at(i).get());
+                    auto second = dynamic_cast<ir::RangedFor *>(stmts.at(i + 1).get());
+                    if (first && second && fusable(first, second))
+                    {
+                        fuse(first, second);
+                        stmts.erase(stmts.begin() + i + 1);
+                        continue;
+                    }
+                    i += 1;
+                }
+            }
+
+            void run(ir::Function &fn)
+            {
+                m_locals.clear();
+                m_local_arrays.clear();
+                for (auto &a : fn.args)
+                    m_locals.insert(a.name);
+                std::vector<ir::Expr *> work{&fn};
+                while (work.size() > 0)
+                {
+                    ir::Expr *e = work.back();
+                    work.pop_back();
+                    if (auto var = dynamic_cast<ir::Variable *>(e))
+                        m_locals.insert(var->name);
+                    else if (auto arr = dynamic_cast<ir::ArrayVariable *>(e))
+                        m_local_arrays.insert(arr->name);
+                    for (auto c : children(e))
+                        work.push_back(c->get());
+                }
+                visit(fn.body);
+                if (m_fused > 0)
+                {
+                    der_debug(std::format("fused {} loops in {}", m_fused, fn.name));
+                }
+            }
+        };
+
+        // inside lkola bodies: `i * c` becomes a separate counter bumped by c every iteration, and
+        // multiplies, divides and modulos by powers of two on values known to be >= 0 become shifts and masks.
+        // a counter used as an array index is widened to ptrdiff_t so the index needs no sign extension.
+        struct StrengthReduction
+        {
+            std::set<std::string> &m_includes;
+            std::map<std::string, std::string> m_int_locals{};
+            std::set<std::string> m_nonneg{};
+            size_t m_depth = 0;
+            size_t m_ivs = 0;
+            size_t m_shifts = 0;
+
+            StrengthReduction(std::set<std::string> &includes) : m_includes(includes) {}
+
+            static std::optional<int> log2_of(ir::Expr *e)
+            {
+                auto x = dynamic_cast<ir::Integer *>(e);
+                if (x == nullptr || x->val <= 0 || (x->val & (x->val - 1)) != 0)
+                    return std::nullopt;
+                int k = 0;
+                while ((1 << k) != x->val)
+                    k += 1;
+                return k;
+            }
+
+            static bool written(ir::Expr *e, const std::string &name)
+            {
+                if (auto set = dynamic_cast<ir::SetOp *>(e); set && root_ident(set->target.get()) == name)
+                    return true;
+                // an inner loop's counter, or a name declared in the body, takes a new value every iteration too
+                if (auto loop = dynamic_cast<ir::RangedFor *>(e); loop && loop->ident == name)
+                    return true;
+                if (auto var = dynamic_cast<ir::Variable *>(e); var && var->name == name)
+                    return true;
+                if (auto addr = dynamic_cast<ir::GetAddress *>(e); addr && mentions(addr->victim.get(), name))
+                    return true;
+                for (auto c : children(e))
+                    if (written(c->get(), name))
+                        return true;
+                return false;
+            }
+
+            static bool written(const Stmts &body, const std::string &name)
+            {
+                for (auto &s : body)
+                    if (written(s.get(), name))
+                        return true;
+                return false;
+            }
+
+            static bool indexes(ir::Expr *e, const std::string &name)
+            {
+                if (auto sub = dynamic_cast<ir::Subscript *>(e); sub && mentions(sub->inner.get(), name))
+                    return true;
+                for (auto c : children(e))
+                    if (indexes(c->get(), name))
+                        return true;
+                return false;
+            }
+
+            bool nonneg(ir::Expr *e)
+            {
+                if (auto x = dynamic_cast<ir::Integer *>(e))
+                    return x->val >= 0;
+                if (auto x = dynamic_cast<ir::Ident *>(e))
+                    return m_nonneg.contains(x->_value);
+                if (auto x = dynamic_cast<ir::Group *>(e))
+                    return nonneg(x->inner.get());
+                if (auto x = dynamic_cast<ir::Binary *>(e))
+                {
+                    if (x->op == "&")
+                        return nonneg(x->lfs.get()) || nonneg(x->rfs.get());
+                    if (x->op == "+" || x->op == "*" || x->op == "/" || x->op == "%" || x->op == ">>")
+                        return nonneg(x->lfs.get()) && nonneg(x->rfs.get());
+                }
+                return false;
+            }
+
+            // a factor that stays the same for the whole loop
+            bool invariant_factor(ir::Expr *e, const ir::RangedFor *loop)
+            {
+                if (dynamic_cast<ir::Integer *>(e))
+                    return true;
+                auto id = dynamic_cast<ir::Ident *>(e);
+                return id && id->_value != loop->ident && m_int_locals.contains(id->_value) && !written(loop->body, id->_value);
+            }
+
+            // replaces every `ident * factor` with the counter tracking it, keyed by the factor
+            void replace_products(std::unique_ptr<ir::Expr> &e, ir::RangedFor *loop, std::map<std::string, std::pair<std::string, std::unique_ptr<ir::Expr>>> &ivs)
+            {
+                if (auto inner = dynamic_cast<ir::RangedFor *>(e.get()); inner && inner->ident == loop->ident)
+                    return;
+                for (auto c : children(e.get()))
+                    replace_products(*c, loop, ivs);
+                auto bin = dynamic_cast<ir::Binary *>(e.get());
+                if (bin == nullptr || bin->op != "*")
+                    return;
+                ir::Expr *factor = nullptr;
+                if (auto id = dynamic_cast<ir::Ident *>(bin->lfs.get()); id && id->_value == loop->ident)
+                    factor = bin->rfs.get();
+                else if (auto id = dynamic_cast<ir::Ident *>(bin->rfs.get()); id && id->_value == loop->ident)
+                    factor = bin->lfs.get();
+                if (factor == nullptr || !invariant_factor(factor, loop))
+                    return;
+                std::string key = factor->value();
+                if (!ivs.contains(key))
+                    ivs[key] = {std::format("__der_iv{}", m_ivs++), factor->clone()};
+                e = std::make_unique<ir::Ident>(ivs.at(key).first);
+            }
+
+            void reduce_loop(std::unique_ptr<ir::Expr> &slot)
+            {
+                auto loop = dynamic_cast<ir::RangedFor *>(slot.get());
+                bool counter_fixed = !written(loop->body, loop->ident);
+                if (counter_fixed && loop->ty == "int" && indexes(loop, loop->ident))
+                {
+                    m_includes.insert("stddef.h");
+                    loop->ty = "ptrdiff_t";
+                }
+                bool nonneg_counter = counter_fixed && nonneg(loop->init.get());
+
+                std::map<std::string, std::pair<std::string, std::unique_ptr<ir::Expr>>> ivs{};
+                if (counter_fixed && is_pure(loop->init.get()))
+                    for (auto &s : loop->body)
+                        replace_products(s, loop, ivs);
+
+                Stmts prelude{};
+                std::vector<std::string> nonneg_ivs{};
+                for (auto &[_, iv] : ivs)
+                {
+                    auto &[name, factor] = iv;
+                    std::unique_ptr<ir::Expr> start = nullptr;
+                    auto init = dynamic_cast<ir::Integer *>(loop->init.get());
+                    auto constant = dynamic_cast<ir::Integer *>(factor.get());
+                    if (init && (init->val == 0 || constant))
+                        start = std::make_unique<ir::Integer>(init->val == 0 ? 0 : init->val * constant->val);
+                    else
+                        start = std::make_unique<ir::Binary>(std::make_unique<ir::Group>(loop->init->clone()), "*", factor->clone());
+                    prelude.push_back(std::make_unique<ir::Variable>(loop->ty, name, std::move(start)));
+                    loop->body.push_back(std::make_unique<ir::SetOp>(std::make_unique<ir::Ident>(name), std::make_unique<ir::Binary>(std::make_unique<ir::Ident>(name), "+", factor->clone())));
+                    if (nonneg_counter && nonneg(factor.get()))
+                        nonneg_ivs.push_back(name);
+                }
+
+                m_depth += 1;
+                std::set<std::string> saved = m_nonneg;
+                if (nonneg_counter)
+                    m_nonneg.insert(loop->ident);
+                m_nonneg.insert(nonneg_ivs.begin(), nonneg_ivs.end());
+                for (auto &s : loop->body)
+                    rewrite(s);
+                m_nonneg = std::move(saved);
+                m_depth -= 1;
+
+                if (prelude.size() > 0)
+                {
+                    der_debug(std::format("introduced {} induction variables for loop over {}", prelude.size(), loop->ident));
+                    prelude.push_back(std::move(slot));
+                    slot = std::make_unique<ir::Block>(std::move(prelude));
+                }
+            }
+
+            void rewrite(std::unique_ptr<ir::Expr> &e)
+            {
+                if (dynamic_cast<ir::RangedFor *>(e.get()))
+                {
+                    reduce_loop(e);
+                    return;
+                }
+                for (auto c : children(e.get()))
+                    rewrite(*c);
+                auto bin = dynamic_cast<ir::Binary *>(e.get());
+                if (m_depth == 0 || bin == nullptr)
+                    return;
+                if (bin->op == "*")
+                {
+                    if (auto k = log2_of(bin->rfs.get()); k && nonneg(bin->lfs.get()))
+                        e = std::make_unique<ir::Group>(std::make_unique<ir::Binary>(std::move(bin->lfs), "<<", std::make_unique<ir::Integer>(*k)));
+                    else if (auto k = log2_of(bin->lfs.get()); k && nonneg(bin->rfs.get()))
+                        e = std::make_unique<ir::Group>(std::make_unique<ir::Binary>(std::move(bin->rfs), "<<", std::make_unique<ir::Integer>(*k)));
+                    else
+                        return;
+                }
+                else if (bin->op == "/" || bin->op == "%")
+                {
+                    auto k = log2_of(bin->rfs.get());
+                    if (!k || !nonneg(bin->lfs.get()))
+                        return;
+                    if (bin->op == "/")
+                        e = std::make_unique<ir::Group>(std::make_unique<ir::Binary>(std::move(bin->lfs), ">>", std::make_unique<ir::Integer>(*k)));
+                    else
+                        e = std::make_unique<ir::Group>(std::make_unique<ir::Binary>(std::move(bin->lfs), "&", std::make_unique<ir::Integer>((1 << *k) - 1)));
+                }
+                else
+                    return;
+                m_shifts += 1;
+            }
+
+            void run(ir::Function &fn)
+            {
+                m_int_locals.clear();
+                for (auto &a : fn.args)
+                    if (a.ty == "int")
+                        m_int_locals[a.name] = a.ty;
+                std::vector<ir::Expr *> work{&fn};
+                while (work.size() > 0)
+                {
+                    ir::Expr *e = work.back();
+                    work.pop_back();
+                    if (auto var = dynamic_cast<ir::Variable *>(e); var && var->ty == "int")
+                        m_int_locals[var->name] = var->ty;
+                    for (auto c : children(e))
+                        work.push_back(c->get());
+                }
+                for (auto &s : fn.body)
+                    rewrite(s);
+                if (m_shifts > 0)
+                {
+                    der_debug(std::format("strength reduced {} operations in {}", m_shifts, fn.name));
+                }
+            }
+        };
+
+        // fully unrolls short constant lkola loops, partially unrolls long ones (or ones asking for it with `lkola<n>`)
+        // with a remainder loop, and marks loops whose iterations are independent with simd pragmas.
+        struct LoopUnroll
+        {
+            static constexpr size_t full_unroll_max_trip = 8;
+            static constexpr size_t full_unroll_budget = 64;
+            static constexpr size_t long_trip = 64;
+            static constexpr size_t default_factor = 4;
+            std::set<std::string> m_locals{};
+            std::set<std::string> m_local_arrays{};
+            std::map<std::string, std::string> m_types{};
+            std::set<std::string> m_escaped{};
+            std::string m_prefix = "__der_ur";
+            size_t m_counter = 0;
+
+            static bool has(ir::Expr *e, auto pred)
+            {
+                if (pred(e))
+                    return true;
+                for (auto c : children(e))
+                    if (has(c->get(), pred))
+                        return true;
+                return false;
+            }
+
+            static bool body_has(const Stmts &body, auto pred)
+            {
+                for (auto &s : body)
+                    if (has(s.get(), pred))
+                        return true;
+                return false;
+            }
+
+            static std::optional<int> trip_count(ir::RangedFor *loop)
+            {
+                auto init = dynamic_cast<ir::Integer *>(loop->init.get());
+                auto goal = dynamic_cast<ir::Integer *>(loop->goal.get());
+                if (init == nullptr || goal == nullptr)
+                    return std::nullopt;
+                return goal->val - init->val;
+            }
+
+            // the bound is read again on every iteration, it has to give the same answer no matter how many times that happens
+            bool stable_goal(ir::RangedFor *loop)
+            {
+                if (!is_pure(loop->goal.get()))
+                    return false;
+                return !has(loop->goal.get(), [&](ir::Expr *e)
+                            {
+                    auto id = dynamic_cast<ir::Ident *>(e);
+                    return id && (!m_locals.contains(id->_value) || StrengthReduction::written(loop->body, id->_value)); });
+            }
+
+            // `{ const ty i = value; body }`, without the declaration when the body never reads i
+            std::unique_ptr<ir::Expr> copy_body(ir::RangedFor *loop, std::unique_ptr<ir::Expr> value)
+            {
+                Stmts out{};
+                for (auto &s : loop->body)
+                    if (mentions(s.get(), loop->ident))
+                    {
+                        out.push_back(std::make_unique<ir::Variable>(loop->ty, loop->ident, std::move(value), true));
+                        break;
+                    }
+                for (auto &s : loop->body)
+                    out.push_back(s->clone());
+                return std::make_unique<ir::Block>(std::move(out));
+            }
+
+            static std::unique_ptr<ir::Expr> plus(std::unique_ptr<ir::Expr> e, int k)
+            {
+                if (k == 0)
+                    return e;
+                if (auto x = dynamic_cast<ir::Integer *>(e.get()))
+                    return std::make_unique<ir::Integer>(x->val + k);
+                return std::make_unique<ir::Binary>(std::move(e), "+", std::make_unique<ir::Integer>(k));
+            }
+
+            static std::unique_ptr<ir::Expr> grouped(const std::unique_ptr<ir::Expr> &e)
+            {
+                if (dynamic_cast<ir::Ident *>(e.get()) || dynamic_cast<ir::Integer *>(e.get()))
+                    return e->clone();
+                return std::make_unique<ir::Group>(e->clone());
+            }
+
+            std::unique_ptr<ir::Expr> full_unroll(ir::RangedFor *loop, int trip)
+            {
+                auto init = dynamic_cast<ir::Integer *>(loop->init.get());
+                Stmts out{};
+                for (int k = 0; k < trip; ++k)
+                    out.push_back(copy_body(loop, std::make_unique<ir::Integer>(init->val + k)));
+                return std::make_unique<ir::Block>(std::move(out));
+            }
+
+            // { ty base = init; for(; goal - base >= n; base = base + n) { n copies } remainder }
+            std::unique_ptr<ir::Expr> partial_unroll(ir::RangedFor *loop, size_t factor)
+            {
+                std::string base = std::format("{}{}", m_prefix, m_counter++);
+                auto ident = [&]()
+                { return std::make_unique<ir::Ident>(base); };
+                Stmts out{};
+                out.push_back(std::make_unique<ir::Variable>(loop->ty, base, loop->init->clone()));
+
+                Stmts unrolled{};
+                for (size_t k = 0; k < factor; ++k)
+                    unrolled.push_back(copy_body(loop, plus(ident(), k)));
+                auto left = std::make_unique<ir::Binary>(grouped(loop->goal), "-", ident());
+                auto main = std::make_unique<ir::For>(nullptr, std::make_unique<ir::Logical>(std::move(left), ">=", std::make_unique<ir::Integer>(factor)),
+                                                      std::make_unique<ir::SetOp>(ident(), plus(ident(), factor)), std::move(unrolled));
+                main->vectorize = loop->vectorize;
+                out.push_back(std::move(main));
+
+                auto trip = trip_count(loop);
+                if (trip && *trip % factor == 0)
+                    return std::make_unique<ir::Block>(std::move(out));
+                // with a constant trip count the leftover iterations are known, no need for a loop
+                if (trip)
+                {
+                    for (int k = 0; k < *trip % int(factor); ++k)
+                        out.push_back(copy_body(loop, plus(ident(), k)));
+                    return std::make_unique<ir::Block>(std::move(out));
+                }
+                Stmts rest{};
+                rest.push_back(copy_body(loop, ident()));
+                out.push_back(std::make_unique<ir::For>(nullptr, std::make_unique<ir::Logical>(ident(), "<", loop->goal->clone()),
+                                                        std::make_unique<ir::SetOp>(ident(), plus(ident(), 1)), std::move(rest)));
+                return std::make_unique<ir::Block>(std::move(out));
+            }
+
+            // an array that can't share memory with any other array: a local `[T; n]`
+            bool own_storage(const std::string &name)
+            {
+                return m_local_arrays.contains(name);
+            }
+
+            // iterations can run in any order: no calls or jumps, every array that gets written is only ever accessed at [i],
+            // and scalars from outside are only read. even `x = x + 3` carries x from one iteration to the next, and
+            // `omp simd` without a linear clause for it is allowed to get that wrong
+            bool independent_iterations(ir::RangedFor *loop, std::set<std::string> &arrays)
+            {
+                std::set<std::string> declared{};
+                std::set<std::string> written_arrays{};
+                bool ok = !body_has(loop->body, [&](ir::Expr *e)
+                                    {
+                    if (dynamic_cast<ir::FunctionCall *>(e) || dynamic_cast<ir::Pipe *>(e) || dynamic_cast<ir::Return *>(e) || dynamic_cast<ir::Goto *>(e) ||
+                        dynamic_cast<ir::Label *>(e) || dynamic_cast<ir::RangedFor *>(e) || dynamic_cast<ir::For *>(e) || dynamic_cast<ir::Switch *>(e) ||
+                        dynamic_cast<ir::GetAddress *>(e) || dynamic_cast<ir::PointerDeref *>(e))
+                        return true;
+                    if (auto var = dynamic_cast<ir::Variable *>(e))
+                        declared.insert(var->name);
+                    if (auto sub = dynamic_cast<ir::Subscript *>(e))
+                    {
+                        auto target = dynamic_cast<ir::Ident *>(sub->target.get());
+                        if (target == nullptr)
+                            return true;
+                        arrays.insert(target->_value);
+                    }
+                    auto set = dynamic_cast<ir::SetOp *>(e);
+                    if (set == nullptr)
+                        return false;
+                    if (auto sub = dynamic_cast<ir::Subscript *>(set->target.get()))
+                    {
+                        auto index = dynamic_cast<ir::Ident *>(sub->inner.get());
+                        if (index == nullptr || index->_value != loop->ident)
+                            return true;
+                        written_arrays.insert(root_ident(sub->target.get()));
+                        return false;
+                    }
+                    auto target = dynamic_cast<ir::Ident *>(set->target.get());
+                    return target == nullptr || !declared.contains(target->_value); });
+                if (!ok)
+                    return false;
+                // a written array read at some other index would carry a value from one iteration to the next
+                for (auto &name : written_arrays)
+                    if (body_has(loop->body, [&](ir::Expr *e)
+                                 {
+                        auto sub = dynamic_cast<ir::Subscript *>(e);
+                        if (sub == nullptr || root_ident(sub->target.get()) != name)
+                            return false;
+                        auto index = dynamic_cast<ir::Ident *>(sub->inner.get());
+                        return index == nullptr || index->_value != loop->ident; }))
+                        return false;
+                if (written_arrays.size() == 0)
+                    return false;
+                if (loop->assume_noalias)
+                    return true;
+                // two arrays we didn't allocate ourselves may be the same memory, unless the loop says otherwise
+                size_t foreign = 0;
+                for (auto &name : arrays)
+                    if (!own_storage(name))
+                        foreign += 1;
+                return foreign <= 1;
+            }
+
+            // `T* restrict __der_ra = a;` for every pointer the loop touches, so the C compiler can see they don't overlap.
+            // the alias is taken once before the loop, so a pointer the body declares or moves keeps its own name
+            Stmts restrict_aliases(ir::RangedFor *loop, const std::set<std::string> &arrays)
+            {
+                Stmts out{};
+                for (auto &name : arrays)
+                {
+                    if (own_storage(name) || !m_types.contains(name) || !m_types.at(name).ends_with("*"))
+                        continue;
+                    if (body_has(loop->body, [&](ir::Expr *e)
+                                 {
+                        auto set = dynamic_cast<ir::SetOp *>(e);
+                        auto target = set ? dynamic_cast<ir::Ident *>(set->target.get()) : nullptr;
+                        auto var = dynamic_cast<ir::Variable *>(e);
+                        return (target && target->_value == name) || (var && var->name == name); }))
+                        continue;
+                    std::string alias = std::format("__der_ra{}", m_counter++);
+                    out.push_back(std::make_unique<ir::Variable>(std::format("{} restrict", m_types.at(name)), alias, std::make_unique<ir::Ident>(name)));
+                    for (auto &s : loop->body)
+                        rename(s, name, alias);
+                }
+                return out;
+            }
+
+            void visit(std::unique_ptr<ir::Expr> &stmt)
+            {
+                for (auto nested : nested_blocks(stmt.get()))
+                    for (auto &s : *nested)
+                        visit(s);
+                auto loop = dynamic_cast<ir::RangedFor *>(stmt.get());
+                if (loop == nullptr)
+                    return;
+
+                Stmts aliases{};
+                std::set<std::string> arrays{};
+                if (independent_iterations(loop, arrays))
+                {
+                    loop->vectorize = true;
+                    if (loop->assume_noalias)
+                        aliases = restrict_aliases(loop, arrays);
+                }
+
+                bool can_copy = !StrengthReduction::written(loop->body, loop->ident) && !body_has(loop->body, [](ir::Expr *e)
+                                                                                                 { return dynamic_cast<ir::Label *>(e) != nullptr; });
+                auto trip = trip_count(loop);
+                std::unique_ptr<ir::Expr> replaced = nullptr;
+                if (can_copy && loop->unroll != 1 && trip && *trip > 0)
+                {
+                    size_t limit = loop->unroll > 1 ? loop->unroll : full_unroll_max_trip;
+                    if (size_t(*trip) <= limit && size_t(*trip) * loop->body.size() <= full_unroll_budget)
+                        replaced = full_unroll(loop, *trip);
+                }
+                if (!replaced && can_copy && stable_goal(loop))
+                {
+                    // loops that get vectorized are unrolled by the C compiler already
+                    if (loop->unroll > 1)
+                        replaced = partial_unroll(loop, loop->unroll);
+                    else if (loop->unroll == 0 && !loop->vectorize && trip && *trip >= int(long_trip))
+                        replaced = partial_unroll(loop, default_factor);
+                }
+                if (replaced)
+                {
+                    der_debug(std::format("unrolled loop over {}", loop->ident));
+                    stmt = std::move(replaced);
+                }
+                if (aliases.size() > 0)
+                {
+                    aliases.push_back(std::move(stmt));
+                    stmt = std::make_unique<ir::Block>(std::move(aliases));
+                }
+            }
+
+            void collect(ir::Function &fn)
+            {
+                m_locals.clear();
+                m_local_arrays.clear();
+                m_types.clear();
+                m_escaped.clear();
+                for (auto &a : fn.args)
+                {
+                    m_locals.insert(a.name);
+                    m_types[a.name] = a.ty;
+                }
+                std::vector<ir::Expr *> work{&fn};
+                while (work.size() > 0)
+                {
+                    ir::Expr *e = work.back();
+                    work.pop_back();
+                    if (auto var = dynamic_cast<ir::Variable *>(e))
+                    {
+                        m_locals.insert(var->name);
+                        m_types[var->name] = var->ty;
+                    }
+                    else if (auto arr = dynamic_cast<ir::ArrayVariable *>(e))
+                    {
+                        m_locals.insert(arr->name);
+                        m_local_arrays.insert(arr->name);
+                    }
+                    else if (auto addr = dynamic_cast<ir::GetAddress *>(e))
+                        m_escaped.insert(root_ident(addr->victim.get()));
+                    for (auto c : children(e))
+                        work.push_back(c->get());
+                }
+            }
+
+            void run(ir::Function &fn)
+            {
+                collect(fn);
+                for (auto &s : fn.body)
+                    visit(s);
+            }
+        };
+
+        // a perfect two level lkola nest over a rectangle is walked tile by tile, so the rows and columns it
+        // touches stay in cache while they're being used. only done when asked for with --tile or a cache size.
+        struct LoopTiling
+        {
+            size_t m_tile = 0;
+            std::set<std::string> m_locals{};
+            std::set<std::string> m_local_arrays{};
+            size_t m_counter = 0;
+
+            LoopTiling(size_t tile) : m_tile(tile) {}
+
+            struct Linear
+            {
+                long i = 0;
+                long j = 0;
+            };
+
+            // coefficients of i and j in an index, when they're plain numbers
+            static std::optional<Linear> linear(ir::Expr *e, const std::string &i, const std::string &j)
+            {
+                if (auto id = dynamic_cast<ir::Ident *>(e))
+                    return Linear{id->_value == i, id->_value == j};
+                if (dynamic_cast<ir::Integer *>(e))
+                    return Linear{};
+                if (auto g = dynamic_cast<ir::Group *>(e))
+                    return linear(g->inner.get(), i, j);
+                auto bin = dynamic_cast<ir::Binary *>(e);
+                if (bin == nullptr)
+                    return std::nullopt;
+                auto l = linear(bin->lfs.get(), i, j);
+                auto r = linear(bin->rfs.get(), i, j);
+                if (!l || !r)
+                    return std::nullopt;
+                if (bin->op == "+")
+                    return Linear{l->i + r->i, l->j + r->j};
+                if (bin->op == "-")
+                    return Linear{l->i - r->i, l->j - r->j};
+                if (bin->op == "*")
+                {
+                    auto lc = dynamic_cast<ir::Integer *>(bin->lfs.get());
+                    auto rc = dynamic_cast<ir::Integer *>(bin->rfs.get());
+                    if (rc)
+                        return Linear{l->i * rc->val, l->j * rc->val};
+                    if (lc)
+                        return Linear{r->i * lc->val, r->j * lc->val};
+                    if (l->i == 0 && l->j == 0 && r->i == 0 && r->j == 0)
+                        return Linear{};
+                }
+                return std::nullopt;
+            }
+
+            bool invariant(ir::Expr *e, ir::RangedFor *outer, ir::RangedFor *inner)
+            {
+                return is_pure(e) && !LoopUnroll::has(e, [&](ir::Expr *x)
+                                                      {
+                    auto id = dynamic_cast<ir::Ident *>(x);
+                    return id && (id->_value == outer->ident || id->_value == inner->ident || !m_locals.contains(id->_value) ||
+                                  StrengthReduction::written(inner->body, id->_value)); });
+            }
+
+            // an index built out of i, j, invariants, + - and multiplications by invariants
+            bool affine(ir::Expr *e, ir::RangedFor *outer, ir::RangedFor *inner)
+            {
+                if (auto id = dynamic_cast<ir::Ident *>(e))
+                    return id->_value == outer->ident || id->_value == inner->ident || invariant(e, outer, inner);
+                if (dynamic_cast<ir::Integer *>(e))
+                    return true;
+                if (auto g = dynamic_cast<ir::Group *>(e))
+                    return affine(g->inner.get(), outer, inner);
+                auto bin = dynamic_cast<ir::Binary *>(e);
+                if (bin == nullptr || !affine(bin->lfs.get(), outer, inner) || !affine(bin->rfs.get(), outer, inner))
+                    return false;
+                if (bin->op == "+" || bin->op == "-")
+                    return true;
+                return bin->op == "*" && (invariant(bin->lfs.get(), outer, inner) || invariant(bin->rfs.get(), outer, inner));
+            }
+
+            // `x * S + y` where y runs over 0...S, every (x, y) pair lands on its own element
+            static bool row_major(ir::Expr *e, ir::RangedFor *outer, ir::RangedFor *inner)
+            {
+                auto bin = dynamic_cast<ir::Binary *>(e);
+                if (bin == nullptr || bin->op != "+")
+                    return false;
+                auto mul = dynamic_cast<ir::Binary *>(bin->lfs.get());
+                auto minor = dynamic_cast<ir::Ident *>(bin->rfs.get());
+                if (mul == nullptr || mul->op != "*" || minor == nullptr)
+                    return false;
+                auto major = dynamic_cast<ir::Ident *>(mul->lfs.get());
+                ir::Expr *stride = mul->rfs.get();
+                if (major == nullptr)
+                    return false;
+                ir::RangedFor *minor_loop = minor->_value == inner->ident ? inner : minor->_value == outer->ident ? outer : nullptr;
+                ir::RangedFor *major_loop = major->_value == inner->ident ? inner : major->_value == outer->ident ? outer : nullptr;
+                if (minor_loop == nullptr || major_loop == nullptr || minor_loop == major_loop)
+                    return false;
+                auto start = dynamic_cast<ir::Integer *>(minor_loop->init.get());
+                return start && start->val == 0 && same_expr(minor_loop->goal.get(), stride);
+            }
+
+            // two different iterations writing (or writing and reading) the same element must stay in the same order
+            // when the iteration space is walked tile by tile. that holds when the element's index can't be hit again by
+            // moving forward in one dimension and backward in the other.
+            bool tiles_keep_order(ir::Expr *index, ir::RangedFor *outer, ir::RangedFor *inner)
+            {
+                if (row_major(index, outer, inner))
+                    return true;
+                auto lin = linear(index, outer->ident, inner->ident);
+                if (!lin || (lin->i == 0 && lin->j == 0))
+                    return false;
+                return lin->i == 0 || lin->j == 0 || (lin->i > 0) != (lin->j > 0);
+            }
+
+            bool tileable(ir::RangedFor *outer, ir::RangedFor *inner)
+            {
+                if (outer->ident == inner->ident || outer->ty != inner->ty)
+                    return false;
+                if (!invariant(inner->init.get(), outer, inner) || !invariant(inner->goal.get(), outer, inner) ||
+                    !is_pure(outer->init.get()) || !is_pure(outer->goal.get()) || !invariant(outer->goal.get(), outer, inner))
+                    return false;
+                if (StrengthReduction::written(inner->body, inner->ident) || StrengthReduction::written(inner->body, outer->ident))
+                    return false;
+                // a tile this size would just be the whole loop
+                auto outer_trip = LoopUnroll::trip_count(outer);
+                auto inner_trip = LoopUnroll::trip_count(inner);
+                if (outer_trip && inner_trip && size_t(*outer_trip) <= m_tile && size_t(*inner_trip) <= m_tile)
+                    return false;
+
+                std::set<std::string> declared{};
+                std::map<std::string, ir::Expr *> written{};
+                bool ok = !LoopUnroll::body_has(inner->body, [&](ir::Expr *e)
+                                                {
+                    if (dynamic_cast<ir::FunctionCall *>(e) || dynamic_cast<ir::Pipe *>(e) || dynamic_cast<ir::Return *>(e) || dynamic_cast<ir::Goto *>(e) ||
+                        dynamic_cast<ir::Label *>(e) || dynamic_cast<ir::PointerDeref *>(e) || dynamic_cast<ir::GetAddress *>(e) ||
+                        dynamic_cast<ir::RangedFor *>(e) || dynamic_cast<ir::For *>(e))
+                        return true;
+                    if (auto var = dynamic_cast<ir::Variable *>(e))
+                        declared.insert(var->name);
+                    if (auto sub = dynamic_cast<ir::Subscript *>(e))
+                        return !dynamic_cast<ir::Ident *>(sub->target.get()) || !affine(sub->inner.get(), outer, inner);
+                    auto set = dynamic_cast<ir::SetOp *>(e);
+                    if (set == nullptr)
+                        return false;
+                    if (auto sub = dynamic_cast<ir::Subscript *>(set->target.get()))
+                    {
+                        std::string array = root_ident(sub->target.get());
+                        if (written.contains(array) && !same_expr(written.at(array), sub->inner.get()))
+                            return true;
+                        written[array] = sub->inner.get();
+                        return false;
+                    }
+                    auto target = dynamic_cast<ir::Ident *>(set->target.get());
+                    return target == nullptr || !declared.contains(target->_value); });
+                if (!ok)
+                    return false;
+                for (auto &[array, index] : written)
+                {
+                    if (!tiles_keep_order(index, outer, inner))
+                        return false;
+                    // every other access to a written array has to be the very same element
+                    if (LoopUnroll::body_has(inner->body, [&](ir::Expr *e)
+                                             {
+                        auto sub = dynamic_cast<ir::Subscript *>(e);
+                        return sub && root_ident(sub->target.get()) == array && !same_expr(sub->inner.get(), index); }))
+                        return false;
+                }
+                // two pointers may be the same array, then reads of one are really accesses to the other. `lkola<simd>` promises they aren't.
+                if (written.size() == 0 || outer->assume_noalias || inner->assume_noalias)
+                    return true;
+                std::set<std::string> foreign{};
+                LoopUnroll::body_has(inner->body, [&](ir::Expr *e)
+                                     {
+                    if (auto sub = dynamic_cast<ir::Subscript *>(e); sub && !m_local_arrays.contains(root_ident(sub->target.get())))
+                        foreign.insert(root_ident(sub->target.get()));
+                    return false; });
+                return foreign.size() <= 1;
+            }
+
+            // `ty end = start + tile; goal < end ?? end = goal;`
+            void clamp(Stmts &out, const std::string &end, const std::string &ty, const std::string &start, const std::unique_ptr<ir::Expr> &goal)
+            {
+                out.push_back(std::make_unique<ir::Variable>(ty, end, std::make_unique<ir::Binary>(std::make_unique<ir::Ident>(start), "+", std::make_unique<ir::Integer>(m_tile))));
+                out.push_back(std::make_unique<ir::SmolIf>(std::make_unique<ir::Logical>(LoopUnroll::grouped(goal), "<", std::make_unique<ir::Ident>(end)),
+                                                           std::make_unique<ir::SetOp>(std::make_unique<ir::Ident>(end), goal->clone())));
+            }
+
+            std::unique_ptr<ir::Expr> tile(ir::RangedFor *outer, ir::RangedFor *inner)
+            {
+                size_t id = m_counter++;
+                std::string ti = std::format("__der_ti{}", id), tj = std::format("__der_tj{}", id);
+                std::string ei = std::format("__der_ei{}", id), ej = std::format("__der_ej{}", id);
+                auto step = [&](const std::string &name)
+                {
+                    return std::make_unique<ir::SetOp>(std::make_unique<ir::Ident>(name), std::make_unique<ir::Binary>(std::make_unique<ir::Ident>(name), "+", std::make_unique<ir::Integer>(m_tile)));
+                };
+
+                auto point_inner = std::make_unique<ir::RangedFor>(std::make_unique<ir::Ident>(tj), std::make_unique<ir::Ident>(ej), inner->ident, inner->body);
+                point_inner->unroll = inner->unroll;
+                point_inner->assume_noalias = inner->assume_noalias;
+                Stmts point_outer_body{};
+                point_outer_body.push_back(std::move(point_inner));
+                auto point_outer = std::make_unique<ir::RangedFor>(std::make_unique<ir::Ident>(ti), std::make_unique<ir::Ident>(ei), outer->ident, point_outer_body);
+
+                Stmts tile_body{};
+                clamp(tile_body, ei, outer->ty, ti, outer->goal);
+                clamp(tile_body, ej, inner->ty, tj, inner->goal);
+                tile_body.push_back(std::move(point_outer));
+
+                Stmts tile_rows{};
+                tile_rows.push_back(std::make_unique<ir::For>(std::make_unique<ir::Variable>(inner->ty, tj, inner->init->clone()),
+                                                              std::make_unique<ir::Logical>(std::make_unique<ir::Ident>(tj), "<", inner->goal->clone()), step(tj), std::move(tile_body)));
+                return std::make_unique<ir::For>(std::make_unique<ir::Variable>(outer->ty, ti, outer->init->clone()),
+                                                 std::make_unique<ir::Logical>(std::make_unique<ir::Ident>(ti), "<", outer->goal->clone()), step(ti), std::move(tile_rows));
+            }
+
+            void visit(Stmts &stmts)
+            {
+                for (auto &s : stmts)
+                {
+                    auto outer = dynamic_cast<ir::RangedFor *>(s.get());
+                    ir::RangedFor *inner = outer && outer->body.size() == 1 ? dynamic_cast<ir::RangedFor *>(outer->body.front().get()) : nullptr;
+                    if (inner && tileable(outer, inner))
+                    {
+                        der_debug(std::format("tiled loops over {} and {} by {}", outer->ident, inner->ident, m_tile));
+                        s = tile(outer, inner);
+                        continue;
+                    }
+                    for (auto nested : nested_blocks(s.get()))
+                        visit(*nested);
+                }
+            }
+
+            void run(ir::Function &fn)
+            {
+                if (m_tile < 2)
+                    return;
+                m_locals.clear();
+                m_local_arrays.clear();
+                for (auto &a : fn.args)
+                    m_locals.insert(a.name);
+                std::vector<ir::Expr *> work{&fn};
+                while (work.size() > 0)
+                {
+                    ir::Expr *e = work.back();
+                    work.pop_back();
+                    if (auto var = dynamic_cast<ir::Variable *>(e))
+                        m_locals.insert(var->name);
+                    else if (auto arr = dynamic_cast<ir::ArrayVariable *>(e))
+                    {
+                        m_locals.insert(arr->name);
+                        m_local_arrays.insert(arr->name);
+                    }
+                    for (auto c : children(e))
+                        work.push_back(c->get());
+                }
+                visit(fn.body);
+            }
+        };
+
+        // `s = s + a[i]`, `s = s * x`, `x < s ?? s = x` (min) and friends inside a lkola body chain every iteration
+        // to the previous one. the loop gets unrolled with one accumulator per copy, and they're combined once at the end.
+        struct ReductionLowering
+        {
+            enum class Kind
+            {
+                ADD,
+                MUL,
+                AND,
+                OR,
+                XOR,
+                MIN,
+                MAX
+            };
+
+            struct Reduction
+            {
+                std::string var;
+                Kind kind;
+                std::vector<ir::Expr *> stmts{};
+            };
+
+            LoopUnroll m_unroll{};
+            size_t m_counter = 0;
+
+            ReductionLowering()
+            {
+                m_unroll.m_prefix = "__der_rd";
+            }
+
+            static std::optional<Kind> binary_kind(const std::string &op)
+            {
+                if (op == "+")
+                    return Kind::ADD;
+                if (op == "*")
+                    return Kind::MUL;
+                if (op == "&")
+                    return Kind::AND;
+                if (op == "|")
+                    return Kind::OR;
+                if (op == "^")
+                    return Kind::XOR;
+                return std::nullopt;
+            }
+
+            // `s = s op x` or `s = x op s`
+            static std::optional<std::pair<std::string, Kind>> match_update(ir::Expr *e)
+            {
+                auto set = dynamic_cast<ir::SetOp *>(e);
+                auto target = set ? dynamic_cast<ir::Ident *>(set->target.get()) : nullptr;
+                auto bin = set ? dynamic_cast<ir::Binary *>(set->_value.get()) : nullptr;
+                if (target == nullptr || bin == nullptr)
+                    return std::nullopt;
+                auto kind = binary_kind(bin->op);
+                if (!kind)
+                    return std::nullopt;
+                auto l = dynamic_cast<ir::Ident *>(bin->lfs.get());
+                auto r = dynamic_cast<ir::Ident *>(bin->rfs.get());
+                if (l && l->_value == target->_value && !mentions(bin->rfs.get(), target->_value))
+                    return std::pair{target->_value, *kind};
+                if (r && r->_value == target->_value && !mentions(bin->lfs.get(), target->_value))
+                    return std::pair{target->_value, *kind};
+                return std::nullopt;
+            }
+
+            // `x < s ?? s = x` / `ila s < x { s = x; }`
+            static std::optional<std::pair<std::string, Kind>> match_select(ir::Expr *e)
+            {
+                ir::Expr *cond = nullptr;
+                ir::Expr *update = nullptr;
+                if (auto smol = dynamic_cast<ir::SmolIf *>(e))
+                {
+                    cond = smol->lfs.get();
+                    update = smol->rfs.get();
+                }
+                else if (auto ifs = dynamic_cast<ir::If *>(e); ifs && ifs->body.size() == 1 && ifs->else_block.size() == 0)
+                {
+                    cond = ifs->cond.get();
+                    update = ifs->body.front().get();
+                }
+                auto cmp = dynamic_cast<ir::Logical *>(cond);
+                auto set = dynamic_cast<ir::SetOp *>(update);
+                auto target = set ? dynamic_cast<ir::Ident *>(set->target.get()) : nullptr;
+                if (cmp == nullptr || target == nullptr || mentions(set->_value.get(), target->_value) || !is_pure(set->_value.get()))
+                    return std::nullopt;
+                bool less = cmp->op == "<" || cmp->op == "<=";
+                if (!less && cmp->op != ">" && cmp->op != ">=")
+                    return std::nullopt;
+                auto l = dynamic_cast<ir::Ident *>(cmp->lfs.get());
+                auto r = dynamic_cast<ir::Ident *>(cmp->rfs.get());
+                // `x < s` picks the smaller one, `s < x` the bigger one
+                if (r && r->_value == target->_value && same_expr(cmp->lfs.get(), set->_value.get()))
+                    return std::pair{target->_value, less ? Kind::MIN : Kind::MAX};
+                if (l && l->_value == target->_value && same_expr(cmp->rfs.get(), set->_value.get()))
+                    return std::pair{target->_value, less ? Kind::MAX : Kind::MIN};
+                return std::nullopt;
+            }
+
+            static void find(ir::Expr *e, std::map<std::string, Reduction> &found, std::set<std::string> &broken)
+            {
+                auto m = match_select(e);
+                if (!m)
+                    m = match_update(e);
+                if (m)
+                {
+                    auto &[var, kind] = *m;
+                    if (found.contains(var) && found.at(var).kind != kind)
+                        broken.insert(var);
+                    found.try_emplace(var, Reduction{var, kind}).first->second.stmts.push_back(e);
+                    return;
+                }
+                for (auto c : children(e))
+                    find(c->get(), found, broken);
+            }
+
+            // the variable shows up anywhere but its own update statements
+            static bool used_elsewhere(ir::Expr *e, const Reduction &r)
+            {
+                for (auto s : r.stmts)
+                    if (s == e)
+                        return false;
+                if (auto id = dynamic_cast<ir::Ident *>(e))
+                    return id->_value == r.var;
+                for (auto c : children(e))
+                    if (used_elsewhere(c->get(), r))
+                        return true;
+                return false;
+            }
+
+            static std::unique_ptr<ir::Expr> identity(Kind kind, const std::string &var)
+            {
+                switch (kind)
+                {
+                case Kind::ADD:
+                case Kind::XOR:
+                    return std::make_unique<ir::Integer>(0);
+                case Kind::MUL:
+                    return std::make_unique<ir::Integer>(1);
+                default:
+                    // min, max, & and | don't care about seeing the same value twice
+                    return std::make_unique<ir::Ident>(var);
+                }
+            }
+
+            static const char *op_of(Kind kind)
+            {
+                switch (kind)
+                {
+                case Kind::ADD:
+                    return "+";
+                case Kind::MUL:
+                    return "*";
+                case Kind::AND:
+                    return "&";
+                case Kind::OR:
+                    return "|";
+                default:
+                    return "^";
+                }
+            }
+
+            void lower(std::unique_ptr<ir::Expr> &stmt, std::vector<Reduction> &reductions, size_t lanes)
+            {
+                auto loop = dynamic_cast<ir::RangedFor *>(stmt.get());
+                std::vector<std::vector<std::string>> accs{};
+                Stmts out{};
+                for (auto &r : reductions)
+                {
+                    // partial sums and products wrap instead of overflowing, the end result is the same modulo 2^n
+                    bool wraps = r.kind == Kind::ADD || r.kind == Kind::MUL;
+                    std::string ty = wraps ? "unsigned" : m_unroll.m_types.at(r.var);
+                    accs.emplace_back();
+                    for (size_t k = 0; k < lanes; ++k)
+                    {
+                        std::string name = std::format("__der_acc{}_{}", m_counter, k);
+                        accs.back().push_back(name);
+                        out.push_back(std::make_unique<ir::Variable>(ty, name, k == 0 ? std::make_unique<ir::Ident>(r.var) : identity(r.kind, r.var)));
+                    }
+                    m_counter += 1;
+                }
+
+                auto unrolled = m_unroll.partial_unroll(loop, lanes);
+                auto block = dynamic_cast<ir::Block *>(unrolled.get());
+                // [base, unrolled loop, remainder...], copy k of the unrolled body gets accumulator k, the remainder the first one
+                for (size_t i = 1; i < block->body.size(); ++i)
+                {
+                    auto main = dynamic_cast<ir::For *>(block->body.at(i).get());
+                    for (size_t r = 0; r < reductions.size(); ++r)
+                    {
+                        if (i == 1)
+                            for (size_t k = 0; k < lanes; ++k)
+                                rename(main->body.at(k), reductions.at(r).var, accs.at(r).at(k));
+                        else
+                            rename(block->body.at(i), reductions.at(r).var, accs.at(r).at(0));
+                    }
+                }
+                out.push_back(std::move(unrolled));
+
+                for (size_t r = 0; r < reductions.size(); ++r)
+                {
+                    auto &red = reductions.at(r);
+                    auto &lane = accs.at(r);
+                    if (red.kind == Kind::MIN || red.kind == Kind::MAX)
+                    {
+                        out.push_back(std::make_unique<ir::SetOp>(std::make_unique<ir::Ident>(red.var), std::make_unique<ir::Ident>(lane.at(0))));
+                        for (size_t k = 1; k < lanes; ++k)
+                            out.push_back(std::make_unique<ir::SmolIf>(
+                                std::make_unique<ir::Logical>(std::make_unique<ir::Ident>(lane.at(k)), red.kind == Kind::MIN ? "<" : ">", std::make_unique<ir::Ident>(red.var)),
+                                std::make_unique<ir::SetOp>(std::make_unique<ir::Ident>(red.var), std::make_unique<ir::Ident>(lane.at(k)))));
+                        continue;
+                    }
+                    std::unique_ptr<ir::Expr> total = std::make_unique<ir::Ident>(lane.at(0));
+                    for (size_t k = 1; k < lanes; ++k)
+                        total = std::make_unique<ir::Binary>(std::move(total), op_of(red.kind), std::make_unique<ir::Ident>(lane.at(k)));
+                    if (red.kind == Kind::ADD || red.kind == Kind::MUL)
+                        total = std::make_unique<ir::Cast>(m_unroll.m_types.at(red.var), std::make_unique<ir::Group>(std::move(total)));
+                    out.push_back(std::make_unique<ir::SetOp>(std::make_unique<ir::Ident>(red.var), std::move(total)));
+                }
+                stmt = std::make_unique<ir::Block>(std::move(out));
+            }
+
+            void visit(std::unique_ptr<ir::Expr> &stmt)
+            {
+                for (auto nested : nested_blocks(stmt.get()))
+                    for (auto &s : *nested)
+                        visit(s);
+                auto loop = dynamic_cast<ir::RangedFor *>(stmt.get());
+                if (loop == nullptr || loop->unroll == 1)
+                    return;
+                if (auto trip = LoopUnroll::trip_count(loop); trip && *trip <= int(LoopUnroll::full_unroll_max_trip))
+                    return;
+                if (StrengthReduction::written(loop->body, loop->ident) || !m_unroll.stable_goal(loop))
+                    return;
+                // the accumulators only get folded back into the variable after the loop
+                if (LoopUnroll::body_has(loop->body, [](ir::Expr *e)
+                                         { return dynamic_cast<ir::Return *>(e) || dynamic_cast<ir::Goto *>(e) || dynamic_cast<ir::Label *>(e) ||
+                                                  dynamic_cast<ir::FunctionCall *>(e) || dynamic_cast<ir::Pipe *>(e); }))
+                    return;
+
+                std::map<std::string, Reduction> found{};
+                std::set<std::string> broken{};
+                for (auto &s : loop->body)
+                    find(s.get(), found, broken);
+                std::vector<Reduction> reductions{};
+                for (auto &[var, r] : found)
+                {
+                    if (broken.contains(var) || var == loop->ident || m_unroll.m_escaped.contains(var) || !m_unroll.m_types.contains(var) || m_unroll.m_types.at(var) != "int")
+                        continue;
+                    bool clean = true;
+                    for (auto &s : loop->body)
+                        clean = clean && !used_elsewhere(s.get(), r);
+                    if (clean)
+                        reductions.push_back(r);
+                }
+                if (reductions.size() == 0)
+                    return;
+                der_debug(std::format("lowering {} reductions in loop over {}", reductions.size(), loop->ident));
+                lower(stmt, reductions, loop->unroll > 1 ? loop->unroll : LoopUnroll::default_factor);
+            }
+
+            void run(ir::Function &fn)
+            {
+                m_unroll.collect(fn);
+                for (auto &s : fn.body)
+                    visit(s);
+            }
+        };
+
+        // lkola mota7arik: the body moves into its own function over a [lo, hi) slice, what it reads from the
+        // enclosing function travels in a struct, and the loop becomes a __der_parallel_for call into the runtime.
+        // reductions get a private copy per slice that is folded into the real variable under the runtime's lock.
+        // runs before everything else so the other passes see the outlined loops as plain ones.
+        struct ParallelLowering
+        {
+            // the params, locals and loop counters visible at a statement with their C types, arrays decay to pointers.
+            // the same name can be declared again in another block with another type, so it's built per block
+            using Scope = std::map<std::string, std::string>;
+
+            size_t m_counter = 0;
+            std::string m_fn{};
+            Stmts m_outlined{};
+
+            static void declare(ir::Expr *e, Scope &scope)
+            {
+                if (auto var = dynamic_cast<ir::Variable *>(e))
+                    scope[var->name] = var->ty;
+                else if (auto arr = dynamic_cast<ir::ArrayVariable *>(e))
+                    scope[arr->name] = arr->ty + "*";
+            }
+
+            static void declared(ir::Expr *e, std::set<std::string> &out)
+            {
+                if (auto var = dynamic_cast<ir::Variable *>(e))
+                    out.insert(var->name);
+                else if (auto arr = dynamic_cast<ir::ArrayVariable *>(e))
+                    out.insert(arr->name);
+                else if (auto loop = dynamic_cast<ir::RangedFor *>(e))
+                    out.insert(loop->ident);
+                for (auto c : children(e))
+                    declared(c->get(), out);
+            }
+
+            static std::unique_ptr<ir::Expr> field(const std::string &name)
+            {
+                return std::make_unique<ir::Dot>(std::make_unique<ir::Ident>("__der_ctx"), std::make_unique<ir::Ident>(name));
+            }
+
+            void lower(std::unique_ptr<ir::Expr> &stmt, ir::RangedFor *loop, const Scope &scope)
+            {
+                size_t id = m_counter++;
+                // named after the function so they don't change when other functions do
+                std::string ctx_name = std::format("__der_par_ctx_{}_{}", m_fn, id);
+                std::string ctx_ty = "struct " + ctx_name;
+                std::string body_fn = std::format("__der_par_body_{}_{}", m_fn, id);
+                std::string ctx = std::format("__der_pc{}", id);
+                der_debug(std::format("outlining lkola mota7arik over {} into {}", loop->ident, body_fn));
+
+                std::set<std::string> inner{loop->ident};
+                for (auto &s : loop->body)
+                    declared(s.get(), inner);
+                std::map<std::string, std::string> reductions{};
+                for (auto &[op, var] : loop->reductions)
+                    reductions[var] = op;
+
+                std::vector<ir::StructMember> members{};
+                std::vector<ir::StructInitializer> inits{};
+                Stmts body{};
+                body.push_back(std::make_unique<ir::Variable>(ctx_ty, "__der_ctx", std::make_unique<ir::PointerDeref>(std::make_unique<ir::Cast>(ctx_ty + "*", std::make_unique<ir::Ident>("__der_raw")))));
+                for (auto &[name, ty] : scope)
+                {
+                    if (inner.contains(name))
+                        continue;
+                    if (auto red = reductions.find(name); red != reductions.end())
+                    {
+                        // the slice works on its own copy starting from the identity, min and max start from the value
+                        // before the loop, copied in since other slices may be folding into the variable already
+                        members.push_back(ir::StructMember{name, ty + "*"});
+                        inits.push_back(ir::StructInitializer{name, std::make_unique<ir::GetAddress>(std::make_unique<ir::Ident>(name))});
+                        std::unique_ptr<ir::Expr> start{};
+                        if (red->second == "+")
+                            start = std::make_unique<ir::Integer>(0);
+                        else if (red->second == "*")
+                            start = std::make_unique<ir::Integer>(1);
+                        else
+                        {
+                            std::string before = std::format("__der_{}_0", name);
+                            members.push_back(ir::StructMember{before, ty});
+                            inits.push_back(ir::StructInitializer{before, std::make_unique<ir::Ident>(name)});
+                            start = field(before);
+                        }
+                        body.push_back(std::make_unique<ir::Variable>(ty, name, std::move(start)));
+                        continue;
+                    }
+                    bool used = false;
+                    for (auto &s : loop->body)
+                        used = used || mentions(s.get(), name);
+                    if (!used)
+                        continue;
+                    members.push_back(ir::StructMember{name, ty});
+                    inits.push_back(ir::StructInitializer{name, std::make_unique<ir::Ident>(name)});
+                    body.push_back(std::make_unique<ir::Variable>(ty, name, field(name)));
+                }
+                // C doesn't allow an empty struct
+                if (members.size() == 0)
+                {
+                    members.push_back(ir::StructMember{"__der_unused", "char"});
+                    inits.push_back(ir::StructInitializer{"__der_unused", std::make_unique<ir::Integer>(0)});
+                }
+
+                auto slice = std::make_unique<ir::RangedFor>(*loop);
+                slice->parallel = false;
+                slice->reductions.clear();
+                slice->init = std::make_unique<ir::Ident>("__der_lo");
+                slice->goal = std::make_unique<ir::Ident>("__der_hi");
+                body.push_back(std::move(slice));
+                if (reductions.size() > 0)
+                {
+                    body.push_back(std::make_unique<ir::FunctionCall>(std::make_unique<ir::Ident>("__der_par_lock"), Stmts{}));
+                    for (auto &[var, op] : reductions)
+                    {
+                        auto shared = std::make_unique<ir::PointerDeref>(field(var));
+                        if (op == "+" || op == "*")
+                        {
+                            body.push_back(std::make_unique<ir::SetOp>(shared->clone(), std::make_unique<ir::Binary>(shared->clone(), op, std::make_unique<ir::Ident>(var))));
+                            continue;
+                        }
+                        Stmts then{};
+                        then.push_back(std::make_unique<ir::SetOp>(shared->clone(), std::make_unique<ir::Ident>(var)));
+                        auto cond = std::make_unique<ir::Logical>(std::make_unique<ir::Ident>(var), op == "min" ? "<" : ">", std::move(shared));
+                        body.push_back(std::make_unique<ir::If>(std::move(cond), std::move(then), Stmts{}));
+                    }
+                    body.push_back(std::make_unique<ir::FunctionCall>(std::make_unique<ir::Ident>("__der_par_unlock"), Stmts{}));
+                }
+
+                m_outlined.push_back(std::make_unique<ir::Struct>(ctx_name, members));
+                // static like the runtime, so two modules that both have a lkola mota7arik still link together
+                m_outlined.push_back(std::make_unique<ir::Function>("static void", body_fn, std::vector<ir::CArgTy>{{"void*", "__der_raw"}, {"long", "__der_lo"}, {"long", "__der_hi"}}, body));
+
+                Stmts call{};
+                call.push_back(std::make_unique<ir::Variable>(ctx_ty, ctx, std::make_unique<ir::StructInstance>(inits)));
+                Stmts args{};
+                args.push_back(std::move(loop->init));
+                args.push_back(std::move(loop->goal));
+                args.push_back(std::make_unique<ir::Ident>(body_fn));
+                args.push_back(std::make_unique<ir::GetAddress>(std::make_unique<ir::Ident>(ctx)));
+                call.push_back(std::make_unique<ir::FunctionCall>(std::make_unique<ir::Ident>("__der_parallel_for"), args));
+                stmt = std::make_unique<ir::Block>(std::move(call));
+            }
+
+            // innermost first, so an outer body already holds the call of an inner one when it gets outlined
+            void visit(std::unique_ptr<ir::Expr> &stmt, const Scope &scope)
+            {
+                Scope inside = scope;
+                auto loop = dynamic_cast<ir::RangedFor *>(stmt.get());
+                if (loop)
+                    inside[loop->ident] = loop->ty;
+                else if (auto f = dynamic_cast<ir::For *>(stmt.get()); f && f->init)
+                    declare(f->init.get(), inside);
+                for (auto block : nested_blocks(stmt.get()))
+                    visit(*block, inside);
+                if (loop && loop->parallel)
+                    lower(stmt, loop, scope);
+            }
+
+            // a declaration is in scope for the statements after it in its block
+            void visit(Stmts &block, Scope scope)
+            {
+                for (auto &s : block)
+                {
+                    visit(s, scope);
+                    declare(s.get(), scope);
+                }
+            }
+
+            // returns the structs and functions that have to be emitted before fn
+            Stmts run(ir::Function &fn)
+            {
+                m_fn = fn.name;
+                m_counter = 0;
+                Scope scope{};
+                for (auto &a : fn.args)
+                    scope[a.name] = a.ty;
+                visit(fn.body, scope);
+                Stmts out = std::move(m_outlined);
+                m_outlined.clear();
+                return out;
+            }
+        };
+
+        struct Options
+        {
+            // tile size for nested loops, 0 means derive it from the cache size, if any
+            size_t tile = 0;
+            size_t cache_kb = 0;
+            // false for `derijac run` and `derijac native`: skip the passes that only help a C compiler (tiling, extra
+            // accumulators, shifts, unrolling and pragmas) and leave lkola mota7arik alone, those run it on one thread
+            bool c_backend = true;
+            // threads the functions are optimized on
+            size_t jobs = 1;
+
+            // three square int tiles (two read, one written) should fit in the cache together
+            size_t tile_size() const
+            {
+                if (tile > 0 || cache_kb == 0)
+                    return tile;
+                size_t side = size_t(std::sqrt(double(cache_kb * 1024) / (3 * sizeof(int))));
+                return side >= 16 ? side / 8 * 8 : side;
+            }
+        };
+
+        struct Optimizer
+        {
+            Stmts &m_module;
+            std::set<std::string> &m_includes;
+            Options m_options;
+
+            Optimizer(Stmts &module, std::set<std::string> &includes, const Options &options = {}) : m_module(module), m_includes(includes), m_options(options) {}
+
+            void run()
+            {
+                ParallelLowering parallel{};
+                for (size_t i = 0; i < m_module.size() && m_options.c_backend; ++i)
+                {
+                    if (auto fn = dynamic_cast<ir::Function *>(m_module.at(i).get()))
+                    {
+                        auto outlined = parallel.run(*fn);
+                        size_t n = outlined.size();
+                        m_module.insert(m_module.begin() + i, std::make_move_iterator(outlined.begin()), std::make_move_iterator(outlined.end()));
+                        i += n;
+                    }
+                }
+                std::vector<ir::Function *> fns{};
+                for (auto &e : m_module)
+                    if (auto fn = dynamic_cast<ir::Function *>(e.get()))
+                        fns.push_back(fn);
+                // the passes only ever touch the function they're given, so functions are spread over threads. the
+                // headers they ask for are collected per thread and merged after
+                size_t workers = std::max<size_t>(1, std::min(m_options.jobs, fns.size()));
+                std::vector<std::set<std::string>> includes(workers);
+                std::atomic<size_t> next = 0;
+                auto work = [&](size_t w)
+                {
+                    for (size_t i; (i = next++) < fns.size();)
+                    {
+                        ir::Function *fn = fns.at(i);
+                        TailCallElim{}.run(*fn);
+                        SwitchLowering(m_module).run(*fn);
+                        LoopFusion{}.run(*fn);
+                        if (m_options.c_backend)
+                        {
+                            LoopTiling(m_options.tile_size()).run(*fn);
+                            ReductionLowering{}.run(*fn);
+                            StrengthReduction(includes.at(w)).run(*fn);
+                            LoopUnroll{}.run(*fn);
+                        }
+                        DeadStoreElim{}.run(*fn);
+                    }
+                };
+                std::vector<std::thread> threads{};
+                for (size_t w = 1; w < workers; ++w)
+                    threads.emplace_back(work, w);
+                work(0);
+                for (auto &t : threads)
+                    t.join();
+                for (auto &inc : includes)
+                    m_includes.insert(inc.begin(), inc.end());
+            }
+        };
+    }
+}
+#endif
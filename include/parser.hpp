@@ -1,6 +1,9 @@
 #ifndef DER_PARSER
 #define DER_PARSER
+#include <charconv>
+#include <climits>
 #include <optional>
+#include <format>
 #include "ast.hpp"
 #include "lexer.hpp"
 #include "source_loc.hpp"
@@ -10,12 +13,7 @@ namespace der
 {
     namespace parser
     {
-        struct SyntaxErr
-        {
-            std::string msg = {};
-            SourceLoc loc = {};
-            SyntaxErr(const std::string &m, const SourceLoc &loc) : msg(m), loc(loc) {}
-        };
+        using lexer::SyntaxErr;
 
         inline unsigned short get_precedence(const lexer::TOKENS tok)
         {
@@ -23,7 +21,6 @@ namespace der
             switch (tok)
             {
                 case TOKENS::TOKEN_OPEN_PAREN:
-                case TOKENS::TOKEN_OPEN_BRACKET:
                     return 1;
             case TOKENS::TOKEN_OR:
                 return 11;
@@ -43,10 +40,12 @@ namespace der
                 return 19;
             case TOKENS::TOKEN_DIVIDE:
             case TOKENS::TOKEN_MULTIPLY:
+            case TOKENS::TOKEN_MODULO:
                 return 20;
             case TOKENS::TOKEN_PIPE:
                 return 50;
             case TOKENS::TOKEN_DOT:
+            case TOKENS::TOKEN_OPEN_BRACKET:
                 return 60;
             default:
                 return 5;
@@ -66,20 +65,76 @@ namespace der
                 return *this;
             }
         };
+        // `jbed a.b;`, the module in a/b.der next to the file importing it
+        struct Import
+        {
+            std::string name;
+            SourceLoc loc;
+        };
+
         struct Parser
         {
             std::vector<lexer::TokenHandle> m_input;
             std::vector<AstInfo> m_output;
+            std::vector<Import> m_imports{};
+            // the token each top level expression starts at, --watch tells what changed with them
+            std::vector<size_t> m_decl_starts{};
             size_t m_index = 0;
             Parser(const std::vector<lexer::TokenHandle> &inp) : m_input(inp), m_output({}) {}
 
+            // the number an integer token stands for, a syntax error when it's bigger than max
+            static unsigned long long m_integer(const lexer::TokenHandle &tok, unsigned long long max)
+            {
+                unsigned long long v = 0;
+                const char *end = tok.raw_value.data() + tok.raw_value.size();
+                auto [at, ec] = std::from_chars(tok.raw_value.data(), end, v);
+                if (ec != std::errc{} || at != end || v > max)
+                    throw SyntaxErr(std::format("{} is too big, the most it can be here is {}.", tok.raw_value, max), tok.source_loc);
+                return v;
+            }
+
+            // the jbed lines, they come before anything else in the file so the imports are known without parsing the rest
+            void parse_imports()
+            {
+                while (m_index < m_input.size() && m_current().is(lexer::TOKENS::TOKEN_IMPORT))
+                {
+                    SourceLoc loc = m_current().source_loc;
+                    m_advance();
+                    // the file may end in the middle of it, there's no EOF token to point at
+                    auto expect = [&](lexer::TOKENS tok, const std::string &msg)
+                    {
+                        if (m_index >= m_input.size())
+                            throw SyntaxErr(msg, m_input.back().source_loc);
+                        m_expect_or(tok, m_current(), msg);
+                    };
+                    std::string name{};
+                    while (true)
+                    {
+                        expect(lexer::TOKENS::TOKEN_IDENTIFIER, "expected a module name after 'jbed'.");
+                        name += m_current().raw_value;
+                        m_advance();
+                        if (m_index >= m_input.size() || !m_current().is(lexer::TOKENS::TOKEN_DOT))
+                            break;
+                        name += '.';
+                        m_advance();
+                    }
+                    expect(lexer::TOKENS::TOKEN_SEMICOLON, "Expected ';' after jbed.");
+                    m_advance();
+                    m_imports.push_back({name, loc});
+                }
+            }
+
             void parse()
             {
                 der_debug("called");
                 std::vector<AstInfo> parsed = {};
+                parse_imports();
                 while (m_index < m_input.size())
                 {
                     der_debug("inner loop called");
+                    if (m_current().is(lexer::TOKENS::TOKEN_IMPORT))
+                        throw SyntaxErr("jbed has to come before everything else in the file.", m_current().source_loc);
+                    m_decl_starts.push_back(m_index);
                     auto expr = parse_expr(0);
                     der_debug_e(m_current().raw_value);
                     m_expect_or(lexer::TOKENS::TOKEN_SEMICOLON, m_current(), "Expected ';' after expression.");
@@ -197,6 +252,62 @@ namespace der
 
             AstInfo parse_for_loop()
             {
+                // `lkola<4, simd> i: ...`, an unroll factor and/or a promise that the arrays in the body don't overlap
+                size_t unroll = 0;
+                bool simd = false;
+                if (m_current().is(lexer::TOKENS::TOKEN_LESS_THAN))
+                {
+                    m_advance();
+                    while (m_current().is_not(lexer::TOKENS::TOKEN_GREATER_THAN))
+                    {
+                        if (m_current().is(lexer::TOKENS::TOKEN_INTEGER))
+                            unroll = m_integer(m_current(), UINT_MAX);
+                        else if (m_current().is(lexer::TOKENS::TOKEN_IDENTIFIER) && m_current().raw_value == "simd")
+                            simd = true;
+                        else
+                            throw SyntaxErr("Expected an unroll factor or 'simd' in lkola<...>.", m_current().source_loc);
+                        m_advance();
+                        if (m_current().is(lexer::TOKENS::TOKEN_COMMA))
+                            m_advance();
+                        else
+                            m_expect_or(lexer::TOKENS::TOKEN_GREATER_THAN, m_current(), "Expected '>' after lkola hints.");
+                    }
+                    m_advance();
+                }
+                // `lkola mota7arik(+ s, min lo) i: ...`, iterations are spread over threads,
+                // the listed variables are the only shared ones the body is allowed to write
+                bool parallel = false;
+                std::vector<std::pair<std::string, std::string>> reductions{};
+                if (m_current().is(lexer::TOKENS::KEYWORD_MOTA7ARIK))
+                {
+                    parallel = true;
+                    m_advance();
+                    if (m_current().is(lexer::TOKENS::TOKEN_OPEN_PAREN))
+                    {
+                        m_advance();
+                        while (m_current().is_not(lexer::TOKENS::TOKEN_CLOSE_PAREN))
+                        {
+                            std::string op{};
+                            if (m_current().is(lexer::TOKENS::TOKEN_PLUS))
+                                op = "+";
+                            else if (m_current().is(lexer::TOKENS::TOKEN_MULTIPLY))
+                                op = "*";
+                            else if (m_current().is(lexer::TOKENS::TOKEN_IDENTIFIER) && (m_current().raw_value == "min" || m_current().raw_value == "max"))
+                                op = m_current().raw_value;
+                            else
+                                throw SyntaxErr("Expected a reduction operator ('+', '*', 'min' or 'max') in mota7arik(...).", m_current().source_loc);
+                            m_advance();
+                            m_expect_or(lexer::TOKENS::TOKEN_IDENTIFIER, m_current(), "Expected a variable after the reduction operator.");
+                            reductions.push_back({op, m_current().raw_value});
+                            m_advance();
+                            if (m_current().is(lexer::TOKENS::TOKEN_COMMA))
+                                m_advance();
+                            else
+                                m_expect_or(lexer::TOKENS::TOKEN_CLOSE_PAREN, m_current(), "Expected ')' after reductions.");
+                        }
+                        m_advance();
+                    }
+                }
                 m_expect_or(lexer::TOKENS::TOKEN_IDENTIFIER, m_current(), "Expected identifier after for loop");
                 std::string ident = m_current().raw_value;
                 m_advance();
@@ -213,7 +324,12 @@ namespace der
                 der_debug_e(m_current().raw_value);
                 m_expect_or(lexer::TOKENS::TOKEN_CLOSE_BRACE, m_current(), "Expected '}' after for loop statement.");
                 m_advance();
-                return AstInfo(std::make_unique<ast::RangedFor<AstInfo>>(ident, _begin.expr->clone(), _end.expr->clone(), body), m_current().source_loc);
+                auto loop = std::make_unique<ast::RangedFor<AstInfo>>(ident, _begin.expr->clone(), _end.expr->clone(), body);
+                loop->unroll = unroll;
+                loop->simd = simd;
+                loop->parallel = parallel;
+                loop->reductions = reductions;
+                return AstInfo(std::move(loop), m_current().source_loc);
             }
             std::vector<ast::ptr<ast::Expr>> m_parse_function_args()
             {
@@ -344,7 +460,7 @@ namespace der
                     m_expect_or(TOKENS::TOKEN_SEMICOLON, m_current(), "Expected ';' semicolon after array type");
                     m_advance();
                     m_expect_or(TOKENS::TOKEN_INTEGER, m_current(), "Expected integer after ; in array type.");
-                    size_t size = std::stoul(m_current().raw_value);
+                    size_t size = m_integer(m_current(), INT_MAX);
                     m_advance();
                     m_expect_or(TOKENS::TOKEN_CLOSE_BRACKET, m_current(), "Expected ']' after array type.");
                     return std::make_unique<types::Array>(std::move(ty), size);
@@ -384,6 +500,49 @@ namespace der
                 }
                 return AstInfo(ast::ptr<ast::Expr>(new ast::IfStmt(std::move(head.expr), std::move(body), std::move(else_stmt))), m_current().source_loc);
             }
+            AstInfo parse_match()
+            {
+                /*
+                chouf expr {
+                    pattern => expr,
+                    pattern => {
+                        expr...;
+                    },
+                    _ => expr
+                }
+                */
+                auto scrutinee = parse_expr(0);
+                m_expect_or(lexer::TOKENS::TOKEN_OPEN_BRACE, m_current(), "expected '{' after chouf head.");
+                m_advance();
+                std::vector<ast::MatchArm<AstInfo>> arms{};
+                while (m_current().is_not(lexer::TOKENS::TOKEN_CLOSE_BRACE))
+                {
+                    ast::ptr<ast::Expr> pattern = nullptr;
+                    if (m_current().is(lexer::TOKENS::TOKEN_IDENTIFIER) && m_current().raw_value == "_")
+                        m_advance();
+                    else
+                        pattern = parse_expr(0).expr;
+                    m_expect_or(lexer::TOKENS::TOKEN_FAT_ARROW, m_current(), "expected '=>' after chouf pattern.");
+                    m_advance();
+                    std::vector<AstInfo> body{};
+                    if (m_current().is(lexer::TOKENS::TOKEN_OPEN_BRACE))
+                    {
+                        body = parse_mult_stmt();
+                        m_expect_or(lexer::TOKENS::TOKEN_CLOSE_BRACE, m_current(), "expected '}' after chouf arm.");
+                        m_advance();
+                    }
+                    else
+                    {
+                        body.push_back(parse_expr(0));
+                    }
+                    arms.emplace_back(std::move(pattern), std::move(body));
+                    if (!m_match(lexer::TOKENS::TOKEN_COMMA))
+                        break;
+                }
+                m_expect_or(lexer::TOKENS::TOKEN_CLOSE_BRACE, m_current(), "expected '}' after chouf arms.");
+                m_advance();
+                return AstInfo(std::make_unique<ast::Match<AstInfo>>(std::move(scrutinee.expr), std::move(arms)), scrutinee.loc);
+            }
             AstInfo parse_primary()
             {
                 der_debug("start");
@@ -398,7 +557,7 @@ namespace der
                 case TOKENS::TOKEN_INTEGER:
                     der_debug("recognized integer");
                     m_advance();
-                    return AstInfo(ast::ptr<ast::Expr>(new ast::Integer(th.raw_value)), th.source_loc);
+                    return AstInfo(ast::ptr<ast::Expr>(new ast::Integer(static_cast<long long>(m_integer(th, INT_MAX)))), th.source_loc);
                 case TOKENS::TOKEN_BOOL:
                     der_debug("recognized boolean");
                     m_advance();
@@ -485,6 +644,12 @@ namespace der
                     m_advance();
                     return parse_if_stmt();
                 }
+                case TOKENS::KEYWORD_CHOUF:
+                {
+                    der_debug("recognized keyword CHOUF");
+                    m_advance();
+                    return parse_match();
+                }
                 case TOKENS::KEYWORD_DALATON:
                     der_debug("recognized keyword DALATON");
                     return parse_function();
@@ -518,7 +683,7 @@ namespace der
                 {
                     lexer::TokenHandle current = m_current();
                     using lexer::TOKENS;
-                    if (current.is(TOKENS::TOKEN_PLUS, TOKENS::TOKEN_MINUS, TOKENS::TOKEN_DIVIDE, TOKENS::TOKEN_MULTIPLY))
+                    if (current.is(TOKENS::TOKEN_PLUS, TOKENS::TOKEN_MINUS, TOKENS::TOKEN_DIVIDE, TOKENS::TOKEN_MULTIPLY, TOKENS::TOKEN_MODULO))
                     {
                         der_debug_e(prec);
                         der_debug_e(get_precedence(current.token));
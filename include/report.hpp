@@ -0,0 +1,267 @@
+#ifndef DER_REPORT_HPP
+#define DER_REPORT_HPP
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <format>
+#include <sys/resource.h>
+#include <time.h>
+#include "parser.hpp"
+#include "typechecker.hpp"
+
+// --time-report: wall time, CPU time, allocations and peak memory for each phase of the compiler, as a table or JSON,
+// and --trace: the phases and every top level declaration's checking and lowering as Chrome trace events (open it in
+// chrome://tracing or ui.perfetto.dev). CPU time is the whole process's, so it counts the optimizer's threads too.
+// phases running at the same time (build -j) are all added up, -j 1 gives cleaner numbers.
+namespace der
+{
+    namespace report
+    {
+        // bumped by operator new in main.cpp while there's a report to fill
+        inline std::atomic<bool> counting = false;
+        inline std::atomic<uint64_t> allocations = 0;
+        inline std::atomic<uint64_t> allocated = 0;
+
+        inline void count(size_t bytes)
+        {
+            if (counting.load(std::memory_order_relaxed))
+            {
+                allocations.fetch_add(1, std::memory_order_relaxed);
+                allocated.fetch_add(bytes, std::memory_order_relaxed);
+            }
+        }
+
+        inline double cpu_ms()
+        {
+            timespec ts{};
+            clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+            return double(ts.tv_sec) * 1e3 + double(ts.tv_nsec) / 1e6;
+        }
+
+        // the most memory the process has had since the last reset_peak, in KiB. linux keeps it as VmHWM and lets us
+        // reset it through clear_refs, elsewhere it's the peak of the whole run
+        inline void reset_peak()
+        {
+            std::ofstream out{"/proc/self/clear_refs"};
+            out << "5";
+        }
+
+        inline long peak_rss_kb()
+        {
+            std::ifstream in{"/proc/self/status"};
+            for (std::string line; std::getline(in, line);)
+                if (line.starts_with("VmHWM:"))
+                    return std::stol(line.substr(6));
+            rusage usage{};
+            getrusage(RUSAGE_SELF, &usage);
+            return usage.ru_maxrss;
+        }
+
+        struct Phase
+        {
+            std::string name;
+            double wall_ms = 0, cpu_ms = 0;
+            uint64_t allocations = 0, bytes = 0;
+            long peak_rss_kb = 0;
+        };
+
+        // a complete ("X") trace event
+        struct Span
+        {
+            std::string name, cat;
+            double start_us, dur_us;
+            size_t tid;
+        };
+
+        inline std::string escape(const std::string &s)
+        {
+            std::string out{};
+            for (char c : s)
+            {
+                if (c == '"' || c == '\\')
+                    out += '\\';
+                if (c == '\n')
+                    out += "\\n";
+                else if (c == '\t')
+                    out += "\\t";
+                else if (static_cast<unsigned char>(c) < 0x20)
+                    out += std::format("\\u{:04x}", int(c));
+                else
+                    out += c;
+            }
+            return out;
+        }
+
+        inline std::string bytes_str(double n)
+        {
+            if (n < 1024)
+                return std::format("{:.0f}B", n);
+            if (n < 1024 * 1024)
+                return std::format("{:.1f}KiB", n / 1024);
+            return std::format("{:.1f}MiB", n / 1024 / 1024);
+        }
+
+        struct Report
+        {
+            // in the order they first ran, the same phase running again (for another file) adds to it
+            std::vector<Phase> m_phases{};
+            std::vector<Span> m_spans{};
+            std::chrono::steady_clock::time_point m_start = std::chrono::steady_clock::now();
+            std::mutex m_lock{};
+
+            Report()
+            {
+                counting = true;
+            }
+            ~Report()
+            {
+                counting = false;
+            }
+
+            double now_us() const
+            {
+                return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - m_start).count();
+            }
+
+            static size_t tid()
+            {
+                return std::hash<std::thread::id>{}(std::this_thread::get_id()) % 100000;
+            }
+
+            void span(const std::string &cat, const std::string &name, double start_us)
+            {
+                double end = now_us();
+                std::lock_guard lock{m_lock};
+                m_spans.push_back({name, cat, start_us, end - start_us, tid()});
+            }
+
+            // runs f as the phase called name
+            template <typename F>
+            auto phase(const std::string &name, F &&f)
+            {
+                reset_peak();
+                double start = now_us(), cpu = cpu_ms();
+                uint64_t allocs = allocations.load(), bytes = allocated.load();
+                struct Done
+                {
+                    Report &r;
+                    const std::string &name;
+                    double start, cpu;
+                    uint64_t allocs, bytes;
+                    ~Done()
+                    {
+                        r.add({name, (r.now_us() - start) / 1e3, cpu_ms() - cpu, allocations.load() - allocs, allocated.load() - bytes, peak_rss_kb()});
+                        r.span("phase", name, start);
+                    }
+                } done{*this, name, start, cpu, allocs, bytes};
+                return f();
+            }
+
+            void add(const Phase &p)
+            {
+                std::lock_guard lock{m_lock};
+                for (auto &q : m_phases)
+                    if (q.name == p.name)
+                    {
+                        q.wall_ms += p.wall_ms;
+                        q.cpu_ms += p.cpu_ms;
+                        q.allocations += p.allocations;
+                        q.bytes += p.bytes;
+                        q.peak_rss_kb = std::max(q.peak_rss_kb, p.peak_rss_kb);
+                        return;
+                    }
+                m_phases.push_back(p);
+            }
+
+            // TypeChecker::check and the lowering half of do_the_thing, one span per top level declaration
+            void check(typechecker::TypeChecker &ijk)
+            {
+                phase("check", [&]
+                      {
+                          for (auto &x : ijk.m_input)
+                          {
+                              double start = now_us();
+                              ijk.get_stmt_type(x.expr->get_ty()->clone(), x.loc);
+                              ijk.m_advance();
+                              span("check", decl_name(x), start);
+                          } });
+                phase("lower", [&]
+                      {
+                          for (auto &x : ijk.m_input)
+                          {
+                              double start = now_us();
+                              ijk.m_output.push_back(ijk.convert_to_ir(x.expr->clone()));
+                              span("lower", decl_name(x), start);
+                          } });
+            }
+
+            static std::string decl_name(const parser::AstInfo &x)
+            {
+                if (auto fn = dynamic_cast<ast::Function<parser::AstInfo> *>(x.expr.get()))
+                    return fn->name;
+                if (auto st = dynamic_cast<ast::Struct *>(x.expr.get()))
+                    return "jism " + st->name;
+                if (auto en = dynamic_cast<ast::Enum *>(x.expr.get()))
+                    return "ti3dad " + en->name;
+                if (auto var = dynamic_cast<ast::Variable *>(x.expr.get()))
+                    return "dir " + var->name;
+                return types::ty_name(x.expr->get_ty()->get_ty());
+            }
+
+            Phase total() const
+            {
+                Phase t{"total"};
+                for (auto &p : m_phases)
+                {
+                    t.wall_ms += p.wall_ms;
+                    t.cpu_ms += p.cpu_ms;
+                    t.allocations += p.allocations;
+                    t.bytes += p.bytes;
+                    t.peak_rss_kb = std::max(t.peak_rss_kb, p.peak_rss_kb);
+                }
+                return t;
+            }
+
+            std::string table() const
+            {
+                std::string out = std::format("{:<10} {:>10} {:>10} {:>12} {:>10} {:>10}\n", "phase", "wall", "cpu", "allocations", "allocated", "peak rss");
+                auto row = [](const Phase &p)
+                {
+                    return std::format("{:<10} {:>8.2f}ms {:>8.2f}ms {:>12} {:>10} {:>10}\n", p.name, p.wall_ms, p.cpu_ms, p.allocations, bytes_str(double(p.bytes)), bytes_str(double(p.peak_rss_kb) * 1024));
+                };
+                for (auto &p : m_phases)
+                    out += row(p);
+                return out + row(total());
+            }
+
+            std::string json() const
+            {
+                auto obj = [](const Phase &p)
+                {
+                    return std::format("{{\"name\": \"{}\", \"wall_ms\": {:.3f}, \"cpu_ms\": {:.3f}, \"allocations\": {}, \"bytes\": {}, \"peak_rss_kb\": {}}}", escape(p.name), p.wall_ms, p.cpu_ms, p.allocations, p.bytes, p.peak_rss_kb);
+                };
+                std::string out = "{\"phases\": [";
+                for (size_t i = 0; i < m_phases.size(); ++i)
+                    out += (i ? ", " : "") + obj(m_phases.at(i));
+                return out + "], \"total\": " + obj(total()) + "}\n";
+            }
+
+            std::string trace() const
+            {
+                std::string out = "{\"traceEvents\": [\n";
+                for (size_t i = 0; i < m_spans.size(); ++i)
+                {
+                    auto &s = m_spans.at(i);
+                    out += std::format("{{\"name\": \"{}\", \"cat\": \"{}\", \"ph\": \"X\", \"ts\": {:.3f}, \"dur\": {:.3f}, \"pid\": 1, \"tid\": {}}}{}\n", escape(s.name), s.cat, s.start_us, s.dur_us, s.tid, i + 1 < m_spans.size() ? "," : "");
+                }
+                return out + "], \"displayTimeUnit\": \"ms\"}\n";
+            }
+        };
+    }
+}
+#endif
@@ -0,0 +1,382 @@
+#ifndef DER_RUNTIME_HPP
+#define DER_RUNTIME_HPP
+#include <string>
+
+namespace der
+{
+    namespace runtime
+    {
+        // C support code pasted into programs that use lkola mota7arik, needs -pthread when linking.
+        // the range is cut into chunks (about 8 per thread), every thread starts on its own contiguous run
+        // of chunks taking them from the front, and once that's empty it steals from the back of the others.
+        // the threads are started once and then sleep between loops, the calling thread works too.
+        // DER_THREADS overrides the thread count, a mota7arik loop started from inside another one runs inline.
+        // what the generated code calls, split C (--split) has it in the header and the rest in a single file
+        inline constexpr const char *parallel_for_api = R"(
+typedef void (*__der_par_body)(void *ctx, long lo, long hi);
+void __der_par_lock(void);
+void __der_par_unlock(void);
+void __der_parallel_for(long lo, long hi, __der_par_body body, void *ctx);
+)";
+
+        inline constexpr const char *parallel_for_pool = R"(
+struct __der_par_queue {
+    pthread_mutex_t lock;
+    long head, tail;
+};
+
+static struct {
+    pthread_once_t once;
+    pthread_mutex_t job, lock, combine;
+    pthread_cond_t wake, done;
+    int workers;
+    struct __der_par_queue *queues;
+    unsigned long generation;
+    int running;
+    __der_par_body body;
+    void *ctx;
+    long lo, hi, chunk;
+} __der_pool = {.once = PTHREAD_ONCE_INIT, .job = PTHREAD_MUTEX_INITIALIZER, .lock = PTHREAD_MUTEX_INITIALIZER, .combine = PTHREAD_MUTEX_INITIALIZER, .wake = PTHREAD_COND_INITIALIZER, .done = PTHREAD_COND_INITIALIZER};
+
+static __thread int __der_par_nested = 0;
+
+static int __der_par_take(struct __der_par_queue *q, int steal, long *chunk) {
+    int ok = 0;
+    pthread_mutex_lock(&q->lock);
+    if (q->head < q->tail) {
+        *chunk = steal ? --q->tail : q->head++;
+        ok = 1;
+    }
+    pthread_mutex_unlock(&q->lock);
+    return ok;
+}
+
+static void __der_par_work(int self) {
+    int n = __der_pool.workers;
+    long c;
+    for (;;) {
+        int found = __der_par_take(&__der_pool.queues[self], 0, &c);
+        for (int k = 1; !found && k < n; ++k)
+            found = __der_par_take(&__der_pool.queues[(self + k) % n], 1, &c);
+        if (!found)
+            return;
+        long lo = __der_pool.lo + c * __der_pool.chunk;
+        long hi = __der_pool.hi - lo > __der_pool.chunk ? lo + __der_pool.chunk : __der_pool.hi;
+        __der_pool.body(__der_pool.ctx, lo, hi);
+    }
+}
+
+static void *__der_par_thread(void *arg) {
+    int self = (int)(long)arg;
+    unsigned long seen = 0;
+    __der_par_nested = 1;
+    for (;;) {
+        pthread_mutex_lock(&__der_pool.lock);
+        while (__der_pool.generation == seen)
+            pthread_cond_wait(&__der_pool.wake, &__der_pool.lock);
+        seen = __der_pool.generation;
+        pthread_mutex_unlock(&__der_pool.lock);
+        __der_par_work(self);
+        pthread_mutex_lock(&__der_pool.lock);
+        if (--__der_pool.running == 0)
+            pthread_cond_signal(&__der_pool.done);
+        pthread_mutex_unlock(&__der_pool.lock);
+    }
+    return 0;
+}
+
+static void __der_par_init(void) {
+    const char *env = getenv("DER_THREADS");
+    long n = env ? atol(env) : sysconf(_SC_NPROCESSORS_ONLN);
+    if (n < 1)
+        n = 1;
+    __der_pool.queues = calloc(n, sizeof *__der_pool.queues);
+    if (!__der_pool.queues)
+        n = 0;
+    for (long i = 0; i < n; ++i)
+        pthread_mutex_init(&__der_pool.queues[i].lock, 0);
+    long started = 1;
+    for (; started < n; ++started) {
+        pthread_t t;
+        if (pthread_create(&t, 0, __der_par_thread, (void *)started) != 0)
+            break;
+        pthread_detach(t);
+    }
+    __der_pool.workers = n > 0 ? (int)started : 0;
+}
+)";
+
+        inline constexpr const char *parallel_for_calls[] = {"void __der_par_lock(void) { pthread_mutex_lock(&__der_pool.combine); }\n",
+                                                             "void __der_par_unlock(void) { pthread_mutex_unlock(&__der_pool.combine); }\n\n",
+                                                             R"(void __der_parallel_for(long lo, long hi, __der_par_body body, void *ctx) {
+    if (hi <= lo)
+        return;
+    pthread_once(&__der_pool.once, __der_par_init);
+    int n = __der_pool.workers;
+    if (n <= 1 || __der_par_nested) {
+        body(ctx, lo, hi);
+        return;
+    }
+    pthread_mutex_lock(&__der_pool.job);
+    long chunk = (hi - lo + 8L * n - 1) / (8L * n);
+    long total = (hi - lo + chunk - 1) / chunk;
+    pthread_mutex_lock(&__der_pool.lock);
+    for (int w = 0; w < n; ++w) {
+        __der_pool.queues[w].head = total * w / n;
+        __der_pool.queues[w].tail = total * (w + 1) / n;
+    }
+    __der_pool.body = body;
+    __der_pool.ctx = ctx;
+    __der_pool.lo = lo;
+    __der_pool.hi = hi;
+    __der_pool.chunk = chunk;
+    __der_pool.running = n - 1;
+    __der_pool.generation += 1;
+    pthread_cond_broadcast(&__der_pool.wake);
+    pthread_mutex_unlock(&__der_pool.lock);
+    __der_par_nested = 1;
+    __der_par_work(0);
+    __der_par_nested = 0;
+    pthread_mutex_lock(&__der_pool.lock);
+    while (__der_pool.running > 0)
+        pthread_cond_wait(&__der_pool.done, &__der_pool.lock);
+    pthread_mutex_unlock(&__der_pool.lock);
+    pthread_mutex_unlock(&__der_pool.job);
+}
+)"};
+
+        // the whole runtime. in a single C file everything is static; shared, the functions the program calls are
+        // left for the other files (which see parallel_for_api) and the typedef is expected to be there already
+        inline std::string parallel_for(bool shared = false)
+        {
+            std::string out = shared ? "" : "\ntypedef void (*__der_par_body)(void *ctx, long lo, long hi);\n";
+            out += parallel_for_pool;
+            for (auto call : parallel_for_calls)
+                out += (shared ? "" : "static ") + std::string(call);
+            return out;
+        }
+
+        // assembly pasted after the functions `derijac native` emits, it stands in for the bits of libc the
+        // program would otherwise get: _start, kteb and dkhel over raw read/write syscalls, and the few string
+        // functions string chouf calls. output is buffered and flushed when full and before exiting.
+        inline constexpr const char *native = R"(	.text
+	.globl _start
+_start:
+	xorl %ebp, %ebp
+	andq $-16, %rsp
+	call __der_init
+	call main
+	movl %eax, %ebx
+	call __der_flush
+	movl %ebx, %edi
+	movl $60, %eax
+	syscall
+
+__der_flush:
+	pushq %rbx
+	leaq __der_out_buf(%rip), %rsi
+	movq __der_out_len(%rip), %rbx
+1:	testq %rbx, %rbx
+	jle 2f
+	movl $1, %eax
+	movl $1, %edi
+	movq %rbx, %rdx
+	syscall
+	testq %rax, %rax
+	jle 2f
+	addq %rax, %rsi
+	subq %rax, %rbx
+	jmp 1b
+2:	movq $0, __der_out_len(%rip)
+	popq %rbx
+	ret
+
+__der_putc:
+	movq __der_out_len(%rip), %rax
+	cmpq $4096, %rax
+	jb 1f
+	pushq %rdi
+	call __der_flush
+	popq %rdi
+	xorl %eax, %eax
+1:	leaq __der_out_buf(%rip), %rcx
+	movb %dil, (%rcx,%rax)
+	incq %rax
+	movq %rax, __der_out_len(%rip)
+	ret
+
+	.globl __der_kteb_char
+__der_kteb_char:
+	call __der_putc
+	movl $10, %edi
+	jmp __der_putc
+
+	.globl __der_kteb_str
+__der_kteb_str:
+	pushq %rbx
+	movq %rdi, %rbx
+1:	movzbl (%rbx), %edi
+	testl %edi, %edi
+	je 2f
+	call __der_putc
+	incq %rbx
+	jmp 1b
+2:	movl $10, %edi
+	call __der_putc
+	popq %rbx
+	ret
+
+	.globl __der_kteb_int
+__der_kteb_int:
+	pushq %rbx
+	pushq %r12
+	subq $40, %rsp
+	movslq %edi, %rax
+	leaq 32(%rsp), %r12
+	movb $10, 31(%rsp)
+	leaq 31(%rsp), %rbx
+	movq %rax, %r8
+	testq %rax, %rax
+	jns 1f
+	negq %rax
+1:	movl $10, %ecx
+2:	xorl %edx, %edx
+	divq %rcx
+	addl $48, %edx
+	decq %rbx
+	movb %dl, (%rbx)
+	testq %rax, %rax
+	jne 2b
+	testq %r8, %r8
+	jns 3f
+	decq %rbx
+	movb $45, (%rbx)
+3:	movzbl (%rbx), %edi
+	call __der_putc
+	incq %rbx
+	cmpq %r12, %rbx
+	jne 3b
+	addq $40, %rsp
+	popq %r12
+	popq %rbx
+	ret
+
+__der_getc:
+	movq __der_in_pos(%rip), %rax
+	cmpq __der_in_len(%rip), %rax
+	jb 1f
+	xorl %eax, %eax
+	xorl %edi, %edi
+	leaq __der_in_buf(%rip), %rsi
+	movl $4096, %edx
+	syscall
+	testq %rax, %rax
+	jg 2f
+	movl $-1, %eax
+	ret
+2:	movq %rax, __der_in_len(%rip)
+	xorl %eax, %eax
+1:	leaq __der_in_buf(%rip), %rcx
+	movzbl (%rcx,%rax), %edx
+	incq %rax
+	movq %rax, __der_in_pos(%rip)
+	movl %edx, %eax
+	ret
+
+# like scanf("%d"): skips whitespace, reads an optional minus and digits, 0 when there's no number
+	.globl dkhel
+dkhel:
+	pushq %rbx
+	pushq %r12
+	pushq %r13
+1:	call __der_getc
+	cmpl $32, %eax
+	je 1b
+	leal -9(%rax), %ecx
+	cmpl $4, %ecx
+	jbe 1b
+	xorl %r12d, %r12d
+	cmpl $45, %eax
+	jne 2f
+	movl $1, %r12d
+	call __der_getc
+2:	xorl %ebx, %ebx
+	xorl %r13d, %r13d
+3:	leal -48(%rax), %ecx
+	cmpl $9, %ecx
+	ja 4f
+	imull $10, %ebx, %ebx
+	addl %ecx, %ebx
+	movl $1, %r13d
+	call __der_getc
+	jmp 3b
+4:	cmpl $-1, %eax
+	je 5f
+	decq __der_in_pos(%rip)
+5:	movl %ebx, %eax
+	negl %eax
+	testl %r12d, %r12d
+	cmove %ebx, %eax
+	testl %r13d, %r13d
+	cmove %r13d, %eax
+	popq %r13
+	popq %r12
+	popq %rbx
+	ret
+
+	.globl strlen
+strlen:
+	movq %rdi, %rax
+1:	cmpb $0, (%rax)
+	je 2f
+	incq %rax
+	jmp 1b
+2:	subq %rdi, %rax
+	ret
+
+	.globl memcmp
+memcmp:
+	movl %edx, %edx
+	xorl %ecx, %ecx
+1:	cmpq %rdx, %rcx
+	jae 2f
+	movzbl (%rdi,%rcx), %eax
+	movzbl (%rsi,%rcx), %r8d
+	incq %rcx
+	subl %r8d, %eax
+	je 1b
+	ret
+2:	xorl %eax, %eax
+	ret
+
+	.globl __der_str_hash
+__der_str_hash:
+	movl %esi, %esi
+	xorl %eax, %eax
+	xorl %ecx, %ecx
+1:	cmpq %rsi, %rcx
+	jae 2f
+	imull %edx, %eax
+	movzbl (%rdi,%rcx), %r8d
+	addl %r8d, %eax
+	incq %rcx
+	jmp 1b
+2:	andl $0x7fffffff, %eax
+	ret
+
+	.bss
+	.p2align 3
+__der_out_len:
+	.zero 8
+__der_in_pos:
+	.zero 8
+__der_in_len:
+	.zero 8
+__der_out_buf:
+	.zero 4096
+__der_in_buf:
+	.zero 4096
+)";
+    }
+}
+#endif
@@ -0,0 +1,356 @@
+#ifndef DER_SERVER_HPP
+#define DER_SERVER_HPP
+#include <cerrno>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <vector>
+#include <format>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio_ext.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// `derijac --server` stays up and compiles whatever `derijac --client ...` sends it over a unix socket, keeping what
+// it made of each file in memory in between (see frontend in main.cpp). the client sends its working directory, its
+// arguments, the environment variables the compiler reads and its stdin/stdout/stderr, so the compiler's messages,
+// the C compiler's and the program's in `run` go straight to the client's terminal. the server answers with the
+// exit status. requests are handled one at a time, they all share the server's working directory and descriptors.
+// since the client hands over its descriptors and the server runs whatever CC it's told, both ends make sure the
+// other one is the same user (SO_PEERCRED), and the socket lives in a directory only that user can get into.
+namespace der
+{
+    namespace server
+    {
+        inline const std::vector<std::string> &forwarded_env()
+        {
+            static const std::vector<std::string> out{"CC", "DER_CACHE_DIR", "DER_THREADS"};
+            return out;
+        }
+
+        // DER_SOCKET, or in $XDG_RUNTIME_DIR, or in a directory of our own in /tmp
+        inline std::string socket_path()
+        {
+            if (const char *path = std::getenv("DER_SOCKET"); path && *path)
+                return path;
+            if (const char *dir = std::getenv("XDG_RUNTIME_DIR"); dir && *dir)
+                return std::format("{}/derijac.sock", dir);
+            return std::format("/tmp/derijac-{}/derijac.sock", getuid());
+        }
+
+        // the directory of the socket has to belong to us and be closed to everyone else, otherwise someone else
+        // could have put their own socket there first. with create it's made (0700) when it isn't there yet. a
+        // DER_SOCKET is taken as it is, the peer checks are still done on it
+        inline bool trusted_dir(const std::string &path, bool create)
+        {
+            if (const char *env = std::getenv("DER_SOCKET"); env && *env)
+                return true;
+            std::string dir = std::filesystem::path(path).parent_path().string();
+            if (create)
+                mkdir(dir.c_str(), 0700);
+            struct stat st{};
+            return lstat(dir.c_str(), &st) == 0 && S_ISDIR(st.st_mode) && st.st_uid == getuid() && (st.st_mode & 077) == 0;
+        }
+
+        // whether the other end of a connected socket is running as us
+        inline bool same_user(int sock)
+        {
+            ucred cred{};
+            socklen_t len = sizeof cred;
+            return getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &len) == 0 && len == sizeof cred && cred.uid == getuid();
+        }
+
+        struct Request
+        {
+            std::string cwd;
+            // name=value, or just the name when it isn't set on the client's side
+            std::vector<std::string> env{};
+            std::vector<std::string> args{};
+        };
+
+        inline void put(std::string &out, const std::string &s)
+        {
+            uint32_t n = uint32_t(s.size());
+            out.append(reinterpret_cast<const char *>(&n), sizeof n);
+            out += s;
+        }
+
+        inline std::optional<std::string> get(const std::string &in, size_t &at)
+        {
+            uint32_t n = 0;
+            if (in.size() - at < sizeof n)
+                return std::nullopt;
+            std::memcpy(&n, in.data() + at, sizeof n);
+            at += sizeof n;
+            if (in.size() - at < n)
+                return std::nullopt;
+            at += n;
+            return in.substr(at - n, n);
+        }
+
+        inline bool read_exactly(int fd, char *data, size_t size)
+        {
+            for (size_t done = 0; done < size;)
+            {
+                ssize_t n = read(fd, data + done, size - done);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n <= 0)
+                    return false;
+                done += size_t(n);
+            }
+            return true;
+        }
+
+        inline bool write_exactly(int fd, const char *data, size_t size)
+        {
+            for (size_t done = 0; done < size;)
+            {
+                ssize_t n = write(fd, data + done, size - done);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n <= 0)
+                    return false;
+                done += size_t(n);
+            }
+            return true;
+        }
+
+        inline sockaddr_un address(const std::string &path)
+        {
+            sockaddr_un addr{};
+            addr.sun_family = AF_UNIX;
+            std::strncpy(addr.sun_path, path.c_str(), sizeof addr.sun_path - 1);
+            return addr;
+        }
+
+        // the request goes as its size, sent along with the three descriptors, then the request itself
+        inline bool send_request(int sock, const Request &req)
+        {
+            std::string body{};
+            put(body, req.cwd);
+            put(body, std::to_string(req.env.size()));
+            for (auto &e : req.env)
+                put(body, e);
+            for (auto &a : req.args)
+                put(body, a);
+            uint32_t size = uint32_t(body.size());
+            iovec iov{&size, sizeof size};
+            int fds[3] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+            alignas(cmsghdr) char control[CMSG_SPACE(sizeof fds)]{};
+            msghdr msg{};
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof control;
+            cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+            cmsg->cmsg_level = SOL_SOCKET;
+            cmsg->cmsg_type = SCM_RIGHTS;
+            cmsg->cmsg_len = CMSG_LEN(sizeof fds);
+            std::memcpy(CMSG_DATA(cmsg), fds, sizeof fds);
+            ssize_t n;
+            while ((n = sendmsg(sock, &msg, 0)) < 0 && errno == EINTR)
+                ;
+            return n == ssize_t(sizeof size) && write_exactly(sock, body.data(), body.size());
+        }
+
+        inline std::optional<Request> receive_request(int sock, int (&fds)[3])
+        {
+            uint32_t size = 0;
+            iovec iov{&size, sizeof size};
+            alignas(cmsghdr) char control[CMSG_SPACE(sizeof fds)]{};
+            msghdr msg{};
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof control;
+            ssize_t n;
+            while ((n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC)) < 0 && errno == EINTR)
+                ;
+            cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+            if (n != ssize_t(sizeof size) || !cmsg || cmsg->cmsg_type != SCM_RIGHTS || cmsg->cmsg_len != CMSG_LEN(sizeof fds))
+            {
+                // descriptors that came along are open in this process now, even when the request isn't answered
+                for (; n >= 0 && cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+                    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+                        for (size_t i = 0; i < (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int); ++i)
+                        {
+                            int fd = -1;
+                            std::memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof fd, sizeof fd);
+                            close(fd);
+                        }
+                return std::nullopt;
+            }
+            std::memcpy(fds, CMSG_DATA(cmsg), sizeof fds);
+            std::string body(size, '\0');
+            Request req{};
+            size_t at = 0;
+            auto cwd = read_exactly(sock, body.data(), size) ? get(body, at) : std::nullopt;
+            auto envs = cwd ? get(body, at) : std::nullopt;
+            size_t count = 0;
+            if (!envs || std::from_chars(envs->data(), envs->data() + envs->size(), count) != std::from_chars_result{envs->data() + envs->size(), std::errc{}})
+            {
+                for (int fd : fds)
+                    close(fd);
+                return std::nullopt;
+            }
+            req.cwd = *cwd;
+            // a count bigger than what's in the body stops at the end of it
+            for (size_t i = count; i > 0; --i)
+                if (auto e = get(body, at))
+                    req.env.push_back(*e);
+                else
+                    break;
+            while (auto a = get(body, at))
+                req.args.push_back(*a);
+            return req;
+        }
+
+        // sends the arguments to a running server and waits for it to be done, nullopt when there's no server to
+        // talk to (or none we trust). it's up to the server from there, even if it dies half way through that's a
+        // failed compile
+        inline std::optional<int> forward(const std::string &path, const std::vector<std::string> &args)
+        {
+            if (!trusted_dir(path, false))
+                return std::nullopt;
+            int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            sockaddr_un addr = address(path);
+            if (sock < 0 || connect(sock, reinterpret_cast<sockaddr *>(&addr), sizeof addr) != 0 || !same_user(sock))
+            {
+                if (sock >= 0)
+                    close(sock);
+                return std::nullopt;
+            }
+            Request req{};
+            char *cwd = getcwd(nullptr, 0);
+            req.cwd = cwd ? cwd : ".";
+            std::free(cwd);
+            for (auto &name : forwarded_env())
+            {
+                const char *value = std::getenv(name.c_str());
+                req.env.push_back(value ? name + "=" + value : name);
+            }
+            req.args = args;
+            int32_t status = 1;
+            std::fflush(stdout);
+            std::cout.flush();
+            if (!send_request(sock, req) || !read_exactly(sock, reinterpret_cast<char *>(&status), sizeof status))
+                status = 1;
+            close(sock);
+            return status;
+        }
+
+        // answers requests until killed, `handle` gets the arguments (the first one standing for the program) and
+        // returns the exit status. false when the socket can't be set up
+        inline bool serve(const std::string &path, const std::function<int(const std::vector<std::string> &)> &handle)
+        {
+            // a client going away mid request shouldn't take the server with it
+            signal(SIGPIPE, SIG_IGN);
+            if (!trusted_dir(path, true))
+            {
+                errno = EACCES;
+                return false;
+            }
+            sockaddr_un addr = address(path);
+            // a socket nobody answers on is left over from a server that's gone
+            int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            bool taken = probe >= 0 && connect(probe, reinterpret_cast<sockaddr *>(&addr), sizeof addr) == 0;
+            if (probe >= 0)
+                close(probe);
+            if (taken)
+            {
+                errno = EADDRINUSE;
+                return false;
+            }
+            unlink(path.c_str());
+            int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (listener < 0)
+                return false;
+            // only we get to connect to it, whatever the directory allows
+            mode_t mask = umask(077);
+            bool bound = bind(listener, reinterpret_cast<sockaddr *>(&addr), sizeof addr) == 0;
+            umask(mask);
+            if (!bound || listen(listener, 16) != 0)
+            {
+                close(listener);
+                return false;
+            }
+            char *home = getcwd(nullptr, 0);
+            std::string dir = home ? home : "/";
+            std::free(home);
+            int saved[3];
+            for (int i = 0; i < 3; ++i)
+                saved[i] = fcntl(i, F_DUPFD_CLOEXEC, 3);
+            while (true)
+            {
+                int client = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+                if (client < 0)
+                    continue;
+                if (!same_user(client))
+                {
+                    close(client);
+                    continue;
+                }
+                int fds[3];
+                auto req = receive_request(client, fds);
+                if (!req)
+                {
+                    close(client);
+                    continue;
+                }
+                std::cout.flush();
+                std::fflush(stdout);
+                for (int i = 0; i < 3; ++i)
+                {
+                    dup2(fds[i], i);
+                    close(fds[i]);
+                }
+                for (auto &e : req->env)
+                {
+                    auto eq = e.find('=');
+                    if (eq == std::string::npos)
+                        unsetenv(e.c_str());
+                    else
+                        setenv(e.substr(0, eq).c_str(), e.substr(eq + 1).c_str(), 1);
+                }
+                int32_t status = 1;
+                if (chdir(req->cwd.c_str()) != 0)
+                    std::cout << std::format("\u001b[1m\u001b[31merror:\u001b[m the server can't get into '{}'.\n", req->cwd);
+                else
+                {
+                    try
+                    {
+                        status = handle(req->args);
+                    }
+                    catch (...)
+                    {
+                        std::cout << "\u001b[1m\u001b[31merror:\u001b[m the compiler crashed.\n";
+                    }
+                }
+                // whatever the program in `run` didn't read belongs to that client
+                std::cout.flush();
+                std::fflush(stdout);
+                __fpurge(stdin);
+                clearerr(stdin);
+                std::cin.clear();
+                for (int i = 0; i < 3; ++i)
+                    dup2(saved[i], i);
+                if (chdir(dir.c_str()) != 0)
+                    return false;
+                write_exactly(client, reinterpret_cast<const char *>(&status), sizeof status);
+                close(client);
+            }
+        }
+    }
+}
+#endif
@@ -5,13 +5,71 @@
 #include "types.hpp"
 #include "lexer.hpp"
 #include "der_ir.hpp"
+#include "runtime.hpp"
 #include <map>
+#include <set>
 #include <string>
 #include <memory>
+#include <optional>
+#include <cstdint>
+#include <algorithm>
+#include <stdexcept>
 namespace der
 {
     namespace typechecker
     {
+        // a collision free hash for a handful of same length strings: one char, two chars, or a multiplicative hash over all of them
+        struct PerfectHash
+        {
+            std::vector<size_t> positions{};
+            uint32_t seed = 0;
+            std::vector<uint32_t> values{};
+
+            static uint32_t str_hash(const std::string &s, uint32_t seed)
+            {
+                uint32_t h = 0;
+                for (unsigned char c : s)
+                    h = h * seed + c;
+                return h & 0x7fffffffu;
+            }
+
+            static bool distinct(const std::vector<uint32_t> &v)
+            {
+                std::set<uint32_t> seen(v.begin(), v.end());
+                return seen.size() == v.size();
+            }
+
+            static std::optional<PerfectHash> find(const std::vector<std::string> &keys)
+            {
+                size_t len = keys.front().size();
+                for (size_t p = 0; p < len; ++p)
+                {
+                    PerfectHash h{.positions = {p}};
+                    for (auto &k : keys)
+                        h.values.push_back((unsigned char)k[p]);
+                    if (distinct(h.values))
+                        return h;
+                }
+                for (size_t p = 0; p < len; ++p)
+                    for (size_t q = p + 1; q < len; ++q)
+                    {
+                        PerfectHash h{.positions = {p, q}};
+                        for (auto &k : keys)
+                            h.values.push_back(((unsigned char)k[p] << 8) | (unsigned char)k[q]);
+                        if (distinct(h.values))
+                            return h;
+                    }
+                for (uint32_t seed = 31; seed < 100000; seed += 2)
+                {
+                    PerfectHash h{.seed = seed};
+                    for (auto &k : keys)
+                        h.values.push_back(str_hash(k, seed));
+                    if (distinct(h.values))
+                        return h;
+                }
+                return std::nullopt;
+            }
+        };
 
         struct TypeChecker
         {
@@ -32,6 +90,14 @@ namespace der
             std::vector<std::unique_ptr<der::ir::Expr>> m_output{};
             bool is_in_fn = false;
             std::shared_ptr<types::TypeHandle> ret_fn_ty = nullptr;
+            // headers and static helpers the generated C needs, written before everything else
+            std::set<std::string> c_includes{};
+            std::map<std::string, std::string> c_helpers{};
+            // declarations of everything the program imports with jbed (see modules.hpp), they go right after the helpers
+            std::string c_imported{};
+            size_t m_match_counter = 0;
+            // builtins the program called, see check_builtin
+            std::set<std::string> m_builtins{};
 
             TypeChecker(const std::vector<parser::AstInfo> &in) : m_input(in) {}
 
@@ -44,13 +110,17 @@ namespace der
                 if (m_index < m_input.size())
                     m_index += 1;
             }
-            void do_the_thing()
+            void check()
             {
                 for (auto &x : m_input)
                 {
                     get_stmt_type(x.expr->get_ty()->clone(), x.loc);
                     m_advance();
                 }
+            }
+            void do_the_thing()
+            {
+                check();
                 for (auto &x : m_input)
                 {
                     der_debug("converting to ir.....");
@@ -63,6 +133,11 @@ namespace der
             std::string get_output()
             {
                 std::string out;
+                for (auto &h : c_includes)
+                    out += std::format("#include <{}>\n", h);
+                for (auto &[_, helper] : c_helpers)
+                    out += helper;
+                out += c_imported;
                 for (auto &&a : m_output)
                 {
                     out += std::format("{};\n", a->value());
@@ -100,7 +175,7 @@ namespace der
                     der_debug("recognized BIN_OP IR.");
                     std::unique_ptr<ir::Expr> lfs = convert_to_ir(std::move(binop->left));
                     std::unique_ptr<ir::Expr> rfs = convert_to_ir(std::move(binop->right));
-                    return std::make_unique<der::ir::Binary>(std::move(lfs), lexer::tokens_to_str[binop->op], std::move(rfs));
+                    return std::make_unique<der::ir::Binary>(std::move(lfs), lexer::tokens_to_str.at(binop->op), std::move(rfs));
                 }
                 else if (expr->get_ty()->get_ty() == types::TYPES::UNARY_OP)
                 {
@@ -115,7 +190,7 @@ namespace der
                     ast::LogicalBinaryOper *logop = dynamic_cast<ast::LogicalBinaryOper *>(expr.get());
                     std::unique_ptr<ir::Expr> lfs = convert_to_ir(std::move(logop->left));
                     std::unique_ptr<ir::Expr> rfs = convert_to_ir(std::move(logop->right));
-                    return std::make_unique<der::ir::Logical>(std::move(lfs), lexer::tokens_to_str[logop->op], std::move(rfs));
+                    return std::make_unique<der::ir::Logical>(std::move(lfs), lexer::tokens_to_str.at(logop->op), std::move(rfs));
                 }
                 else if (expr->get_ty()->get_ty() == types::TYPES::IDENT)
                 {
@@ -129,6 +204,9 @@ namespace der
                     std::vector<std::unique_ptr<der::ir::Expr>> args;
                     for (auto &a : callee->args)
                         args.push_back(convert_to_ir(a->clone()));
+                    auto name = dynamic_cast<ast::Identifier *>(callee->callee.get());
+                    if (name && m_builtins.contains(name->ident))
+                        add_builtin(name->ident, args);
                     return std::make_unique<der::ir::FunctionCall>(convert_to_ir(std::move(callee->callee)), args);
                 }
                 else if (expr->get_ty()->get_ty() == types::TYPES::VAR)
@@ -240,7 +318,17 @@ namespace der
                     std::vector<std::unique_ptr<ir::Expr>> body = {};
                     for (auto &e : ranged_for->body)
                         body.push_back(convert_to_ir(e.expr->clone()));
-                    return std::make_unique<ir::RangedFor>(std::move(init), std::move(goal), ident, body);
+                    auto loop = std::make_unique<ir::RangedFor>(std::move(init), std::move(goal), ident, body);
+                    loop->unroll = ranged_for->unroll;
+                    loop->assume_noalias = ranged_for->simd;
+                    loop->parallel = ranged_for->parallel;
+                    loop->reductions = ranged_for->reductions;
+                    if (loop->parallel)
+                    {
+                        c_includes.insert({"pthread.h", "stdlib.h", "unistd.h"});
+                        c_helpers["__der_parallel_for"] = runtime::parallel_for();
+                    }
+                    return loop;
                 }
                 else if (expr->get_ty()->get_ty() == types::TYPES::SUBSCRIPT)
                 {
@@ -282,12 +370,150 @@ namespace der
                 {
                     return std::make_unique<ir::GetAddress>(convert_to_ir(std::move(dynamic_cast<ast::AddressOper *>(expr.get())->victim)));
                 }
+                else if (expr->get_ty()->get_ty() == types::TYPES::MATCH)
+                {
+                    ast::Match<parser::AstInfo> *match = dynamic_cast<ast::Match<parser::AstInfo> *>(expr.get());
+                    std::unique_ptr<ir::Expr> scrutinee = convert_to_ir(match->scrutinee->clone());
+                    std::vector<std::pair<std::shared_ptr<ast::Expr>, std::vector<std::unique_ptr<ir::Expr>>>> cases{};
+                    std::vector<std::unique_ptr<ir::Expr>> default_block{};
+                    bool on_strings = false;
+                    for (auto &arm : match->arms)
+                    {
+                        std::vector<std::unique_ptr<ir::Expr>> body{};
+                        for (auto &a : arm.body)
+                            body.push_back(convert_to_ir(a.expr->clone()));
+                        if (arm.pattern == nullptr)
+                        {
+                            default_block = std::move(body);
+                            continue;
+                        }
+                        if (dynamic_cast<ast::String *>(arm.pattern.get()))
+                            on_strings = true;
+                        cases.emplace_back(arm.pattern->clone(), std::move(body));
+                    }
+                    if (cases.size() == 0)
+                    {
+                        default_block.insert(default_block.begin(), std::move(scrutinee));
+                        return std::make_unique<ir::Block>(std::move(default_block));
+                    }
+                    if (on_strings)
+                        return lower_string_match(std::move(scrutinee), cases, std::move(default_block));
+                    std::vector<ir::SwitchCase> switch_cases{};
+                    for (auto &[pattern, body] : cases)
+                        switch_cases.emplace_back(convert_to_ir(pattern), std::move(body));
+                    return std::make_unique<ir::Switch>(std::move(scrutinee), std::move(switch_cases), std::move(default_block));
+                }
                 else
                 {
-                    throw 44;
+                    // the checker lets through nothing that gets here
+                    throw std::logic_error(std::format("can't turn {} into C.", expr->debug()));
                 }
             }
 
+            // a switch on the length, then a switch on a perfect hash of the strings sharing that length,
+            // so a match costs one strlen, one hash and a single memcmp.
+            std::unique_ptr<ir::Expr> lower_string_match(std::unique_ptr<ir::Expr> scrutinee, std::vector<std::pair<std::shared_ptr<ast::Expr>, std::vector<std::unique_ptr<ir::Expr>>>> &cases, std::vector<std::unique_ptr<ir::Expr>> &&default_block)
+            {
+                c_includes.insert("string.h");
+                size_t id = m_match_counter++;
+                std::string subject = std::format("__der_chouf_s{}", id);
+                std::string end = std::format("__der_chouf_end{}", id);
+                auto ident = [&]()
+                { return std::make_unique<ir::Ident>(subject); };
+                // whether an arm jumps to the end, the label isn't written otherwise
+                bool jumps = false;
+                auto hit = [&](const std::string &raw, size_t len, std::vector<std::unique_ptr<ir::Expr>> &body)
+                {
+                    std::vector<std::unique_ptr<ir::Expr>> args{};
+                    args.push_back(ident());
+                    args.push_back(std::make_unique<ir::String>(raw));
+                    args.push_back(std::make_unique<ir::Integer>(len));
+                    auto cmp = std::make_unique<ir::Logical>(std::make_unique<ir::FunctionCall>(std::make_unique<ir::Ident>("memcmp"), args), "==", std::make_unique<ir::Integer>(0));
+                    std::vector<std::unique_ptr<ir::Expr>> then{};
+                    for (auto &s : body)
+                        then.push_back(std::move(s));
+                    if (then.empty() || !dynamic_cast<ir::Return *>(then.back().get()))
+                    {
+                        then.push_back(std::make_unique<ir::Goto>(end));
+                        jumps = true;
+                    }
+                    return std::make_unique<ir::If>(std::move(cmp), std::move(then), std::vector<std::unique_ptr<ir::Expr>>{});
+                };
+                auto char_at = [&](size_t p)
+                {
+                    return std::make_unique<ir::Cast>("unsigned char", std::make_unique<ir::Subscript>(ident(), std::make_unique<ir::Integer>(p)));
+                };
+
+                std::map<size_t, std::vector<size_t>> by_len{};
+                std::vector<std::string> raws{};
+                std::vector<std::string> bytes{};
+                for (size_t i = 0; i < cases.size(); ++i)
+                {
+                    raws.push_back(dynamic_cast<ast::String *>(cases.at(i).first.get())->value);
+                    bytes.push_back(lexer::unescape(raws.back()));
+                    by_len[bytes.back().size()].push_back(i);
+                }
+
+                std::vector<ir::SwitchCase> len_cases{};
+                for (auto &[len, idxs] : by_len)
+                {
+                    std::vector<std::unique_ptr<ir::Expr>> group{};
+                    std::vector<std::string> keys{};
+                    for (size_t i : idxs)
+                        keys.push_back(bytes.at(i));
+                    std::optional<PerfectHash> hash = std::nullopt;
+                    if (idxs.size() > 1 && len > 0)
+                        hash = PerfectHash::find(keys);
+                    if (!hash)
+                    {
+                        for (size_t i : idxs)
+                            group.push_back(hit(raws.at(i), len, cases.at(i).second));
+                    }
+                    else
+                    {
+                        std::unique_ptr<ir::Expr> key = nullptr;
+                        if (hash->positions.size() == 1)
+                            key = char_at(hash->positions.at(0));
+                        else if (hash->positions.size() == 2)
+                            key = std::make_unique<ir::Binary>(std::make_unique<ir::Binary>(char_at(hash->positions.at(0)), "<<", std::make_unique<ir::Integer>(8)), "|", char_at(hash->positions.at(1)));
+                        else
+                        {
+                            c_helpers["__der_str_hash"] = "static inline unsigned __der_str_hash(const char *s, unsigned long n, unsigned seed) {\n"
+                                                          "\tunsigned h = 0;\n"
+                                                          "\tfor (unsigned long i = 0; i < n; ++i)\n"
+                                                          "\t\th = h * seed + (unsigned char)s[i];\n"
+                                                          "\treturn h & 0x7fffffffu;\n"
+                                                          "}\n";
+                            std::vector<std::unique_ptr<ir::Expr>> args{};
+                            args.push_back(ident());
+                            args.push_back(std::make_unique<ir::Integer>(len));
+                            args.push_back(std::make_unique<ir::Integer>(hash->seed));
+                            key = std::make_unique<ir::FunctionCall>(std::make_unique<ir::Ident>("__der_str_hash"), args);
+                        }
+                        std::vector<ir::SwitchCase> hash_cases{};
+                        for (size_t k = 0; k < idxs.size(); ++k)
+                        {
+                            std::vector<std::unique_ptr<ir::Expr>> body{};
+                            body.push_back(hit(raws.at(idxs.at(k)), len, cases.at(idxs.at(k)).second));
+                            hash_cases.emplace_back(std::make_unique<ir::Integer>(hash->values.at(k)), std::move(body));
+                        }
+                        group.push_back(std::make_unique<ir::Switch>(std::move(key), std::move(hash_cases), std::vector<std::unique_ptr<ir::Expr>>{}));
+                    }
+                    len_cases.emplace_back(std::make_unique<ir::Integer>(len), std::move(group));
+                }
+
+                std::vector<std::unique_ptr<ir::Expr>> out{};
+                out.push_back(std::make_unique<ir::Variable>("const char*", subject, std::move(scrutinee)));
+                std::vector<std::unique_ptr<ir::Expr>> strlen_args{};
+                strlen_args.push_back(ident());
+                out.push_back(std::make_unique<ir::Switch>(std::make_unique<ir::FunctionCall>(std::make_unique<ir::Ident>("strlen"), strlen_args), std::move(len_cases), std::vector<std::unique_ptr<ir::Expr>>{}));
+                for (auto &s : default_block)
+                    out.push_back(std::move(s));
+                if (jumps)
+                    out.push_back(std::make_unique<ir::Label>(end));
+                return std::make_unique<ir::Block>(std::move(out));
+            }
+
             // need to handle much more complicated types, array and shit as well
             std::string convert_c_type(const std::shared_ptr<types::TypeHandle> &type)
             {
@@ -396,6 +622,11 @@ namespace der
                     types::Return *ret = dynamic_cast<types::Return *>(type.get());
                     ret_fn_ty = get_expr_type(std::move(ret->ty), loc);
                 }
+                else if (type->get_ty() == types::TYPES::MATCH)
+                {
+                    der_debug("chouf encounter.");
+                    check_match(dynamic_cast<types::Match *>(type.get()), loc);
+                }
                 else if (type->get_ty() == types::TYPES::SMOL_IF)
                 {
                     der_debug("smol if encounter.");
@@ -518,8 +749,7 @@ namespace der
                 {
                     der_debug("shit");
                     der_debug_e(type->debug());
-                    throw 99;
-                    return std::unique_ptr<types::TypeHandle>(new types::Dummy());
+                    throw types::CompilationErr(std::format("can't tell the type of {}.", type->debug()), loc);
                 }
             }
 
@@ -575,11 +805,7 @@ namespace der
                     }
                     else
                     {
-                        if (local_scope.at(ident->ident)->is_same(actual_rfs.get()))
-                        {
-                            local_scope[ident->ident] = op->lfs->clone();
-                        }
-                        else
+                        if (!local_scope.at(ident->ident)->is_same(actual_rfs.get()))
                         {
                             throw types::CompilationErr(std::format("identifier '{}' is type {}, you are trying to assign it with a {} instead.", ident->ident,
                                                                     local_scope.at(ident->ident)->debug(), actual_rfs->debug()),
@@ -672,6 +898,9 @@ namespace der
                 der_debug("start");
                 der_debug("lfs check");
                 auto t = bin->clone();
+                // the op comes as "" when the lexer has a token for it but the C side doesn't
+                if (bin->op.empty())
+                    throw types::CompilationErr("binary operation not supported.", loc);
                 auto lfs = get_expr_type(std::move(bin->lfs), loc);
                 der_debug("rfs check");
                 auto rfs = get_expr_type(std::move(bin->rfs), loc);
@@ -693,11 +922,14 @@ namespace der
             std::shared_ptr<types::TypeHandle> check_logical_binary(types::LogicalBinaryOp *bin, const SourceLoc &loc)
             {
                 der_debug("start");
+                if (bin->op.empty())
+                    throw types::CompilationErr("logical binary operation not supported.", loc);
                 der_debug("lfs check");
                 auto lfs = get_expr_type(std::move(bin->lfs), loc);
                 der_debug("rfs check");
                 auto rfs = get_expr_type(std::move(bin->rfs), loc);
-                if (lfs->get_ty() != rfs->get_ty())
+                // enum values come back as the enum itself or as one of its members, is_same knows both
+                if (lfs->get_ty() != rfs->get_ty() && !lfs->is_same(rfs.get()))
                     throw types::CompilationErr("logical binary operation not supported by different operand types.", loc);
                 return std::shared_ptr<types::Bool>(new types::Bool());
             }
@@ -720,7 +952,7 @@ namespace der
             {
                 auto outer = get_expr_type(std::move(sub->target), loc);
                 auto inner = get_expr_type(std::move(sub->inner), loc);
-                der_debug_e(types::ty_to_str[outer->get_ty()]);
+                der_debug_e(types::ty_name(outer->get_ty()));
                 if ((outer->get_ty() != types::TYPES::ARRAY) && (outer->get_ty() != types::TYPES::STRING))
                     throw types::CompilationErr("subscript valabe ssdfqksdqkds dure les arrays and strings uwu", loc);
                 if (inner->get_ty() != types::TYPES::INTEGER)
@@ -760,6 +992,16 @@ namespace der
                 {
                     throw types::CompilationErr("for loop init must be integers.", loc);
                 }
+                if (ranged_for->parallel)
+                {
+                    for (auto &[op, var] : ranged_for->reductions)
+                    {
+                        if (!local_scope.contains(var) || local_scope[var]->get_ty() != types::TYPES::INTEGER)
+                            throw types::CompilationErr(std::format("reduction variable '{}' must be a ra9m local of the enclosing function.", var), loc);
+                    }
+                    std::set<std::string> locals{ranged_for->ident};
+                    check_parallel_writes(ranged_for->stmts, ranged_for, locals, nullptr, loc);
+                }
                 local_scope[ranged_for->ident] = std::make_shared<types::Integer>();
                 auto old = local_scope;
                 for (std::unique_ptr<types::TypeHandle> &e : ranged_for->stmts)
@@ -769,6 +1011,73 @@ namespace der
                 }
                 local_scope = old;
             }
+            // the iterations of lkola mota7arik run concurrently, so a variable living outside the body
+            // can only be written if it's one of the declared reductions, and only in a shape the lowering
+            // knows how to split: `s = s + x` for + and *, or under an `ila` comparing it for min and max
+            void check_parallel_writes(const std::vector<std::unique_ptr<types::TypeHandle>> &stmts, types::RangedFor *loop, std::set<std::string> locals, const types::TypeHandle *guard, const SourceLoc &loc)
+            {
+                auto is_ident = [](const types::TypeHandle *ty, const std::string &name)
+                {
+                    auto id = dynamic_cast<const types::Identifier *>(ty);
+                    return id && id->ident == name;
+                };
+                for (auto &stmt : stmts)
+                {
+                    if (auto var = dynamic_cast<types::Variable *>(stmt.get()))
+                        locals.insert(var->name);
+                    else if (stmt->get_ty() == types::TYPES::RETURN)
+                        throw types::CompilationErr("can't rje3 from inside lkola mota7arik.", loc);
+                    else if (auto _if = dynamic_cast<types::If *>(stmt.get()))
+                    {
+                        check_parallel_writes(_if->body, loop, locals, _if->cond.get(), loc);
+                        check_parallel_writes(_if->else_stmt, loop, locals, _if->cond.get(), loc);
+                    }
+                    else if (auto inner = dynamic_cast<types::RangedFor *>(stmt.get()))
+                    {
+                        auto scope = locals;
+                        scope.insert(inner->ident);
+                        check_parallel_writes(inner->stmts, loop, scope, nullptr, loc);
+                    }
+                    else if (auto match = dynamic_cast<types::Match *>(stmt.get()))
+                    {
+                        for (auto &arm : match->arms)
+                            check_parallel_writes(arm.body, loop, locals, nullptr, loc);
+                    }
+                    else if (auto set = dynamic_cast<types::SetOp *>(stmt.get()))
+                    {
+                        // element and pointer writes are fine, the iterations are expected to touch different ones
+                        const types::TypeHandle *target = set->lfs.get();
+                        bool member = false;
+                        while (auto dot = dynamic_cast<const types::DotOp *>(target))
+                        {
+                            target = dot->lfs.get();
+                            member = true;
+                        }
+                        auto id = dynamic_cast<const types::Identifier *>(target);
+                        if (!id || locals.contains(id->ident))
+                            continue;
+                        if (id->ident == loop->ident)
+                            throw types::CompilationErr(std::format("can't write the lkola mota7arik counter '{}'.", id->ident), loc);
+                        auto red = std::find_if(loop->reductions.begin(), loop->reductions.end(), [&](auto &r)
+                                                { return r.second == id->ident; });
+                        if (red == loop->reductions.end() || member)
+                            throw types::CompilationErr(std::format("'{}' is shared between the threads of lkola mota7arik, make it local to the loop or declare it as a reduction: mota7arik(+ {}).", id->ident, id->ident), loc);
+                        auto &[op, name] = *red;
+                        if (op == "+" || op == "*")
+                        {
+                            auto bin = dynamic_cast<const types::BinaryOp *>(set->rfs.get());
+                            if (!bin || bin->op != op || !(is_ident(bin->lfs.get(), name) || is_ident(bin->rfs.get(), name)))
+                                throw types::CompilationErr(std::format("reduction '{}' can only be updated as {} = {} {} ...", name, name, name, op), loc);
+                        }
+                        else
+                        {
+                            auto cmp = dynamic_cast<const types::LogicalBinaryOp *>(guard);
+                            if (!cmp || (cmp->op != "<" && cmp->op != ">") || !(is_ident(cmp->lfs.get(), name) || is_ident(cmp->rfs.get(), name)))
+                                throw types::CompilationErr(std::format("reduction '{}' can only be updated inside an ila comparing it, like ila x < {} {{ {} = x; }}", name, name, name), loc);
+                        }
+                    }
+                }
+            }
             // FIXME: bruv use the function body statement source loc instead of just copying the end of function loc u dumbass
             void check_fn(types::Function *fnc, const SourceLoc &loc)
             {
@@ -790,7 +1099,12 @@ namespace der
                 {
                     der_debug_e(fnc->args.at(i).ident);
                     der_debug_e(fnc->args.at(i).ty->debug());
-                    local_scope[fnc->args.at(i).ident] = fnc->args.at(i).ty->clone();
+                    auto &arg_ty = fnc->args.at(i).ty;
+                    // user defined types (structs/enums) are resolved right away so the body sees the actual type
+                    if (arg_ty->get_ty() == types::TYPES::IDENT && local_scope.contains(dynamic_cast<types::Identifier *>(arg_ty.get())->ident))
+                        local_scope[fnc->args.at(i).ident] = local_scope.at(dynamic_cast<types::Identifier *>(arg_ty.get())->ident)->clone();
+                    else
+                        local_scope[fnc->args.at(i).ident] = arg_ty->clone();
                 }
 
                 for (size_t i = 0; i < fnc->body.size(); ++i)
@@ -810,13 +1124,54 @@ namespace der
                 ret_fn_ty = nullptr;
                 local_scope = old;
             }
+            // kteb prints one value on its own line, dkhel reads a ra9m from stdin.
+            // they're only builtins as long as the program doesn't define its own
+            std::shared_ptr<types::TypeHandle> check_builtin(const std::string &name, types::Fcall *fcall, const SourceLoc &loc)
+            {
+                m_builtins.insert(name);
+                if (name == "dkhel")
+                {
+                    if (fcall->args.size() != 0)
+                        throw types::CompilationErr("dkhel doesn't take any arguments, it just reads a ra9m.", loc);
+                    return std::make_shared<types::Integer>();
+                }
+                if (fcall->args.size() != 1)
+                    throw types::CompilationErr(std::format("kteb prints exactly one value, you supplied {}.", fcall->args.size()), loc);
+                auto kind = get_expr_type(std::move(fcall->args.at(0)), loc)->get_ty();
+                if (kind != types::TYPES::INTEGER && kind != types::TYPES::CHAR && kind != types::TYPES::BOOL && kind != types::TYPES::STRING && kind != types::TYPES::ENUM && kind != types::TYPES::ENUM_INSTANCE)
+                    throw types::CompilationErr(std::format("kteb can't print a {}.", types::ty_name(kind)), loc);
+                return std::make_shared<types::Void>();
+            }
+            // the C side: kteb dispatches on the argument's C type, so a char literal (an int in C) is cast first
+            void add_builtin(const std::string &name, std::vector<std::unique_ptr<ir::Expr>> &args)
+            {
+                c_includes.insert("stdio.h");
+                if (name == "dkhel")
+                {
+                    c_helpers["dkhel"] = "static inline int dkhel(void) {\n"
+                                         "\tint v = 0;\n"
+                                         "\tif (scanf(\"%d\", &v) != 1)\n"
+                                         "\t\tv = 0;\n"
+                                         "\treturn v;\n"
+                                         "}\n";
+                    return;
+                }
+                c_helpers["kteb"] = "static inline void __der_kteb_int(int v) { printf(\"%d\\n\", v); }\n"
+                                    "static inline void __der_kteb_char(char v) { printf(\"%c\\n\", v); }\n"
+                                    "static inline void __der_kteb_str(const char *v) { printf(\"%s\\n\", v); }\n"
+                                    "#define kteb(x) _Generic((x), char: __der_kteb_char, char *: __der_kteb_str, const char *: __der_kteb_str, default: __der_kteb_int)(x)\n";
+                if (args.size() == 1 && dynamic_cast<ir::Char *>(args.at(0).get()))
+                    args.at(0) = std::make_unique<ir::Cast>("char", std::move(args.at(0)));
+            }
             std::shared_ptr<types::TypeHandle> check_fncall(types::Fcall *fcall, const SourceLoc &loc)
             {
+                if (auto id = dynamic_cast<types::Identifier *>(fcall->callee.get()); id && (id->ident == "kteb" || id->ident == "dkhel") && !local_scope.contains(id->ident))
+                    return check_builtin(id->ident, fcall, loc);
                 auto old = local_scope;
                 auto callee = get_expr_type(std::move(fcall->callee), loc);
                 if (callee->get_ty() != types::TYPES::FUNCTION)
                 {
-                    throw types::CompilationErr(std::format("'{}' machi fonction bach tcalliha hhhhhhhh.", types::ty_to_str[callee->get_ty()]), loc);
+                    throw types::CompilationErr(std::format("'{}' machi fonction bach tcalliha hhhhhhhh.", types::ty_name(callee->get_ty())), loc);
                 }
                 types::Function *fn_callee = dynamic_cast<types::Function *>(callee.get());
                 {
@@ -874,7 +1229,7 @@ namespace der
                     //             else if (auto l = generics_scope.at(g->ident); l->get_ty() != call_ty->get_ty())
                     //             {
                     //                 der_debug_e(l->get_ty() == argty);
-                    //                 throw types::CompilationErr(std::format("generic '{}' deduced to '{}', but you supplied a '{}'.", g->ident, types::ty_to_str[l->get_ty()], types::ty_to_str[call_ty->get_ty()]), loc);
+                    //                 throw types::CompilationErr(std::format("generic '{}' deduced to '{}', but you supplied a '{}'.", g->ident, types::ty_name(l->get_ty()), types::ty_name(call_ty->get_ty())), loc);
                     //             }
                     //             else
                     //             {
@@ -910,6 +1265,55 @@ namespace der
                 local_scope = old;
                 return fn_callee->ret_ty->clone();
             }
+            void check_match(types::Match *match, const SourceLoc &loc)
+            {
+                auto scrutinee = get_expr_type(std::move(match->scrutinee), loc);
+                auto kind = scrutinee->get_ty();
+                if (kind != types::TYPES::INTEGER && kind != types::TYPES::CHAR && kind != types::TYPES::BOOL && kind != types::TYPES::STRING && kind != types::TYPES::ENUM && kind != types::TYPES::ENUM_INSTANCE)
+                    throw types::CompilationErr("chouf only works on ra9m, harf, bool, ktba and enums.", loc);
+                std::set<std::string> seen{};
+                std::set<std::string> covered{};
+                bool has_wildcard = false;
+                for (auto &arm : match->arms)
+                {
+                    if (has_wildcard)
+                        throw types::CompilationErr("chouf arm after '_' can never be reached.", loc);
+                    if (arm.pattern == nullptr)
+                    {
+                        has_wildcard = true;
+                    }
+                    else
+                    {
+                        auto pk = arm.pattern->get_ty();
+                        bool constant = pk == types::TYPES::INTEGER || pk == types::TYPES::CHAR || pk == types::TYPES::BOOL || pk == types::TYPES::STRING || pk == types::TYPES::DOT_OP;
+                        if (pk == types::TYPES::UNARY_OP)
+                            constant = dynamic_cast<types::UnaryOp *>(arm.pattern.get())->victim->get_ty() == types::TYPES::INTEGER;
+                        if (!constant)
+                            throw types::CompilationErr("chouf patterns must be literals or enum members.", loc);
+                        if (seen.contains(arm.key))
+                            throw types::CompilationErr("chouf pattern is repeated.", loc);
+                        seen.insert(arm.key);
+                        auto pattern = get_expr_type(arm.pattern->clone(), loc);
+                        if (pk == types::TYPES::DOT_OP && pattern->get_ty() != types::TYPES::ENUM_INSTANCE)
+                            throw types::CompilationErr("chouf patterns must be literals or enum members.", loc);
+                        if (!scrutinee->is_same(pattern.get()))
+                            throw types::CompilationErr(std::format("chouf pattern is {}, but the value is {}.", pattern->debug(), scrutinee->debug()), loc);
+                        if (pattern->get_ty() == types::TYPES::ENUM_INSTANCE)
+                            covered.insert(dynamic_cast<types::EnumInstance *>(pattern.get())->value);
+                    }
+                    for (auto &s : arm.body)
+                        get_stmt_type(s->clone(), loc);
+                }
+                if (has_wildcard || (kind != types::TYPES::ENUM && kind != types::TYPES::ENUM_INSTANCE))
+                    return;
+                const types::Enum &_enum = kind == types::TYPES::ENUM ? *dynamic_cast<types::Enum *>(scrutinee.get()) : dynamic_cast<types::EnumInstance *>(scrutinee.get())->en;
+                std::string missing{};
+                for (auto &m : _enum.members)
+                    if (!covered.contains(m))
+                        missing += missing.empty() ? m : ", " + m;
+                if (!missing.empty())
+                    throw types::CompilationErr(std::format("chouf on enum {} doesn't handle: {}, add them or a '_' arm.", _enum.name, missing), loc);
+            }
             void check_struct(types::Struct *_struct, const SourceLoc &loc)
             {
                 if (local_scope.find(_struct->name) != local_scope.end())
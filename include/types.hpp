@@ -45,10 +45,11 @@ namespace der
             POINTER_DEREF,
             GET_ADDRESS,
             CAST,
+            MATCH,
             DUMMY
         };
 
-        std::map<TYPES, std::string> ty_to_str{
+        inline const std::map<TYPES, std::string> ty_to_str{
             {TYPES::BOOL, "bool"},
             {TYPES::INTEGER, "ra9m"},
             {TYPES::STRING, "ktba"},
@@ -57,6 +58,13 @@ namespace der
 
         };
 
+        // the name the language gives a type, empty for the ones that don't have one
+        inline std::string ty_name(TYPES ty)
+        {
+            auto it = ty_to_str.find(ty);
+            return it == ty_to_str.end() ? "" : it->second;
+        }
+
         struct TypeHandle
         {
             virtual std::string debug() const = 0;
@@ -263,10 +271,12 @@ namespace der
         {
             std::unique_ptr<TypeHandle> lfs;
             std::unique_ptr<TypeHandle> rfs;
+            // operator spelling, only used to recognise reductions
+            std::string op;
 
-            BinaryOp(std::unique_ptr<TypeHandle> lfs, std::unique_ptr<TypeHandle> rfs) : lfs(std::move(lfs)), rfs(std::move(rfs)) {}
+            BinaryOp(std::unique_ptr<TypeHandle> lfs, std::unique_ptr<TypeHandle> rfs, const std::string &op = "") : lfs(std::move(lfs)), rfs(std::move(rfs)), op(op) {}
 
-            BinaryOp(const BinaryOp &other) : lfs(other.lfs->clone()), rfs(other.rfs->clone()) {}
+            BinaryOp(const BinaryOp &other) : lfs(other.lfs->clone()), rfs(other.rfs->clone()), op(other.op) {}
 
             TYPES get_ty() const override
             {
@@ -375,10 +385,12 @@ namespace der
         {
             std::unique_ptr<TypeHandle> lfs;
             std::unique_ptr<TypeHandle> rfs;
+            // operator spelling, only used to recognise reductions
+            std::string op;
 
-            LogicalBinaryOp(std::unique_ptr<TypeHandle> lfs, std::unique_ptr<TypeHandle> rfs) : lfs(std::move(lfs)), rfs(std::move(rfs)) {}
+            LogicalBinaryOp(std::unique_ptr<TypeHandle> lfs, std::unique_ptr<TypeHandle> rfs, const std::string &op = "") : lfs(std::move(lfs)), rfs(std::move(rfs)), op(op) {}
 
-            LogicalBinaryOp(const LogicalBinaryOp &other) : lfs(other.lfs->clone()), rfs(other.rfs->clone()) {}
+            LogicalBinaryOp(const LogicalBinaryOp &other) : lfs(other.lfs->clone()), rfs(other.rfs->clone()), op(other.op) {}
 
             TYPES get_ty() const override
             {
@@ -426,6 +438,10 @@ namespace der
             std::unique_ptr<TypeHandle> f_end;
             std::vector<std::unique_ptr<TypeHandle>> stmts;
             std::string ident;
+            // lkola mota7arik: iterations may run on any thread
+            bool parallel = false;
+            // (operator, variable) pairs from `mota7arik(+ s, min lo)`
+            std::vector<std::pair<std::string, std::string>> reductions;
 
             RangedFor(const std::string &ident, std::unique_ptr<TypeHandle> f1, std::unique_ptr<TypeHandle> f2, const std::vector<std::unique_ptr<TypeHandle>> &stmt) : ident(ident), f_start(std::move(f1)), f_end(std::move(f2))
             {
@@ -434,7 +450,7 @@ namespace der
                     stmts.push_back(e->clone());
                 }
             }
-            RangedFor(const RangedFor &other) : ident(other.ident), f_start(other.f_start->clone()), f_end(other.f_end->clone())
+            RangedFor(const RangedFor &other) : ident(other.ident), f_start(other.f_start->clone()), f_end(other.f_end->clone()), parallel(other.parallel), reductions(other.reductions)
             {
                 for (auto &e : other.stmts)
                 {
@@ -542,9 +558,7 @@ namespace der
             }
             bool is_same(TypeHandle *other) const override
             {
-                std::cout << "ababababababa\n";
                 Array *x = dynamic_cast<Array *>(other);
-                std::cout << "bbbbbbbbbbbbbbbb\n";
                 return (ty->get_ty() == x->ty->get_ty()) && (size == x->size);
             }
         };
@@ -891,6 +905,47 @@ namespace der
             }
         };
 
+        struct MatchArm
+        {
+            // nullptr for the `_` arm
+            std::unique_ptr<TypeHandle> pattern;
+            std::string key;
+            std::vector<std::unique_ptr<TypeHandle>> body;
+            MatchArm(std::unique_ptr<TypeHandle> pattern, const std::string &key, std::vector<std::unique_ptr<TypeHandle>> &&body) : pattern(std::move(pattern)), key(key), body(std::move(body)) {}
+            MatchArm(const MatchArm &other) : pattern(other.pattern ? other.pattern->clone() : nullptr), key(other.key)
+            {
+                for (const auto &a : other.body)
+                    body.push_back(a->clone());
+            }
+        };
+
+        struct Match : TypeHandle
+        {
+            std::unique_ptr<TypeHandle> scrutinee;
+            std::vector<MatchArm> arms;
+
+            Match(std::unique_ptr<TypeHandle> scrutinee, std::vector<MatchArm> &&arms) : scrutinee(std::move(scrutinee)), arms(std::move(arms)) {}
+            Match(const Match &other) : scrutinee(other.scrutinee->clone()), arms(other.arms) {}
+
+            TYPES get_ty() const override
+            {
+                return TYPES::MATCH;
+            }
+            std::unique_ptr<TypeHandle> clone() const override
+            {
+                return std::make_unique<Match>(*this);
+            }
+            std::string debug() const override
+            {
+                return "Ty.Match";
+            }
+
+            bool is_same(TypeHandle *other) const override
+            {
+                return false;
+            }
+        };
+
         struct Dummy : TypeHandle
         {
             TYPES get_ty() const override
@@ -0,0 +1,1196 @@
+#ifndef DER_VM_HPP
+#define DER_VM_HPP
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <memory>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+#include <format>
+#include "der_ir.hpp"
+#include "lexer.hpp"
+#include "debug.hpp"
+
+// `derijac run`: the lowered IR is turned into register bytecode and interpreted right away, no C compiler involved.
+// every function gets a window of registers, its arguments are the first ones and a call just slides the window
+// up to where the caller put them. ints behave like the C `int` the other backend emits, strings are the same
+// `const char *` they'd be in C, arrays are runs of slots in an arena that's popped when the function returns.
+// structs and pointers aren't supported yet.
+#if defined(__GNUC__) || defined(__clang__)
+#define DER_VM_COMPUTED_GOTO
+#endif
+
+namespace der
+{
+    namespace vm
+    {
+        using Value = int64_t;
+        using Stmts = std::vector<std::unique_ptr<ir::Expr>>;
+
+        struct VmErr
+        {
+            std::string msg;
+            VmErr(const std::string &m) : msg(m) {}
+        };
+
+        // R[x] is a register of the current window, K a constant, G a global.
+        // jumps always keep their target in c.
+#define DER_VM_OPS(X)                                          \
+    X(MOV)    /* R[a] = R[b] */                                \
+    X(LOADI)  /* R[a] = b */                                   \
+    X(LOADK)  /* R[a] = K[b] */                                \
+    X(GETG)   /* R[a] = G[b] */                                \
+    X(SETG)   /* G[a] = R[b] */                                \
+    X(ADD)    /* R[a] = R[b] + R[c], and so on */              \
+    X(SUB)                                                     \
+    X(MUL)                                                     \
+    X(DIV)                                                     \
+    X(MOD)                                                     \
+    X(BAND)                                                    \
+    X(BOR)                                                     \
+    X(BXOR)                                                    \
+    X(SHL)                                                     \
+    X(SHR)                                                     \
+    X(ADDI)   /* R[a] = R[b] + c */                            \
+    X(NEG)    /* R[a] = -R[b] */                               \
+    X(NOT)    /* R[a] = !R[b] */                               \
+    X(TRUNC8) /* R[a] = (char)R[b] */                          \
+    X(ZEXT8)  /* R[a] = (unsigned char)R[b] */                 \
+    X(EQ)     /* R[a] = R[b] == R[c], and so on */             \
+    X(NE)                                                      \
+    X(LT)                                                      \
+    X(LE)                                                      \
+    X(GT)                                                      \
+    X(GE)                                                      \
+    X(JMP)    /* goto c */                                     \
+    X(JZ)     /* if !R[a] goto c */                            \
+    X(JNZ)    /* if R[a] goto c */                             \
+    X(JEQ)    /* if R[a] == R[b] goto c, and so on */          \
+    X(JNE)                                                     \
+    X(JLT)                                                     \
+    X(JLE)                                                     \
+    X(JGT)                                                     \
+    X(JGE)                                                     \
+    X(JEQI)   /* if R[a] == b goto c, and so on */             \
+    X(JNEI)                                                    \
+    X(JLTI)                                                    \
+    X(JLEI)                                                    \
+    X(JGTI)                                                    \
+    X(JGEI)                                                    \
+    X(INCLT)  /* if ++R[a] < R[b] goto c, closes a lkola */    \
+    X(INCLTI) /* if ++R[a] < b goto c */                       \
+    X(TABLE)  /* goto tables[b][R[a]] */                       \
+    X(ALLOC)  /* R[a] = b zeroed slots from the arena */       \
+    X(LOADX)  /* R[a] = R[b][R[c]] */                          \
+    X(STOREX) /* R[a][R[b]] = R[c] */                          \
+    X(STOREI) /* R[a][b] = R[c] */                             \
+    X(LOADB)  /* R[a] = ((const char *)R[b])[R[c]] */          \
+    X(CALL)   /* R[a] = functions[b](R[c], R[c + 1], ...) */   \
+    X(NATIVE) /* R[a] = natives[b](R[c], R[c + 1], ...) */     \
+    X(RET)    /* return R[a] */                                \
+    X(PUTI)   /* kteb an int */                                \
+    X(PUTC)   /* kteb a char */                                \
+    X(PUTS)   /* kteb a string */                              \
+    X(GETI)   /* R[a] = dkhel() */
+
+#define DER_VM_ENUM(x) x,
+        enum class Op : uint8_t
+        {
+            DER_VM_OPS(DER_VM_ENUM)
+        };
+#undef DER_VM_ENUM
+
+        // C library functions the lowered IR itself calls (string chouf)
+        enum class Native : int32_t
+        {
+            STRLEN,
+            MEMCMP,
+            STR_HASH,
+        };
+
+        struct Instr
+        {
+            Op op;
+            int32_t a = 0;
+            int32_t b = 0;
+            int32_t c = 0;
+        };
+
+        struct FunctionInfo
+        {
+            std::string name;
+            std::string ret_ty;
+            size_t arity = 0;
+            int32_t entry = 0;
+            // registers the function needs, arguments included
+            int32_t frame = 0;
+        };
+
+        struct JumpTable
+        {
+            Value low = 0;
+            std::vector<int32_t> targets{};
+            int32_t fallback = 0;
+        };
+
+        struct Program
+        {
+            std::vector<Instr> code{};
+            std::vector<FunctionInfo> functions{};
+            std::vector<Value> constants{};
+            // backing storage for the string constants, a deque so the pointers stay put
+            std::deque<std::string> strings{};
+            std::vector<JumpTable> tables{};
+            size_t globals = 0;
+            // runs the global initializers, then main
+            std::optional<size_t> init{};
+            std::optional<size_t> main{};
+        };
+
+        inline std::string strip_pointer(const std::string &ty)
+        {
+            if (!ty.ends_with("*"))
+                return "int";
+            std::string out = ty.substr(0, ty.size() - 1);
+            while (out.ends_with(" "))
+                out.pop_back();
+            if (out.starts_with("const ") && !out.ends_with("*"))
+                out = out.substr(6);
+            return out;
+        }
+
+        struct Compiler
+        {
+            struct Local
+            {
+                int32_t reg;
+                std::string ty;
+            };
+            struct Global
+            {
+                int32_t index;
+                std::string ty;
+            };
+
+            Program m_prog{};
+            std::map<std::string, size_t> m_functions{};
+            std::map<std::string, Value> m_enums{};
+            std::map<std::string, Global> m_globals{};
+
+            // per function state
+            std::vector<std::map<std::string, Local>> m_scopes{};
+            int32_t m_top = 0;
+            int32_t m_max = 0;
+            // jump targets are label ids until the function is done, then they're patched to code offsets
+            std::vector<int32_t> m_label_pcs{};
+            std::map<std::string, int32_t> m_named_labels{};
+            std::vector<size_t> m_tables_used{};
+            bool m_in_init = false;
+
+            static bool is_jump(Op op)
+            {
+                switch (op)
+                {
+                case Op::JMP:
+                case Op::JZ:
+                case Op::JNZ:
+                case Op::JEQ:
+                case Op::JNE:
+                case Op::JLT:
+                case Op::JLE:
+                case Op::JGT:
+                case Op::JGE:
+                case Op::JEQI:
+                case Op::JNEI:
+                case Op::JLTI:
+                case Op::JLEI:
+                case Op::JGTI:
+                case Op::JGEI:
+                case Op::INCLT:
+                case Op::INCLTI:
+                    return true;
+                default:
+                    return false;
+                }
+            }
+
+            static ir::Expr *strip(ir::Expr *e)
+            {
+                while (auto g = dynamic_cast<ir::Group *>(e))
+                    e = g->inner.get();
+                return e;
+            }
+
+            static std::optional<Value> constant(ir::Expr *e, const std::map<std::string, Value> &enums)
+            {
+                e = strip(e);
+                if (auto x = dynamic_cast<ir::Integer *>(e))
+                    return x->val;
+                if (auto x = dynamic_cast<ir::Char *>(e))
+                    return Value(x->val);
+                if (auto x = dynamic_cast<ir::Bool *>(e))
+                    return Value(x->val);
+                if (auto x = dynamic_cast<ir::Ident *>(e); x && enums.contains(x->_value))
+                    return enums.at(x->_value);
+                if (auto x = dynamic_cast<ir::Unary *>(e); x && x->op == "-")
+                {
+                    if (auto v = constant(x->victim.get(), enums))
+                        return -*v;
+                }
+                return std::nullopt;
+            }
+            std::optional<Value> constant(ir::Expr *e) const
+            {
+                return constant(e, m_enums);
+            }
+            static bool fits(Value v)
+            {
+                return v >= INT32_MIN && v <= INT32_MAX;
+            }
+
+            [[noreturn]] static void unsupported(ir::Expr *e)
+            {
+                throw VmErr(std::format("derijac run doesn't support '{}' yet, compile it to C instead.", e->value()));
+            }
+
+            void emit(Op op, int32_t a = 0, int32_t b = 0, int32_t c = 0)
+            {
+                m_prog.code.push_back(Instr{op, a, b, c});
+            }
+            int32_t new_label()
+            {
+                m_label_pcs.push_back(-1);
+                return int32_t(m_label_pcs.size() - 1);
+            }
+            void place(int32_t label)
+            {
+                m_label_pcs.at(label) = int32_t(m_prog.code.size());
+            }
+            int32_t temp()
+            {
+                m_top += 1;
+                m_max = std::max(m_max, m_top);
+                return m_top - 1;
+            }
+
+            std::optional<Local> lookup(const std::string &name) const
+            {
+                for (auto it = m_scopes.rbegin(); it != m_scopes.rend(); ++it)
+                    if (auto found = it->find(name); found != it->end())
+                        return found->second;
+                return std::nullopt;
+            }
+            int32_t declare(const std::string &name, const std::string &ty)
+            {
+                int32_t reg = temp();
+                m_scopes.back()[name] = Local{reg, ty};
+                return reg;
+            }
+
+            // the C type of an expression, just enough to pick how kteb prints it and how [] reads
+            std::string type_of(ir::Expr *e)
+            {
+                e = strip(e);
+                if (dynamic_cast<ir::String *>(e))
+                    return "const char*";
+                if (dynamic_cast<ir::Char *>(e))
+                    return "char";
+                if (auto x = dynamic_cast<ir::Cast *>(e))
+                    return x->ty;
+                if (auto x = dynamic_cast<ir::Ident *>(e))
+                {
+                    if (auto local = lookup(x->_value))
+                        return local->ty;
+                    if (m_globals.contains(x->_value))
+                        return m_globals.at(x->_value).ty;
+                    return "int";
+                }
+                if (auto x = dynamic_cast<ir::Subscript *>(e))
+                    return strip_pointer(type_of(x->target.get()));
+                if (auto x = dynamic_cast<ir::FunctionCall *>(e))
+                {
+                    auto callee = dynamic_cast<ir::Ident *>(x->callee.get());
+                    if (callee && m_functions.contains(callee->_value))
+                        return m_prog.functions.at(m_functions.at(callee->_value)).ret_ty;
+                }
+                return "int";
+            }
+
+            // jumps to target when e's truthiness is `when`, comparisons and && / || never materialize a bool
+            void jump_if(ir::Expr *e, bool when, int32_t target)
+            {
+                e = strip(e);
+                if (auto v = constant(e))
+                {
+                    if ((*v != 0) == when)
+                        emit(Op::JMP, 0, 0, target);
+                    return;
+                }
+                if (auto un = dynamic_cast<ir::Unary *>(e); un && un->op == "!")
+                    return jump_if(un->victim.get(), !when, target);
+                if (auto log = dynamic_cast<ir::Logical *>(e))
+                {
+                    if (log->op == "&&" || log->op == "||")
+                    {
+                        // `a && b` is true only if both are, `a || b` false only if both are
+                        bool all = (log->op == "&&") == when;
+                        if (all)
+                        {
+                            int32_t skip = new_label();
+                            jump_if(log->lfs.get(), !when, skip);
+                            jump_if(log->rfs.get(), when, target);
+                            place(skip);
+                        }
+                        else
+                        {
+                            jump_if(log->lfs.get(), when, target);
+                            jump_if(log->rfs.get(), when, target);
+                        }
+                        return;
+                    }
+                    static const std::map<std::string, std::pair<Op, Op>> jumps{
+                        {"==", {Op::JEQ, Op::JNE}},
+                        {"!=", {Op::JNE, Op::JEQ}},
+                        {"<", {Op::JLT, Op::JGE}},
+                        {"<=", {Op::JLE, Op::JGT}},
+                        {">", {Op::JGT, Op::JLE}},
+                        {">=", {Op::JGE, Op::JLT}},
+                    };
+                    if (auto it = jumps.find(log->op); it != jumps.end())
+                    {
+                        int32_t save = m_top;
+                        Op op = when ? it->second.first : it->second.second;
+                        int32_t a = expr(log->lfs.get());
+                        if (auto k = constant(log->rfs.get()); k && fits(*k))
+                            emit(Op(int(op) + int(Op::JEQI) - int(Op::JEQ)), a, int32_t(*k), target);
+                        else
+                            emit(op, a, expr(log->rfs.get()), target);
+                        m_top = save;
+                        return;
+                    }
+                }
+                int32_t save = m_top;
+                emit(when ? Op::JNZ : Op::JZ, expr(e), 0, target);
+                m_top = save;
+            }
+
+            int32_t call(ir::Expr *callee_expr, const std::vector<ir::Expr *> &args, int32_t want)
+            {
+                auto callee = dynamic_cast<ir::Ident *>(strip(callee_expr));
+                if (!callee)
+                    unsupported(callee_expr);
+                const std::string &name = callee->_value;
+                if (m_functions.contains(name))
+                {
+                    auto &fn = m_prog.functions.at(m_functions.at(name));
+                    if (fn.arity != args.size())
+                        throw VmErr(std::format("'{}' takes {} arguments.", name, fn.arity));
+                    int32_t dst = want >= 0 ? want : temp();
+                    int32_t base = m_top;
+                    for (size_t i = 0; i < args.size(); ++i)
+                        temp();
+                    for (size_t i = 0; i < args.size(); ++i)
+                        expr(args.at(i), base + int32_t(i));
+                    emit(Op::CALL, dst, int32_t(m_functions.at(name)), base);
+                    m_top = base;
+                    return dst;
+                }
+                if (name == "kteb" && args.size() == 1)
+                {
+                    std::string ty = type_of(args.at(0));
+                    int32_t v = expr(args.at(0));
+                    emit(ty == "char" ? Op::PUTC : (ty == "const char*" || ty == "char*") ? Op::PUTS : Op::PUTI, v);
+                    return v;
+                }
+                if (name == "dkhel" && args.size() == 0)
+                {
+                    int32_t dst = want >= 0 ? want : temp();
+                    emit(Op::GETI, dst);
+                    return dst;
+                }
+                static const std::map<std::string, std::pair<Native, size_t>> natives{
+                    {"strlen", {Native::STRLEN, 1}},
+                    {"memcmp", {Native::MEMCMP, 3}},
+                    {"__der_str_hash", {Native::STR_HASH, 3}},
+                };
+                if (auto it = natives.find(name); it != natives.end() && it->second.second == args.size())
+                {
+                    int32_t dst = want >= 0 ? want : temp();
+                    int32_t base = m_top;
+                    for (size_t i = 0; i < args.size(); ++i)
+                        temp();
+                    for (size_t i = 0; i < args.size(); ++i)
+                        expr(args.at(i), base + int32_t(i));
+                    emit(Op::NATIVE, dst, int32_t(it->second.first), base);
+                    m_top = base;
+                    return dst;
+                }
+                throw VmErr(std::format("'{}' isn't a function derijac run knows about.", name));
+            }
+
+            // compiles e and returns the register holding its value, which is `want` when given.
+            // only the last instruction writes `want`, so `s = a[i] + s` can't clobber s before reading it
+            int32_t expr(ir::Expr *e, int32_t want = -1)
+            {
+                e = strip(e);
+                auto dst = [&]()
+                { return want >= 0 ? want : temp(); };
+                if (auto v = constant(e))
+                {
+                    int32_t d = dst();
+                    if (fits(*v))
+                        emit(Op::LOADI, d, int32_t(*v));
+                    else
+                    {
+                        m_prog.constants.push_back(*v);
+                        emit(Op::LOADK, d, int32_t(m_prog.constants.size() - 1));
+                    }
+                    return d;
+                }
+                if (auto x = dynamic_cast<ir::String *>(e))
+                {
+                    // the literal is kept as written in the C output, so the escapes still need resolving
+                    m_prog.strings.push_back(lexer::unescape(x->val));
+                    m_prog.constants.push_back(reinterpret_cast<Value>(m_prog.strings.back().c_str()));
+                    int32_t d = dst();
+                    emit(Op::LOADK, d, int32_t(m_prog.constants.size() - 1));
+                    return d;
+                }
+                if (auto x = dynamic_cast<ir::Ident *>(e))
+                {
+                    if (auto local = lookup(x->_value))
+                    {
+                        if (want >= 0 && want != local->reg)
+                            emit(Op::MOV, want, local->reg);
+                        return want >= 0 ? want : local->reg;
+                    }
+                    if (auto g = m_globals.find(x->_value); g != m_globals.end())
+                    {
+                        int32_t d = dst();
+                        emit(Op::GETG, d, g->second.index);
+                        return d;
+                    }
+                    throw VmErr(std::format("unknown name '{}'.", x->_value));
+                }
+                if (auto x = dynamic_cast<ir::Binary *>(e))
+                {
+                    static const std::map<std::string, Op> ops{
+                        {"+", Op::ADD},
+                        {"-", Op::SUB},
+                        {"*", Op::MUL},
+                        {"/", Op::DIV},
+                        {"%", Op::MOD},
+                        {"&", Op::BAND},
+                        {"|", Op::BOR},
+                        {"^", Op::BXOR},
+                        {"<<", Op::SHL},
+                        {">>", Op::SHR},
+                    };
+                    auto it = ops.find(x->op);
+                    if (it == ops.end())
+                        unsupported(e);
+                    int32_t save = m_top;
+                    int32_t a = expr(x->lfs.get());
+                    if (auto k = constant(x->rfs.get()); k && (x->op == "+" || x->op == "-") && fits(*k) && fits(-*k))
+                    {
+                        m_top = save;
+                        int32_t d = dst();
+                        emit(Op::ADDI, d, a, int32_t(x->op == "+" ? *k : -*k));
+                        return d;
+                    }
+                    int32_t b = expr(x->rfs.get());
+                    m_top = save;
+                    int32_t d = dst();
+                    emit(it->second, d, a, b);
+                    return d;
+                }
+                if (auto x = dynamic_cast<ir::Logical *>(e))
+                {
+                    static const std::map<std::string, Op> ops{
+                        {"==", Op::EQ},
+                        {"!=", Op::NE},
+                        {"<", Op::LT},
+                        {"<=", Op::LE},
+                        {">", Op::GT},
+                        {">=", Op::GE},
+                    };
+                    if (auto it = ops.find(x->op); it != ops.end())
+                    {
+                        int32_t save = m_top;
+                        int32_t a = expr(x->lfs.get());
+                        int32_t b = expr(x->rfs.get());
+                        m_top = save;
+                        int32_t d = dst();
+                        emit(it->second, d, a, b);
+                        return d;
+                    }
+                    // && and ||, built in a scratch register since the operands may read `want`
+                    int32_t t = temp();
+                    int32_t end = new_label();
+                    emit(Op::LOADI, t, 0);
+                    jump_if(e, false, end);
+                    emit(Op::LOADI, t, 1);
+                    place(end);
+                    if (want >= 0)
+                    {
+                        emit(Op::MOV, want, t);
+                        return want;
+                    }
+                    return t;
+                }
+                if (auto x = dynamic_cast<ir::Unary *>(e))
+                {
+                    if (x->op == "+")
+                        return expr(x->victim.get(), want);
+                    if (x->op != "-" && x->op != "!")
+                        unsupported(e);
+                    int32_t save = m_top;
+                    int32_t v = expr(x->victim.get());
+                    m_top = save;
+                    int32_t d = dst();
+                    emit(x->op == "-" ? Op::NEG : Op::NOT, d, v);
+                    return d;
+                }
+                if (auto x = dynamic_cast<ir::Cast *>(e))
+                {
+                    int32_t save = m_top;
+                    int32_t v = expr(x->victim.get());
+                    m_top = save;
+                    int32_t d = dst();
+                    if (x->ty == "char")
+                        emit(Op::TRUNC8, d, v);
+                    else if (x->ty == "unsigned char")
+                        emit(Op::ZEXT8, d, v);
+                    else if (d != v)
+                        emit(Op::MOV, d, v);
+                    return d;
+                }
+                if (auto x = dynamic_cast<ir::Subscript *>(e))
+                {
+                    int32_t save = m_top;
+                    bool bytes = type_of(x->target.get()) == "const char*";
+                    int32_t base = expr(x->target.get());
+                    int32_t index = expr(x->inner.get());
+                    m_top = save;
+                    int32_t d = dst();
+                    emit(bytes ? Op::LOADB : Op::LOADX, d, base, index);
+                    return d;
+                }
+                if (auto x = dynamic_cast<ir::FunctionCall *>(e))
+                {
+                    std::vector<ir::Expr *> args{};
+                    for (auto &a : x->args)
+                        args.push_back(a.get());
+                    return call(x->callee.get(), args, want);
+                }
+                if (auto x = dynamic_cast<ir::Pipe *>(e))
+                    return call(x->rfs.get(), {x->lfs.get()}, want);
+                unsupported(e);
+            }
+
+            void assign(ir::SetOp *set)
+            {
+                ir::Expr *target = strip(set->target.get());
+                if (auto id = dynamic_cast<ir::Ident *>(target))
+                {
+                    if (auto local = lookup(id->_value))
+                    {
+                        expr(set->_value.get(), local->reg);
+                        return;
+                    }
+                    if (auto g = m_globals.find(id->_value); g != m_globals.end())
+                    {
+                        emit(Op::SETG, g->second.index, expr(set->_value.get()));
+                        return;
+                    }
+                    throw VmErr(std::format("unknown name '{}'.", id->_value));
+                }
+                if (auto sub = dynamic_cast<ir::Subscript *>(target); sub && type_of(sub->target.get()) != "const char*")
+                {
+                    int32_t base = expr(sub->target.get());
+                    int32_t index = expr(sub->inner.get());
+                    emit(Op::STOREX, base, index, expr(set->_value.get()));
+                    return;
+                }
+                unsupported(set);
+            }
+
+            void block(const Stmts & body)
+            {
+                m_scopes.push_back({});
+                int32_t save = m_top;
+                for (auto &s : body)
+                    stmt(s.get());
+                m_top = save;
+                m_scopes.pop_back();
+            }
+
+            void array(int32_t reg, ir::ArrayVariable *arr)
+            {
+                emit(Op::ALLOC, reg, int32_t(arr->size));
+                auto values = dynamic_cast<ir::Array *>(arr->_value.get());
+                if (!values)
+                    unsupported(arr);
+                for (size_t i = 0; i < values->values.size() && i < arr->size; ++i)
+                {
+                    int32_t save = m_top;
+                    emit(Op::STOREI, reg, int32_t(i), expr(values->values.at(i).get()));
+                    m_top = save;
+                }
+            }
+
+            int32_t label_for(const std::string &name)
+            {
+                if (!m_named_labels.contains(name))
+                    m_named_labels[name] = new_label();
+                return m_named_labels.at(name);
+            }
+
+            void stmt(ir::Expr *e)
+            {
+                int32_t save = m_top;
+                if (auto var = dynamic_cast<ir::Variable *>(e))
+                {
+                    if (var->ty.starts_with("struct "))
+                        unsupported(e);
+                    // the initializer is compiled before the name exists, `dir x = x + 1` reads the outer x
+                    int32_t reg = temp();
+                    if (var->_value)
+                        expr(var->_value.get(), reg);
+                    m_top = reg + 1;
+                    m_scopes.back()[var->name] = Local{reg, var->ty};
+                    return;
+                }
+                if (auto arr = dynamic_cast<ir::ArrayVariable *>(e))
+                {
+                    if (m_in_init)
+                    {
+                        // a global array, it's built here and published to its slot
+                        int32_t reg = temp();
+                        array(reg, arr);
+                        emit(Op::SETG, m_globals.at(arr->name).index, reg);
+                        m_top = save;
+                        return;
+                    }
+                    int32_t reg = declare(arr->name, arr->ty + "*");
+                    array(reg, arr);
+                    return;
+                }
+                if (auto set = dynamic_cast<ir::SetOp *>(e))
+                    assign(set);
+                else if (auto x = dynamic_cast<ir::If *>(e))
+                {
+                    int32_t other = new_label();
+                    jump_if(x->cond.get(), false, other);
+                    block(x->body);
+                    if (x->else_block.size() > 0)
+                    {
+                        int32_t end = new_label();
+                        emit(Op::JMP, 0, 0, end);
+                        place(other);
+                        block(x->else_block);
+                        place(end);
+                    }
+                    else
+                        place(other);
+                }
+                else if (auto x = dynamic_cast<ir::SmolIf *>(e))
+                {
+                    int32_t end = new_label();
+                    jump_if(x->lfs.get(), false, end);
+                    stmt(x->rfs.get());
+                    place(end);
+                }
+                else if (auto x = dynamic_cast<ir::RangedFor *>(e))
+                    ranged_for(x);
+                else if (auto x = dynamic_cast<ir::For *>(e))
+                {
+                    // init; goto cond; top: body; step; cond: if (cond) goto top;
+                    m_scopes.push_back({});
+                    if (x->init)
+                        stmt(x->init.get());
+                    int32_t top = new_label(), cond = new_label();
+                    emit(Op::JMP, 0, 0, cond);
+                    place(top);
+                    block(x->body);
+                    if (x->step)
+                        stmt(x->step.get());
+                    place(cond);
+                    jump_if(x->cond.get(), true, top);
+                    m_scopes.pop_back();
+                }
+                else if (auto x = dynamic_cast<ir::Block *>(e))
+                    block(x->body);
+                else if (auto x = dynamic_cast<ir::Return *>(e))
+                    emit(Op::RET, expr(x->ret.get()));
+                else if (auto x = dynamic_cast<ir::Label *>(e))
+                    place(label_for(x->name));
+                else if (auto x = dynamic_cast<ir::Goto *>(e))
+                    emit(Op::JMP, 0, 0, label_for(x->label));
+                else if (auto x = dynamic_cast<ir::Switch *>(e))
+                    lower_switch(x);
+                else
+                    expr(e);
+                m_top = save;
+            }
+
+            // the counter lives in a register for the whole loop, the goal is read again on every
+            // iteration like in C, a constant or a plain variable goal closes the loop with one INCLT
+            void ranged_for(ir::RangedFor *loop)
+            {
+                m_scopes.push_back({});
+                int32_t save = m_top;
+                int32_t i = temp();
+                expr(loop->init.get(), i);
+                m_scopes.back()[loop->ident] = Local{i, "int"};
+                int32_t top = new_label(), end = new_label();
+                auto goal = constant(loop->goal.get());
+                std::optional<Local> goal_var{};
+                if (auto id = dynamic_cast<ir::Ident *>(strip(loop->goal.get())))
+                    goal_var = lookup(id->_value);
+                if (goal && fits(*goal))
+                {
+                    emit(Op::JGEI, i, int32_t(*goal), end);
+                    place(top);
+                    block(loop->body);
+                    emit(Op::INCLTI, i, int32_t(*goal), top);
+                }
+                else if (goal_var)
+                {
+                    emit(Op::JGE, i, goal_var->reg, end);
+                    place(top);
+                    block(loop->body);
+                    emit(Op::INCLT, i, goal_var->reg, top);
+                }
+                else
+                {
+                    int32_t cond = new_label();
+                    emit(Op::JMP, 0, 0, cond);
+                    place(top);
+                    block(loop->body);
+                    emit(Op::ADDI, i, i, 1);
+                    place(cond);
+                    int32_t g = expr(loop->goal.get());
+                    emit(Op::JLT, i, g, top);
+                }
+                place(end);
+                m_top = save;
+                m_scopes.pop_back();
+            }
+
+            // dense case values go through a jump table, sparse ones through a row of compare and jumps
+            void lower_switch(ir::Switch *sw)
+            {
+                int32_t save = m_top;
+                int32_t scrutinee = expr(sw->scrutinee.get());
+                std::vector<std::pair<Value, int32_t>> cases{};
+                for (auto &c : sw->cases)
+                {
+                    auto v = constant(c.label.get());
+                    if (!v)
+                        unsupported(c.label.get());
+                    cases.push_back({*v, new_label()});
+                }
+                int32_t fallback = new_label(), end = new_label();
+                Value low = INT64_MAX, high = INT64_MIN;
+                for (auto &[v, _] : cases)
+                {
+                    low = std::min(low, v);
+                    high = std::max(high, v);
+                }
+                if (cases.size() >= 4 && high - low < Value(cases.size()) * 2 + 8)
+                {
+                    JumpTable table{low, std::vector<int32_t>(size_t(high - low + 1), fallback), fallback};
+                    for (auto &[v, label] : cases)
+                        table.targets.at(size_t(v - low)) = label;
+                    m_prog.tables.push_back(std::move(table));
+                    m_tables_used.push_back(m_prog.tables.size() - 1);
+                    emit(Op::TABLE, scrutinee, int32_t(m_prog.tables.size() - 1));
+                }
+                else
+                {
+                    for (auto &[v, label] : cases)
+                    {
+                        if (fits(v))
+                            emit(Op::JEQI, scrutinee, int32_t(v), label);
+                        else
+                        {
+                            m_prog.constants.push_back(v);
+                            int32_t k = temp();
+                            emit(Op::LOADK, k, int32_t(m_prog.constants.size() - 1));
+                            emit(Op::JEQ, scrutinee, k, label);
+                        }
+                    }
+                    emit(Op::JMP, 0, 0, fallback);
+                }
+                for (size_t i = 0; i < cases.size(); ++i)
+                {
+                    place(cases.at(i).second);
+                    block(sw->cases.at(i).body);
+                    emit(Op::JMP, 0, 0, end);
+                }
+                place(fallback);
+                block(sw->default_block);
+                place(end);
+                m_top = save;
+            }
+
+            void function(size_t index, const std::vector<ir::CArgTy> &args, const Stmts & body)
+            {
+                auto &info = m_prog.functions.at(index);
+                info.entry = int32_t(m_prog.code.size());
+                m_scopes.assign(1, {});
+                m_top = 0;
+                m_max = 0;
+                m_label_pcs.clear();
+                m_named_labels.clear();
+                m_tables_used.clear();
+                for (auto &a : args)
+                {
+                    if (a.ty.starts_with("struct "))
+                        throw VmErr(std::format("derijac run doesn't support struct arguments yet ('{}' of {}).", a.name, info.name));
+                    declare(a.name, a.ty);
+                }
+                for (auto &s : body)
+                    stmt(s.get());
+                int32_t zero = temp();
+                emit(Op::LOADI, zero, 0);
+                emit(Op::RET, zero);
+                for (size_t pc = size_t(info.entry); pc < m_prog.code.size(); ++pc)
+                {
+                    auto &in = m_prog.code.at(pc);
+                    if (is_jump(in.op))
+                        in.c = m_label_pcs.at(in.c);
+                }
+                for (size_t t : m_tables_used)
+                {
+                    auto &table = m_prog.tables.at(t);
+                    for (auto &target : table.targets)
+                        target = m_label_pcs.at(target);
+                    table.fallback = m_label_pcs.at(table.fallback);
+                }
+                m_prog.functions.at(index).frame = m_max;
+            }
+
+            Program compile(const Stmts & module)
+            {
+                // names first, functions can call ones defined after them
+                Stmts init{};
+                for (auto &e : module)
+                {
+                    if (auto fn = dynamic_cast<ir::Function *>(e.get()))
+                    {
+                        m_functions[fn->name] = m_prog.functions.size();
+                        m_prog.functions.push_back(FunctionInfo{fn->name, fn->ret_ty, fn->args.size()});
+                    }
+                    else if (auto en = dynamic_cast<ir::Enum *>(e.get()))
+                    {
+                        for (size_t i = 0; i < en->members.size(); ++i)
+                            m_enums[std::format("{}_{}", en->name, en->members.at(i))] = Value(i);
+                    }
+                    else if (auto var = dynamic_cast<ir::Variable *>(e.get()))
+                    {
+                        m_globals[var->name] = Global{int32_t(m_globals.size()), var->ty};
+                        if (var->_value)
+                            init.push_back(std::make_unique<ir::SetOp>(std::make_unique<ir::Ident>(var->name), var->_value->clone()));
+                    }
+                    else if (auto arr = dynamic_cast<ir::ArrayVariable *>(e.get()))
+                    {
+                        m_globals[arr->name] = Global{int32_t(m_globals.size()), arr->ty + "*"};
+                        init.push_back(arr->clone());
+                    }
+                }
+                m_prog.globals = m_globals.size();
+                for (auto &e : module)
+                {
+                    if (auto fn = dynamic_cast<ir::Function *>(e.get()))
+                        function(m_functions.at(fn->name), fn->args, fn->body);
+                }
+                // global arrays live in the arena under init's frame, which is never popped since init is the outermost call
+                m_prog.init = m_prog.functions.size();
+                m_prog.functions.push_back(FunctionInfo{"__der_init", "int", 0});
+                m_in_init = true;
+                function(*m_prog.init, {}, init);
+                m_in_init = false;
+                if (m_functions.contains("main"))
+                    m_prog.main = m_functions.at("main");
+                return std::move(m_prog);
+            }
+        };
+
+        struct Machine
+        {
+            static constexpr size_t register_count = size_t(1) << 20;
+            static constexpr size_t arena_size = size_t(1) << 22;
+            static constexpr size_t max_depth = size_t(1) << 16;
+
+            struct Frame
+            {
+                const Instr *ret;
+                Value *base;
+                int32_t dest;
+                Value *arena;
+            };
+
+            // left uninitialized on purpose, only the pages a program touches get mapped
+            std::unique_ptr<Value[]> m_registers{new Value[register_count]};
+            std::unique_ptr<Value[]> m_arena{new Value[arena_size]};
+            Value *m_arena_top = m_arena.get();
+            std::vector<Value> m_globals{};
+            std::vector<Frame> m_frames{};
+
+            static Value wrap(uint64_t v)
+            {
+                return Value(int32_t(uint32_t(v)));
+            }
+
+            Value native(Native which, const Value *args)
+            {
+                switch (which)
+                {
+                case Native::STRLEN:
+                    return Value(std::strlen(reinterpret_cast<const char *>(args[0])));
+                case Native::MEMCMP:
+                    return std::memcmp(reinterpret_cast<const void *>(args[0]), reinterpret_cast<const void *>(args[1]), size_t(args[2]));
+                case Native::STR_HASH:
+                {
+                    // same as the __der_str_hash helper the C output gets
+                    auto s = reinterpret_cast<const unsigned char *>(args[0]);
+                    uint32_t h = 0;
+                    for (Value i = 0; i < args[1]; ++i)
+                        h = h * uint32_t(args[2]) + s[i];
+                    return Value(h & 0x7fffffffu);
+                }
+                }
+                return 0;
+            }
+
+            // runs the program's initializers then main, main's return value is the exit code
+            int run(const Program &prog)
+            {
+                if (!prog.main)
+                    throw VmErr("there's no main function to run.");
+                m_globals.assign(prog.globals, 0);
+                execute(prog, *prog.init);
+                return int(execute(prog, *prog.main));
+            }
+
+            Value execute(const Program &prog, size_t entry)
+            {
+                const Instr *code = prog.code.data();
+                const Value *K = prog.constants.data();
+                Value *G = m_globals.data();
+                Value *const registers_end = m_registers.get() + register_count;
+                Value *const arena_end = m_arena.get() + arena_size;
+                Value *R = m_registers.get();
+                size_t bottom = m_frames.size();
+                if (R + prog.functions.at(entry).frame > registers_end)
+                    throw VmErr("stack overflow.");
+                const Instr *ip = code + prog.functions.at(entry).entry;
+
+#ifdef DER_VM_COMPUTED_GOTO
+#define DER_VM_LABEL(x) &&op_##x,
+                static const void *dispatch[] = {DER_VM_OPS(DER_VM_LABEL)};
+#undef DER_VM_LABEL
+#define DER_VM_CASE(x) op_##x:
+#define DER_VM_DISPATCH() goto *dispatch[size_t(ip->op)]
+#else
+#define DER_VM_CASE(x) case Op::x:
+#define DER_VM_DISPATCH() goto dispatch
+#endif
+#define DER_VM_NEXT() \
+    do                \
+    {                 \
+        ++ip;         \
+        DER_VM_DISPATCH(); \
+    } while (0)
+#define DER_VM_JUMP() \
+    do                \
+    {                 \
+        ip = code + ip->c; \
+        DER_VM_DISPATCH(); \
+    } while (0)
+#define DER_VM_ARITH(x, expr)   \
+    DER_VM_CASE(x)              \
+    R[ip->a] = wrap(expr);      \
+    DER_VM_NEXT();
+#define DER_VM_COMPARE(x, cmp, jx, jix) \
+    DER_VM_CASE(x)                      \
+    R[ip->a] = R[ip->b] cmp R[ip->c];   \
+    DER_VM_NEXT();                      \
+    DER_VM_CASE(jx)                     \
+    if (R[ip->a] cmp R[ip->b])          \
+        DER_VM_JUMP();                  \
+    DER_VM_NEXT();                      \
+    DER_VM_CASE(jix)                    \
+    if (R[ip->a] cmp ip->b)             \
+        DER_VM_JUMP();                  \
+    DER_VM_NEXT();
+
+#ifdef DER_VM_COMPUTED_GOTO
+                DER_VM_DISPATCH();
+#else
+            dispatch:
+                switch (ip->op)
+                {
+#endif
+                DER_VM_CASE(MOV)
+                R[ip->a] = R[ip->b];
+                DER_VM_NEXT();
+                DER_VM_CASE(LOADI)
+                R[ip->a] = ip->b;
+                DER_VM_NEXT();
+                DER_VM_CASE(LOADK)
+                R[ip->a] = K[ip->b];
+                DER_VM_NEXT();
+                DER_VM_CASE(GETG)
+                R[ip->a] = G[ip->b];
+                DER_VM_NEXT();
+                DER_VM_CASE(SETG)
+                G[ip->a] = R[ip->b];
+                DER_VM_NEXT();
+                DER_VM_ARITH(ADD, uint64_t(R[ip->b]) + uint64_t(R[ip->c]))
+                DER_VM_ARITH(SUB, uint64_t(R[ip->b]) - uint64_t(R[ip->c]))
+                DER_VM_ARITH(MUL, uint64_t(R[ip->b]) * uint64_t(R[ip->c]))
+                DER_VM_ARITH(BAND, R[ip->b] & R[ip->c])
+                DER_VM_ARITH(BOR, R[ip->b] | R[ip->c])
+                DER_VM_ARITH(BXOR, R[ip->b] ^ R[ip->c])
+                DER_VM_ARITH(SHL, uint32_t(R[ip->b]) << (R[ip->c] & 31))
+                DER_VM_ARITH(SHR, int32_t(R[ip->b]) >> (R[ip->c] & 31))
+                DER_VM_ARITH(ADDI, uint64_t(R[ip->b]) + uint64_t(Value(ip->c)))
+                DER_VM_ARITH(NEG, 0 - uint64_t(R[ip->b]))
+                DER_VM_CASE(DIV)
+                if (R[ip->c] == 0)
+                    throw VmErr("division by zero.");
+                R[ip->a] = wrap(uint64_t(R[ip->b] / R[ip->c]));
+                DER_VM_NEXT();
+                DER_VM_CASE(MOD)
+                if (R[ip->c] == 0)
+                    throw VmErr("division by zero.");
+                R[ip->a] = wrap(uint64_t(R[ip->b] % R[ip->c]));
+                DER_VM_NEXT();
+                DER_VM_CASE(NOT)
+                R[ip->a] = !R[ip->b];
+                DER_VM_NEXT();
+                DER_VM_CASE(TRUNC8)
+                R[ip->a] = Value(char(R[ip->b]));
+                DER_VM_NEXT();
+                DER_VM_CASE(ZEXT8)
+                R[ip->a] = Value(uint8_t(R[ip->b]));
+                DER_VM_NEXT();
+                DER_VM_COMPARE(EQ, ==, JEQ, JEQI)
+                DER_VM_COMPARE(NE, !=, JNE, JNEI)
+                DER_VM_COMPARE(LT, <, JLT, JLTI)
+                DER_VM_COMPARE(LE, <=, JLE, JLEI)
+                DER_VM_COMPARE(GT, >, JGT, JGTI)
+                DER_VM_COMPARE(GE, >=, JGE, JGEI)
+                DER_VM_CASE(JMP)
+                DER_VM_JUMP();
+                DER_VM_CASE(JZ)
+                if (!R[ip->a])
+                    DER_VM_JUMP();
+                DER_VM_NEXT();
+                DER_VM_CASE(JNZ)
+                if (R[ip->a])
+                    DER_VM_JUMP();
+                DER_VM_NEXT();
+                DER_VM_CASE(INCLT)
+                R[ip->a] = wrap(uint64_t(R[ip->a]) + 1);
+                if (R[ip->a] < R[ip->b])
+                    DER_VM_JUMP();
+                DER_VM_NEXT();
+                DER_VM_CASE(INCLTI)
+                R[ip->a] = wrap(uint64_t(R[ip->a]) + 1);
+                if (R[ip->a] < ip->b)
+                    DER_VM_JUMP();
+                DER_VM_NEXT();
+                DER_VM_CASE(TABLE)
+                {
+                    const JumpTable &table = prog.tables[size_t(ip->b)];
+                    Value slot = R[ip->a] - table.low;
+                    ip = code + (slot >= 0 && slot < Value(table.targets.size()) ? table.targets[size_t(slot)] : table.fallback);
+                    DER_VM_DISPATCH();
+                }
+                DER_VM_CASE(ALLOC)
+                if (m_arena_top + ip->b > arena_end)
+                    throw VmErr("out of memory for arrays.");
+                std::memset(m_arena_top, 0, sizeof(Value) * size_t(ip->b));
+                R[ip->a] = reinterpret_cast<Value>(m_arena_top);
+                m_arena_top += ip->b;
+                DER_VM_NEXT();
+                DER_VM_CASE(LOADX)
+                R[ip->a] = reinterpret_cast<const Value *>(R[ip->b])[R[ip->c]];
+                DER_VM_NEXT();
+                DER_VM_CASE(STOREX)
+                reinterpret_cast<Value *>(R[ip->a])[R[ip->b]] = R[ip->c];
+                DER_VM_NEXT();
+                DER_VM_CASE(STOREI)
+                reinterpret_cast<Value *>(R[ip->a])[ip->b] = R[ip->c];
+                DER_VM_NEXT();
+                DER_VM_CASE(LOADB)
+                R[ip->a] = Value(reinterpret_cast<const char *>(R[ip->b])[R[ip->c]]);
+                DER_VM_NEXT();
+                DER_VM_CASE(CALL)
+                {
+                    const FunctionInfo &fn = prog.functions[size_t(ip->b)];
+                    Value *base = R + ip->c;
+                    if (base + fn.frame > registers_end || m_frames.size() - bottom >= max_depth)
+                        throw VmErr(std::format("stack overflow in '{}'.", fn.name));
+                    m_frames.push_back(Frame{ip + 1, R, ip->a, m_arena_top});
+                    R = base;
+                    ip = code + fn.entry;
+                    DER_VM_DISPATCH();
+                }
+                DER_VM_CASE(NATIVE)
+                R[ip->a] = native(Native(ip->b), R + ip->c);
+                DER_VM_NEXT();
+                DER_VM_CASE(RET)
+                {
+                    Value result = R[ip->a];
+                    if (m_frames.size() == bottom)
+                        return result;
+                    Frame frame = m_frames.back();
+                    m_frames.pop_back();
+                    m_arena_top = frame.arena;
+                    R = frame.base;
+                    R[frame.dest] = result;
+                    ip = frame.ret;
+                    DER_VM_DISPATCH();
+                }
+                DER_VM_CASE(PUTI)
+                std::printf("%d\n", int(R[ip->a]));
+                DER_VM_NEXT();
+                DER_VM_CASE(PUTC)
+                std::printf("%c\n", char(R[ip->a]));
+                DER_VM_NEXT();
+                DER_VM_CASE(PUTS)
+                std::printf("%s\n", reinterpret_cast<const char *>(R[ip->a]));
+                DER_VM_NEXT();
+                DER_VM_CASE(GETI)
+                {
+                    int v = 0;
+                    if (std::scanf("%d", &v) != 1)
+                        v = 0;
+                    R[ip->a] = v;
+                    DER_VM_NEXT();
+                }
+#ifndef DER_VM_COMPUTED_GOTO
+                }
+#endif
+                return 0;
+#undef DER_VM_CASE
+#undef DER_VM_DISPATCH
+#undef DER_VM_NEXT
+#undef DER_VM_JUMP
+#undef DER_VM_ARITH
+#undef DER_VM_COMPARE
+            }
+        };
+    }
+}
+#undef DER_VM_OPS
+#endif
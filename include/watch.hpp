@@ -0,0 +1,290 @@
+#ifndef DER_WATCH_HPP
+#define DER_WATCH_HPP
+#include <cerrno>
+#include <chrono>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+#include <format>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "typechecker.hpp"
+#include "optimizer.hpp"
+#include "emit.hpp"
+#include "cache.hpp"
+
+// `derijac --watch`: the compiler stays up and compiles again whenever one of the files it read changes. what every
+// file came out as is kept in memory (see frontend in main.cpp, the compile server does the same), and when a file
+// changes only the functions whose tokens changed are lowered and optimized again, the others are taken from the
+// last build as they are. that's as long as everything around the function bodies (structs, enums, globals,
+// function signatures, imports) is the same, otherwise they're all redone. the C is then only written from the
+// first byte that's different.
+namespace der
+{
+    namespace watch
+    {
+        // what a function of the last build needed besides its IR
+        struct Region
+        {
+            // its tokens and everything around function bodies
+            std::string key;
+            std::set<std::string> includes{};
+            std::map<std::string, std::string> helpers{};
+        };
+
+        struct Module
+        {
+            // of the source and everything else that went into it
+            std::string hash;
+            std::shared_ptr<typechecker::TypeChecker> checked{};
+            // by function name
+            std::map<std::string, Region> regions{};
+        };
+
+        // where the time of a rebuild went, in milliseconds
+        struct Stats
+        {
+            double lex = 0, parse = 0, check = 0, lower = 0, optimize = 0, emit = 0;
+            size_t functions = 0, reused = 0;
+            // bytes of output, and how many of them actually had to be written
+            size_t bytes = 0, written = 0;
+
+            Stats &operator+=(const Stats &o)
+            {
+                lex += o.lex;
+                parse += o.parse;
+                check += o.check;
+                lower += o.lower;
+                optimize += o.optimize;
+                emit += o.emit;
+                functions += o.functions;
+                reused += o.reused;
+                bytes += o.bytes;
+                written += o.written;
+                return *this;
+            }
+        };
+
+        inline double since(std::chrono::steady_clock::time_point &start)
+        {
+            auto now = std::chrono::steady_clock::now();
+            double ms = std::chrono::duration<double, std::milli>(now - start).count();
+            start = now;
+            return ms;
+        }
+
+        // the tokens in [from, to), spaces and line breaks don't count
+        inline std::string tokens_text(const std::vector<lexer::TokenHandle> &tokens, size_t from, size_t to)
+        {
+            std::string out{};
+            for (size_t i = from; i < to && i < tokens.size(); ++i)
+                out += std::format("{}\x1f{}\x1e", int(tokens.at(i).token), tokens.at(i).raw_value);
+            return out;
+        }
+
+        // checks, lowers and optimizes the module like do_the_thing and the optimizer would. functions whose key is the
+        // same as in `previous` have their IR moved out of it instead, so it can't be used after. context stands for
+        // what went into the module besides its source (the options, the interfaces it imports)
+        inline void lower(typechecker::TypeChecker &ijk, const std::vector<lexer::TokenHandle> &tokens, const std::vector<size_t> &starts, const optimizer::Options &options, const std::string &context, Module *previous, Module &out, Stats &stats)
+        {
+            auto start = std::chrono::steady_clock::now();
+            ijk.check();
+            stats.check += since(start);
+
+            size_t n = ijk.m_input.size();
+            std::vector<std::string> names(n), texts(n);
+            cache::Key around{};
+            around.add(context);
+            for (size_t i = 0; i < n; ++i)
+            {
+                size_t end = i + 1 < n ? starts.at(i + 1) : tokens.size();
+                texts.at(i) = tokens_text(tokens, starts.at(i), end);
+                auto fn = dynamic_cast<ast::Function<parser::AstInfo> *>(ijk.m_input.at(i).expr.get());
+                if (!fn)
+                {
+                    around.add(texts.at(i));
+                    continue;
+                }
+                names.at(i) = fn->name;
+                size_t body = starts.at(i);
+                while (body < end && tokens.at(body).token != lexer::TOKENS::TOKEN_OPEN_BRACE)
+                    ++body;
+                around.add(tokens_text(tokens, starts.at(i), body));
+            }
+            std::string around_hash = around.hex();
+
+            std::vector<bool> reused(n, false);
+            for (size_t i = 0; i < n; ++i)
+            {
+                std::string key{};
+                if (!names.at(i).empty())
+                {
+                    ++stats.functions;
+                    key = cache::Key{}.add(around_hash).add(texts.at(i)).hex();
+                    if (previous && previous->checked)
+                        if (auto found = previous->regions.find(names.at(i)); found != previous->regions.end() && found->second.key == key)
+                        {
+                            reused.at(i) = true;
+                            out.regions[names.at(i)] = found->second;
+                            ++stats.reused;
+                            continue;
+                        }
+                }
+                auto includes = ijk.c_includes;
+                auto helpers = ijk.c_helpers;
+                ijk.m_output.push_back(ijk.convert_to_ir(ijk.m_input.at(i).expr->clone()));
+                if (names.at(i).empty())
+                    continue;
+                Region region{key};
+                for (auto &h : ijk.c_includes)
+                    if (!includes.contains(h))
+                        region.includes.insert(h);
+                for (auto &[name, helper] : ijk.c_helpers)
+                    if (!helpers.contains(name))
+                        region.helpers[name] = helper;
+                out.regions[names.at(i)] = region;
+            }
+            stats.lower += since(start);
+
+            // only what was just lowered goes through the optimizer, the headers it asks for are put on every one of
+            // those functions since there's no telling which one wanted them
+            auto includes = ijk.c_includes;
+            optimizer::Optimizer(ijk.m_output, ijk.c_includes, options).run();
+            for (size_t i = 0; i < n; ++i)
+                if (!names.at(i).empty() && !reused.at(i))
+                    for (auto &h : ijk.c_includes)
+                        if (!includes.contains(h))
+                            out.regions.at(names.at(i)).includes.insert(h);
+            stats.optimize += since(start);
+
+            // back in source order, with the functions from the last build where they belong
+            std::map<std::string, optimizer::Stmts> kept{};
+            if (previous && previous->checked)
+            {
+                optimizer::Stmts group{};
+                for (auto &e : previous->checked->m_output)
+                {
+                    bool whole = !emit::outlined(e.get());
+                    auto fn = dynamic_cast<ir::Function *>(e.get());
+                    std::string name = fn ? fn->name : "";
+                    group.push_back(std::move(e));
+                    if (whole && fn)
+                        kept[name] = std::move(group);
+                    if (whole)
+                        group.clear();
+                }
+                previous->checked->m_output.clear();
+            }
+            optimizer::Stmts fresh = std::move(ijk.m_output);
+            ijk.m_output.clear();
+            size_t at = 0;
+            for (size_t i = 0; i < n; ++i)
+            {
+                if (reused.at(i))
+                {
+                    for (auto &e : kept.at(names.at(i)))
+                        ijk.m_output.push_back(std::move(e));
+                    auto &region = out.regions.at(names.at(i));
+                    ijk.c_includes.insert(region.includes.begin(), region.includes.end());
+                    ijk.c_helpers.insert(region.helpers.begin(), region.helpers.end());
+                    continue;
+                }
+                while (emit::outlined(fresh.at(at).get()))
+                    ijk.m_output.push_back(std::move(fresh.at(at++)));
+                ijk.m_output.push_back(std::move(fresh.at(at++)));
+            }
+        }
+
+        // makes path hold data, only writing from where it starts to differ from what's already there, and up to
+        // where it stops differing when the size didn't change. returns how many bytes were written, or nullopt when
+        // the file can't be written
+        inline std::optional<size_t> update_file(const std::string &path, const std::string &data)
+        {
+            auto old = cache::read_file(path).value_or("");
+            size_t same = 0;
+            while (same < old.size() && same < data.size() && old[same] == data[same])
+                ++same;
+            if (same == data.size() && old.size() == data.size())
+                return 0;
+            size_t end = data.size();
+            if (old.size() == data.size())
+                while (end > same && old[end - 1] == data[end - 1])
+                    --end;
+            int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+            if (fd < 0)
+                return std::nullopt;
+            bool ok = true;
+            for (size_t done = same; ok && done < end;)
+            {
+                ssize_t n = pwrite(fd, data.data() + done, end - done, off_t(done));
+                if (n < 0 && errno == EINTR)
+                    continue;
+                ok = n > 0;
+                done += ok ? size_t(n) : 0;
+            }
+            ok = ok && ftruncate(fd, off_t(data.size())) == 0;
+            ok = close(fd) == 0 && ok;
+            if (!ok)
+                return std::nullopt;
+            return end - same;
+        }
+
+        // waits until one of the files changes. the directories are watched rather than the files, editors tend to
+        // write a new file and rename it over the old one. a file changed since `since` counts right away, that's one
+        // changed while it was being compiled. once something changes, what else comes within `settle` is let through
+        // too, editors write in several goes
+        inline void wait(const std::set<std::string> &paths, std::filesystem::file_time_type since, std::chrono::milliseconds settle = std::chrono::milliseconds(30))
+        {
+            int fd = inotify_init1(IN_CLOEXEC);
+            std::map<int, std::string> dirs{};
+            std::set<std::pair<std::string, std::string>> wanted{};
+            bool changed = false;
+            for (auto &p : paths)
+            {
+                auto abs = std::filesystem::weakly_canonical(p);
+                std::string dir = abs.parent_path().string();
+                wanted.insert({dir, abs.filename().string()});
+                int wd = inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+                if (wd >= 0)
+                    dirs[wd] = dir;
+                std::error_code ec{};
+                auto mtime = std::filesystem::last_write_time(abs, ec);
+                changed = changed || (!ec && mtime > since);
+            }
+            int timeout = changed ? int(settle.count()) : -1;
+            alignas(inotify_event) char buf[4096];
+            while (true)
+            {
+                pollfd pfd{fd, POLLIN, 0};
+                int ready = poll(&pfd, 1, timeout);
+                if (ready < 0 && errno == EINTR)
+                    continue;
+                if (ready <= 0)
+                    break;
+                ssize_t len = read(fd, buf, sizeof buf);
+                if (len <= 0)
+                    break;
+                for (ssize_t off = 0; off < len;)
+                {
+                    auto ev = reinterpret_cast<inotify_event *>(buf + off);
+                    off += ssize_t(sizeof(inotify_event) + ev->len);
+                    if (ev->len && dirs.contains(ev->wd) && wanted.contains({dirs.at(ev->wd), ev->name}))
+                        changed = true;
+                }
+                if (changed)
+                    timeout = int(settle.count());
+            }
+            close(fd);
+        }
+    }
+}
+#endif
@@ -1,48 +1,213 @@
 #include <iostream>
 #include <format>
+#include <filesystem>
 #include <fstream>
+#include <cctype>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <set>
+#include <thread>
+#include <vector>
 #include "include/lexer.hpp"
 #include "include/parser.hpp"
 #include "include/types.hpp"
 #include "include/typechecker.hpp"
+#include "include/optimizer.hpp"
+#include "include/vm.hpp"
+#include "include/codegen.hpp"
+#include "include/jit.hpp"
+#include "include/driver.hpp"
+#include "include/cache.hpp"
+#include "include/modules.hpp"
+#include "include/emit.hpp"
+#include "include/server.hpp"
+#include "include/watch.hpp"
+#include "include/report.hpp"
+#include "include/batch.hpp"
 
-int main(int argc, char **argv)
+// counts allocations for --time-report (see report.hpp)
+void *operator new(std::size_t size)
 {
-    if (argc < 2)
-    {
-        std::cout << "\u001b[1m\u001b[31merror:\u001b[m no input file specified.\n";
-        return 1;
-    }
-    std::ifstream file{argv[1]};
+    der::report::count(size);
+    if (void *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc{};
+}
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+void operator delete(void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+static void error(const std::string &msg)
+{
+    std::cout << std::format("\u001b[1m\u001b[31merror:\u001b[m {}\n", msg);
+}
+
+// the executable a .der file turns into
+static std::string executable_name(const std::string &filename)
+{
+    return filename.ends_with(".der") ? filename.substr(0, filename.size() - 4) : filename + ".out";
+}
+
+static std::optional<std::string> read_source(const std::string &filename)
+{
+    std::ifstream file{filename};
     if (!file.is_open())
     {
-        std::cout << std::format("\u001b[1m\u001b[31merror:\u001b[m failed to open file '{}'.\n", argv[1]);
-        return 1;
+        error(std::format("failed to open file '{}'.", filename));
+        return std::nullopt;
     }
-    std::string filename = argv[1];
     std::string input = {};
     std::string tmp;
     while (std::getline(file, tmp))
         (input += tmp) += '\n';
-    auto xyz = der::lexer::Lexer(input);
-    xyz.lex();
-    auto abc = der::parser::Parser(xyz.get_output());
+    return input;
+}
+
+// the cache key of what `stage` makes out of a source, everything but the tools after the front end goes in it
+static std::string source_key(const std::string &source, const der::optimizer::Options &options, const std::string &stage)
+{
+    return der::cache::Key{}
+        .add(der::cache::file_identity("/proc/self/exe"))
+        .add(stage)
+        .add(std::format("{} {} {}", options.tile, options.cache_kb, options.c_backend))
+        .add(source)
+        .hex();
+}
+
+static bool uses_pthread(const std::string &c)
+{
+    return c.find("#include <pthread.h>") != std::string::npos;
+}
+
+// what `derijac --server` and `--watch` made of each file they've seen, by its absolute path. only the last version
+// of a file is kept, and what changed in it is all that's compiled again (see watch.hpp)
+static std::optional<std::map<std::string, der::watch::Module>> warm{};
+static der::watch::Stats stats{};
+static std::mutex warm_lock{};
+// the files the last command read, --watch waits on them
+static std::set<std::string> watched{};
+
+// --time-report and --trace
+static std::optional<der::report::Report> report{};
+
+template <typename F>
+static auto measured(const std::string &phase, F &&f)
+{
+    if (report)
+        return report->phase(phase, f);
+    return f();
+}
+
+// with --watch (and the server), only the part of the file that changed is written
+static void write_output(const std::string &path, const std::string &data)
+{
+    if (!warm)
+    {
+        std::ofstream outfile{path};
+        outfile << data;
+        return;
+    }
+    auto written = der::watch::update_file(path, data);
+    std::lock_guard lock{warm_lock};
+    stats.bytes += data.size();
+    stats.written += written.value_or(0);
+}
+
+// lexes, parses, checks and optimizes a source, then hands the type checker holding the module to `then`.
+// errors in the program are printed here and give nullopt, otherwise it's whatever `then` returned.
+// imports are the interfaces of the modules it imports (and what they import), only `build` has them
+template <typename F>
+static std::optional<int> frontend(const std::string &path, const std::string &input, const der::optimizer::Options &options, F &&then, const std::vector<der::modules::Interface> *imports = nullptr)
+{
+    std::string file{}, context{}, hash{};
+    der::watch::Stats spent{};
+    auto start = std::chrono::steady_clock::now();
+    auto timed = [&](auto &ijk)
+    {
+        auto status = measured("emit", [&]
+                               { return then(ijk); });
+        spent.emit += der::watch::since(start);
+        std::lock_guard lock{warm_lock};
+        stats += spent;
+        return status;
+    };
+    if (warm)
+    {
+        file = std::filesystem::weakly_canonical(path).string();
+        // everything that goes into the module but its source
+        der::cache::Key key{};
+        key.add(std::format("{} {} {}", options.tile, options.cache_kb, options.c_backend));
+        if (imports)
+            for (auto &iface : *imports)
+                key.add(iface.hash);
+        context = key.hex();
+        hash = der::cache::Key{}.add(context).add(input).hex();
+        std::shared_ptr<der::typechecker::TypeChecker> hit{};
+        {
+            std::lock_guard lock{warm_lock};
+            if (auto found = warm->find(file); found != warm->end() && found->second.hash == hash)
+                hit = found->second.checked;
+        }
+        if (hit)
+            return timed(*hit);
+    }
     try
     {
-        abc.parse();
+        auto xyz = der::lexer::Lexer(input);
+        measured("lex", [&]
+                 { xyz.lex(); });
+        spent.lex += der::watch::since(start);
+        auto abc = der::parser::Parser(xyz.get_output());
+        measured("parse", [&]
+                 { abc.parse(); });
+        spent.parse += der::watch::since(start);
         // for (const auto &a : abc.get_output())
         // {
         //     std::cout << a.expr->debug() << '\n';
         // }
-        auto ijk = der::typechecker::TypeChecker(abc.get_output());
+        if (!abc.m_imports.empty() && imports == nullptr)
+            throw der::parser::SyntaxErr("jbed only works with `derijac build` for now.", abc.m_imports.front().loc);
+        auto ijk = std::make_shared<der::typechecker::TypeChecker>(abc.get_output());
         try
         {
-            ijk.do_the_thing();
+            if (imports)
+                for (auto &iface : *imports)
+                    der::modules::import_into(*ijk, iface, abc.m_imports.front().loc);
+            if (warm)
+            {
+                der::watch::Module *previous = nullptr;
+                {
+                    std::lock_guard lock{warm_lock};
+                    if (auto found = warm->find(file); found != warm->end())
+                        previous = &found->second;
+                }
+                der::watch::Module next{hash, ijk};
+                der::watch::lower(*ijk, abc.m_input, abc.m_decl_starts, options, context, previous, next, spent);
+                start = std::chrono::steady_clock::now();
+                std::lock_guard lock{warm_lock};
+                (*warm)[file] = std::move(next);
+            }
+            else
+            {
+                if (report)
+                    report->check(*ijk);
+                else
+                    ijk->do_the_thing();
+                measured("optimize", [&]
+                         { der::optimizer::Optimizer(ijk->m_output, ijk->c_includes, options).run(); });
+            }
             // for(auto& [key, _]: ijk.local_scope)
             //     der_debug(key);
-            std::ofstream outfile{filename + ".c"};
-            outfile << ijk.get_output();
-            std::cout << std::format("\u001b[1m\u001b[33msuccessfully written output C code to '{}.c'\u001b[m\n", filename);
+            return timed(*ijk);
         }
         catch (const der::types::CompilationErr &exc)
         {
@@ -53,4 +218,568 @@ int main(int argc, char **argv)
     {
         std::cout << std::format("\u001b[1m\u001b[31m[khata2 imla2i]:\u001b[m {} (line: {}, col: {})\n", exc.msg, exc.loc.line + 1, exc.loc.column + 1);
     }
+    std::lock_guard lock{warm_lock};
+    stats += spent;
+    return std::nullopt;
+}
+
+static int command(int argc, char **argv)
+{
+    std::vector<std::string> filenames = {};
+    der::optimizer::Options options{};
+    // `derijac run file.der` interprets the program instead of writing C,
+    // `derijac native file.der` turns it into an executable with nothing but as and ld,
+    // `derijac jit file.der` turns it into machine code in memory and runs it,
+    // `derijac build files...` pipes the C into the C compiler and gets executables out of it,
+    // `derijac batch input` compiles many programs in one go (see batch.hpp)
+    std::string mode = argc > 1 ? argv[1] : "";
+    bool run = mode == "run";
+    bool native = mode == "native";
+    bool jit = mode == "jit";
+    bool build = mode == "build";
+    bool batch = mode == "batch";
+    options.c_backend = !run && !native && !jit;
+    der::driver::Profile profile = *der::driver::find_profile("release");
+    std::string cc = std::getenv("CC") ? std::getenv("CC") : "cc";
+    std::string output = {};
+    bool timings = false;
+    size_t jobs = std::max(1u, std::thread::hardware_concurrency());
+    // --split N: the C goes into a header and N files that can be compiled at the same time
+    size_t split = 0;
+    // DER_CACHE_DIR or --cache turn the build cache on, --no-cache turns it off again
+    std::optional<der::cache::Cache> cache{};
+    if (const char *dir = std::getenv("DER_CACHE_DIR"); dir && *dir)
+        cache.emplace(dir);
+    for (int i = run || native || jit || build || batch ? 2 : 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        bool takes_value = arg == "--tile" || arg == "--l1-cache" || arg == "--l2-cache" || arg == "--cache" || (options.c_backend && (arg == "-j" || arg == "--split")) || (build && (arg == "--profile" || arg == "--cc" || arg == "--manifest")) || ((build || batch) && arg == "-o");
+        if (takes_value && i + 1 >= argc)
+        {
+            error(std::format("'{}' expects a value.", arg));
+            return 1;
+        }
+        if (arg == "--tile" || arg == "--l1-cache" || arg == "--l2-cache" || (options.c_backend && (arg == "-j" || arg == "--split")))
+        {
+            if (!std::isdigit(static_cast<unsigned char>(argv[i + 1][0])))
+            {
+                error(std::format("'{}' expects a number.", arg));
+                return 1;
+            }
+            size_t n = std::stoul(argv[++i]);
+            if (arg == "-j")
+                jobs = std::max<size_t>(n, 1);
+            else if (arg == "--split")
+                split = n;
+            else if (arg == "--tile")
+                options.tile = n;
+            // tiles are sized for the innermost cache we're told about
+            else if (arg == "--l1-cache" || options.cache_kb == 0)
+                options.cache_kb = n;
+        }
+        else if (build && arg == "--profile")
+        {
+            auto found = der::driver::find_profile(argv[++i]);
+            if (!found)
+            {
+                std::string names{};
+                for (auto &p : der::driver::profiles())
+                    names += (names.empty() ? "" : ", ") + p.name;
+                error(std::format("unknown profile '{}', pick one of: {}.", argv[i], names));
+                return 1;
+            }
+            profile = *found;
+        }
+        else if (arg == "--cache")
+            cache.emplace(argv[++i]);
+        else if (arg == "--no-cache")
+            cache.reset();
+        else if (build && arg == "--cc")
+            cc = argv[++i];
+        else if ((build || batch) && arg == "-o")
+            output = argv[++i];
+        else if (build && arg == "--timings")
+            timings = true;
+        else if (build && arg == "--manifest")
+        {
+            // a project: the files to build, one per line and relative to the manifest, # starts a comment
+            std::string manifest = argv[++i];
+            std::ifstream in{manifest};
+            if (!in.is_open())
+            {
+                error(std::format("failed to open file '{}'.", manifest));
+                return 1;
+            }
+            for (std::string line; std::getline(in, line);)
+            {
+                line = line.substr(0, line.find('#'));
+                line.erase(0, line.find_first_not_of(" \t\r"));
+                line.erase(line.find_last_not_of(" \t\r") + 1);
+                if (!line.empty())
+                    filenames.push_back((std::filesystem::path(manifest).parent_path() / line).string());
+            }
+        }
+        else
+            filenames.push_back(arg);
+    }
+    if (filenames.empty())
+    {
+        error("no input file specified.");
+        return 1;
+    }
+    watched.insert(filenames.begin(), filenames.end());
+    // a build of several files already has a thread per file
+    options.jobs = build && filenames.size() > 1 ? 1 : jobs;
+    if (batch)
+    {
+        if (filenames.size() != 1)
+        {
+            error("batch takes a single input: a JSON lines file, a directory, or - for stdin.");
+            return 1;
+        }
+        der::batch::Reader reader{filenames.front(), std::cin};
+        if (!reader.ok())
+        {
+            error(std::format("failed to open file '{}'.", filenames.front()));
+            return 1;
+        }
+        std::ofstream file{};
+        if (!output.empty())
+        {
+            file.open(output);
+            if (!file.is_open())
+            {
+                error(std::format("failed to open file '{}'.", output));
+                return 1;
+            }
+        }
+        // the programs are spread over the threads, each one is optimized on the thread compiling it
+        der::CompileOptions batch_options{options};
+        batch_options.optimizer.jobs = 1;
+        auto started = std::chrono::steady_clock::now();
+        auto summary = der::batch::run(reader, batch_options, jobs, output.empty() ? std::cout : file);
+        std::cerr << std::format("\u001b[1m\u001b[33mcompiled {} of {} programs in {:.0f}ms\u001b[m\n", summary.compiled, summary.compiled + summary.failed,
+                                 std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count());
+        return summary.failed ? 1 : 0;
+    }
+    if (build)
+    {
+        if (!output.empty() && filenames.size() > 1)
+        {
+            error("'-o' only works with a single input file.");
+            return 1;
+        }
+        auto started = std::chrono::steady_clock::now();
+        der::modules::Graph graph{};
+        try
+        {
+            graph = der::modules::discover(filenames, jobs);
+        }
+        catch (const der::modules::ModuleErr &exc)
+        {
+            std::cout << std::format("\u001b[1m\u001b[31m[khata2 f jbed]:\u001b[m {}\n", exc.msg);
+            return 1;
+        }
+        const auto &units = graph.units;
+        for (auto &unit : units)
+            watched.insert(unit.path);
+        std::string tools = der::cache::file_identity(der::cache::find_program(cc));
+        for (auto &flag : profile.flags)
+            tools += " " + flag;
+        der::modules::Builder builder{units, cc, profile, der::cache::Key{}.add(source_key("", options, "module")).add(tools).hex()};
+        builder.m_compile = [&](const der::modules::Unit &unit, const std::vector<der::modules::Interface> &imports)
+        {
+            std::optional<der::modules::Compiled> out{};
+            frontend(unit.path, unit.source, options, [&](der::typechecker::TypeChecker &ijk)
+                     {
+                         std::string c = ijk.get_output();
+                         out = der::modules::Compiled{c, der::modules::exported(ijk)};
+                         return 0; }, &imports);
+            return out;
+        };
+        auto exe_of = [&](size_t u)
+        {
+            return output.empty() ? executable_name(units.at(u).path) : output;
+        };
+        // a file that neither imports nor is imported is a program of its own, its C goes straight into an executable.
+        // the others are modules, built into objects and linked once everything a program is made of is done
+        auto standalone = [&](size_t u)
+        {
+            return units.at(u).deps.empty() && !units.at(u).imported;
+        };
+        // what to say about each task, printed once they're all done so it doesn't depend on which thread got there first
+        std::vector<std::string> reports(units.size());
+        // --split: the header is pasted in front of every part so nothing has to be written next to the source, the
+        // parts are compiled to objects on their own and linked. the C isn't cached, only the executable
+        auto build_split = [&](size_t u, const std::string &exe, const std::string &exe_key, std::chrono::steady_clock::time_point start)
+        {
+            std::optional<der::emit::Split> parts{};
+            frontend(units.at(u).path, units.at(u).source, options, [&](der::typechecker::TypeChecker &ijk)
+                     {
+                         parts = der::emit::split(ijk, split, jobs);
+                         return 0; });
+            if (!parts)
+                return false;
+            builder.m_timings.at(u).frontend = builder.since(start);
+            start = std::chrono::steady_clock::now();
+            bool pthread = uses_pthread(parts->header);
+            std::vector<std::string> objects{};
+            std::vector<der::driver::Task> compiles{};
+            for (size_t i = 0; i < parts->units.size(); ++i)
+            {
+                objects.push_back(std::format("{}.{}.o", exe, i));
+                compiles.push_back({{}, double(parts->units.at(i).size()), [&, i]
+                                    {
+                                        der::driver::Job job{parts->header + parts->units.at(i), objects.at(i), pthread, true};
+                                        return der::driver::spawn(der::driver::cc_command(cc, profile, job), &job.c) == 0;
+                                    }});
+            }
+            auto ok = der::driver::run_tasks(compiles, jobs);
+            bool linked = std::ranges::all_of(ok, [](bool b)
+                                              { return b; }) &&
+                          der::driver::spawn(der::driver::link_command(cc, profile, objects, exe, pthread)) == 0;
+            for (auto &o : objects)
+                std::filesystem::remove(o);
+            if (!linked)
+            {
+                reports.at(u) = std::format("\u001b[1m\u001b[31m[khata2 f build]:\u001b[m {} couldn't compile the C for '{}'.\n", cc, units.at(u).path);
+                return false;
+            }
+            builder.m_timings.at(u).cc = builder.since(start);
+            builder.m_timings.at(u).compiled = true;
+            if (auto built = cache ? der::cache::read_file(exe) : std::nullopt)
+                cache->write(exe_key, "exe", *built, true);
+            reports.at(u) = std::format("\u001b[1m\u001b[33msuccessfully written executable '{}' ({} parts)\u001b[m\n", exe, objects.size());
+            return true;
+        };
+        std::vector<der::driver::Task> tasks(units.size());
+        for (size_t u = 0; u < units.size(); ++u)
+        {
+            tasks.at(u).deps = units.at(u).deps;
+            // the front end and the C compiler are both about linear in the size of the source
+            tasks.at(u).cost = double(units.at(u).source.size());
+            if (!standalone(u))
+            {
+                tasks.at(u).run = [&, u]
+                {
+                    try
+                    {
+                        builder.compile(u);
+                        return true;
+                    }
+                    catch (const der::modules::ModuleErr &exc)
+                    {
+                        reports.at(u) = std::format("\u001b[1m\u001b[31m[khata2 f jbed]:\u001b[m {}\n", exc.msg);
+                        return false;
+                    }
+                };
+                continue;
+            }
+            tasks.at(u).run = [&, u]
+            {
+                const std::string &source = units.at(u).source;
+                std::string exe = exe_of(u);
+                std::string c_key = source_key(source, options, "c");
+                auto exe_hash = der::cache::Key{}.add(c_key).add(tools);
+                if (split)
+                    exe_hash.add(std::format("split {}", split));
+                std::string exe_key = exe_hash.hex();
+                if (cache && cache->restore(exe_key, "exe", exe, true))
+                {
+                    reports.at(u) = std::format("\u001b[1m\u001b[33msuccessfully written executable '{}' (cached)\u001b[m\n", exe);
+                    return true;
+                }
+                auto start = std::chrono::steady_clock::now();
+                if (split)
+                    return build_split(u, exe, exe_key, start);
+                std::optional<std::string> c = cache ? cache->read(c_key, "c") : std::nullopt;
+                if (!c)
+                {
+                    frontend(units.at(u).path, source, options, [&](der::typechecker::TypeChecker &ijk)
+                             {
+                                 c = ijk.get_output();
+                                 return 0; });
+                    if (!c)
+                        return false;
+                    if (cache)
+                        cache->write(c_key, "c", *c);
+                }
+                builder.m_timings.at(u).frontend = builder.since(start);
+                start = std::chrono::steady_clock::now();
+                der::driver::Job job{*c, exe, uses_pthread(*c)};
+                if (der::driver::spawn(der::driver::cc_command(cc, profile, job), &job.c) != 0)
+                {
+                    reports.at(u) = std::format("\u001b[1m\u001b[31m[khata2 f build]:\u001b[m {} couldn't compile the C for '{}'.\n", cc, units.at(u).path);
+                    return false;
+                }
+                builder.m_timings.at(u).cc = builder.since(start);
+                builder.m_timings.at(u).compiled = true;
+                if (auto built = cache ? der::cache::read_file(exe) : std::nullopt)
+                    cache->write(exe_key, "exe", *built, true);
+                reports.at(u) = std::format("\u001b[1m\u001b[33msuccessfully written executable '{}'\u001b[m\n", exe);
+                return true;
+            };
+        }
+        // how long each program took to link, by the index of its task
+        std::map<size_t, double> link_ms{};
+        for (size_t root : graph.roots)
+        {
+            if (standalone(root))
+                continue;
+            size_t t = tasks.size();
+            link_ms[t] = 0;
+            der::driver::Task link{builder.closure(root), 1, [&, t, root]
+                                   {
+                                       auto start = std::chrono::steady_clock::now();
+                                       try
+                                       {
+                                           builder.link(root, exe_of(root));
+                                       }
+                                       catch (const der::modules::ModuleErr &exc)
+                                       {
+                                           reports.at(t) = std::format("\u001b[1m\u001b[31m[khata2 f jbed]:\u001b[m {}\n", exc.msg);
+                                           return false;
+                                       }
+                                       link_ms.at(t) = builder.since(start);
+                                       auto parts = builder.closure(root);
+                                       parts.push_back(root);
+                                       size_t compiled = std::ranges::count_if(parts, [&](size_t u)
+                                                                               { return builder.m_timings.at(u).compiled; });
+                                       reports.at(t) = std::format("\u001b[1m\u001b[33msuccessfully written executable '{}' ({} of {} modules recompiled)\u001b[m\n", exe_of(root), compiled, parts.size());
+                                       return true;
+                                   }};
+            link.deps.push_back(root);
+            tasks.push_back(link);
+            reports.emplace_back();
+        }
+        auto ok = der::driver::run_tasks(tasks, jobs);
+        for (auto &r : reports)
+            std::cout << r;
+        if (timings)
+        {
+            std::cout << std::format("{:>10} {:>10}  {}\n", "frontend", "cc", "file");
+            for (size_t u = 0; u < units.size(); ++u)
+                if (auto &t = builder.m_timings.at(u); t.compiled)
+                    std::cout << std::format("{:>8.1f}ms {:>8.1f}ms  {}\n", t.frontend, t.cc, units.at(u).path);
+            for (auto &[t, ms] : link_ms)
+                if (ok.at(t))
+                    std::cout << std::format("{:>10} {:>8.1f}ms  {} (link)\n", "", ms, exe_of(tasks.at(t).deps.back()));
+            std::cout << std::format("{} files in {:.1f}ms, -j {}\n", units.size(), builder.since(started), jobs);
+        }
+        return std::ranges::all_of(ok, [](bool b)
+                                   { return b; })
+                   ? 0
+                   : 1;
+    }
+    std::string filename = filenames.back();
+    auto source = read_source(filename);
+    if (!source)
+        return 1;
+    // native executables depend on as and ld instead of a C compiler
+    std::string key = native ? der::cache::Key{}
+                                   .add(source_key(*source, options, "native"))
+                                   .add(der::cache::file_identity(der::cache::find_program("as")))
+                                   .add(der::cache::file_identity(der::cache::find_program("ld")))
+                                   .hex()
+                             : source_key(*source, options, "c");
+    if (cache && !run && !jit)
+    {
+        if (native && cache->restore(key, "exe", executable_name(filename), true))
+        {
+            cache->restore(key, "o", filename + ".o");
+            std::cout << std::format("\u001b[1m\u001b[33msuccessfully written executable '{}' (cached)\u001b[m\n", executable_name(filename));
+            return 0;
+        }
+        if (!native && !split && cache->restore(key, "c", filename + ".c"))
+        {
+            std::cout << std::format("\u001b[1m\u001b[33msuccessfully written output C code to '{}.c' (cached)\u001b[m\n", filename);
+            return 0;
+        }
+    }
+    auto status = frontend(filename, *source, options, [&](der::typechecker::TypeChecker &ijk) -> int
+                           {
+        if (run)
+        {
+            try
+            {
+                auto program = der::vm::Compiler{}.compile(ijk.m_output);
+                int status = der::vm::Machine{}.run(program);
+                std::fflush(stdout);
+                return status;
+            }
+            catch (const der::vm::VmErr &exc)
+            {
+                std::fflush(stdout);
+                std::cout << std::format("\u001b[1m\u001b[31m[khata2 f run]:\u001b[m {}\n", exc.msg);
+                return 1;
+            }
+        }
+        if (jit)
+        {
+            try
+            {
+                auto code = der::jit::load(ijk.m_output);
+                int status = code.entry();
+                std::fflush(stdout);
+                return status;
+            }
+            catch (const der::codegen::CodegenErr &exc)
+            {
+                std::fflush(stdout);
+                std::cout << std::format("\u001b[1m\u001b[31m[khata2 f jit]:\u001b[m {}\n", exc.msg);
+                return 1;
+            }
+        }
+        if (native)
+        {
+            try
+            {
+                std::string exe = executable_name(filename);
+                {
+                    std::ofstream outfile{filename + ".s"};
+                    outfile << der::codegen::Codegen{}.generate(ijk.m_output);
+                }
+                if (der::driver::spawn({"as", "-o", filename + ".o", filename + ".s"}) != 0)
+                    throw der::codegen::CodegenErr(std::format("as couldn't assemble '{}.s'.", filename));
+                if (der::driver::spawn({"ld", "-o", exe, filename + ".o"}) != 0)
+                    throw der::codegen::CodegenErr(std::format("ld couldn't link '{}.o'.", filename));
+                if (cache)
+                {
+                    if (auto object = der::cache::read_file(filename + ".o"))
+                        cache->write(key, "o", *object);
+                    if (auto built = der::cache::read_file(exe))
+                        cache->write(key, "exe", *built, true);
+                }
+                std::cout << std::format("\u001b[1m\u001b[33msuccessfully written executable '{}'\u001b[m\n", exe);
+                return 0;
+            }
+            catch (const der::codegen::CodegenErr &exc)
+            {
+                std::cout << std::format("\u001b[1m\u001b[31m[khata2 f native]:\u001b[m {}\n", exc.msg);
+                return 1;
+            }
+        }
+        if (split)
+        {
+            auto parts = der::emit::split(ijk, split, jobs);
+            std::string header = std::filesystem::path(filename).filename().string() + ".h";
+            write_output(filename + ".h", parts.header);
+            for (size_t i = 0; i < parts.units.size(); ++i)
+                write_output(std::format("{}.{}.c", filename, i), std::format("#include \"{}\"\n", header) + parts.units.at(i));
+            std::cout << std::format("\u001b[1m\u001b[33msuccessfully written output C code to '{}.h' and {} files\u001b[m\n", filename, parts.units.size());
+            return 0;
+        }
+        std::string c = ijk.get_output();
+        if (cache)
+            cache->write(key, "c", c);
+        write_output(filename + ".c", c);
+        std::cout << std::format("\u001b[1m\u001b[33msuccessfully written output C code to '{}.c'\u001b[m\n", filename);
+        return 0; });
+    // a program with mistakes in it still exits with 0, like it always did
+    return status.value_or(0);
+}
+
+// the command with --time-report[=json] and --trace FILE taken out of it: once it's done, the first prints where the
+// time and memory went (to stderr), the second writes it as trace events
+static int reported(std::vector<char *> args)
+{
+    std::string time_report{}, trace{};
+    std::vector<char *> rest{};
+    for (size_t i = 0; i < args.size(); ++i)
+    {
+        std::string arg = args.at(i);
+        if (arg == "--time-report" || arg == "--time-report=json")
+            time_report = arg;
+        else if (arg == "--trace" && i + 1 < args.size())
+            trace = args.at(++i);
+        else if (arg == "--trace")
+        {
+            error("'--trace' expects a value.");
+            return 1;
+        }
+        else
+            rest.push_back(args.at(i));
+    }
+    if (!time_report.empty() || !trace.empty())
+        report.emplace();
+    rest.push_back(nullptr);
+    int status = command(int(rest.size() - 1), rest.data());
+    if (!report)
+        return status;
+    if (!time_report.empty())
+        std::cerr << (time_report == "--time-report" ? report->table() : report->json());
+    if (!trace.empty())
+    {
+        std::ofstream out{trace};
+        out << report->trace();
+    }
+    report.reset();
+    return status;
+}
+
+int main(int argc, char **argv)
+{
+    std::string mode = argc > 1 ? argv[1] : "";
+    // `derijac --server` compiles for `derijac --client ...` until it's killed, keeping every file it's seen in memory.
+    // a client with no server around compiles by itself
+    if (mode == "--server")
+    {
+        warm.emplace();
+        std::string path = der::server::socket_path();
+        std::cout << std::format("\u001b[1m\u001b[33mlistening on '{}'\u001b[m\n", path) << std::flush;
+        der::server::serve(path, [](const std::vector<std::string> &args)
+                           {
+                               std::vector<char *> argv{};
+                               for (auto &a : args)
+                                   argv.push_back(const_cast<char *>(a.c_str()));
+                               return reported(argv); });
+        error(std::format("can't listen on '{}': {}.", path, std::strerror(errno)));
+        return 1;
+    }
+    if (mode == "--client")
+    {
+        std::vector<std::string> args{argv[0]};
+        for (int i = 2; i < argc; ++i)
+            args.push_back(argv[i]);
+        if (auto status = der::server::forward(der::server::socket_path(), args))
+            return *status;
+        argv[1] = argv[0];
+        return reported({argv + 1, argv + argc});
+    }
+    // `derijac --watch ...` does the rest of the command again every time one of the files it read changes
+    std::vector<char *> args{};
+    bool watch = false;
+    for (int i = 0; i < argc; ++i)
+    {
+        if (std::string(argv[i]) == "--watch")
+            watch = true;
+        else
+            args.push_back(argv[i]);
+    }
+    if (!watch)
+        return reported(args);
+    if (mode == "run" || mode == "native" || mode == "jit")
+    {
+        error("--watch only works when writing C or with build.");
+        return 1;
+    }
+    warm.emplace();
+    while (true)
+    {
+        auto began = std::filesystem::file_time_type::clock::now();
+        auto start = std::chrono::steady_clock::now();
+        stats = {};
+        watched.clear();
+        reported(args);
+        double total = der::watch::since(start);
+        if (watched.empty())
+            return 1;
+        // the C compiler, writing files and the build bookkeeping, or the whole thing for a file that didn't change
+        double phases = stats.lex + stats.parse + stats.check + stats.lower + stats.optimize + stats.emit;
+        std::cout << std::format("\u001b[1m\u001b[33m[watch]\u001b[m {:.1f}ms: lex {:.1f}ms, parse {:.1f}ms, check {:.1f}ms, lower {:.1f}ms, optimize {:.1f}ms, emit {:.1f}ms, rest {:.1f}ms, {} of {} functions recompiled, {} of {} bytes written\n",
+                                 total, stats.lex, stats.parse, stats.check, stats.lower, stats.optimize, stats.emit, std::max(0.0, total - phases),
+                                 stats.functions - stats.reused, stats.functions, stats.written, stats.bytes)
+                  << std::flush;
+        der::watch::wait(watched, began);
+    }
 }